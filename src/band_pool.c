@@ -0,0 +1,120 @@
+// band_pool.c
+// See band_pool.h. Workers sleep on a condition variable between jobs and
+// grab band indices from a shared atomic counter, so uneven bands balance
+// themselves.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "band_pool.h"
+
+struct band_pool {
+  int             nthreads;
+  pthread_t      *thr;
+  pthread_mutex_t mtx;
+  pthread_cond_t  wake;
+  pthread_cond_t  idle;
+  unsigned long   generation;   // bumped for every job
+  int             quit;
+  int             busy;         // workers still inside the current job
+
+  // current job
+  band_fn         fn;
+  void           *ctx;
+  int             nbands;
+  int             next_band;    // atomic
+};
+
+static void run_bands(band_pool_t *p, band_fn fn, void *ctx, int nbands) {
+  for (;;) {
+    int b = __atomic_fetch_add(&p->next_band, 1, __ATOMIC_RELAXED);
+    if (b >= nbands) break;
+    fn(ctx, b, nbands);
+  }
+}
+
+static void *worker(void *arg) {
+  band_pool_t *p = arg;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&p->mtx);
+  for (;;) {
+    while (!p->quit && p->generation == seen) pthread_cond_wait(&p->wake, &p->mtx);
+    if (p->quit) break;
+    seen = p->generation;
+    band_fn fn = p->fn;
+    void *ctx = p->ctx;
+    int nbands = p->nbands;
+    pthread_mutex_unlock(&p->mtx);
+
+    run_bands(p, fn, ctx, nbands);
+
+    pthread_mutex_lock(&p->mtx);
+    if (--p->busy == 0) pthread_cond_signal(&p->idle);
+  }
+  pthread_mutex_unlock(&p->mtx);
+  return NULL;
+}
+
+band_pool_t *band_pool_new(int nthreads) {
+  if (nthreads <= 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = n > 0 ? (int)n : 1;
+  }
+  band_pool_t *p = calloc(1, sizeof(*p));
+  if (!p) return NULL;
+  pthread_mutex_init(&p->mtx, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  pthread_cond_init(&p->idle, NULL);
+  p->nthreads = 1;
+  if (nthreads > 1) {
+    p->thr = calloc((size_t)nthreads - 1, sizeof(*p->thr));
+    for (int i = 0; p->thr && i < nthreads - 1; i++) {
+      if (pthread_create(&p->thr[i], NULL, worker, p) != 0) break;
+      p->nthreads++;
+    }
+  }
+  return p;
+}
+
+void band_pool_free(band_pool_t *p) {
+  if (!p) return;
+  pthread_mutex_lock(&p->mtx);
+  p->quit = 1;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->mtx);
+  for (int i = 0; i < p->nthreads - 1; i++) pthread_join(p->thr[i], NULL);
+  pthread_cond_destroy(&p->idle);
+  pthread_cond_destroy(&p->wake);
+  pthread_mutex_destroy(&p->mtx);
+  free(p->thr);
+  free(p);
+}
+
+int band_pool_threads(const band_pool_t *p) {
+  return p ? p->nthreads : 1;
+}
+
+void band_pool_run(band_pool_t *p, int nbands, band_fn fn, void *ctx) {
+  if (!p || p->nthreads == 1 || nbands <= 1) {
+    for (int b = 0; b < nbands; b++) fn(ctx, b, nbands);
+    return;
+  }
+
+  pthread_mutex_lock(&p->mtx);
+  p->fn = fn;
+  p->ctx = ctx;
+  p->nbands = nbands;
+  p->next_band = 0;
+  p->busy = p->nthreads - 1;
+  p->generation++;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->mtx);
+
+  run_bands(p, fn, ctx, nbands);
+
+  pthread_mutex_lock(&p->mtx);
+  while (p->busy > 0) pthread_cond_wait(&p->idle, &p->mtx);
+  pthread_mutex_unlock(&p->mtx);
+}
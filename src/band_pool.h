@@ -0,0 +1,29 @@
+// band_pool.h
+// Small persistent worker pool that splits a frame into horizontal bands.
+// The calling thread works too and band_pool_run() returns once every band
+// is done, so callers see a plain synchronous function.
+
+#if !defined(__BAND_POOL_H__)
+#define __BAND_POOL_H__
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct band_pool band_pool_t;
+
+typedef void (*band_fn)(void *ctx, int band, int nbands);
+
+// nthreads counts the caller: 1 means no extra threads; 0 picks one per
+// online CPU.
+extern band_pool_t *band_pool_new(int nthreads);
+extern void         band_pool_free(band_pool_t *p);
+extern int          band_pool_threads(const band_pool_t *p);
+
+// Runs fn(ctx, i, nbands) for i in [0, nbands). p may be NULL (runs inline).
+extern void         band_pool_run(band_pool_t *p, int nbands, band_fn fn, void *ctx);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,483 @@
+// bench_pipeline.c
+// End-to-end pipeline benchmark. Makes (or loads) a 3840x1920 @ 29.97
+// H.264 capture, then replays it through min_latency_from_uvc -- the same
+// appsrc path as a camera -- once per decoder/convert/output configuration,
+// at camera cadence and unthrottled. Each run reports output fps, CPU time
+// per frame and peak RSS (from wait4() on the child) and the per-stage
+// latency percentiles the child writes with --stats-json.
+//
+// Results are appended to a JSON-lines file, one object per run, tagged
+// with `git describe`, so runs from two commits can be diffed or loaded
+// side by side. A short table goes to stdout.
+//
+// The synthetic stream is a moving SMPTE pattern from videotestsrc through
+// x264enc (openh264enc if x264 is missing), SPS/PPS before every IDR as
+// the camera sends them. It is cached as bench_4k_<kbps>k_g<gop>_<n>.tcap.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+
+#include <libuvc/libuvc.h>
+#include "thetauvc.h"
+#include "h264_nal.h"
+#include "tcap.h"
+
+#define BENCH_W          3840
+#define BENCH_H          1920
+#define BENCH_FPS_NUM    30000
+#define BENCH_FPS_DEN    1001
+#define MAX_CONFIGS      16
+#define MAX_CHILD_ARGS   64
+
+struct config {
+  const char *name;
+  const char *args;        // extra min_latency_from_uvc arguments, space separated
+};
+
+// Readers never block the shmring; shmsink waits for a reader, which the
+// bench provides (see drain_start()).
+static struct config g_defaults[] = {
+  { "videoconvert-shmsink", "--output shmsink" },
+  { "videoconvert-shmring", "--output shmring" },
+  { "simd-shmring",         "--convert simd" },
+  { "simd-cubemap960",      "--convert simd --cubemap 960" },
+  { "nvdec-simd-shmring",   "--nvdec --convert simd" },
+};
+
+static uint64_t now_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [--input FILE.tcap | [--bitrate KBPS] [--gop N] [--frames N] [--cache DIR]]\n"
+    "          [--speed paced|max|both] [--config NAME=ARGS]... [--bin PATH]\n"
+    "          [--out FILE] [--log FILE] [--label TEXT]\n"
+    "  --input FILE : replay this capture instead of a synthetic one\n"
+    "  --bitrate K  : synthetic stream bitrate in kbit/s (default: 25000)\n"
+    "  --gop N      : synthetic stream IDR interval in frames (default: 30)\n"
+    "  --frames N   : synthetic stream length (default: 600)\n"
+    "  --cache DIR  : where synthetic streams are kept (default: .)\n"
+    "  --speed S    : camera cadence, unthrottled, or both (default: both)\n"
+    "  --config NAME=ARGS: a configuration, as min_latency_from_uvc arguments; repeatable,\n"
+    "                 replaces the default set (videoconvert/simd, shmsink/shmring, cubemap, nvdec)\n"
+    "  --bin PATH   : pipeline binary (default: ./min_latency_from_uvc)\n"
+    "  --out FILE   : JSON lines, appended, one per run (default: bench_pipeline.jsonl)\n"
+    "  --log FILE   : the pipeline's own output (default: bench_pipeline.log)\n"
+    "  --label TEXT : free text stored with every result\n",
+    prog);
+}
+
+/* ---------- Synthetic stream ---------- */
+
+static gboolean have_element(const char *name) {
+  GstElementFactory *f = gst_element_factory_find(name);
+  if (f) gst_object_unref(f);
+  return f != NULL;
+}
+
+static int generate(const char *path, unsigned int kbps, unsigned int gop, unsigned int frames) {
+  const char *enc = NULL;
+  gchar *enc_desc = NULL;
+  if (have_element("x264enc")) {
+    enc = "x264enc";
+    enc_desc = g_strdup_printf("x264enc bitrate=%u key-int-max=%u bframes=0 speed-preset=ultrafast "
+                               "tune=zerolatency byte-stream=true", kbps, gop);
+  } else if (have_element("openh264enc")) {
+    enc = "openh264enc";
+    enc_desc = g_strdup_printf("openh264enc bitrate=%u gop-size=%u complexity=low",
+                               kbps * 1000u, gop);
+  } else {
+    fprintf(stderr, "no H.264 encoder (x264enc, openh264enc) to make the test stream; use --input\n");
+    return -1;
+  }
+  gchar *desc = g_strdup_printf(
+      "videotestsrc num-buffers=%u pattern=smpte horizontal-speed=4 ! "
+      "video/x-raw,format=I420,width=%d,height=%d,framerate=%d/%d ! %s ! "
+      "h264parse config-interval=-1 ! video/x-h264,stream-format=byte-stream,alignment=au ! "
+      "appsink name=out sync=false", frames, BENCH_W, BENCH_H, BENCH_FPS_NUM, BENCH_FPS_DEN, enc_desc);
+  g_free(enc_desc);
+  GError *err = NULL;
+  GstElement *pipeline = gst_parse_launch(desc, &err);
+  g_free(desc);
+  if (!pipeline) {
+    fprintf(stderr, "test stream pipeline: %s\n", err ? err->message : "?");
+    g_clear_error(&err);
+    return -1;
+  }
+
+  struct tcap_mode m = {
+    .mode = THETAUVC_MODE_UHD_2997, .width = BENCH_W, .height = BENCH_H, .fps = 30,
+    .frame_interval = 10000000u * BENCH_FPS_DEN / BENCH_FPS_NUM,
+    .clock_frequency = 48000000u, .max_frame_size = BENCH_W * BENCH_H * 3 / 2,
+  };
+  gchar *tmp = g_strdup_printf("%s.part", path);
+  tcap_writer_t *wr = tcap_writer_open(tmp, &m);
+  if (!wr) { g_free(tmp); gst_object_unref(pipeline); return -1; }
+
+  fprintf(stderr, "making %s with %s (%u frames)...\n", path, enc, frames);
+  uint64_t t0 = now_monotonic_ns();
+  GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "out");
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+  unsigned int n = 0;
+  for (GstSample *s; (s = gst_app_sink_pull_sample(GST_APP_SINK(sink))) != NULL; ++n) {
+    GstBuffer *b = gst_sample_get_buffer(s);
+    GstMapInfo map;
+    if (b && gst_buffer_map(b, &map, GST_MAP_READ)) {
+      // Camera cadence, as the device clock would stamp it.
+      int64_t t_ns = (int64_t)n * 1000000000LL * BENCH_FPS_DEN / BENCH_FPS_NUM;
+      uvc_frame_t f;
+      memset(&f, 0, sizeof(f));
+      f.data = map.data;
+      f.data_bytes = map.size;
+      f.sequence = n;
+      f.capture_time.tv_sec = t_ns / 1000000000LL;
+      f.capture_time.tv_usec = (t_ns % 1000000000LL) / 1000;
+      struct h264_au_info au;
+      h264_au_classify(map.data, map.size, &au);
+      tcap_writer_append(wr, &f, au.has_idr ? TCAP_FLAG_IDR : 0);
+      gst_buffer_unmap(b, &map);
+    }
+    gst_sample_unref(s);
+  }
+  gboolean eos = gst_app_sink_is_eos(GST_APP_SINK(sink));
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+
+  int rc = tcap_writer_close(wr);
+  if (rc == 0 && eos && n == frames) rc = rename(tmp, path);
+  else {
+    fprintf(stderr, "test stream stopped after %u of %u frames\n", n, frames);
+    unlink(tmp);
+    rc = -1;
+  }
+  g_free(tmp);
+  if (rc == 0) fprintf(stderr, "  %.1f s\n", (double)(now_monotonic_ns() - t0) / 1e9);
+  return rc;
+}
+
+// What the stream actually is, whatever the encoder was asked for.
+struct stream_info {
+  size_t   frames;
+  double   kbps;
+  double   gop;              // mean IDR interval, frames
+  unsigned width, height;
+};
+
+static int stream_info(const char *path, struct stream_info *si) {
+  tcap_reader_t *r = tcap_reader_open(path);
+  if (!r) return -1;
+  memset(si, 0, sizeof(*si));
+  si->frames = tcap_reader_count(r);
+  si->width  = tcap_reader_mode(r)->width;
+  si->height = tcap_reader_mode(r)->height;
+  uint64_t bytes = 0, idrs = 0;
+  for (size_t i = 0; i < si->frames; ++i) {
+    const struct tcap_index_entry *e = tcap_reader_entry(r, i);
+    bytes += e->size;
+    if (e->flags & TCAP_FLAG_IDR) idrs++;
+  }
+  if (si->frames > 1) {
+    int64_t span = tcap_reader_entry(r, si->frames - 1)->capture_ns - tcap_reader_entry(r, 0)->capture_ns;
+    double dur = (double)span / 1e9 * (double)si->frames / (double)(si->frames - 1);
+    if (dur > 0) si->kbps = (double)bytes * 8.0 / dur / 1000.0;
+  }
+  si->gop = idrs ? (double)si->frames / (double)idrs : 0.0;
+  tcap_reader_close(r);
+  return 0;
+}
+
+/* ---------- shmsink reader ---------- */
+
+// shmsink waits for a reader before it lets a frame through; this one
+// takes every frame and drops it, like a fast consumer would.
+// The caller removes a stale socket before starting the child.
+static GstElement *drain_start(const char *socket_path, pid_t child) {
+  gchar *desc = g_strdup_printf("shmsrc socket-path=%s is-live=true ! fakesink sync=false", socket_path);
+  GstElement *p = gst_parse_launch(desc, NULL);
+  g_free(desc);
+  if (!p) return NULL;
+  // Up to 10 s for the child to build its pipeline and open the socket.
+  for (int i = 0; i < 200; ++i) {
+    if (access(socket_path, F_OK) == 0 &&
+        gst_element_set_state(p, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE)
+      return p;
+    gst_element_set_state(p, GST_STATE_NULL);
+    siginfo_t si;
+    si.si_pid = 0;
+    if (waitid(P_PID, (id_t)child, &si, WEXITED | WNOHANG | WNOWAIT) != 0 || si.si_pid != 0) break;
+    usleep(50000);
+  }
+  gst_object_unref(p);
+  return NULL;
+}
+
+/* ---------- Runs ---------- */
+
+struct run_result {
+  int      status;           // exit code, or -signal
+  int      timed_out;
+  double   wall_s;
+  double   cpu_s;            // user + system, all threads
+  long     max_rss_kb;
+  char    *json;             // the child's --stats-json line, NULL if none
+};
+
+static char *read_line(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) return NULL;
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t n = getline(&line, &cap, fp);
+  fclose(fp);
+  if (n <= 0) { free(line); return NULL; }
+  while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+  return line;
+}
+
+static int run_one(const char *bin, const char *input, double speed, const char *args,
+                   int log_fd, double timeout_s, struct run_result *res) {
+  memset(res, 0, sizeof(*res));
+  char stats[] = "/tmp/bench_pipeline_XXXXXX";
+  int sfd = mkstemp(stats);
+  if (sfd < 0) { perror("mkstemp"); return -1; }
+  close(sfd);
+
+  char speed_s[32];
+  snprintf(speed_s, sizeof(speed_s), "%g", speed);
+  char *copy = strdup(args);
+  char *argv[MAX_CHILD_ARGS];
+  int argc = 0;
+  argv[argc++] = (char *)bin;
+  argv[argc++] = "--replay";       argv[argc++] = (char *)input;
+  argv[argc++] = "--replay-speed"; argv[argc++] = speed_s;
+  argv[argc++] = "--lat-report";   argv[argc++] = "0";
+  argv[argc++] = "--stats-json";   argv[argc++] = stats;
+  for (char *save = NULL, *tok = strtok_r(copy, " ", &save); tok && argc < MAX_CHILD_ARGS - 1;
+       tok = strtok_r(NULL, " ", &save))
+    argv[argc++] = tok;
+  argv[argc] = NULL;
+
+  const char *shm_sock = "/tmp/theta_bgr.sock";
+  int shmsink = strstr(args, "shmsink") != NULL;
+  if (shmsink) unlink(shm_sock);
+
+  uint64_t t0 = now_monotonic_ns();
+  pid_t pid = fork();
+  if (pid < 0) { perror("fork"); free(copy); unlink(stats); return -1; }
+  if (pid == 0) {
+    dup2(log_fd, STDOUT_FILENO);
+    dup2(log_fd, STDERR_FILENO);
+    execv(bin, argv);
+    perror(bin);
+    _exit(127);
+  }
+
+  GstElement *drain = shmsink ? drain_start(shm_sock, pid) : NULL;
+
+  int wstatus = 0;
+  struct rusage ru;
+  int sent = 0;
+  for (;;) {
+    pid_t r = wait4(pid, &wstatus, WNOHANG, &ru);
+    if (r == pid) break;
+    if (r < 0 && errno != EINTR) { perror("wait4"); break; }
+    double elapsed = (double)(now_monotonic_ns() - t0) / 1e9;
+    // A stuck run is stopped like Ctrl+C would, so its stats still get written.
+    if (sent == 0 && elapsed > timeout_s)       { kill(pid, SIGINT);  sent = 1; res->timed_out = 1; }
+    if (sent == 1 && elapsed > timeout_s + 10.0) { kill(pid, SIGKILL); sent = 2; }
+    usleep(20000);
+  }
+  res->wall_s = (double)(now_monotonic_ns() - t0) / 1e9;
+  if (drain) {
+    gst_element_set_state(drain, GST_STATE_NULL);
+    gst_object_unref(drain);
+  }
+
+  res->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : WIFSIGNALED(wstatus) ? -WTERMSIG(wstatus) : -1;
+  res->cpu_s = (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6 +
+               (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+  res->max_rss_kb = ru.ru_maxrss;
+  res->json = read_line(stats);
+  unlink(stats);
+  free(copy);
+  return 0;
+}
+
+// Pulls "key":<number> out of the child's line, after `from` if given.
+static double json_num(const char *js, const char *from, const char *key) {
+  if (!js) return 0.0;
+  const char *p = from ? strstr(js, from) : js;
+  if (!p) return 0.0;
+  char pat[64];
+  snprintf(pat, sizeof(pat), "\"%s\":", key);
+  p = strstr(p, pat);
+  return p ? strtod(p + strlen(pat), NULL) : 0.0;
+}
+
+static void json_string(FILE *fp, const char *v) {
+  fputc('"', fp);
+  for (const unsigned char *p = (const unsigned char *)(v ? v : ""); *p; ++p) {
+    if (*p == '"' || *p == '\\') fprintf(fp, "\\%c", *p);
+    else if (*p < 0x20)         fprintf(fp, "\\u%04x", *p);
+    else                        fputc(*p, fp);
+  }
+  fputc('"', fp);
+}
+
+static void git_describe(char *out, size_t size) {
+  out[0] = '\0';
+  FILE *p = popen("git describe --always --dirty 2>/dev/null", "r");
+  if (!p) return;
+  if (fgets(out, (int)size, p)) out[strcspn(out, "\n")] = '\0';
+  pclose(p);
+}
+
+int main(int argc, char **argv) {
+  const char *input = NULL, *cache = ".", *bin = "./min_latency_from_uvc";
+  const char *out_path = "bench_pipeline.jsonl", *log_path = "bench_pipeline.log", *label = "";
+  unsigned int kbps = 25000, gop = 30, frames = 600;
+  int paced = 1, unthrottled = 1;
+  struct config configs[MAX_CONFIGS];
+  int nconfigs = 0;
+
+  gst_init(&argc, &argv);
+  for (int i = 1; i < argc; ++i) {
+    if      (!strcmp(argv[i], "--input")   && i+1 < argc) input = argv[++i];
+    else if (!strcmp(argv[i], "--bitrate") && i+1 < argc) kbps = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--gop")     && i+1 < argc) gop = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--frames")  && i+1 < argc) frames = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--cache")   && i+1 < argc) cache = argv[++i];
+    else if (!strcmp(argv[i], "--bin")     && i+1 < argc) bin = argv[++i];
+    else if (!strcmp(argv[i], "--out")     && i+1 < argc) out_path = argv[++i];
+    else if (!strcmp(argv[i], "--log")     && i+1 < argc) log_path = argv[++i];
+    else if (!strcmp(argv[i], "--label")   && i+1 < argc) label = argv[++i];
+    else if (!strcmp(argv[i], "--speed")   && i+1 < argc) {
+      const char *s = argv[++i];
+      if      (!strcmp(s, "paced")) { paced = 1; unthrottled = 0; }
+      else if (!strcmp(s, "max"))   { paced = 0; unthrottled = 1; }
+      else if (!strcmp(s, "both"))  { paced = 1; unthrottled = 1; }
+      else { usage(argv[0]); return 1; }
+    }
+    else if (!strcmp(argv[i], "--config") && i+1 < argc && nconfigs < MAX_CONFIGS) {
+      char *eq = strchr(argv[++i], '=');
+      if (!eq || eq == argv[i]) { usage(argv[0]); return 1; }
+      *eq = '\0';
+      configs[nconfigs].name = argv[i];
+      configs[nconfigs].args = eq + 1;
+      nconfigs++;
+    }
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else {
+      fprintf(stderr, "Unknown or excess arg: %s\n", argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (kbps == 0 || gop == 0 || frames < 2) { usage(argv[0]); return 1; }
+  if (access(bin, X_OK) != 0) { fprintf(stderr, "%s: not found (make min_latency_from_uvc)\n", bin); return 1; }
+
+  if (nconfigs == 0) {
+    gboolean nvdec = have_element("nvh264dec");
+    for (size_t i = 0; i < sizeof(g_defaults) / sizeof(g_defaults[0]); ++i) {
+      if (strstr(g_defaults[i].args, "--nvdec") && !nvdec) {
+        fprintf(stderr, "skipping %s: no nvh264dec\n", g_defaults[i].name);
+        continue;
+      }
+      configs[nconfigs++] = g_defaults[i];
+    }
+  }
+
+  char gen_path[1024];
+  if (!input) {
+    snprintf(gen_path, sizeof(gen_path), "%s/bench_4k_%uk_g%u_%u.tcap", cache, kbps, gop, frames);
+    if (access(gen_path, R_OK) != 0 && generate(gen_path, kbps, gop, frames) != 0) return 1;
+    input = gen_path;
+  }
+  struct stream_info si;
+  if (stream_info(input, &si) != 0) return 1;
+  double duration_s = (double)si.frames * BENCH_FPS_DEN / BENCH_FPS_NUM;
+
+  int log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (log_fd < 0) { perror(log_path); return 1; }
+  FILE *out = fopen(out_path, "a");
+  if (!out) { perror(out_path); return 1; }
+
+  char commit[128];
+  git_describe(commit, sizeof(commit));
+  time_t now = time(NULL);
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  printf("%s: %zu frames %ux%u, %.0f kbit/s, GOP %.1f; commit %s\n", input, si.frames,
+         si.width, si.height, si.kbps, si.gop, commit[0] ? commit : "?");
+  printf("%-24s %-6s %8s %9s %8s %8s %8s %8s %6s\n", "config", "speed", "fps", "cpu ms/f",
+         "p50 ms", "p99 ms", "p99.9 ms", "rss MB", "exit");
+
+  int failed = 0;
+  for (int c = 0; c < nconfigs; ++c) {
+    for (int pass = 0; pass < 2; ++pass) {
+      if ((pass == 0 && !paced) || (pass == 1 && !unthrottled)) continue;
+      double speed = pass == 0 ? 1.0 : 0.0;
+      const char *speed_name = pass == 0 ? "paced" : "max";
+      dprintf(log_fd, "==== %s %s: %s\n", configs[c].name, speed_name, configs[c].args);
+
+      struct run_result r;
+      if (run_one(bin, input, speed, configs[c].args, log_fd, duration_s + 60.0, &r) != 0) return 1;
+      double frames_out = json_num(r.json, NULL, "frames_out");
+      const char *total = "\"usb->render total\"";
+      printf("%-24s %-6s %8.1f %9.2f %8.1f %8.1f %8.1f %8.0f %6d%s\n", configs[c].name, speed_name,
+             json_num(r.json, NULL, "out_fps"),
+             frames_out > 0 ? r.cpu_s * 1e3 / frames_out : 0.0,
+             json_num(r.json, total, "p50_us") / 1e3, json_num(r.json, total, "p99_us") / 1e3,
+             json_num(r.json, total, "p999_us") / 1e3, (double)r.max_rss_kb / 1024.0, r.status,
+             r.timed_out ? " (timeout)" : !r.json ? " (no stats)" : "");
+      fflush(stdout);
+      if (r.status != 0 || r.timed_out || !r.json) failed = 1;
+
+      fputs("{\"bench\":\"pipeline\",\"commit\":", out);
+      json_string(out, commit);
+      fputs(",\"time\":", out);
+      json_string(out, stamp);
+      fputs(",\"label\":", out);
+      json_string(out, label);
+      fputs(",\"input\":", out);
+      json_string(out, input);
+      fprintf(out, ",\"stream\":{\"frames\":%zu,\"width\":%u,\"height\":%u,\"kbps\":%.1f,\"gop\":%.2f}",
+              si.frames, si.width, si.height, si.kbps, si.gop);
+      fputs(",\"config\":", out);
+      json_string(out, configs[c].name);
+      fputs(",\"args\":", out);
+      json_string(out, configs[c].args);
+      fprintf(out, ",\"speed\":\"%s\",\"exit\":%d,\"timeout\":%s,\"wall_s\":%.3f,\"cpu_s\":%.3f,"
+                   "\"cpu_ms_per_frame\":%.3f,\"peak_rss_kb\":%ld,\"run\":%s}\n",
+              speed_name, r.status, r.timed_out ? "true" : "false", r.wall_s, r.cpu_s,
+              frames_out > 0 ? r.cpu_s * 1e3 / frames_out : 0.0, r.max_rss_kb,
+              r.json ? r.json : "null");
+      fflush(out);
+      free(r.json);
+    }
+  }
+
+  fclose(out);
+  close(log_fd);
+  printf("results appended to %s, pipeline output in %s\n", out_path, log_path);
+  return failed;
+}
@@ -0,0 +1,124 @@
+// clock_fit.c
+// See clock_fit.h. The weighted means and co-moments are updated with
+// West's incremental algorithm, decayed by exp(-dx / tau) before each pair,
+// which stays stable where raw sums of x^2 over hours would not. Until the
+// pairs span a few seconds only the offset is fitted: a rate from a short
+// baseline would mostly be jitter.
+
+#include <math.h>
+#include <string.h>
+
+#include "clock_fit.h"
+
+#define LOAD(p)     __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELAXED)
+
+#define MIN_RATE_SPAN_NS  5e9     // x span before the rate is fitted
+#define SCALE_FLOOR_NS    1000.0  // residuals under 1 us are never outliers
+#define SCALE_ALPHA       0.02
+#define GAUSS_ABS_TO_SD   1.2533  // sigma / E|r| for a normal distribution
+
+void clock_fit_init(clock_fit_t *f, int64_t tau_ns, double k) {
+  memset(f, 0, sizeof(*f));
+  f->tau_ns = tau_ns > 0 ? tau_ns : CLOCK_FIT_DEFAULT_TAU_NS;
+  f->k      = k > 0 ? k : CLOCK_FIT_DEFAULT_K;
+  f->rate   = 1.0;
+}
+
+static void restart(clock_fit_t *f, int64_t x, int64_t y) {
+  f->x0 = x;
+  f->y0 = y;
+  f->last_x = 0;
+  f->w = f->mx = f->my = f->cxx = f->cxy = 0;
+  f->rate = 1.0;
+  f->icpt = 0;
+  f->scale = 0;
+  f->ms_resid = 0;
+  f->n = 0;
+  f->run_out = 0;
+  STORE(f->st.ready, 0);
+}
+
+static void store_max(int64_t *dst, int64_t v) {
+  if (v > LOAD(*dst)) STORE(*dst, v);
+}
+
+int64_t clock_fit_update(clock_fit_t *f, int64_t x, int64_t y) {
+  if (f->n == 0) restart(f, x, y);
+  double dx = (double)(x - f->x0), dy = (double)(y - f->y0);
+
+  double r = f->n > 0 ? dy - (f->icpt + f->rate * dx) : 0;
+  double ar = fabs(r), wt = 1.0;
+  if (f->n >= CLOCK_FIT_WARMUP) {
+    double thr = f->k * (f->scale > SCALE_FLOOR_NS ? f->scale : SCALE_FLOOR_NS);
+    if (ar > thr) {
+      wt = thr / ar;
+      STORE(f->st.outliers, f->st.outliers + 1);
+      if (++f->run_out >= CLOCK_FIT_MAX_OUTLIERS) {
+        // Not noise any more: the clock stepped. Start over from here.
+        STORE(f->st.resets, f->st.resets + 1);
+        restart(f, x, y);
+        dx = dy = r = ar = 0;
+        wt = 1.0;
+      }
+    } else {
+      f->run_out = 0;
+    }
+  }
+
+  if (f->n > 0) {
+    // Robust sigma: outliers count only up to 3 sigma.
+    double cap = f->scale > 0 ? 3 * f->scale : ar;
+    double est = (ar < cap ? ar : cap) * GAUSS_ABS_TO_SD;
+    double a = f->n < CLOCK_FIT_WARMUP ? 1.0 / f->n : SCALE_ALPHA;
+    f->scale += a * (est - f->scale);
+    if (wt == 1.0) f->ms_resid += a * (r * r - f->ms_resid);
+  }
+
+  double lambda = dx > f->last_x ? exp(-(dx - f->last_x) / (double)f->tau_ns) : 1.0;
+  f->last_x = dx > f->last_x ? dx : f->last_x;
+  f->w   *= lambda;
+  f->cxx *= lambda;
+  f->cxy *= lambda;
+  f->w += wt;
+  double ddx = dx - f->mx;
+  f->mx += wt * ddx / f->w;
+  double ddy = dy - f->my;
+  f->my += wt * ddy / f->w;
+  f->cxx += wt * ddx * (dx - f->mx);
+  f->cxy += wt * ddx * (dy - f->my);
+  f->n++;
+
+  int rate_ok = f->n >= CLOCK_FIT_WARMUP && f->last_x >= MIN_RATE_SPAN_NS && f->cxx > 0;
+  f->rate = rate_ok ? f->cxy / f->cxx : 1.0;
+  f->icpt = f->my - f->rate * f->mx;
+
+  STORE(f->st.samples, f->st.samples + 1);
+  STORE(f->st.offset_ns, (f->y0 - f->x0) + (int64_t)llround(f->icpt + (f->rate - 1.0) * dx));
+  STORE(f->st.drift_ppb, (int64_t)llround((f->rate - 1.0) * 1e9));
+  STORE(f->st.resid_rms_ns, (int64_t)llround(sqrt(f->ms_resid)));
+  store_max(&f->st.resid_max_ns, (int64_t)llround(ar));
+  STORE(f->st.ready, rate_ok);
+  return (int64_t)llround(r);
+}
+
+int64_t clock_fit_map(const clock_fit_t *f, int64_t x) {
+  if (f->n == 0) return x;
+  return f->y0 + (int64_t)llround(f->icpt + f->rate * (double)(x - f->x0));
+}
+
+int clock_fit_ready(const clock_fit_t *f) {
+  return LOAD(f->st.ready);
+}
+
+void clock_fit_get_stats(clock_fit_t *f, struct clock_fit_stats *out, int reset_max) {
+  out->offset_ns    = LOAD(f->st.offset_ns);
+  out->drift_ppb    = LOAD(f->st.drift_ppb);
+  out->resid_rms_ns = LOAD(f->st.resid_rms_ns);
+  out->resid_max_ns = LOAD(f->st.resid_max_ns);
+  out->samples      = LOAD(f->st.samples);
+  out->outliers     = LOAD(f->st.outliers);
+  out->resets       = LOAD(f->st.resets);
+  out->ready        = LOAD(f->st.ready);
+  if (reset_max) STORE(f->st.resid_max_ns, 0);
+}
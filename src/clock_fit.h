@@ -0,0 +1,72 @@
+// clock_fit.h
+// Online estimate of how one clock maps onto another, y = offset + rate * x,
+// from a stream of (x, y) pairs such as (Vicon timestamp, host receive
+// time) or (device frame time, host arrival time). It is a weighted least
+// squares fit with exponential forgetting (time constant tau on the x
+// clock), so drift is tracked over hours without keeping any history.
+// Each pair is first checked against the current fit: residuals beyond
+// k robust sigmas are down-weighted (Huber), so a late packet or a USB
+// hiccup barely moves the estimate. A long run of outliers means the clock
+// jumped (device restart, Vicon reset) and restarts the fit.
+//
+// Single writer; clock_fit_get_stats() is safe from any thread.
+
+#if !defined(__CLOCK_FIT_H__)
+#define __CLOCK_FIT_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define CLOCK_FIT_DEFAULT_TAU_NS  (60ll * 1000000000ll)
+#define CLOCK_FIT_DEFAULT_K       2.5
+#define CLOCK_FIT_WARMUP          16      // pairs before the fit is trusted
+#define CLOCK_FIT_MAX_OUTLIERS    50      // consecutive, before restarting
+
+struct clock_fit_stats {
+  int64_t  offset_ns;          // y - x at the latest x
+  int64_t  drift_ppb;          // (rate - 1) * 1e9
+  int64_t  resid_rms_ns;       // of inliers, exponentially weighted
+  int64_t  resid_max_ns;       // largest |residual| since the last report
+  uint64_t samples;
+  uint64_t outliers;           // pairs down-weighted
+  uint64_t resets;
+  int      ready;
+};
+
+typedef struct clock_fit {
+  int64_t  tau_ns;
+  double   k;
+  // Fit state; x and y are kept relative to the first pair so that doubles
+  // hold nanoseconds exactly enough over days.
+  int64_t  x0, y0;
+  double   last_x;
+  double   w, mx, my, cxx, cxy;
+  double   rate, icpt;
+  double   scale;              // robust sigma of the residuals
+  double   ms_resid;
+  unsigned n, run_out;
+  // Published for readers (relaxed atomics).
+  struct clock_fit_stats st;
+} clock_fit_t;
+
+// tau_ns 0 and k 0 take the defaults.
+extern void    clock_fit_init(clock_fit_t *f, int64_t tau_ns, double k);
+
+// Adds a pair; returns its residual against the fit before the update
+// (0 while warming up).
+extern int64_t clock_fit_update(clock_fit_t *f, int64_t x, int64_t y);
+
+// y for a given x on the current fit; x + (y0 - x0) until there is one.
+extern int64_t clock_fit_map(const clock_fit_t *f, int64_t x);
+extern int     clock_fit_ready(const clock_fit_t *f);
+
+// reset_max clears resid_max_ns for the next report.
+extern void    clock_fit_get_stats(clock_fit_t *f, struct clock_fit_stats *out, int reset_max);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
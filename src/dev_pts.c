@@ -0,0 +1,77 @@
+// dev_pts.c
+// See dev_pts.h.
+
+#include <string.h>
+
+#include "dev_pts.h"
+
+// 30000/1001 fps, in ns
+#define DEFAULT_INTERVAL_NS  33366667ll
+
+static int64_t interval_ns(uint32_t frame_interval) {
+  return frame_interval ? (int64_t)frame_interval * 100 : DEFAULT_INTERVAL_NS;
+}
+
+void dev_pts_init(dev_pts_t *d, uint32_t frame_interval, int64_t base_ns) {
+  memset(d, 0, sizeof(*d));
+  clock_fit_init(&d->fit, 0, 0);
+  d->interval_ns = interval_ns(frame_interval);
+  d->base_ns     = base_ns;
+}
+
+void dev_pts_restart(dev_pts_t *d, uint32_t frame_interval) {
+  clock_fit_init(&d->fit, 0, 0);
+  d->interval_ns = interval_ns(frame_interval);
+  d->have_seq    = 0;
+}
+
+static uint64_t absdiff(int64_t a, int64_t b) {
+  return (uint64_t)(a > b ? a - b : b - a);
+}
+
+uint64_t dev_pts_stamp(dev_pts_t *d, uint32_t sequence, int64_t arrival_ns,
+                       uint64_t *duration_ns) {
+  // The sequence restarts with the stream: a new device clock.
+  if (d->have_seq && sequence <= d->last_seq) {
+    clock_fit_init(&d->fit, 0, 0);
+    d->have_seq = 0;
+  }
+  int64_t x = (int64_t)sequence * d->interval_ns;
+  clock_fit_update(&d->fit, x, arrival_ns);
+  int64_t t = clock_fit_map(&d->fit, x);
+  int64_t period = (int64_t)((double)d->interval_ns * d->fit.rate);
+
+  uint64_t pts = t > d->base_ns ? (uint64_t)(t - d->base_ns) : 0;
+  // Never backwards, even across a refit.
+  if (d->last_pts && pts <= d->last_pts) pts = d->last_pts + 1;
+
+  if (d->have_seq && sequence == d->last_seq + 1) {
+    lat_hist_record_ns(&d->interval[DEV_PTS_JIT_ARRIVAL], absdiff(arrival_ns - d->last_arrival_ns, period));
+    lat_hist_record_ns(&d->interval[DEV_PTS_JIT_PTS], absdiff((int64_t)(pts - d->last_pts), period));
+  }
+  d->last_seq        = sequence;
+  d->have_seq        = 1;
+  d->last_arrival_ns = arrival_ns;
+  d->last_pts        = pts;
+  if (duration_ns) *duration_ns = (uint64_t)period;
+  return pts;
+}
+
+int64_t dev_pts_frame_time(const dev_pts_t *d, uint32_t sequence) {
+  return clock_fit_map(&d->fit, (int64_t)sequence * d->interval_ns);
+}
+
+void dev_pts_dump(dev_pts_t *d, int interval, FILE *fp) {
+  static const char *names[DEV_PTS_JIT_NUM] = { "usb arrival", "device pts" };
+  static struct lat_hist snap;   // caller's thread only; too big for the stack
+
+  fprintf(fp, "Frame cadence jitter, |delta - %.3f ms| (%s):\n",
+          (double)d->interval_ns * d->fit.rate / 1e6, interval ? "last interval" : "whole run");
+  for (int i = 0; i < DEV_PTS_JIT_NUM; ++i) {
+    lat_hist_reset(&snap);
+    lat_hist_drain(&snap, &d->interval[i]);
+    if (interval) lat_hist_print(&snap, names[i], fp);
+    lat_hist_drain(&d->total[i], &snap);
+    if (!interval) lat_hist_print(&d->total[i], names[i], fp);
+  }
+}
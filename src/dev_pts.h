@@ -0,0 +1,68 @@
+// dev_pts.h
+// Buffer timestamps from the camera's own clock. libuvc hands frames over
+// without the payload PTS/SCR, but the camera emits exactly one frame per
+// negotiated dwFrameInterval, so sequence x interval is a device clock
+// that USB scheduling cannot disturb. A clock_fit maps it onto host
+// CLOCK_MONOTONIC: host time only anchors the stream (offset) and measures
+// the real frame rate (drift), it no longer sets the spacing of PTS.
+//
+// Also keeps the cadence jitter both ways, |arrival delta - period| and
+// |PTS delta - period|, so the improvement can be seen.
+// Stamping is for one thread; the report may run on another.
+
+#if !defined(__DEV_PTS_H__)
+#define __DEV_PTS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "clock_fit.h"
+#include "lat_hist.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum dev_pts_jit {
+  DEV_PTS_JIT_ARRIVAL = 0,
+  DEV_PTS_JIT_PTS,
+  DEV_PTS_JIT_NUM,
+};
+
+typedef struct dev_pts {
+  clock_fit_t     fit;            // device ns -> host monotonic ns
+  int64_t         interval_ns;    // nominal frame period
+  int64_t         base_ns;        // host monotonic time of PTS 0
+  uint32_t        last_seq;
+  int             have_seq;
+  int64_t         last_arrival_ns;
+  uint64_t        last_pts;
+  // |delta - period| per consecutive frame pair, arrival and PTS.
+  struct lat_hist interval[DEV_PTS_JIT_NUM];   // since the last dump
+  struct lat_hist total[DEV_PTS_JIT_NUM];      // folded in by each dump
+} dev_pts_t;
+
+// frame_interval is dwFrameInterval (100 ns units; 0 = 30000/1001 fps).
+// base_ns is the host monotonic time that PTS are counted from.
+extern void     dev_pts_init(dev_pts_t *d, uint32_t frame_interval, int64_t base_ns);
+
+// After a mode switch: new period, refit from the next frame, same base.
+extern void     dev_pts_restart(dev_pts_t *d, uint32_t frame_interval);
+
+// PTS in ns for a frame, strictly increasing; *duration_ns (may be NULL)
+// gets the measured frame period.
+extern uint64_t dev_pts_stamp(dev_pts_t *d, uint32_t sequence, int64_t arrival_ns,
+                              uint64_t *duration_ns);
+
+// Host monotonic time of a frame on the fitted device clock: its mean
+// arrival time, i.e. exposure plus the average delivery latency.
+extern int64_t  dev_pts_frame_time(const dev_pts_t *d, uint32_t sequence);
+
+// Prints the cadence jitter, arrival vs PTS: for the last interval (and
+// folds it into the run totals) or for the whole run. Call from one thread.
+extern void     dev_pts_dump(dev_pts_t *d, int interval, FILE *fp);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
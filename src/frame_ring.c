@@ -0,0 +1,193 @@
+// frame_ring.c
+// See frame_ring.h.
+//
+// head is written only by the producer. tail is advanced with a CAS by the
+// consumer when it takes a frame, and by the producer when DROP_OLDEST has
+// to evict one; whoever wins the CAS owns the slot's pointer. Both indices
+// are free-running 64-bit counters, so there is no ABA on tail.
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <semaphore.h>
+
+#include "frame_ring.h"
+
+struct frame_ring_slot {
+  _Atomic(void *)   item;
+  _Atomic uint64_t  t_push_ns;
+};
+
+struct frame_ring {
+  unsigned int              depth;
+  enum frame_ring_overflow  policy;
+  struct frame_ring_slot   *slots;
+  sem_t                     avail;
+  atomic_int                closed;
+
+  _Alignas(64) _Atomic uint64_t head;
+  _Alignas(64) _Atomic uint64_t tail;
+
+  // Statistics: producer-owned and consumer-owned counters kept apart.
+  _Alignas(64) _Atomic uint64_t pushed;
+  _Atomic uint64_t          overwritten;
+  _Atomic uint64_t          rejected;
+  _Atomic unsigned int      max_occupancy;
+  _Alignas(64) _Atomic uint64_t popped;
+  _Atomic uint64_t          max_residency_ns;
+};
+
+static uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void store_max_u64(_Atomic uint64_t *dst, uint64_t v) {
+  uint64_t cur = atomic_load_explicit(dst, memory_order_relaxed);
+  while (v > cur &&
+         !atomic_compare_exchange_weak_explicit(dst, &cur, v, memory_order_relaxed,
+                                                memory_order_relaxed))
+    ;
+}
+
+frame_ring_t *frame_ring_new(unsigned int depth, enum frame_ring_overflow policy) {
+  if (depth == 0) return NULL;
+  frame_ring_t *r = calloc(1, sizeof(*r));
+  if (!r) return NULL;
+  r->slots = calloc(depth, sizeof(*r->slots));
+  if (!r->slots || sem_init(&r->avail, 0, 0) != 0) {
+    free(r->slots);
+    free(r);
+    return NULL;
+  }
+  r->depth  = depth;
+  r->policy = policy;
+  return r;
+}
+
+void frame_ring_free(frame_ring_t *r) {
+  if (!r) return;
+  sem_destroy(&r->avail);
+  free(r->slots);
+  free(r);
+}
+
+void *frame_ring_push(frame_ring_t *r, void *item, uint64_t now_ns) {
+  void *dropped = NULL;
+  uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  for (;;) {
+    uint64_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (h - t < r->depth) break;
+
+    if (r->policy == FRAME_RING_DROP_NEWEST) {
+      atomic_fetch_add_explicit(&r->rejected, 1, memory_order_relaxed);
+      return item;
+    }
+
+    // Evict the oldest frame. Losing the race means the consumer just took
+    // it, which frees a slot all the same.
+    struct frame_ring_slot *s = &r->slots[t % r->depth];
+    void *old = atomic_load_explicit(&s->item, memory_order_relaxed);
+    if (atomic_compare_exchange_strong_explicit(&r->tail, &t, t + 1, memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      atomic_fetch_add_explicit(&r->overwritten, 1, memory_order_relaxed);
+      dropped = old;
+      break;
+    }
+  }
+
+  struct frame_ring_slot *s = &r->slots[h % r->depth];
+  atomic_store_explicit(&s->item, item, memory_order_relaxed);
+  atomic_store_explicit(&s->t_push_ns, now_ns, memory_order_relaxed);
+  atomic_store_explicit(&r->head, h + 1, memory_order_release);
+  atomic_fetch_add_explicit(&r->pushed, 1, memory_order_relaxed);
+
+  unsigned int occ = (unsigned int)(h + 1 - atomic_load_explicit(&r->tail, memory_order_relaxed));
+  if (occ > atomic_load_explicit(&r->max_occupancy, memory_order_relaxed))
+    atomic_store_explicit(&r->max_occupancy, occ, memory_order_relaxed);
+
+  sem_post(&r->avail);
+  return dropped;
+}
+
+void *frame_ring_try_pop(frame_ring_t *r) {
+  for (;;) {
+    uint64_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint64_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (t == h) return NULL;
+
+    struct frame_ring_slot *s = &r->slots[t % r->depth];
+    void *item = atomic_load_explicit(&s->item, memory_order_relaxed);
+    uint64_t t_push = atomic_load_explicit(&s->t_push_ns, memory_order_relaxed);
+    if (atomic_compare_exchange_strong_explicit(&r->tail, &t, t + 1, memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      atomic_fetch_add_explicit(&r->popped, 1, memory_order_relaxed);
+      uint64_t now = mono_ns();
+      if (now > t_push) store_max_u64(&r->max_residency_ns, now - t_push);
+      return item;
+    }
+    // The producer evicted this slot under us; retry with the new tail.
+  }
+}
+
+void *frame_ring_pop(frame_ring_t *r, int timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec  += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+
+  for (;;) {
+    void *item = frame_ring_try_pop(r);
+    if (item) return item;
+    if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+    // Posts can outnumber frames (evictions, close), so a wake-up only
+    // means "look again".
+    if (sem_timedwait(&r->avail, &deadline) != 0 && errno == ETIMEDOUT)
+      return frame_ring_try_pop(r);
+  }
+}
+
+unsigned int frame_ring_occupancy(frame_ring_t *r) {
+  uint64_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+  uint64_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+  return (unsigned int)(h >= t ? h - t : 0);
+}
+
+void frame_ring_close(frame_ring_t *r) {
+  atomic_store_explicit(&r->closed, 1, memory_order_release);
+  sem_post(&r->avail);
+}
+
+void frame_ring_get_stats(frame_ring_t *r, struct frame_ring_stats *out, int reset_peaks) {
+  memset(out, 0, sizeof(*out));
+  uint64_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+  uint64_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+  out->depth       = r->depth;
+  out->occupancy   = (unsigned int)(h >= t ? h - t : 0);
+  out->pushed      = atomic_load_explicit(&r->pushed, memory_order_relaxed);
+  out->popped      = atomic_load_explicit(&r->popped, memory_order_relaxed);
+  out->overwritten = atomic_load_explicit(&r->overwritten, memory_order_relaxed);
+  out->rejected    = atomic_load_explicit(&r->rejected, memory_order_relaxed);
+  if (reset_peaks) {
+    out->max_occupancy    = atomic_exchange_explicit(&r->max_occupancy, 0, memory_order_relaxed);
+    out->max_residency_ns = atomic_exchange_explicit(&r->max_residency_ns, 0, memory_order_relaxed);
+  } else {
+    out->max_occupancy    = atomic_load_explicit(&r->max_occupancy, memory_order_relaxed);
+    out->max_residency_ns = atomic_load_explicit(&r->max_residency_ns, memory_order_relaxed);
+  }
+}
+
+int frame_ring_parse_overflow(const char *s, enum frame_ring_overflow *out) {
+  if (!strcmp(s, "drop-oldest")) { *out = FRAME_RING_DROP_OLDEST; return 0; }
+  if (!strcmp(s, "drop-newest")) { *out = FRAME_RING_DROP_NEWEST; return 0; }
+  return -1;
+}
+
+const char *frame_ring_overflow_name(enum frame_ring_overflow policy) {
+  return policy == FRAME_RING_DROP_NEWEST ? "drop-newest" : "drop-oldest";
+}
@@ -0,0 +1,66 @@
+// frame_ring.h
+// Bounded single-producer/single-consumer ring of opaque frame pointers.
+// The producer (libuvc transfer thread) never blocks: when the ring is full
+// the overflow policy decides which frame falls out. The consumer (push
+// thread) sleeps on a semaphore until something arrives.
+
+#if !defined(__FRAME_RING_H__)
+#define __FRAME_RING_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define FRAME_RING_DEFAULT_DEPTH 8
+
+enum frame_ring_overflow {
+  FRAME_RING_DROP_OLDEST = 0,   // overwrite the oldest queued frame
+  FRAME_RING_DROP_NEWEST,       // reject the incoming frame
+};
+
+typedef struct frame_ring frame_ring_t;
+
+struct frame_ring_stats {
+  unsigned int depth;
+  unsigned int occupancy;         // frames queued right now
+  unsigned int max_occupancy;     // peak since the last peak reset
+  uint64_t     pushed;
+  uint64_t     popped;
+  uint64_t     overwritten;       // DROP_OLDEST evictions
+  uint64_t     rejected;          // DROP_NEWEST refusals
+  uint64_t     max_residency_ns;  // longest push->pop time since the last peak reset
+};
+
+extern frame_ring_t *frame_ring_new(unsigned int depth, enum frame_ring_overflow policy);
+extern void          frame_ring_free(frame_ring_t *r);
+
+// Producer side. Returns the frame that did not make it into the ring (the
+// evicted oldest one, or item itself when rejected), or NULL. The caller
+// owns the returned pointer and must release it.
+extern void         *frame_ring_push(frame_ring_t *r, void *item, uint64_t now_ns);
+
+// Consumer side. Waits up to timeout_ms for a frame; returns NULL on
+// timeout or once the ring has been closed and drained.
+extern void         *frame_ring_pop(frame_ring_t *r, int timeout_ms);
+
+// Non-blocking pop used to drain the ring at shutdown.
+extern void         *frame_ring_try_pop(frame_ring_t *r);
+
+// Frames currently queued; cheap enough to call per frame from either side.
+extern unsigned int  frame_ring_occupancy(frame_ring_t *r);
+
+// Wakes the consumer; subsequent pops return what is left, then NULL.
+extern void          frame_ring_close(frame_ring_t *r);
+
+extern void          frame_ring_get_stats(frame_ring_t *r, struct frame_ring_stats *out,
+                                          int reset_peaks);
+
+extern int           frame_ring_parse_overflow(const char *s, enum frame_ring_overflow *out);
+extern const char   *frame_ring_overflow_name(enum frame_ring_overflow policy);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,95 @@
+// gop_shed.c
+// See gop_shed.h. Only the ingest thread mutates the state; counters are
+// written with relaxed atomics so a reporter thread can read them.
+
+#include <string.h>
+
+#include "gop_shed.h"
+
+#define LOAD(p)     __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELAXED)
+
+void gop_shed_init(gop_shed_t *g, enum gop_shed_policy policy) {
+  memset(g, 0, sizeof(*g));
+  g->policy = policy;
+}
+
+static void begin_skip(gop_shed_t *g, uint64_t now_ns) {
+  if (g->skipping) return;
+  g->skipping = 1;
+  g->skip_start_ns = now_ns;
+  STORE(g->episodes, g->episodes + 1);
+}
+
+static int drop(gop_shed_t *g) {
+  STORE(g->shed, g->shed + 1);
+  return 0;
+}
+
+int gop_shed_admit(gop_shed_t *g, const struct h264_au_info *au,
+                   int congested, uint64_t now_ns) {
+  if (g->policy == GOP_SHED_NONE) {
+    STORE(g->admitted, g->admitted + 1);
+    return 1;
+  }
+
+  // An IDR always resynchronises the decoder, so it ends any skip run and
+  // is never shed itself.
+  if (au->has_idr) {
+    if (g->skipping) {
+      uint64_t dt = now_ns - g->skip_start_ns;
+      STORE(g->last_recovery_ns, dt);
+      if (dt > g->max_recovery_ns) STORE(g->max_recovery_ns, dt);
+      g->skipping = 0;
+    }
+    STORE(g->admitted, g->admitted + 1);
+    return 1;
+  }
+
+  if (g->skipping) return drop(g);
+
+  // Parameter sets or SEI without a picture: cheap and harmless to keep.
+  if (!au->has_slice) {
+    STORE(g->admitted, g->admitted + 1);
+    return 1;
+  }
+
+  if (congested) {
+    if (g->policy == GOP_SHED_GOP) {
+      begin_skip(g, now_ns);
+      return drop(g);
+    }
+    if (!au->is_reference) return drop(g);
+  }
+
+  STORE(g->admitted, g->admitted + 1);
+  return 1;
+}
+
+void gop_shed_note_loss(gop_shed_t *g, uint64_t now_ns) {
+  if (g->policy == GOP_SHED_NONE) return;
+  begin_skip(g, now_ns);
+}
+
+void gop_shed_get_stats(const gop_shed_t *g, struct gop_shed_stats *out) {
+  out->admitted         = LOAD(g->admitted);
+  out->shed             = LOAD(g->shed);
+  out->episodes         = LOAD(g->episodes);
+  out->last_recovery_ns = LOAD(g->last_recovery_ns);
+  out->max_recovery_ns  = LOAD(g->max_recovery_ns);
+}
+
+int gop_shed_parse_policy(const char *s, enum gop_shed_policy *out) {
+  if (!strcmp(s, "none"))   { *out = GOP_SHED_NONE;   return 0; }
+  if (!strcmp(s, "nonref")) { *out = GOP_SHED_NONREF; return 0; }
+  if (!strcmp(s, "gop"))    { *out = GOP_SHED_GOP;    return 0; }
+  return -1;
+}
+
+const char *gop_shed_policy_name(enum gop_shed_policy policy) {
+  switch (policy) {
+    case GOP_SHED_NONREF: return "nonref";
+    case GOP_SHED_GOP:    return "gop";
+    default:              return "none";
+  }
+}
@@ -0,0 +1,65 @@
+// gop_shed.h
+// Congestion policy for the encoded ingest path. Instead of letting a leaky
+// queue drop arbitrary buffers (which corrupts every following P-frame until
+// the next IDR), frames are shed in decoder-safe units:
+//   - nonref: drop only non-reference pictures while congested
+//   - gop:    once congested, drop everything up to the next IDR
+// A frame lost elsewhere (ring overflow) also forces a skip to the next IDR.
+
+#if !defined(__GOP_SHED_H__)
+#define __GOP_SHED_H__
+
+#include <stdint.h>
+
+#include "h264_nal.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum gop_shed_policy {
+  GOP_SHED_NONE = 0,
+  GOP_SHED_NONREF,
+  GOP_SHED_GOP,
+};
+
+struct gop_shed_stats {
+  uint64_t admitted;
+  uint64_t shed;               // frames dropped by the policy
+  uint64_t episodes;           // skip-to-IDR runs started
+  uint64_t last_recovery_ns;   // first shed frame -> IDR admitted, last run
+  uint64_t max_recovery_ns;
+};
+
+typedef struct gop_shed {
+  enum gop_shed_policy policy;
+  int      skipping;           // dropping until the next IDR
+  uint64_t skip_start_ns;
+  uint64_t admitted;
+  uint64_t shed;
+  uint64_t episodes;
+  uint64_t last_recovery_ns;
+  uint64_t max_recovery_ns;
+} gop_shed_t;
+
+extern void gop_shed_init(gop_shed_t *g, enum gop_shed_policy policy);
+
+// Returns 1 if the access unit should go downstream, 0 to drop it.
+extern int  gop_shed_admit(gop_shed_t *g, const struct h264_au_info *au,
+                           int congested, uint64_t now_ns);
+
+// Reports a frame lost outside the policy's control. Unless policy is none,
+// every frame up to the next IDR is then shed.
+extern void gop_shed_note_loss(gop_shed_t *g, uint64_t now_ns);
+
+// Snapshot for reporting; safe to call from another thread (values are
+// read individually and may be one frame apart).
+extern void gop_shed_get_stats(const gop_shed_t *g, struct gop_shed_stats *out);
+
+extern int         gop_shed_parse_policy(const char *s, enum gop_shed_policy *out);
+extern const char *gop_shed_policy_name(enum gop_shed_policy policy);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
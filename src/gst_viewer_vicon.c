@@ -9,17 +9,42 @@
 #include <gst/app/gstappsrc.h>
 #include "libuvc/libuvc.h"
 #include "thetauvc.h"
+#include "h264_pool.h"
+#include "h264_nal.h"
+#include "gop_shed.h"
+#include "tcap.h"
+#include "vicon_log.h"
+#include "vicon_rx.h"
+#include "vicon_frame_log.h"
+#include "vicon_track.h"
+#include "clock_fit.h"
+#include "dev_pts.h"
+#include "pretrig.h"
+#include "kf_index.h"
+#include "metrics.h"
+#include "stream_watch.h"
+#include "ingest_mon.h"
 #include <time.h>
 #include <signal.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <stdint.h>
+#include <errno.h>
 
 #define VICON_PORT 5005
 #define VICON_SYNC_PORT 5006
-#define MAX_PIPELINE_LEN 1024
-#define VICON_MAX_PKT  2048
+#define TRIGGER_PORT 5007
+#define MAX_PIPELINE_LEN 2048
+/* Octets en attente dans appsrc au-delà desquels on considère le décodeur en retard */
+#define SHED_HIGH_BYTES (1024 * 1024)
+/* Marge de la branche d'enregistrement avant qu'elle ne bloque le tee */
+#define RECORD_QUEUE_NS (4ULL * 1000000000ULL)
+/* Période du bilan des horloges (s) */
+#define CLOCK_REPORT_S 10
+/* Pause du thread Vicon après une erreur de réception (ms) */
+#define VICON_RX_ERROR_PAUSE_MS 100
 
 static gboolean first_frame = TRUE;
 
@@ -34,25 +59,118 @@ struct gst_src {
     guint bus_watch_id;
     uint32_t dwFrameInterval;
     uint32_t dwClockFrequency;
+    h264_pool_t *pool;          /* buffers H.264 recyclés (pas de malloc par frame) */
+    gop_shed_t shed;            /* délestage par GOP (remplace la queue leaky) */
+    int64_t t0_ns;              /* monotonic au démarrage du timer : PTS 0 */
+    dev_pts_t pts;              /* PTS tirés de l'horloge caméra, ancrés sur l'hôte */
+    struct h264_stream h264;    /* type des AU, SPS/PPS courants, GOP (callback seul) */
+    uint32_t last_seq;          /* séquence UVC précédente (callback seul) */
+    int have_seq;
 };
 static struct gst_src src;
 
 /* ---------- Sockets & fichiers ---------- */
-static int vicon_sock = -1;
+static vicon_rx_t         *vicon_rx  = NULL;   /* réception UDP par lots (recvmmsg) */
+static vicon_log_writer_t *vicon_log = NULL;   /* toutes les trames, en binaire */
+static vicon_frame_log_t  *frame_log = NULL;   /* CSV par frame vidéo, écrit par son propre thread */
 
 static int latency_sock = -1;
 static struct sockaddr_in latency_dest;
 
-static char output_filename[256];      /* vidéo MP4 */
-static char vicon_frame_csv[256];      /* (optionnel) CSV “par frame vidéo” */
-static char vicon_100hz_csv[256];      /* CSV 100 Hz (toutes les trames) */
-
-/* ---------- Buffer partagé pour la “dernière trame Vicon” ---------- */
-static pthread_mutex_t last_pkt_mtx = PTHREAD_MUTEX_INITIALIZER;
-static size_t          last_pkt_len = 0;
-static char            last_pkt_buf[VICON_MAX_PKT];
+static char output_filename[256];      /* vidéo MP4 (motif %05d si segmenté) */
+static char vicon_frame_csv[256];      /* CSV “par frame vidéo” */
+static char vicon_log_path[256];       /* log binaire de toutes les trames (export CSV : vicon_export) */
+
+/* ---------- Enregistrement / rejeu des frames brutes (sans caméra) ---------- */
+static const char    *record_path  = NULL;   /* --record FICHIER */
+static const char    *replay_path  = NULL;   /* --replay FICHIER */
+static double         replay_speed = 1.0;    /* 0 = aussi vite que possible */
+static int            replay_loop  = 0;
+static const char    *serial       = NULL;   /* --serial : THETA à ouvrir (NULL = la première) */
+static double         replay_stall_s = 0;    /* --replay-stall : panne simulée toutes les N s */
+static double         replay_down_s  = 0;    /* ... « débranchée » pendant tant de secondes */
+
+/* ---------- Caméra et reconnexion à chaud ----------
+   Plus de frame pendant stall_frames intervalles (flux figé, caméra
+   débranchée) : le superviseur ferme la caméra, la retrouve par son numéro
+   de série et renégocie le même mode, sans toucher au pipeline, au MP4 ni
+   aux logs Vicon. */
+static uvc_context_t       *ctx  = NULL;
+static uvc_device_handle_t *devh = NULL;   /* NULL pendant une reconnexion */
+static uvc_stream_ctrl_t    ctrl;
+static char                 dev_serial[64];   /* tel qu'ouvert */
+static unsigned             stall_frames = STREAM_WATCH_DEFAULT_STALL_FRAMES;   /* 0 = jamais */
+static stream_watch_t       watch;
+static unsigned             reconnect_tries = 0;
+
+/* ---------- Santé de l'ingestion USB ----------
+   Le callback note séquence, taille, IDR et retard sur l'horloge caméra de
+   chaque AU ; toutes les INGEST_REPORT_S on résume la fenêtre et on signale
+   les seuils franchis (trous USB, retards bus ou encodeur, rafales, IDR). */
+#define INGEST_REPORT_S 2
+static unsigned                  ingest_window = INGEST_MON_DEFAULT_WINDOW;   /* 0 = désactivé */
+static ingest_mon_t             *ingest = NULL;
+static struct ingest_mon_summary ingest_sum;   /* dernier bilan (boucle principale) */
+
+/* ---------- Enregistrement MP4 ----------
+   Par défaut un seul fichier MP4 fragmenté : un fragment (moof+mdat) est
+   écrit toutes les fragment_ms, la mémoire du muxer ne grandit plus avec la
+   durée et un arrêt brutal ne perd que le dernier fragment. --segment-sec /
+   --segment-mb découpent en plus en fichiers successifs, coupés sur un IDR
+   et finalisés à chaque bascule. --faststart revient à l'ancien fichier
+   unique réécrit à l'EOS. */
+static unsigned       segment_sec  = 0;      /* 0 = pas de découpe par durée */
+static unsigned       segment_mb   = 0;      /* 0 = pas de découpe par taille */
+static unsigned       fragment_ms  = 1000;
+static int            mp4_faststart = 0;
+static char           mp4_kfi_path[256];     /* index des images clés du MP4 */
+static kf_index_writer_t *mp4_kfi  = NULL;
+static struct h264_stream mp4_h264;          /* vu du thread de streaming d'appsrc */
+static GstElement    *mp4_mux      = NULL;   /* splitmuxsink, si segmenté */
+static unsigned       mp4_segment  = 0;      /* segment en cours (son _%05d) */
+static int64_t        mp4_seg_pts  = -1;     /* PTS de son premier IDR */
+static uint64_t       mp4_seg_bytes = 0;
+static tcap_writer_t *recorder     = NULL;
+static tcap_reader_t *replay       = NULL;
+static tcap_player_t *player       = NULL;
+
+/* ---------- Enregistrement sur déclenchement ----------
+   --pretrigger N garde en mémoire les N dernières secondes (H.264 tel que
+   reçu + pose Vicon de chaque frame) au lieu d'enregistrer le MP4 en
+   continu. Un déclenchement (SIGUSR1, "TRIGGER" en UDP sur trigger_port,
+   touche t) écrit ces N secondes et les --posttrigger M suivantes. */
+static double         pretrig_sec   = 0;     /* 0 = enregistrement continu */
+static double         posttrig_sec  = 5;
+static unsigned       pretrig_mb    = PRETRIG_DEFAULT_MB;
+static int            trigger_port  = TRIGGER_PORT;
+static pretrig_t     *pretrig       = NULL;
+static char           clip_prefix[256];
+static int            trigger_sock  = -1;
+static pthread_t      trigger_thr;
+static volatile int   trigger_run   = 0;
+
+/* ---------- Historique Vicon indexé par le temps (lecture sans verrou) ---------- */
+static vicon_track_t *vicon_track    = NULL;
+static int64_t        vicon_delay_ns = 0;    /* --vicon-delay : capture → callback UVC */
+static uint64_t       frame_match[VICON_TRACK_OLD + 1];   /* écrit par le seul callback */
+static clock_fit_t    vicon_clk;             /* horloge Vicon → monotonic hôte (thread Vicon) */
 
 /* ---------- Contrôle du thread Vicon ---------- */
+/* --metrics : exposition Prometheus. Le callback écrit dans son propre
+   fragment de compteurs, sans verrou ; le reste est lu au moment du scrape. */
+static const char      *metrics_addr = NULL;
+static metrics_t       *metrics      = NULL;
+static metrics_shard_t *cb_ms        = NULL;   /* écrit par le seul callback */
+static struct {
+    int received, bytes, size, gaps, no_buffer, pushed, push_errors;
+    int match[VICON_TRACK_OLD + 1];
+} mid;
+/* Tailles d'AU : 16 Kio .. 4 Mio */
+#define N_SIZE_BOUNDS 9
+static const double size_bounds[N_SIZE_BOUNDS] = {
+    16384, 32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+};
+
 static pthread_t vicon_thr;
 static volatile int vicon_run = 0;
 
@@ -65,6 +183,11 @@ static void handle_sigint(int sig) {
     if (src.loop) g_main_loop_quit(src.loop);
 }
 
+static void handle_sigusr1(int sig) {
+    (void)sig;
+    pretrig_trigger(pretrig);   /* un simple drapeau atomique */
+}
+
 /* ---------- Bus callback ---------- */
 static gboolean gst_bus_cb(GstBus *bus, GstMessage *message, gpointer data) {
     (void)bus; (void)data;
@@ -77,6 +200,15 @@ static gboolean gst_bus_cb(GstBus *bus, GstMessage *message, gpointer data) {
             if (dbg) g_free(dbg);
             if (src.loop) g_main_loop_quit(src.loop);
             break;
+        case GST_MESSAGE_ELEMENT: {
+            /* splitmuxsink : un segment vient d'être finalisé */
+            const GstStructure *st = gst_message_get_structure(message);
+            if (st && gst_structure_has_name(st, "splitmuxsink-fragment-closed")) {
+                const gchar *loc = gst_structure_get_string(st, "location");
+                fprintf(stderr, "Segment terminé : %s\n", loc ? loc : "?");
+            }
+            break;
+        }
         default: break;
     }
     return TRUE;
@@ -89,62 +221,115 @@ static void generate_timestamp_suffix(char *buffer, size_t size) {
     strftime(buffer, size, "%Y%m%d_%H%M%S", tm_info);
 }
 
-/* Parsing et écriture CSV d’un paquet Vicon (timestamp ISO + floats) */
-static void csv_write_parsed_packet(FILE *f, const char *data, ssize_t len) {
-    if (!f || len <= 0) return;
-    const char *comma = memchr(data, ',', len);
-    if (!comma) return;
-    size_t ts_len = (size_t)(comma - data);
-    char timestamp[128] = {0};
-    if (ts_len >= sizeof(timestamp)) ts_len = sizeof(timestamp) - 1;
-    memcpy(timestamp, data, ts_len);
-
-    const char *float_data = comma + 1;
-    ssize_t float_len = len - (ssize_t)(ts_len + 1);
-    if (float_len <= 0) return;
-
-    int nf = (int)(float_len / (ssize_t)sizeof(float));
-    if (nf <= 0) return;
-
-    /* copie sûre */
-    float *coords = (float*)malloc((size_t)nf * sizeof(float));
-    if (!coords) return;
-    memcpy(coords, float_data, (size_t)nf * sizeof(float));
-
-    fprintf(f, "%s", timestamp);
-    for (int i = 0; i < nf; ++i) fprintf(f, ",%.6f", coords[i]);
-    fprintf(f, "\n");
-    free(coords);
+/* Fin de la branche d'enregistrement selon le mode choisi */
+static void record_sink_desc(char *out, size_t size, const char *output_file) {
+    if (segment_sec || segment_mb) {
+        /* async-finalize : chaque segment est fermé par son propre muxer,
+           la bascule ne bloque pas le flux. Pas de max-size-* : c'est la
+           sonde d'index qui décide des coupures (record_index_probe), elle
+           sait ainsi dans quel fichier tombe chaque IDR. */
+        snprintf(out, size,
+            "splitmuxsink name=mux location=\"%s\" "
+            "async-finalize=true muxer-factory=mp4mux sink-factory=filesink "
+            "muxer-properties=\"properties,fragment-duration=(uint)%u\"",
+            output_file, fragment_ms);
+    } else if (mp4_faststart) {
+        snprintf(out, size,
+            "mp4mux faststart=true name=mux ! "
+            "filesink location=\"%s\" async=false sync=false", output_file);
+    } else {
+        snprintf(out, size,
+            "mp4mux fragment-duration=%u name=mux ! "
+            "filesink location=\"%s\" async=false sync=false", fragment_ms, output_file);
+    }
+}
+
+/* ---------- Index des images clés du MP4 ----------
+   Sonde sur la sortie d'appsrc : le thread de streaming, pas le callback
+   USB. Chaque buffer qui passe là devient, dans l'ordre, un échantillon du
+   MP4 ; à chaque IDR on note son numéro, son PTS et les SPS/PPS en vigueur.
+   En mode segmenté la sonde coupe aussi les fichiers : au premier IDR
+   au-delà de --segment-sec / --segment-mb, elle demande à splitmuxsink de
+   couper à son temps de course (appsrc en format temps, segment à 0 : c'est
+   son PTS). Le buffer n'a pas encore traversé la queue d'enregistrement,
+   la coupure tombe donc exactement sur lui, et l'entrée d'index porte le
+   numéro du fichier qui le contient. */
+static GstPadProbeReturn record_index_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    (void)pad; (void)data;
+    GstBuffer *buf = gst_pad_probe_info_get_buffer(info);
+    GstMapInfo map;
+    if (!buf || !gst_buffer_map(buf, &map, GST_MAP_READ)) return GST_PAD_PROBE_OK;
+    struct h264_au_info au;
+    uint64_t frame = mp4_h264.aus;
+    h264_stream_update(&mp4_h264, map.data, map.size, &au);
+    if (au.has_idr) {
+        int64_t pts = (int64_t)GST_BUFFER_PTS(buf);
+        if (mp4_mux && mp4_seg_pts >= 0 &&
+            ((segment_sec && pts - mp4_seg_pts >= (int64_t)segment_sec * 1000000000LL) ||
+             (segment_mb && mp4_seg_bytes >= (uint64_t)segment_mb * 1024ULL * 1024ULL))) {
+            g_signal_emit_by_name(mp4_mux, "split-at-running-time", (GstClockTime)pts);
+            mp4_segment++;
+            mp4_seg_pts = -1;
+        }
+        if (mp4_seg_pts < 0) {
+            mp4_seg_pts = pts;
+            mp4_seg_bytes = 0;
+        }
+        kf_index_set_segment(mp4_kfi, mp4_segment);
+        kf_index_add(mp4_kfi, &mp4_h264, frame, 0, pts,
+                     (uint32_t)GST_BUFFER_OFFSET(buf), (uint32_t)map.size);
+    }
+    mp4_seg_bytes += map.size;
+    gst_buffer_unmap(buf, &map);
+    return GST_PAD_PROBE_OK;
 }
 
 /* ---------- Initialisation pipeline GStreamer ----------
    appsrc (H.264 byte-stream) → h264parse → tee
    - branche 1: décodage → v4l2sink (temps réel)
-   - branche 2: MP4 (mp4mux → filesink)
+   - branche 2: MP4 (mp4mux fragmenté ou splitmuxsink → fichiers), absente
+     avec --pretrigger
+   La queue de la branche 2 absorbe quelques secondes : une écriture disque
+   lente ou une bascule de segment ne remonte pas jusqu'au tee, donc
+   l'aperçu ne s'arrête pas.
 */
 static int gst_src_init(int *argc, char ***argv, const char *output_file) {
     GstCaps *caps;
     GstBus *bus;
     char pipeline_str[MAX_PIPELINE_LEN];
-
+    char record_sink[768];
+    char record_branch[1024] = "";
+
+    /* En mode déclenchement, pas de branche MP4 : les extraits sont écrits
+       depuis l'anneau, hors pipeline */
+    if (pretrig_sec <= 0) {
+        record_sink_desc(record_sink, sizeof(record_sink), output_file);
+        snprintf(record_branch, sizeof(record_branch),
+            "t. ! queue max-size-buffers=0 max-size-bytes=0 max-size-time=%llu ! "
+            "video/x-h264,stream-format=avc,alignment=au ! %s",
+            (unsigned long long)RECORD_QUEUE_NS, record_sink);
+    }
     snprintf(pipeline_str, MAX_PIPELINE_LEN,
         "appsrc name=ap is-live=true block=false format=time ! "
-        "queue max-size-buffers=1 leaky=downstream ! "
+        "queue max-size-buffers=4 ! "
         "h264parse config-interval=-1 ! tee name=t "
         /* Aperçu temps réel */
         "t. ! queue ! avdec_h264 ! videoconvert ! "
         "video/x-raw,format=YUY2,width=3840,height=1920,framerate=30/1 ! "
         "v4l2sink device=/dev/video2 sync=false "
         /* Enregistrement MP4 (sans ré-encoder) */
-        "t. ! queue ! video/x-h264,stream-format=avc,alignment=au ! "
-        "mp4mux faststart=true name=mux ! "
-        "filesink location=\"%s\" async=false sync=false",
-        output_file
+        "%s",
+        record_branch
     );
 
     gst_init(argc, argv);
 
     src.timer = g_timer_new();
+    {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        src.t0_ns = (int64_t)t0.tv_sec * 1000000000LL + t0.tv_nsec;
+    }
     src.loop  = g_main_loop_new(NULL, TRUE);
     src.pipeline = gst_parse_launch(pipeline_str, NULL);
     if (!src.pipeline) { g_printerr("Pipeline GStreamer invalide\n"); return FALSE; }
@@ -154,6 +339,17 @@ static int gst_src_init(int *argc, char ***argv, const char *output_file) {
     src.appsrc = gst_bin_get_by_name(GST_BIN(src.pipeline), "ap");
     if (!src.appsrc) { g_printerr("appsrc introuvable\n"); return FALSE; }
 
+    if (pretrig_sec <= 0) {
+        GstPad *pad = gst_element_get_static_pad(src.appsrc, "src");
+        h264_stream_init(&mp4_h264);
+        mp4_kfi = kf_index_open(mp4_kfi_path);
+        if (segment_sec || segment_mb) mp4_mux = gst_bin_get_by_name(GST_BIN(src.pipeline), "mux");
+        /* Segmenté, la sonde reste nécessaire même sans index : elle coupe */
+        if (pad && (mp4_kfi || mp4_mux))
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, record_index_probe, NULL, NULL);
+        if (pad) gst_object_unref(pad);
+    }
+
     caps = gst_caps_new_simple("video/x-h264",
         "stream-format", G_TYPE_STRING, "byte-stream",
         "alignment",     G_TYPE_STRING, "au",
@@ -171,43 +367,67 @@ static int gst_src_init(int *argc, char ***argv, const char *output_file) {
     return TRUE;
 }
 
-/* ---------- Thread Vicon : lit 100% des paquets et écrit vicon_100hz_*.csv ---------- */
+/* ---------- Thread Vicon : lit 100% des paquets et les ajoute au log binaire ----------
+   Un recvmmsg vide la file du socket d'un coup (jusqu'à VICON_RX_BATCH trames),
+   directement dans des enregistrements de taille fixe écrits en une seule
+   écriture. Pas de formatage texte ici : le CSV s'obtient après coup avec
+   vicon_export. Pas de pause quand la file est vide : le tampon noyau (8 Mo)
+   absorbe les rafales, et SO_RXQ_OVFL dit si quelque chose a quand même été
+   perdu. Une erreur de réception, elle, est signalée une fois puis suivie
+   d'une pause, pour ne pas boucler à vide sur un socket en échec. */
 static void* vicon_thread_fn(void *arg) {
     (void)arg;
-    FILE *f100 = fopen(vicon_100hz_csv, "w");
-    if (!f100) {
-        perror("open vicon_100hz_csv");
-        return NULL;
-    }
-    /* En-tête simple (facultatif) */
-    fprintf(f100, "vicon_timestamp,values...\n");
-    fflush(f100);
-
-    char buf[VICON_MAX_PKT];
-    struct sockaddr_in srcaddr;
-    socklen_t slen = sizeof(srcaddr);
+    struct vicon_record *batch = calloc(VICON_RX_BATCH, sizeof(*batch));
+    if (!batch) return NULL;
+    uint64_t drops_seen = 0;
+    int log_failed = 0;
+    int rx_failed = 0;
 
     while (vicon_run) {
-        ssize_t n = recvfrom(vicon_sock, buf, sizeof(buf), 0, (struct sockaddr*)&srcaddr, &slen);
-        if (n <= 0) {
-            if (!vicon_run) break;
-            /* petite pause pour ne pas surcharger si erreur transitoire */
-            usleep(1000);
+        int n = vicon_rx_batch(vicon_rx, batch, VICON_RX_BATCH);
+        if (n < 0) {
+            if (!rx_failed)
+                fprintf(stderr, "vicon : erreur de réception (%s), nouvel essai toutes les %d ms\n",
+                        g_strerror(errno), VICON_RX_ERROR_PAUSE_MS);
+            rx_failed = 1;
+            g_usleep(VICON_RX_ERROR_PAUSE_MS * 1000);
             continue;
         }
+        if (n == 0) continue;
+        if (rx_failed) {
+            fprintf(stderr, "vicon : réception rétablie\n");
+            rx_failed = 0;
+        }
+
+        if (vicon_log_append(vicon_log, batch, (size_t)n) != 0 && !log_failed) {
+            fprintf(stderr, "vicon : écriture du log %s impossible\n", vicon_log_path);
+            log_failed = 1;
+        }
 
-        /* Écrit TOUTES les trames Vicon reçues (100 Hz typ.) */
-        csv_write_parsed_packet(f100, buf, n);
+        /* Pertes noyau : signalées dès qu'elles apparaissent */
+        if (batch[n - 1].drops != drops_seen) {
+            fprintf(stderr, "vicon : %u trames perdues par le noyau (file du socket pleine)\n",
+                    batch[n - 1].drops);
+            drops_seen = batch[n - 1].drops;
+        }
 
-        /* Met à disposition la dernière trame pour le callback vidéo */
-        pthread_mutex_lock(&last_pkt_mtx);
-        if ((size_t)n > sizeof(last_pkt_buf)) n = sizeof(last_pkt_buf);
-        memcpy(last_pkt_buf, buf, (size_t)n);
-        last_pkt_len = (size_t)n;
-        pthread_mutex_unlock(&last_pkt_mtx);
+        /* Décodées une fois ici, datées à la réception noyau, puis mises à
+           disposition du callback vidéo dans l'historique */
+        for (int i = 0; i < n; ++i) {
+            struct vicon_sample smp;
+            if (!vicon_sample_parse(&smp, &batch[i])) continue;
+            /* Base de temps commune : l'horodatage Vicon ramené sur le
+               monotonic hôte par l'ajustement, plutôt que l'heure de
+               réception qui porte la gigue réseau */
+            if (smp.vicon_ns) {
+                clock_fit_update(&vicon_clk, smp.vicon_ns, smp.t_ns);
+                if (clock_fit_ready(&vicon_clk)) smp.t_ns = clock_fit_map(&vicon_clk, smp.vicon_ns);
+            }
+            vicon_track_push(vicon_track, &smp);
+        }
     }
 
-    fclose(f100);
+    free(batch);
     return NULL;
 }
 
@@ -221,7 +441,146 @@ static void setup_latency_socket(void) {
     latency_dest.sin_addr.s_addr = inet_addr("127.0.0.1");
 }
 
-/* ---------- Callback UVC : pousse la vidéo; lit la DERNIÈRE trame Vicon (optionnel) ---------- */
+/* ---------- Horloges : décalage, dérive et résidu des deux ajustements ---------- */
+static void clock_line(const char *name, clock_fit_t *f) {
+    struct clock_fit_stats cs;
+    clock_fit_get_stats(f, &cs, 1);
+    if (!cs.samples) return;
+    fprintf(stderr, "  %-14s décalage %+.3f ms  dérive %+.2f ppm  résidu %.3f ms (max %.3f)  "
+                    "aberrants %llu  reprises %llu%s\n",
+            name, (double)cs.offset_ns / 1e6, (double)cs.drift_ppb / 1e3,
+            (double)cs.resid_rms_ns / 1e6, (double)cs.resid_max_ns / 1e6,
+            (unsigned long long)cs.outliers, (unsigned long long)cs.resets,
+            cs.ready ? "" : "  (en rodage)");
+}
+
+static gboolean clock_report(gpointer data) {
+    (void)data;
+    fprintf(stderr, "Horloges → monotonic hôte :\n");
+    clock_line("caméra", &src.pts.fit);
+    clock_line("Vicon", &vicon_clk);
+    if (ingest) ingest_mon_print(&ingest_sum, stderr);
+    return TRUE;
+}
+
+/* ---------- Métriques (--metrics) : valeurs tenues par les modules ---------- */
+static double mx_shed(void *a) {
+    (void)a;
+    struct gop_shed_stats ss;
+    gop_shed_get_stats(&src.shed, &ss);
+    return (double)ss.shed;
+}
+
+static double mx_appsrc_bytes(void *a) {
+    (void)a;
+    return (double)gst_app_src_get_current_level_bytes(GST_APP_SRC(src.appsrc));
+}
+
+static double mx_pool_allocs(void *a) {
+    (void)a;
+    struct h264_pool_stats ps;
+    h264_pool_get_stats(src.pool, &ps);
+    return (double)ps.allocs;
+}
+
+static double mx_vicon(void *a) {
+    struct vicon_rx_stats vs;
+    vicon_rx_get_stats(vicon_rx, &vs);
+    switch ((intptr_t)a) {
+    case 0:  return (double)vs.packets;
+    case 1:  return (double)vs.kernel_drops;
+    case 2:  return (double)vs.truncated;
+    default: return (double)vs.errors;
+    }
+}
+
+static double mx_watch(void *a) {
+    switch ((intptr_t)a) {
+    case 0:  return (double)watch.st.stalls;
+    case 1:  return (double)watch.st.last_recovery_ns / 1e9;
+    default: return watch.stalled ? 1.0 : 0.0;
+    }
+}
+
+/* Valeurs du dernier bilan d'ingestion ; au-delà de 2 : alerte (a - 3) active */
+static double mx_ingest(void *a) {
+    switch ((intptr_t)a) {
+    case 0:  return ingest_sum.late_p99_ms / 1e3;
+    case 1:  return ingest_sum.bitrate_now_bps;
+    case 2:  return ingest_sum.idr_interval_ms / 1e3;
+    default: return (ingest_sum.active >> ((intptr_t)a - 3)) & 1u ? 1.0 : 0.0;
+    }
+}
+
+static double mx_frame_log_dropped(void *a) {
+    (void)a;
+    struct vicon_frame_log_stats fs;
+    vicon_frame_log_get_stats(frame_log, &fs);
+    return (double)fs.dropped;
+}
+
+/* Tout est enregistré avant le premier callback et avant le serveur. */
+static void setup_metrics(void) {
+    metrics = metrics_new();
+    if (!metrics) return;
+    cb_ms = metrics_shard_new(metrics);
+    metrics_t *m = metrics;
+    mid.received = metrics_counter(m, "theta_frames_received_total", "Access units from USB (or replay)", NULL);
+    mid.bytes    = metrics_counter(m, "theta_usb_bytes_total", "H.264 bytes from USB; rate() x 8 is the bitrate", NULL);
+    mid.size     = metrics_histogram(m, "theta_usb_frame_bytes", "Access unit size", NULL,
+                                     size_bounds, N_SIZE_BOUNDS);
+    mid.gaps     = metrics_counter(m, "theta_sequence_gaps_total", "Frames missing from the UVC sequence", NULL);
+    mid.pushed   = metrics_counter(m, "theta_frames_pushed_total", "Buffers handed to appsrc", NULL);
+    mid.push_errors = metrics_counter(m, "theta_push_errors_total", "push-buffer calls that failed", NULL);
+    mid.no_buffer = metrics_counter(m, "theta_frames_dropped_total", "Frames dropped before appsrc",
+                                    "reason=\"no_buffer\"");
+    metrics_counter_fn(m, "theta_frames_dropped_total", "Frames dropped before appsrc",
+                       "reason=\"shed\"", mx_shed, NULL);
+    metrics_gauge_fn(m, "theta_appsrc_queued_bytes", "Bytes queued in appsrc", NULL, mx_appsrc_bytes, NULL);
+    metrics_counter_fn(m, "theta_buffer_allocs_total", "H.264 buffer heap allocations", NULL,
+                       mx_pool_allocs, NULL);
+    metrics_counter_fn(m, "theta_stream_stalls_total", "Times the stream stopped and was reconnected", NULL,
+                       mx_watch, (void *)0);
+    metrics_gauge_fn(m, "theta_stream_recovery_seconds", "Last frame before the last stall to the first after it",
+                     NULL, mx_watch, (void *)1);
+    metrics_gauge_fn(m, "theta_stream_stalled", "1 while the stream is stalled and being reconnected", NULL,
+                     mx_watch, (void *)2);
+
+    if (ingest) {
+        metrics_gauge_fn(m, "theta_usb_late_seconds",
+                         "p99 of arrival minus the camera frame clock over the ingest window", NULL,
+                         mx_ingest, (void *)0);
+        metrics_gauge_fn(m, "theta_usb_bitrate_bps", "H.264 bitrate over the last second", NULL,
+                         mx_ingest, (void *)1);
+        metrics_gauge_fn(m, "theta_idr_interval_seconds", "Last IDR to IDR interval", NULL,
+                         mx_ingest, (void *)2);
+        for (int a = 0; a < INGEST_ALERT_NUM; ++a) {
+            char l[64];
+            snprintf(l, sizeof(l), "alert=\"%s\"", ingest_alert_name((enum ingest_alert)a));
+            metrics_gauge_fn(m, "theta_ingest_alert", "1 while this USB ingest alert is raised", l,
+                             mx_ingest, (void *)(intptr_t)(3 + a));
+        }
+    }
+
+    metrics_counter_fn(m, "theta_vicon_packets_total", "Vicon datagrams received; rate() is the packet rate",
+                       NULL, mx_vicon, (void *)0);
+    metrics_counter_fn(m, "theta_vicon_lost_total", "Vicon datagrams lost", "reason=\"kernel\"",
+                       mx_vicon, (void *)1);
+    metrics_counter_fn(m, "theta_vicon_lost_total", "Vicon datagrams lost", "reason=\"truncated\"",
+                       mx_vicon, (void *)2);
+    metrics_counter_fn(m, "theta_vicon_rx_errors_total", "Vicon socket errors", NULL, mx_vicon, (void *)3);
+    metrics_counter_fn(m, "theta_vicon_frame_log_dropped_total", "Per-frame pose rows lost (queue full)",
+                       NULL, mx_frame_log_dropped, NULL);
+    for (int r = 0; r <= VICON_TRACK_OLD; ++r) {
+        char l[64];
+        snprintf(l, sizeof(l), "result=\"%s\"", vicon_track_result_name((enum vicon_track_result)r));
+        mid.match[r] = metrics_counter(m, "theta_vicon_frame_match_total",
+                                       "How each video frame got its pose", l);
+    }
+    if (metrics_listen(m, metrics_addr) == 0) printf("Métriques             : %s\n", metrics_addr);
+}
+
+/* ---------- Callback UVC : pousse la vidéo; pose Vicon interpolée par frame (optionnel) ---------- */
 static void cb(uvc_frame_t *frame, void *ptr) {
     struct gst_src *s = (struct gst_src *)ptr;
 
@@ -230,35 +589,80 @@ static void cb(uvc_frame_t *frame, void *ptr) {
     struct timespec ts_latency;
     clock_gettime(CLOCK_MONOTONIC, &ts_latency);
     uint64_t timestamp_us = (uint64_t)ts_latency.tv_sec * 1000000ULL + (uint64_t)ts_latency.tv_nsec / 1000ULL;
+    stream_watch_frame(&watch, (uint64_t)ts_latency.tv_sec * 1000000000ULL + (uint64_t)ts_latency.tv_nsec);
     sendto(latency_sock, &timestamp_us, sizeof(timestamp_us), 0,
            (struct sockaddr *)&latency_dest, sizeof(latency_dest));
 
-    /* ----- (Optionnel) Log “par frame vidéo” : on ne lit pas le socket !
-       On prend juste la DERNIÈRE trame que le thread Vicon a déposée. ----- */
-    size_t copy_len = 0;
-    char   copy_buf[VICON_MAX_PKT];
-    pthread_mutex_lock(&last_pkt_mtx);
-    if (last_pkt_len > 0) {
-        copy_len = last_pkt_len;
-        if (copy_len > sizeof(copy_buf)) copy_len = sizeof(copy_buf);
-        memcpy(copy_buf, last_pkt_buf, copy_len);
-    }
-    pthread_mutex_unlock(&last_pkt_mtx);
-
-    if (copy_len > 0) {
-        FILE *ff = fopen(vicon_frame_csv, "a");
-        if (ff) {
-            csv_write_parsed_packet(ff, copy_buf, (ssize_t)copy_len);
-            fclose(ff);
+    metrics_add(cb_ms, mid.received, 1);
+    metrics_add(cb_ms, mid.bytes, frame->data_bytes);
+    metrics_observe(cb_ms, mid.size, size_bounds, N_SIZE_BOUNDS, (double)frame->data_bytes);
+    if (s->have_seq && frame->sequence > s->last_seq + 1)
+        metrics_add(cb_ms, mid.gaps, frame->sequence - s->last_seq - 1);
+    s->last_seq = frame->sequence;
+    s->have_seq = 1;
+
+    struct h264_au_info au;
+    if (h264_stream_update(&s->h264, frame->data, frame->data_bytes, &au) && s->h264.ps_changes)
+        fprintf(stderr, "SPS/PPS changés (génération %u)\n", s->h264.ps.gen);
+    if (recorder) tcap_writer_append(recorder, frame, au.has_idr ? TCAP_FLAG_IDR : 0);
+    int congested = gst_app_src_get_current_level_bytes(GST_APP_SRC(s->appsrc)) >= SHED_HIGH_BYTES;
+    uint64_t now_ns = (uint64_t)ts_latency.tv_sec * 1000000000ULL + (uint64_t)ts_latency.tv_nsec;
+
+    /* Horloge caméra : libuvc ne donne pas le PTS du flux, mais la caméra
+       produit une frame tous les dwFrameInterval ; séquence × intervalle
+       est donc son horloge, ajustée ici sur l'heure d'arrivée. L'heure
+       d'arrivée ne fait qu'ancrer et mesurer la dérive : la gigue USB ne
+       passe plus dans les PTS. Toutes les frames y contribuent, même
+       celles qu'on jette ensuite. */
+    uint64_t duration_ns;
+    uint64_t pts_ns = dev_pts_stamp(&s->pts, frame->sequence, (int64_t)now_ns, &duration_ns);
+    int64_t t_frame = dev_pts_frame_time(&s->pts, frame->sequence);
+    /* Séquence, taille et retard sur l'horloge caméra : la santé de l'USB */
+    ingest_mon_frame(ingest, frame->sequence, (uint32_t)frame->data_bytes, au.has_idr,
+                     (int64_t)now_ns, t_frame);
+
+    /* Anneau pré-déclenchement : toutes les frames, même celles que
+       l'aperçu va délester, avec leur pose. Une copie en mémoire
+       préallouée, jamais d'appel système. */
+    struct vicon_frame_rec pose;
+    enum vicon_track_result m = VICON_TRACK_EMPTY;
+    if (pretrig) {
+        m = vicon_track_lookup(vicon_track, t_frame - vicon_delay_ns, &pose.pose);
+        pose.frame_seq = frame->sequence;
+        pose.match     = (int32_t)m;
+        pretrig_push(pretrig, frame, t_frame, &au, &s->h264.ps,
+                     m != VICON_TRACK_EMPTY ? &pose : NULL);
+    }
+
+    /* Délestage : si appsrc accumule du retard, on jette des GOP entiers
+       (jusqu'au prochain IDR) plutôt que des buffers au hasard. Fait avant
+       le log Vicon pour que le CSV par frame reste aligné sur la vidéo. */
+    if (!gop_shed_admit(&s->shed, &au, congested, now_ns)) return;
+
+    /* ----- Log “par frame vidéo” : on ne lit pas le socket et on n'écrit
+       rien ici. La pose à l'instant de la frame est interpolée entre les
+       deux trames Vicon qui l'encadrent, directement dans un emplacement
+       préalloué ; le thread d'écriture fait le reste. File pleine = ligne
+       perdue (comptée), jamais d'attente. ----- */
+    struct vicon_frame_rec *rec = vicon_frame_log_reserve(frame_log);
+    if (rec) {
+        if (pretrig) rec->pose = pose.pose;
+        else         m = vicon_track_lookup(vicon_track, t_frame - vicon_delay_ns, &rec->pose);
+        frame_match[m]++;
+        metrics_add(cb_ms, mid.match[m], 1);
+        if (m != VICON_TRACK_EMPTY) {
+            rec->frame_seq = frame->sequence;
+            rec->match     = (int32_t)m;
+            vicon_frame_log_commit(frame_log);
         }
     }
 
-    /* Push H.264 vers appsrc */
+    /* Push H.264 vers appsrc (copie dans un buffer du pool) */
     GstBuffer *buffer;
     GstFlowReturn ret;
-    GstMapInfo map;
 
-    buffer = gst_buffer_new_allocate(NULL, frame->data_bytes, NULL);
+    buffer = h264_pool_fill(s->pool, frame->data, frame->data_bytes);
+    if (!buffer) { metrics_add(cb_ms, mid.no_buffer, 1); return; }
 
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
@@ -268,75 +672,299 @@ static void cb(uvc_frame_t *frame, void *ptr) {
         first_frame = FALSE;
     }
 
-    gdouble elapsed = g_timer_elapsed(s->timer, NULL);
-    GST_BUFFER_PTS(buffer)       = (GstClockTime)(elapsed * GST_SECOND);
+    GST_BUFFER_PTS(buffer)       = (GstClockTime)pts_ns;
     GST_BUFFER_DTS(buffer)       = GST_CLOCK_TIME_NONE;
-    GST_BUFFER_DURATION(buffer)  = (GstClockTime)(1.0 / 30.0 * GST_SECOND);
+    GST_BUFFER_DURATION(buffer)  = (GstClockTime)duration_ns;   /* 29.97 : 33,37 ms, pas 1/30 */
     GST_BUFFER_OFFSET(buffer)    = frame->sequence;
-
-    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
-    memcpy(map.data, frame->data, frame->data_bytes);
-    gst_buffer_unmap(buffer, &map);
+    if (!au.has_idr) GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
 
     g_signal_emit_by_name(s->appsrc, "push-buffer", buffer, &ret);
     gst_buffer_unref(buffer);
 
-    if (ret != GST_FLOW_OK) fprintf(stderr, "push-buffer error: %d\n", ret);
+    metrics_add(cb_ms, mid.pushed, 1);
+    if (ret != GST_FLOW_OK) {
+        fprintf(stderr, "push-buffer error: %d\n", ret);
+        metrics_add(cb_ms, mid.push_errors, 1);
+    }
 }
 
 static void* keywait(void *arg) {
     (void)arg;
-    printf("Press any key to stop...\n");
+    printf(pretrig ? "Press t + Enter to trigger, any other key to stop...\n"
+                   : "Press any key to stop...\n");
     char c;
-    (void)read(0, &c, 1);
+    while (read(0, &c, 1) == 1 && pretrig && (c == 't' || c == 'T')) {
+        pretrig_trigger(pretrig);
+        fprintf(stderr, "Déclenchement (clavier)\n");
+        while (read(0, &c, 1) == 1 && c != '\n') {}   /* fin de ligne */
+    }
     if (src.loop) g_main_loop_quit(src.loop);
     return NULL;
 }
 
+/* ---------- Déclenchement par UDP : un datagramme "TRIGGER" ---------- */
+static void* trigger_thread_fn(void *arg) {
+    (void)arg;
+    char msg[64];
+    while (trigger_run) {
+        struct pollfd pfd = { trigger_sock, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        ssize_t n = recv(trigger_sock, msg, sizeof(msg), 0);
+        if (n >= 7 && !memcmp(msg, "TRIGGER", 7)) {
+            pretrig_trigger(pretrig);
+            fprintf(stderr, "Déclenchement (UDP)\n");
+        }
+    }
+    return NULL;
+}
+
+static int start_trigger_listener(void) {
+    trigger_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (trigger_sock < 0) { perror("trigger socket"); return 0; }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)trigger_port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(trigger_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("trigger bind");
+        close(trigger_sock);
+        trigger_sock = -1;
+        return 0;
+    }
+    trigger_run = 1;
+    if (pthread_create(&trigger_thr, NULL, trigger_thread_fn, NULL) != 0) {
+        trigger_run = 0;
+        close(trigger_sock);
+        trigger_sock = -1;
+        return 0;
+    }
+    return 1;
+}
+
+static void stop_trigger_listener(void) {
+    if (trigger_sock < 0) return;
+    trigger_run = 0;
+    pthread_join(trigger_thr, NULL);
+    close(trigger_sock);
+    trigger_sock = -1;
+}
+
+/* Fin du rejeu (sans boucle) : on arrête comme sur appui clavier */
+static gboolean replay_watch(gpointer data) {
+    (void)data;
+    if (!tcap_player_done(player)) return TRUE;
+    fprintf(stderr, "replay terminé\n");
+    if (src.loop) g_main_loop_quit(src.loop);
+    return FALSE;
+}
 
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
 
+/* Reconnexion : caméra retrouvée par numéro de série (après un
+   rebranchement c'est un autre périphérique USB), même mode, état
+   d'ingestion remis à zéro comme pour un nouveau flux. En rejeu avec
+   --replay-stall, on relance simplement le lecteur. */
+static int reconnect(void) {
+    if (player) return tcap_player_restart(player) == 0;
+
+    if (devh) {
+        uvc_stop_streaming(devh);   /* attend la fin du callback : l'état est à nous */
+        uvc_close(devh);
+        devh = NULL;
+    }
+    uvc_device_t *dev = NULL;
+    if (thetauvc_find_device_by_serial(ctx, &dev, dev_serial[0] ? dev_serial : serial) != UVC_SUCCESS || !dev)
+        return 0;
+    uvc_error_t res = uvc_open(dev, &devh);
+    uvc_unref_device(dev);
+    if (res != UVC_SUCCESS) { devh = NULL; return 0; }
+
+    uvc_stream_ctrl_t c;
+    res = thetauvc_get_stream_ctrl_format_size(devh, THETAUVC_MODE_UHD_2997, &c);
+    if (res == UVC_SUCCESS) {
+        ctrl = c;
+        /* Le nouveau flux repart sur un IDR, séquence remise à zéro */
+        gop_shed_note_loss(&src.shed, mono_ns());
+        src.have_seq = 0;
+        dev_pts_restart(&src.pts, ctrl.dwFrameInterval);
+        ingest_mon_restart(ingest);
+        res = uvc_start_streaming(devh, &ctrl, cb, &src, 0);
+    }
+    if (res != UVC_SUCCESS) {
+        uvc_perror(res, "reconnexion");
+        uvc_close(devh);
+        devh = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Bilan de la fenêtre d'ingestion et alertes, avec la cause probable :
+   une frame en retard de taille normale a attendu sur le bus, une grosse
+   frame (ou celle qui la suit) sur l'encodeur. Un retard qui n'apparaît
+   qu'après l'arrivée est celui du pipeline, pas de l'USB. */
+static gboolean ingest_report(gpointer data) {
+    (void)data;
+    ingest_mon_update(ingest, (int64_t)mono_ns(), &ingest_sum);
+    const struct ingest_mon_summary *s = &ingest_sum;
+    for (int a = 0; a < INGEST_ALERT_NUM; ++a) {
+        const char *name = ingest_alert_name((enum ingest_alert)a);
+        if (s->cleared & (1u << a)) fprintf(stderr, "Ingestion : fin de l'alerte %s\n", name);
+        if (!(s->raised & (1u << a))) continue;
+        switch ((enum ingest_alert)a) {
+        case INGEST_ALERT_GAPS:
+            fprintf(stderr, "⚠️  Ingestion %s : %llu frames perdues sur l'USB parmi les %u dernières\n",
+                    name, (unsigned long long)s->gaps, s->frames);
+            break;
+        case INGEST_ALERT_USB_LATE:
+            fprintf(stderr, "⚠️  Ingestion %s : %u frames de taille normale en retard sur l'horloge caméra "
+                            "(p99 %.1f ms, max %.1f ms) : bus ou pile USB de l'hôte\n",
+                    name, s->late_usb, s->late_p99_ms, s->late_max_ms);
+            break;
+        case INGEST_ALERT_ENCODER_LATE:
+            fprintf(stderr, "⚠️  Ingestion %s : %u grosses frames en retard sur l'horloge caméra "
+                            "(p99 %.1f ms, max %.1f ms, AU max %.0f Kio) : rafales de l'encodeur\n",
+                    name, s->late_encoder, s->late_p99_ms, s->late_max_ms, s->size_max / 1024.0);
+            break;
+        case INGEST_ALERT_BURST:
+            fprintf(stderr, "⚠️  Ingestion %s : %.1f Mbit/s sur la dernière seconde pour %.1f en moyenne\n",
+                    name, s->bitrate_now_bps / 1e6, s->bitrate_avg_bps / 1e6);
+            break;
+        case INGEST_ALERT_IDR:
+            fprintf(stderr, "⚠️  Ingestion %s : IDR toutes les %.0f ms, dernier il y a %.0f ms\n",
+                    name, s->idr_interval_ms, s->idr_age_ms);
+            break;
+        default:
+            break;
+        }
+    }
+    return TRUE;
+}
+
+/* Superviseur de décrochage, toutes les 100 ms */
+static gboolean watch_tick(gpointer data) {
+    (void)data;
+    if (player && tcap_player_done(player)) return TRUE;
+    uint64_t now = mono_ns();
+    switch (stream_watch_tick(&watch, now)) {
+    case STREAM_WATCH_OK:
+        break;
+    case STREAM_WATCH_RECONNECT: {
+        if (reconnect_tries++ == 0)
+            fprintf(stderr, "Flux figé : aucune frame depuis %.0f ms, reconnexion\n",
+                    (double)watch.st.last_detect_ns / 1e6);
+        int ok = reconnect();
+        uint64_t t = mono_ns();
+        stream_watch_attempt(&watch, ok, t);
+        if (!ok)
+            fprintf(stderr, "Tentative %u échouée (%.0f ms), nouvel essai dans %.0f ms\n",
+                    reconnect_tries, (double)(t - now) / 1e6, (double)(watch.next_try_ns - t) / 1e6);
+        break;
+    }
+    case STREAM_WATCH_RECOVERED:
+        fprintf(stderr, "🟢 Flux rétabli : %.0f ms sans frame, %u tentative%s\n",
+                (double)watch.st.last_recovery_ns / 1e6, reconnect_tries, reconnect_tries > 1 ? "s" : "");
+        reconnect_tries = 0;
+        break;
+    }
+    return TRUE;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage : %s [--serial S] [--record FILE] [--replay FILE [--replay-speed X] [--replay-loop]]\n"
+        "           [--replay-stall SEC[,DOWN]] [--vicon-delay MS]\n"
+        "           [--segment-sec N] [--segment-mb N] [--fragment-ms MS] [--faststart]\n"
+        "           [--pretrigger SEC [--posttrigger SEC] [--pretrigger-mb N] [--trigger-port PORT]]\n"
+        "           [--metrics ADDR] [--stall-frames N] [--ingest-window N]\n",
+        prog);
+}
 
 /* ---------- main ---------- */
 int main(int argc, char **argv) {
     signal(SIGINT, handle_sigint);
+    signal(SIGUSR1, handle_sigusr1);
+
+    for (int i = 1; i < argc; ++i) {
+        if      (!strcmp(argv[i], "--record") && i + 1 < argc) record_path = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc) replay_path = argv[++i];
+        else if (!strcmp(argv[i], "--replay-speed") && i + 1 < argc) replay_speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--replay-loop")) replay_loop = 1;
+        else if (!strcmp(argv[i], "--serial") && i + 1 < argc) serial = argv[++i];
+        else if (!strcmp(argv[i], "--vicon-delay") && i + 1 < argc)
+            vicon_delay_ns = (int64_t)(atof(argv[++i]) * 1e6);
+        else if (!strcmp(argv[i], "--segment-sec") && i + 1 < argc) segment_sec = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--segment-mb") && i + 1 < argc) segment_mb = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--fragment-ms") && i + 1 < argc) fragment_ms = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--faststart")) mp4_faststart = 1;
+        else if (!strcmp(argv[i], "--pretrigger") && i + 1 < argc) pretrig_sec = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--posttrigger") && i + 1 < argc) posttrig_sec = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--pretrigger-mb") && i + 1 < argc) pretrig_mb = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trigger-port") && i + 1 < argc) trigger_port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--metrics") && i + 1 < argc) metrics_addr = argv[++i];
+        else if (!strcmp(argv[i], "--stall-frames") && i + 1 < argc) stall_frames = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--ingest-window") && i + 1 < argc) ingest_window = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--replay-stall") && i + 1 < argc) {
+            /* SEC[,DOWN] */
+            char *end;
+            replay_stall_s = strtod(argv[++i], &end);
+            if (*end == ',') replay_down_s = strtod(end + 1, NULL);
+        } else {
+            fprintf(stderr, "Option inconnue : %s\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
     char ts_suffix[64];
     generate_timestamp_suffix(ts_suffix, sizeof(ts_suffix));
 
-    snprintf(output_filename,   sizeof(output_filename),   "output_%s.mp4", ts_suffix);
+    if (segment_sec || segment_mb)
+        snprintf(output_filename, sizeof(output_filename), "output_%s_%%05d.mp4", ts_suffix);
+    else
+        snprintf(output_filename, sizeof(output_filename), "output_%s.mp4", ts_suffix);
+    if (fragment_ms == 0) fragment_ms = 1000;
     snprintf(vicon_frame_csv,   sizeof(vicon_frame_csv),   "vicon_log_%s.csv", ts_suffix);
-    snprintf(vicon_100hz_csv,   sizeof(vicon_100hz_csv),   "vicon_100hz_%s.csv", ts_suffix);
-
-    printf("Vidéo (MP4)           : %s\n", output_filename);
+    snprintf(vicon_log_path,    sizeof(vicon_log_path),    "vicon_%s.vlog", ts_suffix);
+    snprintf(clip_prefix,       sizeof(clip_prefix),       "clip_%s", ts_suffix);
+    kf_index_path(mp4_kfi_path, sizeof(mp4_kfi_path), output_filename);
+
+    if (pretrig_sec > 0)
+        printf("Extraits déclenchés   : %s_NNN.tcap + _vicon.csv (%.1f s avant, %.1f s après, %u Mo max)\n"
+               "                        SIGUSR1, \"TRIGGER\" sur UDP %d ou touche t\n",
+               clip_prefix, pretrig_sec, posttrig_sec, pretrig_mb, trigger_port);
+    else {
+        printf("Vidéo (MP4)           : %s (images clés : %s)\n", output_filename, mp4_kfi_path);
+        if (segment_sec || segment_mb)
+            printf("                        segments coupés sur IDR (%u s / %u Mo, 0 = sans limite), fragments de %u ms\n",
+                   segment_sec, segment_mb, fragment_ms);
+        else if (mp4_faststart)
+            printf("                        fichier unique, index écrit à la fin (--faststart)\n");
+        else
+            printf("                        MP4 fragmenté, fragments de %u ms\n", fragment_ms);
+    }
     printf("Vicon par frame vidéo : %s\n", vicon_frame_csv);
-    printf("Vicon 100 Hz          : %s\n", vicon_100hz_csv);
+    printf("Vicon (toutes trames) : %s (CSV : ./vicon_export %s)\n", vicon_log_path, vicon_log_path);
 
     /* Init GStreamer */
     if (!gst_src_init(&argc, &argv, output_filename)) return -1;
 
     /* Init UVC / THETA */
-    uvc_context_t *ctx = NULL;
     uvc_device_t *dev = NULL;
     uvc_device_t **devlist = NULL;
-    uvc_device_handle_t *devh = NULL;
-    uvc_stream_ctrl_t ctrl;
     uvc_error_t res;
 
     res = uvc_init(&ctx, NULL);
     if (res != UVC_SUCCESS) { uvc_perror(res, "uvc_init"); return -1; }
 
     /* Socket UDP Vicon (réception) — bind une seule fois, thread dédié lira tout */
-    struct sockaddr_in vaddr;
-    vicon_sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (vicon_sock < 0) { perror("socket vicon"); goto exit_fail; }
-    memset(&vaddr, 0, sizeof(vaddr));
-    vaddr.sin_family = AF_INET;
-    vaddr.sin_port   = htons(VICON_PORT);
-    vaddr.sin_addr.s_addr = INADDR_ANY;
-    if (bind(vicon_sock, (struct sockaddr *)&vaddr, sizeof(vaddr)) < 0) {
-        perror("bind vicon");
-        goto exit_fail;
-    }
+    vicon_rx = vicon_rx_open(VICON_PORT, 0);
+    if (!vicon_rx) goto exit_fail;
 
     /* (Optionnel) Lister devices */
     if (argc > 1 && strcmp("-l", argv[1]) == 0) {
@@ -353,17 +981,39 @@ int main(int argc, char **argv) {
             uvc_free_device_list(devlist, 1);
         }
         uvc_exit(ctx);
-        close(vicon_sock);
+        vicon_rx_close(vicon_rx);
         return 0;
     }
 
-    /* Ouverture THETA */
-    res = thetauvc_find_device(ctx, &dev, 0);
-    if (res != UVC_SUCCESS) { fprintf(stderr, "THETA not found\n"); goto exit_fail; }
-    res = uvc_open(dev, &devh);
-    if (res != UVC_SUCCESS) { fprintf(stderr, "Can't open THETA\n"); goto exit_fail; }
+    /* Ouverture THETA, ou fichier de capture à la place de la caméra */
+    if (replay_path) {
+        replay = tcap_reader_open(replay_path);
+        if (!replay) goto exit_fail;
+        printf("Rejeu                 : %s (%zu frames)\n", replay_path, tcap_reader_count(replay));
+    } else {
+        res = thetauvc_find_device_by_serial(ctx, &dev, serial);
+        if (res != UVC_SUCCESS || !dev) {
+            fprintf(stderr, "THETA %s not found\n", serial ? serial : "");
+            goto exit_fail;
+        }
+        uvc_device_descriptor_t *desc;
+        if (uvc_get_device_descriptor(dev, &desc) == UVC_SUCCESS) {
+            if (desc->serialNumber) snprintf(dev_serial, sizeof(dev_serial), "%s", desc->serialNumber);
+            uvc_free_device_descriptor(desc);
+        }
+        res = uvc_open(dev, &devh);
+        uvc_unref_device(dev);
+        if (res != UVC_SUCCESS) { fprintf(stderr, "Can't open THETA\n"); goto exit_fail; }
+    }
 
-    /* Démarre le thread Vicon (lit tout à 100 Hz et écrit vicon_100hz_*.csv) */
+    /* Démarre le thread Vicon (lit tout et l'ajoute à vicon_*.vlog) */
+    vicon_log = vicon_log_open(vicon_log_path);
+    if (!vicon_log) goto exit_fail;
+    frame_log = vicon_frame_log_open(vicon_frame_csv, 0, 0);
+    if (!frame_log) goto exit_fail;
+    vicon_track = vicon_track_new(0, 0);
+    if (!vicon_track) goto exit_fail;
+    clock_fit_init(&vicon_clk, 0, 0);
     vicon_run = 1;
     if (pthread_create(&vicon_thr, NULL, vicon_thread_fn, NULL) != 0) {
         perror("pthread_create vicon");
@@ -387,21 +1037,128 @@ int main(int argc, char **argv) {
     /* Lancement pipeline + streaming */
     gst_element_set_state(src.pipeline, GST_STATE_PLAYING);
 
+    src.framecount = 0;
+    if (replay) {
+        tcap_mode_to_ctrl(tcap_reader_mode(replay), &ctrl);
+        res = UVC_SUCCESS;
+    } else {
+        res = thetauvc_get_stream_ctrl_format_size(devh, THETAUVC_MODE_UHD_2997, &ctrl);
+    }
+    {
+        struct tcap_mode m;
+        unsigned int w = 0, h = 0, fps = 0;
+        unsigned int mode = replay ? tcap_reader_mode(replay)->mode : THETAUVC_MODE_UHD_2997;
+        thetauvc_get_mode_size(mode, &w, &h, &fps);
+        tcap_mode_from_ctrl(&m, mode, w, h, fps, &ctrl);
+        if (record_path) {
+            recorder = tcap_writer_open(record_path, &m);
+            if (recorder) printf("Capture brute           : %s\n", record_path);
+        }
+        if (pretrig_sec > 0) {
+            /* Arène et emplacements alloués ici une fois pour toutes */
+            struct pretrig_config pc;
+            memset(&pc, 0, sizeof(pc));
+            pc.pre_ns  = (int64_t)(pretrig_sec * 1e9);
+            pc.post_ns = (int64_t)(posttrig_sec * 1e9);
+            pc.bytes   = (size_t)pretrig_mb * 1024 * 1024;
+            pc.prefix  = clip_prefix;
+            pc.mode    = m;
+            pretrig = pretrig_new(&pc);
+            if (!pretrig) fprintf(stderr, "pré-déclenchement : allocation de %u Mo impossible\n", pretrig_mb);
+            else start_trigger_listener();
+        }
+    }
+    src.dwFrameInterval = ctrl.dwFrameInterval;
+    src.dwClockFrequency = ctrl.dwClockFrequency;
+    src.pool = h264_pool_new(ctrl.dwMaxVideoFrameSize, H264_POOL_DEFAULT_BUFFERS);
+    gop_shed_init(&src.shed, GOP_SHED_GOP);
+    h264_stream_init(&src.h264);
+    dev_pts_init(&src.pts, ctrl.dwFrameInterval, src.t0_ns);
+    if (ingest_window) {
+        struct ingest_mon_config ic;
+        double interval_ns = (double)ctrl.dwFrameInterval * 100.0;
+        if (replay && replay_speed > 0) interval_ns /= replay_speed;
+        ingest_mon_defaults(&ic, (int64_t)interval_ns);
+        ic.window = ingest_window;
+        ingest = ingest_mon_new(&ic);
+        if (ingest) g_timeout_add_seconds(INGEST_REPORT_S, ingest_report, NULL);
+        else fprintf(stderr, "Fenêtre d'ingestion invalide : %u\n", ingest_window);
+    }
+    g_timeout_add_seconds(CLOCK_REPORT_S, clock_report, NULL);
+    if (metrics_addr) setup_metrics();
+
     pthread_t thr_key;
     pthread_create(&thr_key, NULL, keywait, NULL);
 
+    if (stall_frames) {
+        /* Un rejeu ralenti étire l'intervalle entre frames d'autant */
+        struct stream_watch_config wc;
+        double interval_ns = (double)ctrl.dwFrameInterval * 100.0;
+        if (replay && replay_speed > 0) interval_ns /= replay_speed;
+        stream_watch_defaults(&wc, (uint64_t)interval_ns);
+        wc.stall_frames = stall_frames;
+        stream_watch_init(&watch, &wc, mono_ns());
+    }
 
-    src.framecount = 0;
-    res = thetauvc_get_stream_ctrl_format_size(devh, THETAUVC_MODE_UHD_2997, &ctrl);
-    src.dwFrameInterval = ctrl.dwFrameInterval;
-    src.dwClockFrequency = ctrl.dwClockFrequency;
-    res = uvc_start_streaming(devh, &ctrl, cb, &src, 0);
+    if (replay) {
+        player = tcap_player_start(replay, replay_speed, replay_loop, cb, &src);
+        res = player ? UVC_SUCCESS : UVC_ERROR_OTHER;
+        if (player) g_timeout_add(100, replay_watch, NULL);
+        if (player && replay_stall_s > 0)
+            tcap_player_set_fault(player, (uint64_t)(replay_stall_s * 1e9), (uint64_t)(replay_down_s * 1e9));
+    } else {
+        res = uvc_start_streaming(devh, &ctrl, cb, &src, 0);
+    }
+    if (res == UVC_SUCCESS && stall_frames) g_timeout_add(100, watch_tick, NULL);
 
     if (res == UVC_SUCCESS) {
         fprintf(stderr, "start, hit any key to stop\n");
         g_main_loop_run(src.loop);
         fprintf(stderr, "stop\n");
-        uvc_stop_streaming(devh);
+        metrics_shutdown(metrics);      /* plus de lecture du pool ni d'appsrc */
+        if (player)    tcap_player_stop(player);
+        else if (devh) uvc_stop_streaming(devh);
+        if (recorder && tcap_writer_close(recorder) != 0)
+            fprintf(stderr, "capture %s incomplète (erreur d'écriture)\n", record_path);
+        recorder = NULL;
+        if (pretrig) {
+            struct pretrig_stats ts;
+            pretrig_t *p = pretrig;
+            stop_trigger_listener();
+            pretrig = NULL;             /* plus de SIGUSR1 vers l'anneau */
+            pretrig_get_stats(p, &ts);
+            fprintf(stderr, "Pré-déclenchement : %llu déclenchements, %llu frames perdues "
+                            "(anneau plein pendant une écriture), mémoire max %.1f / %u Mo\n",
+                    (unsigned long long)ts.triggers, (unsigned long long)ts.dropped,
+                    (double)ts.max_bytes_used / (1024.0 * 1024.0), pretrig_mb);
+            pretrig_free(p);            /* termine l'extrait en cours */
+        }
+
+        /* Bilan allocations : avant le pool, 1 allocation par frame */
+        {
+            struct h264_pool_stats ps;
+            gdouble secs = g_timer_elapsed(src.timer, NULL);
+            h264_pool_get_stats(src.pool, &ps);
+            fprintf(stderr, "Frames: %llu  allocations: %llu (%.2f/s)  pool hits: %llu\n",
+                    (unsigned long long)ps.frames, (unsigned long long)ps.allocs,
+                    secs > 0 ? (double)ps.allocs / secs : 0.0,
+                    (unsigned long long)ps.pool_hits);
+
+            struct gop_shed_stats ss;
+            gop_shed_get_stats(&src.shed, &ss);
+            fprintf(stderr, "Délestage : %llu frames en %llu séquences, rattrapage max %.1f ms\n",
+                    (unsigned long long)ss.shed, (unsigned long long)ss.episodes,
+                    (double)ss.max_recovery_ns / 1e6);
+            fprintf(stderr, "H.264 : %llu AU, %llu IDR, GOP %u (max %u), SPS/PPS changés %u fois\n",
+                    (unsigned long long)src.h264.aus, (unsigned long long)src.h264.idrs,
+                    src.h264.gop_frames, src.h264.max_gop_frames, src.h264.ps_changes);
+            if (watch.st.stalls)
+                fprintf(stderr, "Décrochages : %llu, rétablis %llu (%llu tentatives), "
+                                "dernière reprise %.0f ms, max %.0f ms\n",
+                        (unsigned long long)watch.st.stalls, (unsigned long long)watch.st.recoveries,
+                        (unsigned long long)watch.st.attempts, (double)watch.st.last_recovery_ns / 1e6,
+                        (double)watch.st.max_recovery_ns / 1e6);
+        }
 
         /* EOS pour finaliser MP4 */
         GstFlowReturn eos_ret;
@@ -419,29 +1176,90 @@ int main(int argc, char **argv) {
         gst_object_unref(bus);
 
         gst_element_set_state(src.pipeline, GST_STATE_NULL);
+        if (mp4_kfi && kf_index_close(mp4_kfi) != 0)
+            fprintf(stderr, "index %s incomplet (erreur d'écriture)\n", mp4_kfi_path);
+        mp4_kfi = NULL;
+        if (mp4_mux) gst_object_unref(mp4_mux);
+        mp4_mux = NULL;
+        h264_pool_free(src.pool);
+        src.pool = NULL;
         if (src.bus_watch_id) g_source_remove(src.bus_watch_id);
         if (src.loop) g_main_loop_unref(src.loop);
         pthread_cancel(thr_key);
         pthread_join(thr_key, NULL);
     } else {
         uvc_perror(res, "uvc_start_streaming");
+        metrics_shutdown(metrics);
+        if (recorder) tcap_writer_close(recorder);
+        recorder = NULL;
+        stop_trigger_listener();
+        pretrig_t *p = pretrig;
+        pretrig = NULL;
+        pretrig_free(p);
     }
 
     /* Arrêt propre du thread Vicon */
     vicon_run = 0;
-    shutdown(vicon_sock, SHUT_RD); /* pour débloquer recvfrom si besoin */
+    vicon_rx_shutdown(vicon_rx); /* pour débloquer recvmmsg si besoin */
     pthread_join(vicon_thr, NULL);
+    {
+        struct vicon_rx_stats vs;
+        vicon_rx_get_stats(vicon_rx, &vs);
+        fprintf(stderr, "Vicon : %llu trames en %llu lots (max %u), perdues par le noyau : %llu, "
+                        "tronquées : %llu, tampon socket %d octets\n",
+                (unsigned long long)vs.packets, (unsigned long long)vs.batches, vs.max_batch,
+                (unsigned long long)vs.kernel_drops, (unsigned long long)vs.truncated, vs.rcvbuf);
+    }
+    if (vicon_log_close(vicon_log) != 0)
+        fprintf(stderr, "log Vicon %s incomplet (erreur d'écriture)\n", vicon_log_path);
+    {
+        struct vicon_frame_log_stats fs;
+        vicon_frame_log_get_stats(frame_log, &fs);
+        fprintf(stderr, "Vicon par frame : %llu lignes, perdues (file pleine) : %llu, "
+                        "file max %u, %llu synchros disque (max %.1f ms)\n",
+                (unsigned long long)fs.written, (unsigned long long)fs.dropped, fs.max_backlog,
+                (unsigned long long)fs.syncs, (double)fs.max_sync_ns / 1e6);
+        fprintf(stderr, "Appariement : %llu interpolées, %llu après la dernière trame, "
+                        "%llu trous, %llu trop anciennes, %llu sans Vicon\n",
+                (unsigned long long)frame_match[VICON_TRACK_INTERP],
+                (unsigned long long)frame_match[VICON_TRACK_HOLD],
+                (unsigned long long)frame_match[VICON_TRACK_GAP],
+                (unsigned long long)frame_match[VICON_TRACK_OLD],
+                (unsigned long long)frame_match[VICON_TRACK_EMPTY]);
+        if (ingest) {
+            ingest_report(NULL);
+            fprintf(stderr, "Ingestion : %llu frames, %llu perdues sur l'USB, alertes :",
+                    (unsigned long long)ingest_sum.total_frames, (unsigned long long)ingest_sum.total_gaps);
+            for (int a = 0; a < INGEST_ALERT_NUM; ++a)
+                fprintf(stderr, " %s %llu", ingest_alert_name((enum ingest_alert)a),
+                        (unsigned long long)ingest_sum.total_raised[a]);
+            fprintf(stderr, "\n");
+        }
+        clock_report(NULL);
+        dev_pts_dump(&src.pts, 0, stderr);   /* gigue : arrivée USB vs PTS horloge caméra */
+    }
+    if (vicon_frame_log_close(frame_log) != 0)
+        fprintf(stderr, "CSV par frame %s incomplet (erreur d'écriture)\n", vicon_frame_csv);
 
     /* Nettoyage UVC/GStreamer */
-    uvc_close(devh);
+    if (devh) uvc_close(devh);
     uvc_exit(ctx);
-    close(vicon_sock);
+    tcap_reader_close(replay);
+    vicon_rx_close(vicon_rx);
+    vicon_track_free(vicon_track);
+    metrics_free(metrics);
+    ingest_mon_free(ingest);
 
     return 0;
 
 exit_fail:
     vicon_run = 0;
-    if (vicon_sock >= 0) close(vicon_sock);
+    kf_index_close(mp4_kfi);
+    tcap_reader_close(replay);
+    vicon_frame_log_close(frame_log);
+    vicon_log_close(vicon_log);
+    vicon_rx_close(vicon_rx);
+    vicon_track_free(vicon_track);
     if (devh) uvc_close(devh);
     if (ctx)  uvc_exit(ctx);
     return -1;
@@ -0,0 +1,451 @@
+// h264_fanout.c
+// See h264_fanout.h.
+//
+// AU i lives in slot i & mask; its bytes at off % cap in the arena, stored
+// whole (skipping to the arena start when they would wrap). head and the
+// arena offsets are free-running. The producer never waits for anyone:
+// before overwriting arena bytes it advances `claimed`, and a reader checks
+// `claimed` after copying (the seqlock pattern of shm_ring), so bytes at
+// free-running offset p are intact as long as claimed <= p + cap. Slot
+// descriptors are validated the same way through their index field.
+//
+// Everything else belongs to the sender thread: the subscribers, their
+// positions, the parameter sets scanned from the stream, and the
+// remainder of any message a subscriber's socket did not take at once,
+// which is copied out so the arena can move on under it.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "h264_fanout.h"
+
+#define SENDER_POLL_MS  100
+#define AU_SLOTS        8192u     // descriptors; the arena is the real limit
+#define AU_HAS_PS       0x100u    // internal flag: SPS or PPS in the AU
+#define SUB_SNDBUF      (4 << 20)
+
+#define LOAD(p)     atomic_load_explicit(&(p), memory_order_relaxed)
+#define STORE(p, v) atomic_store_explicit(&(p), (v), memory_order_relaxed)
+#define ADD(p, n)   atomic_fetch_add_explicit(&(p), (n), memory_order_relaxed)
+
+struct fo_au {
+  _Atomic uint64_t index;        // == i while slot i is valid
+  uint64_t         off;          // free-running arena offset
+  uint32_t         size;
+  uint32_t         flags;        // H264_FANOUT_IDR | AU_HAS_PS
+  uint64_t         sequence;
+  int64_t          pts_ns;
+  int64_t          capture_ns;
+};
+
+struct fo_sub {
+  int      fd;
+  uint64_t next;                 // next AU to send
+  uint64_t catchup_end;          // AUs below this were cached when it joined
+  int      wait_idr;             // joined (or skipped) with no usable IDR yet
+  int      blocked;              // socket full: wait for POLLOUT
+  uint8_t *buf;                  // message the socket only took part of
+  size_t   buf_cap, off, pending;
+};
+
+struct h264_fanout {
+  struct h264_fanout_config cfg;
+  uint8_t          *arena;
+  uint64_t          cap;
+  struct fo_au     *au;
+  uint64_t          mask;
+  _Atomic uint64_t  head;        // AUs published
+  _Atomic uint64_t  claimed;     // arena bytes the producer may have overwritten, free-running
+  _Atomic uint64_t  last_idr;    // newest IDR index + 1, 0 = none yet
+  _Atomic int64_t   last_pts_ns;
+
+  // Producer only.
+  uint64_t          head_b;
+
+  int               lfd, efd;
+  char              path[108];
+  pthread_t         thr;
+  atomic_int        stop;
+
+  // Sender only.
+  struct fo_sub     subs[H264_FANOUT_MAX_SUBSCRIBERS];
+  int               nsubs;
+  uint64_t          scanned;     // AUs whose parameter sets have been taken
+  struct h264_ps    ps;
+
+  _Atomic uint64_t  published, too_big, joined, rejected, sent, bytes_sent, skipped;
+  atomic_int        subscribers;
+};
+
+void h264_fanout_defaults(struct h264_fanout_config *cfg) {
+  cfg->arena_bytes = (size_t)H264_FANOUT_DEFAULT_MB << 20;
+  cfg->max_lag_ns  = H264_FANOUT_DEFAULT_LAG_NS;
+}
+
+/* ---------- Producer ---------- */
+
+void h264_fanout_publish(h264_fanout_t *f, const uint8_t *data, size_t len,
+                         const struct h264_au_info *au, uint64_t sequence,
+                         int64_t pts_ns, int64_t capture_ns) {
+  if (!f || len == 0) return;
+  if (len > f->cap) {
+    ADD(f->too_big, 1);
+    return;
+  }
+  uint64_t head = LOAD(f->head);
+  uint64_t off = f->head_b;
+  if (off % f->cap + len > f->cap) off += f->cap - off % f->cap;
+
+  // Announce the overwrite, and invalidate the descriptor, before touching
+  // either; readers check both after copying.
+  struct fo_au *a = &f->au[head & f->mask];
+  STORE(f->claimed, off + len);
+  STORE(a->index, UINT64_MAX);
+  atomic_thread_fence(memory_order_release);
+
+  memcpy(f->arena + off % f->cap, data, len);
+  a->off        = off;
+  a->size       = (uint32_t)len;
+  a->flags      = (au->has_idr ? H264_FANOUT_IDR : 0) | (au->has_sps || au->has_pps ? AU_HAS_PS : 0);
+  a->sequence   = sequence;
+  a->pts_ns     = pts_ns;
+  a->capture_ns = capture_ns;
+  atomic_store_explicit(&a->index, head, memory_order_release);
+  f->head_b = off + len;
+
+  STORE(f->last_pts_ns, pts_ns);
+  atomic_store_explicit(&f->head, head + 1, memory_order_release);
+  if (au->has_idr) atomic_store_explicit(&f->last_idr, head + 1, memory_order_release);
+  ADD(f->published, 1);
+
+  // Never blocks: the counter cannot overflow at camera rates.
+  uint64_t one = 1;
+  if (write(f->efd, &one, sizeof(one)) < 0) { /* already signalled */ }
+}
+
+/* ---------- Sender ---------- */
+
+static int bytes_intact(h264_fanout_t *f, uint64_t off) {
+  atomic_thread_fence(memory_order_acquire);
+  return LOAD(f->claimed) <= off + f->cap;
+}
+
+// Copies descriptor i; 0 when it has been overwritten or its bytes have.
+static int au_read(h264_fanout_t *f, uint64_t i, struct fo_au *out) {
+  struct fo_au *a = &f->au[i & f->mask];
+  if (atomic_load_explicit(&a->index, memory_order_acquire) != i) return 0;
+  out->off        = a->off;
+  out->size       = a->size;
+  out->flags      = a->flags;
+  out->sequence   = a->sequence;
+  out->pts_ns     = a->pts_ns;
+  out->capture_ns = a->capture_ns;
+  atomic_thread_fence(memory_order_acquire);
+  if (LOAD(a->index) != i) return 0;
+  return bytes_intact(f, out->off);
+}
+
+// Parameter sets as of the newest AU, for subscribers that join later.
+static void scan_ps(h264_fanout_t *f, uint64_t head) {
+  struct fo_au a;
+  for (; f->scanned < head; ++f->scanned) {
+    if (!au_read(f, f->scanned, &a) || !(a.flags & AU_HAS_PS)) continue;
+    struct h264_ps ps = f->ps;
+    h264_ps_update(&ps, f->arena + a.off % f->cap, a.size);
+    if (bytes_intact(f, a.off)) f->ps = ps;
+  }
+}
+
+static void sub_close(h264_fanout_t *f, int k) {
+  close(f->subs[k].fd);
+  free(f->subs[k].buf);
+  f->subs[k] = f->subs[--f->nsubs];
+  atomic_fetch_sub_explicit(&f->subscribers, 1, memory_order_relaxed);
+}
+
+static int sub_reserve(struct fo_sub *s, size_t n) {
+  if (n <= s->buf_cap) return 0;
+  uint8_t *b = realloc(s->buf, n);
+  if (!b) return -1;
+  s->buf = b;
+  s->buf_cap = n;
+  return 0;
+}
+
+// Late joiner: SPS/PPS, then the GOP so far from its IDR.
+static void sub_join(h264_fanout_t *f, int fd) {
+  if (f->nsubs == H264_FANOUT_MAX_SUBSCRIBERS) {
+    close(fd);
+    ADD(f->rejected, 1);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  int sndbuf = SUB_SNDBUF;
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+  struct fo_sub *s = &f->subs[f->nsubs++];
+  memset(s, 0, sizeof(*s));
+  s->fd = fd;
+  uint64_t head = atomic_load_explicit(&f->head, memory_order_acquire);
+  uint64_t idr  = atomic_load_explicit(&f->last_idr, memory_order_acquire);
+  struct fo_au a;
+  if (idr && au_read(f, idr - 1, &a)) {
+    s->next = idr - 1;
+    s->catchup_end = head;
+  } else {
+    s->next = head;
+    s->wait_idr = 1;
+  }
+
+  uint8_t ps[H264_PS_MAX_BYTES];
+  size_t n = h264_ps_annexb(&f->ps, ps, sizeof(ps));
+  if (n && sub_reserve(s, sizeof(struct h264_fanout_msg) + n) == 0) {
+    struct h264_fanout_msg m = {
+      .magic = H264_FANOUT_MAGIC,
+      .flags = H264_FANOUT_CONFIG,
+      .bytes = (uint32_t)n,
+      .index = s->next,
+    };
+    memcpy(s->buf, &m, sizeof(m));
+    memcpy(s->buf + sizeof(m), ps, n);
+    s->pending = sizeof(m) + n;
+  }
+  ADD(f->joined, 1);
+  atomic_fetch_add_explicit(&f->subscribers, 1, memory_order_relaxed);
+}
+
+// Falling behind: to the newest IDR if it is still there and ahead, else
+// to the live end, waiting for the next one.
+static void sub_skip(h264_fanout_t *f, struct fo_sub *s, uint64_t head) {
+  uint64_t idr = atomic_load_explicit(&f->last_idr, memory_order_acquire);
+  struct fo_au a;
+  uint64_t to;
+  if (idr && idr - 1 > s->next && au_read(f, idr - 1, &a)) {
+    to = idr - 1;
+    s->wait_idr = 0;
+  } else {
+    to = head;
+    s->wait_idr = 1;
+  }
+  ADD(f->skipped, to - s->next);
+  s->next = to;
+}
+
+// Writes until the socket is full or the subscriber is live. -1 drops it.
+static int sub_flush(h264_fanout_t *f, struct fo_sub *s) {
+  for (;;) {
+    if (s->pending) {
+      ssize_t n = send(s->fd, s->buf + s->off, s->pending, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        s->blocked = 1;
+        return 0;
+      }
+      ADD(f->bytes_sent, (uint64_t)n);
+      s->off += (size_t)n;
+      s->pending -= (size_t)n;
+      if (s->pending) {
+        s->blocked = 1;
+        return 0;
+      }
+      s->off = 0;
+      continue;
+    }
+
+    uint64_t head = atomic_load_explicit(&f->head, memory_order_acquire);
+    s->blocked = 0;
+    if (s->next >= head) return 0;
+    struct fo_au a;
+    if (!au_read(f, s->next, &a) || LOAD(f->last_pts_ns) - a.pts_ns > f->cfg.max_lag_ns) {
+      sub_skip(f, s, head);
+      continue;
+    }
+    if (s->wait_idr && !(a.flags & H264_FANOUT_IDR)) {
+      ADD(f->skipped, 1);
+      s->next++;
+      continue;
+    }
+    s->wait_idr = 0;
+
+    struct h264_fanout_msg m = {
+      .magic      = H264_FANOUT_MAGIC,
+      .flags      = (a.flags & H264_FANOUT_IDR) | (s->next < s->catchup_end ? H264_FANOUT_CATCHUP : 0),
+      .bytes      = a.size,
+      .index      = s->next,
+      .sequence   = a.sequence,
+      .pts_ns     = a.pts_ns,
+      .capture_ns = a.capture_ns,
+    };
+    const uint8_t *data = f->arena + a.off % f->cap;
+    struct iovec iov[2] = { { &m, sizeof(m) }, { (void *)data, a.size } };
+    struct msghdr mh = { .msg_iov = iov, .msg_iovlen = 2 };
+    ssize_t n = sendmsg(s->fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+      s->blocked = 1;
+      return 0;
+    }
+    size_t total = sizeof(m) + a.size;
+    if ((size_t)n < total) {
+      // Keep the rest: the arena may be overwritten before the socket drains.
+      if (sub_reserve(s, total - (size_t)n) != 0) return -1;
+      size_t done = (size_t)n, k = 0;
+      if (done < sizeof(m)) {
+        k = sizeof(m) - done;
+        memcpy(s->buf, (const uint8_t *)&m + done, k);
+        done = sizeof(m);
+      }
+      memcpy(s->buf + k, data + (done - sizeof(m)), total - done);
+      s->off = 0;
+      s->pending = total - (size_t)n;
+    }
+    // Overwritten while being sent: what went out is garbage, and the
+    // stream cannot be resynchronised mid-message.
+    if (!bytes_intact(f, a.off)) return -1;
+    ADD(f->bytes_sent, (uint64_t)n);
+    ADD(f->sent, 1);
+    s->next++;
+  }
+}
+
+// Subscribers never write: readable means closed (or junk, discarded).
+static int sub_alive(struct fo_sub *s) {
+  char junk[256];
+  for (;;) {
+    ssize_t n = recv(s->fd, junk, sizeof(junk), MSG_DONTWAIT);
+    if (n > 0) continue;
+    if (n == 0) return 0;
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+}
+
+static void *sender_thread(void *arg) {
+  h264_fanout_t *f = arg;
+  struct pollfd pfd[2 + H264_FANOUT_MAX_SUBSCRIBERS];
+  while (!atomic_load(&f->stop)) {
+    pfd[0] = (struct pollfd){ f->lfd, POLLIN, 0 };
+    pfd[1] = (struct pollfd){ f->efd, POLLIN, 0 };
+    int nsubs = f->nsubs;
+    for (int k = 0; k < nsubs; ++k)
+      pfd[2 + k] = (struct pollfd){ f->subs[k].fd, (short)(POLLIN | (f->subs[k].blocked ? POLLOUT : 0)), 0 };
+    if (poll(pfd, (nfds_t)(2 + nsubs), SENDER_POLL_MS) < 0 && errno != EINTR) break;
+
+    if (pfd[1].revents & POLLIN) {
+      uint64_t v;
+      if (read(f->efd, &v, sizeof(v)) < 0) { /* raced with another wakeup */ }
+    }
+    scan_ps(f, atomic_load_explicit(&f->head, memory_order_acquire));
+
+    // Polled subscribers first, by index from the end so closing one does
+    // not disturb the rest; then the newly accepted ones get their catch-up.
+    for (int k = nsubs - 1; k >= 0; --k) {
+      short re = pfd[2 + k].revents;
+      if (((re & (POLLIN | POLLHUP | POLLERR)) && !sub_alive(&f->subs[k])) ||
+          sub_flush(f, &f->subs[k]) != 0)
+        sub_close(f, k);
+    }
+    if (pfd[0].revents & POLLIN) {
+      for (int fd; (fd = accept4(f->lfd, NULL, NULL, SOCK_CLOEXEC)) >= 0; ) {
+        sub_join(f, fd);
+        if (f->nsubs && f->subs[f->nsubs - 1].fd == fd && sub_flush(f, &f->subs[f->nsubs - 1]) != 0)
+          sub_close(f, f->nsubs - 1);
+      }
+    }
+  }
+  return NULL;
+}
+
+/* ---------- Setup ---------- */
+
+static int open_unix(h264_fanout_t *f, const char *path) {
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sa.sun_path)) return -1;
+  strcpy(sa.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  unlink(path);   // left over from a previous run
+  if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 16) != 0) {
+    close(fd);
+    return -1;
+  }
+  strcpy(f->path, path);
+  return fd;
+}
+
+h264_fanout_t *h264_fanout_new(const char *path, const struct h264_fanout_config *cfg) {
+  h264_fanout_t *f = calloc(1, sizeof(*f));
+  if (!f) return NULL;
+  h264_fanout_defaults(&f->cfg);
+  if (cfg) f->cfg = *cfg;
+  f->cap   = f->cfg.arena_bytes;
+  f->mask  = AU_SLOTS - 1;
+  f->arena = malloc(f->cap);
+  f->au    = calloc(AU_SLOTS, sizeof(*f->au));
+  f->lfd = f->efd = -1;
+  if (!f->arena || !f->au || f->cap == 0) goto fail;
+  for (uint64_t i = 0; i < AU_SLOTS; ++i) STORE(f->au[i].index, UINT64_MAX);
+
+  f->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  f->lfd = open_unix(f, path);
+  if (f->efd < 0 || f->lfd < 0) {
+    fprintf(stderr, "h264 fan-out: cannot listen on %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+  if (pthread_create(&f->thr, NULL, sender_thread, f) != 0) goto fail;
+  return f;
+
+fail:
+  if (f->lfd >= 0) {
+    close(f->lfd);
+    unlink(f->path);
+  }
+  if (f->efd >= 0) close(f->efd);
+  free(f->arena);
+  free(f->au);
+  free(f);
+  return NULL;
+}
+
+void h264_fanout_free(h264_fanout_t *f) {
+  if (!f) return;
+  atomic_store(&f->stop, 1);
+  uint64_t one = 1;
+  if (write(f->efd, &one, sizeof(one)) < 0) { /* the poll timeout catches it */ }
+  pthread_join(f->thr, NULL);
+  while (f->nsubs) sub_close(f, f->nsubs - 1);
+  close(f->lfd);
+  unlink(f->path);
+  close(f->efd);
+  free(f->arena);
+  free(f->au);
+  free(f);
+}
+
+void h264_fanout_get_stats(h264_fanout_t *f, struct h264_fanout_stats *out) {
+  memset(out, 0, sizeof(*out));
+  if (!f) return;
+  out->published   = LOAD(f->published);
+  out->too_big     = LOAD(f->too_big);
+  out->subscribers = (uint64_t)LOAD(f->subscribers);
+  out->joined      = LOAD(f->joined);
+  out->rejected    = LOAD(f->rejected);
+  out->sent        = LOAD(f->sent);
+  out->bytes_sent  = LOAD(f->bytes_sent);
+  out->skipped     = LOAD(f->skipped);
+}
@@ -0,0 +1,89 @@
+// h264_fanout.h
+// Encoded H.264 fan-out: every access unit from the camera, as received,
+// to any number of local subscribers over a Unix stream socket. For
+// consumers that decode on their own or only archive, so they skip the
+// decoded BGR output entirely.
+//
+// The capture thread copies each AU into a fixed byte arena and bumps an
+// index: no allocation, no lock, and one non-blocking eventfd write to
+// wake the sender. A sender thread serves all subscribers from the arena
+// with non-blocking writes, each at its own position, so a slow subscriber
+// only falls behind itself. One that falls out of the arena, or more than
+// max_lag_ns behind, is moved forward to the newest IDR (the skipped AUs
+// are counted and visible to it as a jump in `index`).
+//
+// A subscriber that connects mid-stream first gets the current SPS/PPS,
+// then the current GOP from its IDR (flagged CATCHUP, sent as fast as it
+// reads), then the live stream: it can decode from its first message.
+//
+// Wire format, per message: struct h264_fanout_msg, then `bytes` of
+// Annex-B. Subscribers never write; closing the socket unsubscribes.
+
+#if !defined(__H264_FANOUT_H__)
+#define __H264_FANOUT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "h264_nal.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define H264_FANOUT_MAGIC            0x34363248u   // "H264"
+#define H264_FANOUT_DEFAULT_PATH     "/tmp/theta_h264"   // + ".sock"
+#define H264_FANOUT_DEFAULT_MB       64
+#define H264_FANOUT_DEFAULT_LAG_NS   2000000000ll
+#define H264_FANOUT_MAX_SUBSCRIBERS  32
+
+#define H264_FANOUT_IDR      0x1u    // the AU starts a GOP
+#define H264_FANOUT_CONFIG   0x2u    // SPS + PPS only, sent to a new subscriber first
+#define H264_FANOUT_CATCHUP  0x4u    // part of the GOP cached at connect time
+
+struct h264_fanout_msg {
+  uint32_t magic;
+  uint32_t flags;              // H264_FANOUT_*
+  uint32_t bytes;              // Annex-B payload that follows
+  uint32_t reserved;
+  uint64_t index;              // AU publish counter; a gap = AUs this subscriber missed
+  uint64_t sequence;           // UVC frame sequence
+  int64_t  pts_ns;             // camera frame clock, CLOCK_MONOTONIC based
+  int64_t  capture_ns;         // UVC capture time
+};
+
+struct h264_fanout_config {
+  size_t   arena_bytes;        // AUs kept; must hold a GOP for late joiners
+  int64_t  max_lag_ns;         // a subscriber further behind skips to the newest IDR
+};
+
+struct h264_fanout_stats {
+  uint64_t published;          // AUs published
+  uint64_t too_big;            // AUs larger than the arena, not published
+  uint64_t subscribers;        // connected now
+  uint64_t joined;             // total connections accepted
+  uint64_t rejected;           // refused: H264_FANOUT_MAX_SUBSCRIBERS reached
+  uint64_t sent;               // AUs written, all subscribers
+  uint64_t bytes_sent;
+  uint64_t skipped;            // AUs subscribers lost by falling behind
+};
+
+typedef struct h264_fanout h264_fanout_t;
+
+extern void           h264_fanout_defaults(struct h264_fanout_config *cfg);
+
+// Listens on path (any stale socket is replaced) and starts the sender.
+extern h264_fanout_t *h264_fanout_new(const char *path, const struct h264_fanout_config *cfg);
+extern void           h264_fanout_free(h264_fanout_t *f);
+
+// Capture thread (single producer). au from h264_stream_update().
+extern void           h264_fanout_publish(h264_fanout_t *f, const uint8_t *data, size_t len,
+                                          const struct h264_au_info *au, uint64_t sequence,
+                                          int64_t pts_ns, int64_t capture_ns);
+
+extern void           h264_fanout_get_stats(h264_fanout_t *f, struct h264_fanout_stats *out);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
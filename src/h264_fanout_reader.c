@@ -0,0 +1,191 @@
+// h264_fanout_reader.c
+// Minimal subscriber of min_latency_from_uvc --h264-out. Reads the access
+// units, optionally writes them out as a playable Annex-B stream, and
+// reports the rate, AUs it missed by falling behind, and on each connect
+// how long the catch-up took to reach the live stream.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "h264_fanout.h"
+
+static volatile sig_atomic_t g_stop = 0;
+static int64_t g_deadline_ns = 0;   // --seconds, 0 = none
+
+static void on_sigint(int sig) {
+  (void)sig;
+  g_stop = 1;
+}
+
+static int64_t now_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_us(long us) {
+  struct timespec ts = { .tv_sec = us / 1000000L, .tv_nsec = (us % 1000000L) * 1000L };
+  nanosleep(&ts, NULL);
+}
+
+static int connect_unix(const char *path) {
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sa.sun_path)) return -1;
+  strcpy(sa.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int past_deadline(void) {
+  return g_deadline_ns && now_monotonic_ns() > g_deadline_ns;
+}
+
+// 1 = n bytes read, 0 = closed, Ctrl+C or --seconds over.
+static int read_full(int fd, void *buf, size_t n) {
+  uint8_t *p = buf;
+  while (n) {
+    ssize_t r = read(fd, p, n);
+    if (r < 0 && (errno == EINTR || errno == EAGAIN) && !g_stop && !past_deadline()) continue;
+    if (r <= 0) return 0;
+    p += r;
+    n -= (size_t)r;
+  }
+  return 1;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [--path SOCKET] [--seconds N] [--out FILE|-]\n"
+    "  --path SOCKET: fan-out socket (default: %s.sock)\n"
+    "  --seconds N  : stop after N seconds (default: run until Ctrl+C)\n"
+    "  --out FILE   : write the received stream as Annex-B, - for stdout (reports go to stderr)\n",
+    prog, H264_FANOUT_DEFAULT_PATH);
+}
+
+int main(int argc, char **argv) {
+  const char *path = H264_FANOUT_DEFAULT_PATH ".sock";
+  const char *out_path = NULL;
+  int seconds = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if      (!strcmp(argv[i], "--path")    && i+1 < argc) path = argv[++i];
+    else if (!strcmp(argv[i], "--seconds") && i+1 < argc) seconds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--out")     && i+1 < argc) out_path = argv[++i];
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else {
+      fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *out = NULL;
+  if (out_path) {
+    out = strcmp(out_path, "-") ? fopen(out_path, "wb") : stdout;
+    if (!out) { perror(out_path); return 1; }
+  }
+  FILE *log = out == stdout ? stderr : stdout;
+
+  // No SA_RESTART: Ctrl+C must interrupt a blocking read.
+  struct sigaction sa = { .sa_handler = on_sigint };
+  sigaction(SIGINT, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  uint8_t *buf = NULL;
+  size_t buf_size = 0;
+  if (seconds > 0) g_deadline_ns = now_monotonic_ns() + (int64_t)seconds * 1000000000LL;
+
+  while (!g_stop && !past_deadline()) {
+    int fd = connect_unix(path);
+    if (fd < 0) { sleep_us(100000); continue; }
+    if (g_deadline_ns) {
+      // Wake up now and then to notice the deadline.
+      struct timeval tv = { .tv_sec = 1 };
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    int64_t t_conn = now_monotonic_ns(), t_report = t_conn;
+    int64_t first_idr_ns = -1, live_ns = -1;
+    uint64_t next_index = 0, frames = 0, bytes = 0, missed = 0, catchup = 0, age_n = 0;
+    int64_t age_ns = 0;
+    int have_index = 0;
+    fprintf(log, "Connected to %s\n", path);
+
+    for (;;) {
+      struct h264_fanout_msg m;
+      if (!read_full(fd, &m, sizeof(m))) break;
+      if (m.magic != H264_FANOUT_MAGIC) {
+        fprintf(stderr, "Bad message magic 0x%08x, reconnecting\n", m.magic);
+        break;
+      }
+      if (m.bytes > buf_size) {
+        free(buf);
+        buf_size = m.bytes;
+        buf = malloc(buf_size);
+        if (!buf) { fprintf(stderr, "out of memory\n"); return 1; }
+      }
+      if (!read_full(fd, buf, m.bytes)) break;
+      int64_t now = now_monotonic_ns();
+      if (out && fwrite(buf, 1, m.bytes, out) != m.bytes) {
+        perror(out_path);
+        g_stop = 1;
+        break;
+      }
+      if (m.flags & H264_FANOUT_CONFIG) continue;
+
+      if (have_index && m.index > next_index) missed += m.index - next_index;
+      next_index = m.index + 1;
+      have_index = 1;
+      frames++;
+      bytes += m.bytes;
+      if ((m.flags & H264_FANOUT_IDR) && first_idr_ns < 0) first_idr_ns = now - t_conn;
+      if (m.flags & H264_FANOUT_CATCHUP) {
+        catchup++;
+      } else {
+        if (live_ns < 0) {
+          live_ns = now - t_conn;
+          fprintf(log, "First IDR after %.1f ms, live after %.1f ms (%llu catch-up AUs)\n",
+                  (double)first_idr_ns / 1e6, (double)live_ns / 1e6, (unsigned long long)catchup);
+        }
+        age_ns += now - m.pts_ns;
+        age_n++;
+      }
+
+      if (now - t_report >= 1000000000LL) {
+        double dt = (double)(now - t_report) / 1e9;
+        fprintf(log, "%.1f AU/s  %.2f Mbit/s  frame->received %.2f ms  missed %llu\n",
+                (double)frames / dt, (double)bytes * 8.0 / dt / 1e6,
+                age_n ? (double)age_ns / (double)age_n / 1e6 : 0.0,
+                (unsigned long long)missed);
+        frames = bytes = missed = age_n = 0;
+        age_ns = 0;
+        t_report = now;
+      }
+      if (past_deadline()) break;
+    }
+    close(fd);
+    if (!g_stop && !past_deadline()) {
+      fprintf(log, "Disconnected, retrying\n");
+      sleep_us(100000);
+    }
+  }
+
+  if (out && out != stdout && fclose(out) != 0) perror(out_path);
+  free(buf);
+  return 0;
+}
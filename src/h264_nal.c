@@ -0,0 +1,137 @@
+// h264_nal.c
+// See h264_nal.h.
+
+#include <string.h>
+
+#include "h264_nal.h"
+
+// Returns the offset of the first byte after a 00 00 01 start code at or
+// after from, or len when there is none.
+static size_t find_start(const uint8_t *buf, size_t len, size_t from) {
+  size_t i = from;
+  while (i + 3 <= len) {
+    const uint8_t *p = memchr(buf + i, 0x01, len - i);
+    if (!p) return len;
+    size_t k = (size_t)(p - buf);
+    if (k >= 2 && buf[k - 1] == 0 && buf[k - 2] == 0 && k >= from + 2) return k + 1;
+    i = k + 1;
+  }
+  return len;
+}
+
+int h264_next_nal(const uint8_t *buf, size_t len, size_t *pos,
+                  const uint8_t **nal, size_t *nal_len) {
+  size_t start = find_start(buf, len, *pos);
+  if (start >= len) return 0;
+
+  size_t next = find_start(buf, len, start);
+  size_t end = len;
+  if (next < len) {
+    // Back off the start code, including the leading zero of a 4-byte one.
+    end = next - 3;
+    if (end > start && buf[end - 1] == 0) end--;
+  }
+
+  *nal = buf + start;
+  *nal_len = end - start;
+  *pos = next < len ? next - 3 : len;
+  return 1;
+}
+
+void h264_au_classify(const uint8_t *buf, size_t len, struct h264_au_info *out) {
+  memset(out, 0, sizeof(*out));
+  size_t pos = 0;
+  const uint8_t *nal;
+  size_t nal_len;
+
+  while (h264_next_nal(buf, len, &pos, &nal, &nal_len)) {
+    if (nal_len == 0) continue;
+    unsigned type = nal[0] & 0x1f;
+    unsigned ref_idc = (nal[0] >> 5) & 0x3;
+    out->nal_mask |= 1u << type;
+    out->nal_count++;
+
+    switch (type) {
+      case H264_NAL_SPS: out->has_sps = 1; break;
+      case H264_NAL_PPS: out->has_pps = 1; break;
+      case H264_NAL_IDR:
+      case H264_NAL_SLICE:
+        out->has_slice = 1;
+        out->has_idr = (type == H264_NAL_IDR);
+        out->is_reference = ref_idc != 0;
+        return;
+      default: break;
+    }
+  }
+}
+
+/* ---------- Parameter sets ---------- */
+
+int h264_ps_update(struct h264_ps *ps, const uint8_t *buf, size_t len) {
+  size_t pos = 0, nal_len;
+  const uint8_t *nal;
+  int changed = 0;
+
+  while (h264_next_nal(buf, len, &pos, &nal, &nal_len)) {
+    if (nal_len == 0) continue;
+    unsigned type = nal[0] & 0x1f;
+    uint8_t *dst;
+    uint32_t *dst_len;
+    size_t cap;
+    if (type == H264_NAL_SPS) {
+      dst = ps->sps; dst_len = &ps->sps_len; cap = sizeof(ps->sps);
+    } else if (type == H264_NAL_PPS) {
+      dst = ps->pps; dst_len = &ps->pps_len; cap = sizeof(ps->pps);
+    } else if (type == H264_NAL_IDR || type == H264_NAL_SLICE) {
+      break;
+    } else {
+      continue;
+    }
+    if (nal_len > cap) continue;
+    if (*dst_len == nal_len && memcmp(dst, nal, nal_len) == 0) continue;
+    memcpy(dst, nal, nal_len);
+    *dst_len = (uint32_t)nal_len;
+    changed = 1;
+  }
+  if (changed) ps->gen++;
+  return changed;
+}
+
+size_t h264_ps_annexb(const struct h264_ps *ps, uint8_t *out, size_t cap) {
+  static const uint8_t start[4] = { 0, 0, 0, 1 };
+  size_t n = 2 * sizeof(start) + ps->sps_len + ps->pps_len;
+  if (ps->sps_len == 0 || ps->pps_len == 0 || n > cap) return 0;
+  memcpy(out, start, sizeof(start));
+  memcpy(out + 4, ps->sps, ps->sps_len);
+  memcpy(out + 4 + ps->sps_len, start, sizeof(start));
+  memcpy(out + 8 + ps->sps_len, ps->pps, ps->pps_len);
+  return n;
+}
+
+/* ---------- Stream ---------- */
+
+void h264_stream_init(struct h264_stream *s) {
+  memset(s, 0, sizeof(*s));
+}
+
+int h264_stream_update(struct h264_stream *s, const uint8_t *buf, size_t len,
+                       struct h264_au_info *info) {
+  h264_au_classify(buf, len, info);
+  int changed = 0;
+  if (info->has_sps || info->has_pps) {
+    int had = s->ps.sps_len && s->ps.pps_len;
+    changed = h264_ps_update(&s->ps, buf, len);
+    if (changed && had) s->ps_changes++;
+  }
+  if (info->has_idr) {
+    if (s->idrs > 0) {
+      s->gop_frames = (uint32_t)(s->aus - s->last_idr);
+      if (s->gop_frames > s->max_gop_frames) s->max_gop_frames = s->gop_frames;
+    }
+    s->last_idr = s->aus;
+    s->idrs++;
+    if (s->ps.sps_len && s->ps.pps_len) s->started = 1;
+  }
+  s->aus++;
+  return changed;
+}
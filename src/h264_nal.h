@@ -0,0 +1,92 @@
+// h264_nal.h
+// Minimal Annex-B helpers: walk NAL units and classify an access unit
+// without decoding it. Only NAL headers are inspected. On top of that, a
+// per-stream tracker keeps the current SPS/PPS (so a consumer joining
+// mid-stream can be handed them with the next IDR) and the GOP structure.
+
+#if !defined(__H264_NAL_H__)
+#define __H264_NAL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum h264_nal_type {
+  H264_NAL_SLICE     = 1,
+  H264_NAL_IDR       = 5,
+  H264_NAL_SEI       = 6,
+  H264_NAL_SPS       = 7,
+  H264_NAL_PPS       = 8,
+  H264_NAL_AUD       = 9,
+};
+
+struct h264_au_info {
+  uint32_t nal_mask;      // bit n set when a NAL of type n was seen
+  unsigned nal_count;
+  int      has_idr;
+  int      has_sps;
+  int      has_pps;
+  int      has_slice;     // at least one VCL NAL (type 1 or 5)
+  int      is_reference;  // nal_ref_idc != 0 on the primary picture
+};
+
+// Finds the next NAL unit in buf[0..len) starting at *pos. On success sets
+// *nal/*nal_len to the payload (header byte included, start code excluded),
+// advances *pos past it and returns 1. Returns 0 at end of buffer.
+extern int  h264_next_nal(const uint8_t *buf, size_t len, size_t *pos,
+                          const uint8_t **nal, size_t *nal_len);
+
+// Classifies one access unit. Stops at the first slice NAL: nal_ref_idc and
+// IDR-ness are identical for every slice of a picture, so the slice payload
+// (the bulk of the bytes) is never scanned.
+extern void h264_au_classify(const uint8_t *buf, size_t len, struct h264_au_info *out);
+
+#define H264_SPS_MAX_BYTES  256
+#define H264_PPS_MAX_BYTES  192
+// SPS + PPS with their 4-byte start codes.
+#define H264_PS_MAX_BYTES   (H264_SPS_MAX_BYTES + H264_PPS_MAX_BYTES + 8)
+
+// Latest SPS and PPS of a stream, NAL payloads without start codes. Only one
+// of each is kept: the camera uses a single id.
+struct h264_ps {
+  uint8_t  sps[H264_SPS_MAX_BYTES];
+  uint8_t  pps[H264_PPS_MAX_BYTES];
+  uint32_t sps_len;
+  uint32_t pps_len;
+  uint32_t gen;           // bumped whenever either changes
+};
+
+// Takes the SPS/PPS found before the first slice of an AU. Returns 1 when
+// they differ from what was cached.
+extern int    h264_ps_update(struct h264_ps *ps, const uint8_t *buf, size_t len);
+
+// Writes SPS then PPS as Annex-B to out; returns the length, or 0 when
+// either is missing or out is too small.
+extern size_t h264_ps_annexb(const struct h264_ps *ps, uint8_t *out, size_t cap);
+
+// Ingest-side view of one stream. Single thread.
+struct h264_stream {
+  struct h264_ps ps;
+  uint64_t aus;           // AUs seen
+  uint64_t idrs;
+  uint64_t last_idr;      // AU number (from 0) of the latest IDR
+  uint32_t gop_frames;    // AUs from the previous IDR to the latest one
+  uint32_t max_gop_frames;
+  uint32_t ps_changes;    // changes after the first SPS/PPS
+  int      started;       // an IDR with parameter sets has been seen
+};
+
+extern void h264_stream_init(struct h264_stream *s);
+
+// Classifies the AU into *info and updates the stream. Returns 1 when this
+// AU changed the parameter sets (resolution or profile switch).
+extern int  h264_stream_update(struct h264_stream *s, const uint8_t *buf, size_t len,
+                               struct h264_au_info *info);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
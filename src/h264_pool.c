@@ -0,0 +1,103 @@
+// h264_pool.c
+// See h264_pool.h. Counters are plain atomics so they can be sampled from the
+// main loop while the libuvc thread keeps filling buffers.
+
+#include "h264_pool.h"
+
+struct h264_pool {
+  GstBufferPool *pool;        // NULL when pooling is disabled
+  gsize          size;
+  guint          nbufs;
+
+  guint64        frames;
+  guint64        pool_hits;
+  guint64        allocs;
+};
+
+static GstBuffer *alloc_copy(h264_pool_t *p, const void *data, gsize len) {
+  GstBuffer *buf = gst_buffer_new_allocate(NULL, len, NULL);
+  if (!buf) return NULL;
+  __atomic_add_fetch(&p->allocs, 1, __ATOMIC_RELAXED);
+  gst_buffer_fill(buf, 0, data, len);
+  return buf;
+}
+
+// Preallocates p->nbufs buffers of p->size bytes; on failure pooling is
+// turned off and every frame is allocated.
+static void pool_activate(h264_pool_t *p) {
+  p->pool = gst_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(p->pool);
+  // min == max: everything is allocated on activation, the pool never grows.
+  gst_buffer_pool_config_set_params(config, NULL, (guint)p->size, p->nbufs, p->nbufs);
+  if (!gst_buffer_pool_set_config(p->pool, config) ||
+      !gst_buffer_pool_set_active(p->pool, TRUE)) {
+    g_printerr("h264_pool: cannot activate %u x %zu byte pool, falling back to per-frame allocation\n",
+               p->nbufs, (size_t)p->size);
+    gst_object_unref(p->pool);
+    p->pool = NULL;
+    p->nbufs = 0;
+    return;
+  }
+  __atomic_add_fetch(&p->allocs, p->nbufs, __ATOMIC_RELAXED);
+}
+
+// Buffers still in flight hold their own reference on the pool they came
+// from; a deactivated pool frees them as they come back.
+static void pool_deactivate(h264_pool_t *p) {
+  if (!p->pool) return;
+  gst_buffer_pool_set_active(p->pool, FALSE);
+  gst_object_unref(p->pool);
+  p->pool = NULL;
+}
+
+h264_pool_t *h264_pool_new(gsize frame_size, guint nbufs) {
+  h264_pool_t *p = g_new0(h264_pool_t, 1);
+  p->size  = frame_size ? frame_size : H264_POOL_FALLBACK_FRAMESIZE;
+  p->nbufs = nbufs;
+  if (nbufs) pool_activate(p);
+  return p;
+}
+
+void h264_pool_free(h264_pool_t *p) {
+  if (!p) return;
+  pool_deactivate(p);
+  g_free(p);
+}
+
+gboolean h264_pool_resize(h264_pool_t *p, gsize frame_size) {
+  if (frame_size <= p->size) return FALSE;
+  p->size = frame_size;
+  if (!p->pool) return FALSE;
+  guint nbufs = p->nbufs;
+  pool_deactivate(p);
+  pool_activate(p);
+  return p->nbufs == nbufs;
+}
+
+GstBuffer *h264_pool_fill(h264_pool_t *p, const void *data, gsize len) {
+  __atomic_add_fetch(&p->frames, 1, __ATOMIC_RELAXED);
+
+  if (!p->pool || len > p->size) return alloc_copy(p, data, len);
+
+  GstBuffer *buf = NULL;
+  GstBufferPoolAcquireParams params = { .flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT };
+  if (gst_buffer_pool_acquire_buffer(p->pool, &buf, &params) != GST_FLOW_OK || !buf)
+    return alloc_copy(p, data, len);
+
+  // libuvc reuses frame->data once the callback returns, so one copy into
+  // the recycled buffer is still required; the allocation is what goes away.
+  gst_buffer_fill(buf, 0, data, len);
+  gst_buffer_set_size(buf, (gssize)len);
+  __atomic_add_fetch(&p->pool_hits, 1, __ATOMIC_RELAXED);
+  return buf;
+}
+
+void h264_pool_get_stats(h264_pool_t *p, struct h264_pool_stats *out) {
+  out->frames    = __atomic_load_n(&p->frames,    __ATOMIC_RELAXED);
+  out->pool_hits = __atomic_load_n(&p->pool_hits, __ATOMIC_RELAXED);
+  out->allocs    = __atomic_load_n(&p->allocs,    __ATOMIC_RELAXED);
+}
+
+gsize h264_pool_buffer_size(h264_pool_t *p) {
+  return p->size;
+}
@@ -0,0 +1,50 @@
+// h264_pool.h
+// Recycled GstBuffer pool for encoded H.264 access units delivered by libuvc.
+// Buffers are preallocated once, sized from the negotiated stream control's
+// dwMaxVideoFrameSize, so the frame callback does no per-frame heap allocation.
+
+#if !defined(__H264_POOL_H__)
+#define __H264_POOL_H__
+
+#include <gst/gst.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define H264_POOL_DEFAULT_BUFFERS    8
+#define H264_POOL_FALLBACK_FRAMESIZE (4u * 1024u * 1024u)
+
+typedef struct h264_pool h264_pool_t;
+
+struct h264_pool_stats {
+  guint64 frames;      // buffers handed out
+  guint64 pool_hits;   // served from the recycled pool
+  guint64 allocs;      // fresh heap allocations (prealloc + fallbacks)
+};
+
+// frame_size is usually ctrl.dwMaxVideoFrameSize (0 picks a fallback size).
+// nbufs == 0 disables pooling: every frame gets a fresh allocation, which is
+// the historical behaviour and is kept for A/B comparison of the counters.
+extern h264_pool_t *h264_pool_new(gsize frame_size, guint nbufs);
+extern void         h264_pool_free(h264_pool_t *pool);
+
+// Grows the buffers to frame_size after a renegotiation to a larger mode.
+// Buffers already handed out stay valid. Not thread safe against
+// h264_pool_fill: call while the stream is stopped. TRUE when the pooled
+// buffers were reallocated; FALSE when frame_size already fits, pooling is
+// off, or the new pool could not be activated (pooling is then off).
+extern gboolean     h264_pool_resize(h264_pool_t *pool, gsize frame_size);
+
+// Returns a buffer holding a copy of data[0..len). Never blocks: when every
+// pooled buffer is still in flight downstream, or the frame is larger than
+// the pool's buffer size, it falls back to a counted one-off allocation.
+extern GstBuffer   *h264_pool_fill(h264_pool_t *pool, const void *data, gsize len);
+
+extern void         h264_pool_get_stats(h264_pool_t *pool, struct h264_pool_stats *out);
+extern gsize        h264_pool_buffer_size(h264_pool_t *pool);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,258 @@
+// ingest_mon.c
+// See ingest_mon.h. The callback fills window slot head % window and
+// publishes head; everything derived is computed by the summary, from a
+// copy, so the callback's cost does not depend on the window size.
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ingest_mon.h"
+
+#define ENT_IDR      0x1u
+#define ENT_LATE     0x2u    // late_ns is valid
+#define ENT_CONSEC   0x4u    // sequence follows the previous frame's: interval is valid
+
+struct ent {
+  uint32_t seq;
+  uint32_t bytes;
+  uint32_t flags;
+  uint32_t gap;              // sequence numbers missing just before this frame
+  int64_t  arrival_ns;
+  int64_t  late_ns;
+};
+
+struct ingest_mon {
+  struct ingest_mon_config cfg;
+  struct ent       *win;
+  _Atomic uint64_t  head;           // frames recorded
+  // Callback only (read by the summary through the atomics).
+  uint32_t          last_seq;
+  int               have_seq;
+  _Atomic int64_t   first_ns;
+  _Atomic int64_t   last_idr_ns;
+  _Atomic int64_t   idr_interval_ns;
+  _Atomic uint64_t  total_gaps;
+  // Summary only.
+  struct ent       *snap;
+  uint32_t         *sizes;
+  int64_t          *lates;
+  unsigned          active;
+  uint64_t          raised[INGEST_ALERT_NUM];
+};
+
+static const char *k_names[INGEST_ALERT_NUM] = {
+  "gaps", "usb-late", "encoder-late", "burst", "idr",
+};
+
+const char *ingest_alert_name(enum ingest_alert a) {
+  return (unsigned)a < INGEST_ALERT_NUM ? k_names[a] : "?";
+}
+
+void ingest_mon_defaults(struct ingest_mon_config *cfg, int64_t interval_ns) {
+  cfg->window      = INGEST_MON_DEFAULT_WINDOW;
+  cfg->interval_ns = interval_ns;
+  cfg->late_ns     = interval_ns / 2;
+  cfg->big_frame   = 3.0;
+  cfg->gap_frames  = 1;
+  cfg->late_frames = 3;
+  cfg->burst       = 2.0;
+  cfg->idr_ns      = 5000000000ll;
+}
+
+ingest_mon_t *ingest_mon_new(const struct ingest_mon_config *cfg) {
+  if (cfg->window < 2) return NULL;
+  ingest_mon_t *m = calloc(1, sizeof(*m));
+  if (!m) return NULL;
+  m->cfg   = *cfg;
+  m->win   = calloc(cfg->window, sizeof(*m->win));
+  m->snap  = calloc(cfg->window, sizeof(*m->snap));
+  m->sizes = calloc(cfg->window, sizeof(*m->sizes));
+  m->lates = calloc(cfg->window, sizeof(*m->lates));
+  if (!m->win || !m->snap || !m->sizes || !m->lates) {
+    ingest_mon_free(m);
+    return NULL;
+  }
+  return m;
+}
+
+void ingest_mon_free(ingest_mon_t *m) {
+  if (!m) return;
+  free(m->win);
+  free(m->snap);
+  free(m->sizes);
+  free(m->lates);
+  free(m);
+}
+
+void ingest_mon_frame(ingest_mon_t *m, uint32_t sequence, uint32_t bytes, int idr,
+                      int64_t arrival_ns, int64_t expected_ns) {
+  if (!m) return;
+  uint64_t head = atomic_load_explicit(&m->head, memory_order_relaxed);
+  struct ent *e = &m->win[head % m->cfg.window];
+  e->seq        = sequence;
+  e->bytes      = bytes;
+  e->flags      = (idr ? ENT_IDR : 0) | (expected_ns ? ENT_LATE : 0);
+  e->gap        = 0;
+  e->arrival_ns = arrival_ns;
+  e->late_ns    = expected_ns ? arrival_ns - expected_ns : 0;
+  // A sequence that goes backwards is a restarted stream, not a gap.
+  if (m->have_seq && sequence > m->last_seq) {
+    e->gap = sequence - m->last_seq - 1;
+    if (e->gap == 0) e->flags |= ENT_CONSEC;
+    else atomic_fetch_add_explicit(&m->total_gaps, e->gap, memory_order_relaxed);
+  }
+  m->last_seq = sequence;
+  m->have_seq = 1;
+
+  if (!atomic_load_explicit(&m->first_ns, memory_order_relaxed))
+    atomic_store_explicit(&m->first_ns, arrival_ns, memory_order_relaxed);
+  if (idr) {
+    int64_t last = atomic_load_explicit(&m->last_idr_ns, memory_order_relaxed);
+    if (last) atomic_store_explicit(&m->idr_interval_ns, arrival_ns - last, memory_order_relaxed);
+    atomic_store_explicit(&m->last_idr_ns, arrival_ns, memory_order_relaxed);
+  }
+  atomic_store_explicit(&m->head, head + 1, memory_order_release);
+}
+
+void ingest_mon_restart(ingest_mon_t *m) {
+  if (!m) return;
+  m->have_seq = 0;
+  // An IDR interval across the restart would mean nothing.
+  atomic_store_explicit(&m->last_idr_ns, 0, memory_order_relaxed);
+  atomic_store_explicit(&m->first_ns, 0, memory_order_relaxed);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+#define PCT(arr, n, q) ((arr)[(size_t)((double)((n) - 1) * (q) + 0.5)])
+
+// Copies what is still intact of the window into m->snap, oldest first.
+static unsigned snapshot(ingest_mon_t *m) {
+  uint64_t w = m->cfg.window;
+  uint64_t h1 = atomic_load_explicit(&m->head, memory_order_acquire);
+  uint64_t start = h1 > w ? h1 - w : 0;
+  for (uint64_t i = start; i < h1; ++i) m->snap[i - start] = m->win[i % w];
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t h2 = atomic_load_explicit(&m->head, memory_order_relaxed);
+  // Slots below h2 - window were rewritten under the copy, and so may be
+  // slot h2 % window itself: the writer fills it before publishing h2 + 1.
+  uint64_t valid_from = h2 + 1 > w ? h2 + 1 - w : 0;
+  uint64_t drop = valid_from > start ? valid_from - start : 0;
+  if (drop >= h1 - start) return 0;
+  unsigned n = (unsigned)(h1 - start - drop);
+  if (drop) memmove(m->snap, m->snap + drop, n * sizeof(*m->snap));
+  if (drop) m->snap[0].flags &= ~ENT_CONSEC;
+  return n;
+}
+
+void ingest_mon_update(ingest_mon_t *m, int64_t now_ns, struct ingest_mon_summary *out) {
+  memset(out, 0, sizeof(*out));
+  if (!m) return;
+  const struct ingest_mon_config *cfg = &m->cfg;
+  unsigned n = snapshot(m);
+  const struct ent *s = m->snap;
+
+  out->frames = n;
+  if (n) {
+    int64_t first = s[0].arrival_ns, last = s[n - 1].arrival_ns;
+    out->span_s = (double)(last - first) / 1e9;
+
+    // Sizes first: the median decides what a big frame is.
+    uint64_t bytes = 0, bytes_now = 0;
+    for (unsigned k = 0; k < n; ++k) {
+      m->sizes[k] = s[k].bytes;
+      if (k) bytes += s[k].bytes;   // bytes that arrived within the span
+      if (s[k].arrival_ns > last - 1000000000ll) bytes_now += s[k].bytes;
+    }
+    qsort(m->sizes, n, sizeof(*m->sizes), cmp_u32);
+    out->size_p50 = PCT(m->sizes, n, 0.50);
+    out->size_p99 = PCT(m->sizes, n, 0.99);
+    out->size_max = m->sizes[n - 1];
+    if (last > first) out->bitrate_avg_bps = (double)bytes * 8.0 / ((double)(last - first) / 1e9);
+    out->bitrate_now_bps = (double)bytes_now * 8.0;
+    double big = cfg->big_frame * (double)out->size_p50;
+
+    unsigned nint = 0, nlate = 0;
+    double mean = 0, m2 = 0;
+    for (unsigned k = 0; k < n; ++k) {
+      if (k) out->gaps += s[k].gap;
+      if (k && (s[k].flags & ENT_CONSEC)) {
+        double d = (double)(s[k].arrival_ns - s[k - 1].arrival_ns) / 1e6;
+        nint++;
+        double delta = d - mean;
+        mean += delta / nint;
+        m2 += delta * (d - mean);
+        if (d > out->interval_max_ms) out->interval_max_ms = d;
+      }
+      if (s[k].flags & ENT_LATE) {
+        m->lates[nlate++] = s[k].late_ns;
+        if (s[k].late_ns > cfg->late_ns) {
+          // Held up behind a big frame counts as the big frame's doing.
+          int encoder = (double)s[k].bytes > big || (k && (double)s[k - 1].bytes > big);
+          if (encoder) out->late_encoder++;
+          else         out->late_usb++;
+        }
+      }
+    }
+    out->interval_mean_ms = mean;
+    out->interval_sd_ms = nint > 1 ? sqrt(m2 / (nint - 1)) : 0;
+    if (nlate) {
+      qsort(m->lates, nlate, sizeof(*m->lates), cmp_i64);
+      out->late_p50_ms = (double)PCT(m->lates, nlate, 0.50) / 1e6;
+      out->late_p99_ms = (double)PCT(m->lates, nlate, 0.99) / 1e6;
+      out->late_max_ms = (double)m->lates[nlate - 1] / 1e6;
+    }
+  }
+
+  int64_t last_idr = atomic_load_explicit(&m->last_idr_ns, memory_order_relaxed);
+  int64_t since = last_idr ? last_idr : atomic_load_explicit(&m->first_ns, memory_order_relaxed);
+  out->idr_interval_ms = last_idr ? (double)atomic_load_explicit(&m->idr_interval_ns, memory_order_relaxed) / 1e6 : 0;
+  out->idr_age_ms = since && now_ns > since ? (double)(now_ns - since) / 1e6 : 0;
+
+  unsigned active = 0;
+  if (cfg->gap_frames && out->gaps >= cfg->gap_frames) active |= 1u << INGEST_ALERT_GAPS;
+  if (cfg->late_frames && out->late_usb >= cfg->late_frames) active |= 1u << INGEST_ALERT_USB_LATE;
+  if (cfg->late_frames && out->late_encoder >= cfg->late_frames) active |= 1u << INGEST_ALERT_ENCODER_LATE;
+  // Needs a window long enough for the average to mean something.
+  if (cfg->burst > 0 && out->span_s >= 2.0 && out->bitrate_avg_bps > 0 &&
+      out->bitrate_now_bps > cfg->burst * out->bitrate_avg_bps)
+    active |= 1u << INGEST_ALERT_BURST;
+  // Only while frames are coming: a stalled stream is stream_watch's business.
+  int flowing = n && now_ns - s[n - 1].arrival_ns < 1000000000ll;
+  if (cfg->idr_ns > 0 && flowing &&
+      (out->idr_interval_ms * 1e6 > (double)cfg->idr_ns || out->idr_age_ms * 1e6 > (double)cfg->idr_ns))
+    active |= 1u << INGEST_ALERT_IDR;
+
+  out->active  = active;
+  out->raised  = active & ~m->active;
+  out->cleared = m->active & ~active;
+  m->active = active;
+  for (int a = 0; a < INGEST_ALERT_NUM; ++a) {
+    if (out->raised & (1u << a)) m->raised[a]++;
+    out->total_raised[a] = m->raised[a];
+  }
+  out->total_frames = atomic_load_explicit(&m->head, memory_order_relaxed);
+  out->total_gaps   = atomic_load_explicit(&m->total_gaps, memory_order_relaxed);
+}
+
+void ingest_mon_print(const struct ingest_mon_summary *s, FILE *fp) {
+  fprintf(fp, "USB ingest, last %u frames (%.1f s): gaps %llu, interval %.2f +- %.2f ms (max %.1f), "
+              "late vs camera clock p50 %.2f p99 %.2f max %.2f ms (%u usb, %u encoder)\n",
+          s->frames, s->span_s, (unsigned long long)s->gaps, s->interval_mean_ms, s->interval_sd_ms,
+          s->interval_max_ms, s->late_p50_ms, s->late_p99_ms, s->late_max_ms,
+          s->late_usb, s->late_encoder);
+  fprintf(fp, "  AU size p50 %.0f p99 %.0f max %.0f KB, %.1f Mbit/s avg, %.1f last second, "
+              "IDR every %.0f ms (last %.0f ms ago)\n",
+          s->size_p50 / 1024.0, s->size_p99 / 1024.0, s->size_max / 1024.0,
+          s->bitrate_avg_bps / 1e6, s->bitrate_now_bps / 1e6, s->idr_interval_ms, s->idr_age_ms);
+}
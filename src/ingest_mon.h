@@ -0,0 +1,106 @@
+// ingest_mon.h
+// USB ingest health: what the camera and the bus deliver, before anything
+// of ours touches it. The frame callback records each access unit's UVC
+// sequence, size, IDR flag, arrival time and how late it came against the
+// camera's own frame clock (dev_pts_frame_time), into a fixed window of
+// the last N frames. A timer on another thread summarises the window:
+//   - sequence gaps: frames lost on USB
+//   - arrival interval mean, deviation and max
+//   - lateness against the camera clock, p50/p99/max
+//   - AU size p50/p99/max, average and last-second bitrate
+//   - IDR interval and time since the last IDR
+// and raises or clears threshold alerts.
+//
+// Lateness is what tells the sources of a latency spike apart. A frame
+// that is late and big (or right behind a big one) was held up by the
+// encoder and its transfer: encoder-late. One that is late at normal size
+// was held up on the bus or in the host's USB stack: usb-late. Frames that
+// arrive on time but leave the pipeline late were held up by us, which the
+// per-stage latency (lat_stages.h) shows from arrival onwards.
+//
+// Recording is a handful of plain stores and one release store, no lock.
+// The summary copies the window and drops whatever the callback overwrote
+// meanwhile, the seqlock way. One recording thread, one summarising thread.
+
+#if !defined(__INGEST_MON_H__)
+#define __INGEST_MON_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define INGEST_MON_DEFAULT_WINDOW   300   // frames: 10 s at 30 fps
+
+enum ingest_alert {
+  INGEST_ALERT_GAPS = 0,       // frames missing from the UVC sequence
+  INGEST_ALERT_USB_LATE,       // late frames of normal size
+  INGEST_ALERT_ENCODER_LATE,   // late big frames, or right behind one
+  INGEST_ALERT_BURST,          // last-second bitrate well over the window average
+  INGEST_ALERT_IDR,            // IDR interval (or time since the last IDR) too long
+  INGEST_ALERT_NUM,
+};
+
+struct ingest_mon_config {
+  unsigned window;             // frames kept
+  int64_t  interval_ns;        // nominal frame period
+  int64_t  late_ns;            // arrival this far behind the camera clock = late
+  double   big_frame;          // AU this many times the window's median size = big
+  unsigned gap_frames;         // missing frames in the window that raise GAPS
+  unsigned late_frames;        // late frames in the window that raise *_LATE
+  double   burst;              // last-second bitrate / window average that raises BURST
+  int64_t  idr_ns;             // IDR interval that raises IDR
+};
+
+struct ingest_mon_summary {
+  unsigned frames;             // in the window
+  double   span_s;             // first to last arrival in the window
+  uint64_t gaps;               // missing sequence numbers in the window
+  double   interval_mean_ms;   // arrival to arrival, consecutive sequence numbers only
+  double   interval_sd_ms;
+  double   interval_max_ms;
+  double   late_p50_ms;        // arrival minus camera frame clock
+  double   late_p99_ms;
+  double   late_max_ms;
+  unsigned late_usb;           // late frames in the window, by cause
+  unsigned late_encoder;
+  uint32_t size_p50, size_p99, size_max;
+  double   bitrate_avg_bps;    // over the window
+  double   bitrate_now_bps;    // over the last second
+  double   idr_interval_ms;    // last complete IDR to IDR, 0 = none yet
+  double   idr_age_ms;         // since the last IDR (or the first frame)
+  unsigned active;             // 1 << INGEST_ALERT_* now
+  unsigned raised, cleared;    // ... changed since the previous summary
+  uint64_t total_frames, total_gaps;      // whole run
+  uint64_t total_raised[INGEST_ALERT_NUM];
+};
+
+typedef struct ingest_mon ingest_mon_t;
+
+extern void          ingest_mon_defaults(struct ingest_mon_config *cfg, int64_t interval_ns);
+extern ingest_mon_t *ingest_mon_new(const struct ingest_mon_config *cfg);
+extern void          ingest_mon_free(ingest_mon_t *m);
+
+// Frame callback, every AU in arrival order. expected_ns is the frame's
+// time on the camera clock (dev_pts_frame_time), 0 when unknown.
+extern void          ingest_mon_frame(ingest_mon_t *m, uint32_t sequence, uint32_t bytes, int idr,
+                                      int64_t arrival_ns, int64_t expected_ns);
+
+// The stream was restarted (reconnect, mode switch): the sequence starts
+// over, no gap. Call while no frame is being recorded.
+extern void          ingest_mon_restart(ingest_mon_t *m);
+
+// Summarising thread: the window as of now, and alert changes.
+extern void          ingest_mon_update(ingest_mon_t *m, int64_t now_ns, struct ingest_mon_summary *out);
+
+// Two lines: the window's summary. Alerts are the caller's to report.
+extern void          ingest_mon_print(const struct ingest_mon_summary *s, FILE *fp);
+
+extern const char   *ingest_alert_name(enum ingest_alert a);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
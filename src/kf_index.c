@@ -0,0 +1,152 @@
+// kf_index.c
+// See kf_index.h. One IDR a second or so: each entry is written and flushed
+// on its own, which costs one write() per keyframe.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kf_index.h"
+
+#define KF_INDEX_VERSION 1
+
+_Static_assert(sizeof(struct kf_index_entry) == 512, "kf_index_entry layout");
+_Static_assert(KF_INDEX_PS_BYTES >= H264_PS_MAX_BYTES, "parameter sets must fit an entry");
+
+void kf_index_path(char *out, size_t size, const char *recording) {
+  snprintf(out, size, "%s", recording);
+  char *slash = strrchr(out, '/');
+  char *dot = strrchr(out, '.');
+  if (dot && (!slash || dot > slash)) *dot = '\0';
+  size_t n = strlen(out);
+  if (n >= 5 && strcmp(out + n - 5, "_%05d") == 0) out[n - 5] = '\0';
+  n = strlen(out);
+  if (n + 5 <= size) strcat(out, ".kfi");
+}
+
+/* ---------- Writing ---------- */
+
+struct kf_index_writer {
+  FILE    *fp;
+  int      failed;
+  uint32_t segment;
+};
+
+kf_index_writer_t *kf_index_open(const char *path) {
+  kf_index_writer_t *w = calloc(1, sizeof(*w));
+  if (!w) return NULL;
+  w->fp = fopen(path, "wb");
+  if (!w->fp) { perror(path); free(w); return NULL; }
+
+  struct kf_index_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, KF_INDEX_MAGIC, sizeof(h.magic));
+  h.version     = KF_INDEX_VERSION;
+  h.header_size = sizeof(h);
+  h.entry_size  = sizeof(struct kf_index_entry);
+  if (fwrite(&h, sizeof(h), 1, w->fp) != 1 || fflush(w->fp) != 0) w->failed = 1;
+  return w;
+}
+
+int kf_index_add(kf_index_writer_t *w, const struct h264_stream *s, uint64_t frame,
+                 uint64_t offset, int64_t pts_ns, uint32_t sequence, uint32_t size) {
+  if (!w || w->failed) return -1;
+  struct kf_index_entry e;
+  memset(&e, 0, sizeof(e));
+  e.frame      = frame;
+  e.offset     = offset;
+  e.pts_ns     = pts_ns;
+  e.sequence   = sequence;
+  e.size       = size;
+  e.segment    = w->segment;
+  e.gop_frames = s->idrs > 1 ? s->gop_frames : 0;
+  e.ps_gen     = s->ps.gen;
+  e.ps_size    = (uint32_t)h264_ps_annexb(&s->ps, e.ps, sizeof(e.ps));
+  if (fwrite(&e, sizeof(e), 1, w->fp) != 1 || fflush(w->fp) != 0) {
+    w->failed = 1;
+    return -1;
+  }
+  return 0;
+}
+
+void kf_index_set_segment(kf_index_writer_t *w, uint32_t n) {
+  if (w) w->segment = n;
+}
+
+int kf_index_close(kf_index_writer_t *w) {
+  if (!w) return 0;
+  int rc = w->failed ? -1 : 0;
+  if (fclose(w->fp) != 0) rc = -1;
+  free(w);
+  return rc;
+}
+
+/* ---------- Reading ---------- */
+
+struct kf_index {
+  struct kf_index_entry *e;
+  size_t                 count;
+};
+
+kf_index_t *kf_index_load(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) { perror(path); return NULL; }
+
+  struct kf_index_header h;
+  if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, KF_INDEX_MAGIC, sizeof(h.magic)) != 0 ||
+      h.entry_size != sizeof(struct kf_index_entry) || h.header_size < sizeof(h)) {
+    fprintf(stderr, "%s: not a keyframe index\n", path);
+    fclose(fp);
+    return NULL;
+  }
+
+  kf_index_t *x = calloc(1, sizeof(*x));
+  if (!x) { fclose(fp); return NULL; }
+  size_t cap = 0;
+  fseek(fp, (long)h.header_size, SEEK_SET);
+  for (;;) {
+    if (x->count == cap) {
+      size_t ncap = cap ? cap * 2 : 256;
+      void *tmp = realloc(x->e, ncap * sizeof(*x->e));
+      if (!tmp) break;
+      x->e = tmp;
+      cap = ncap;
+    }
+    // A torn last entry (crash mid-write) is simply not read.
+    if (fread(&x->e[x->count], sizeof(*x->e), 1, fp) != 1) break;
+    x->count++;
+  }
+  fclose(fp);
+  return x;
+}
+
+void kf_index_free(kf_index_t *x) {
+  if (!x) return;
+  free(x->e);
+  free(x);
+}
+
+size_t kf_index_count(const kf_index_t *x) {
+  return x->count;
+}
+
+const struct kf_index_entry *kf_index_get(const kf_index_t *x, size_t i) {
+  return i < x->count ? &x->e[i] : NULL;
+}
+
+const struct kf_index_entry *kf_index_find(const kf_index_t *x, uint64_t frame) {
+  if (x->count == 0 || frame < x->e[0].frame) return NULL;
+  size_t lo = 0, hi = x->count;
+  // Largest i with e[i].frame <= frame.
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (x->e[mid].frame <= frame) lo = mid; else hi = mid;
+  }
+  return &x->e[lo];
+}
+
+const struct kf_index_entry *kf_index_segment_start(const kf_index_t *x,
+                                                    const struct kf_index_entry *e) {
+  while (e > x->e && e[-1].segment == e->segment) --e;
+  return e;
+}
@@ -0,0 +1,89 @@
+// kf_index.h
+// Keyframe index stored next to a recording (FILE.kfi for FILE.mp4 or
+// FILE.tcap): one fixed-size entry per IDR, with the AU number in the
+// recording, its PTS, its byte offset when the container allows, the GOP
+// length, and the SPS/PPS in effect. Every entry is self-contained, so a
+// reader can start decoding at any keyframe without scanning the stream,
+// and frame N maps to its keyframe with a binary search.
+//
+// Layout (little-endian, native structs):
+//   struct kf_index_header
+//   struct kf_index_entry * N
+// Entries are flushed as they are added; a recording cut short keeps every
+// keyframe written before the cut.
+
+#if !defined(__KF_INDEX_H__)
+#define __KF_INDEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "h264_nal.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define KF_INDEX_MAGIC     "KFIDX001"
+#define KF_INDEX_PS_BYTES  464     // entry is 512 bytes
+
+struct kf_index_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t entry_size;
+  uint32_t reserved[5];
+};
+
+struct kf_index_entry {
+  uint64_t frame;          // AU number in the recording, from 0
+  uint64_t offset;         // payload offset in a .tcap, 0 for MP4
+  int64_t  pts_ns;         // buffer PTS (MP4) or capture time (.tcap)
+  uint32_t sequence;       // UVC frame sequence
+  uint32_t size;           // AU bytes
+  uint32_t gop_frames;     // AUs since the previous keyframe, 0 for the first
+  uint32_t ps_gen;         // h264_ps.gen: changes when the parameter sets do
+  uint32_t ps_size;
+  uint32_t segment;        // file of a segmented MP4 (its _%05d), 0 otherwise
+  uint8_t  ps[KF_INDEX_PS_BYTES];   // SPS + PPS, Annex-B
+};
+
+// FILE.ext -> FILE.kfi ("_%05d" before the extension is dropped too, so a
+// segmented recording gets one index). Frame numbers run on across the
+// segments; each segment starts on a keyframe, so a frame's number within
+// its file is frame minus the frame of its segment's first entry.
+extern void kf_index_path(char *out, size_t size, const char *recording);
+
+/* ---------- Writing ---------- */
+typedef struct kf_index_writer kf_index_writer_t;
+
+extern kf_index_writer_t *kf_index_open(const char *path);
+
+// Fills an entry from the stream state (ps and GOP length) and appends it.
+extern int  kf_index_add(kf_index_writer_t *w, const struct h264_stream *s, uint64_t frame,
+                         uint64_t offset, int64_t pts_ns, uint32_t sequence, uint32_t size);
+// Entries added from now on belong to segment n (0 until called).
+extern void kf_index_set_segment(kf_index_writer_t *w, uint32_t n);
+extern int  kf_index_close(kf_index_writer_t *w);
+
+/* ---------- Reading ---------- */
+typedef struct kf_index kf_index_t;
+
+extern kf_index_t *kf_index_load(const char *path);
+extern void        kf_index_free(kf_index_t *x);
+extern size_t      kf_index_count(const kf_index_t *x);
+extern const struct kf_index_entry *kf_index_get(const kf_index_t *x, size_t i);
+
+// The last keyframe at or before frame, i.e. where to start decoding to
+// show it; NULL when frame precedes the first keyframe.
+extern const struct kf_index_entry *kf_index_find(const kf_index_t *x, uint64_t frame);
+
+// The first entry of e's segment: e->frame minus its frame is the AU
+// number within the segment's file.
+extern const struct kf_index_entry *kf_index_segment_start(const kf_index_t *x,
+                                                           const struct kf_index_entry *e);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
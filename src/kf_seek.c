@@ -0,0 +1,108 @@
+// kf_seek.c
+// Keyframe index tool. Lists the keyframes of a recording, tells where to
+// start decoding to show frame N, and for a .tcap capture extracts a
+// playable Annex-B stream starting there: the parameter sets from the
+// index, then the access units from the keyframe on.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "h264_nal.h"
+#include "kf_index.h"
+#include "tcap.h"
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s FILE.kfi               list keyframes\n"
+    "       %s FILE.kfi N             keyframe to start from to show frame N\n"
+    "       %s -x OUT.h264 FILE.tcap N [COUNT]\n"
+    "                                 Annex-B from the keyframe before frame N\n"
+    "                                 up to frame N + COUNT (default: the end)\n",
+    prog, prog, prog);
+}
+
+static void print_entry(const struct kf_index_entry *e, int64_t pts0) {
+  printf("%10llu %5u %10u %12.3f %12llu %9u %5u %4u\n", (unsigned long long)e->frame, e->segment,
+         e->sequence, (double)(e->pts_ns - pts0) / 1e9, (unsigned long long)e->offset, e->size,
+         e->gop_frames, e->ps_gen);
+}
+
+static int list(const kf_index_t *x) {
+  size_t n = kf_index_count(x);
+  if (n == 0) { fprintf(stderr, "no keyframes\n"); return 1; }
+  int64_t pts0 = kf_index_get(x, 0)->pts_ns;
+  printf("%10s %5s %10s %12s %12s %9s %5s %4s\n", "frame", "seg", "sequence", "t_s", "offset", "size",
+         "gop", "ps");
+  for (size_t i = 0; i < n; ++i) print_entry(kf_index_get(x, i), pts0);
+  return 0;
+}
+
+static int seek(const kf_index_t *x, uint64_t frame) {
+  const struct kf_index_entry *e = kf_index_find(x, frame);
+  if (!e) { fprintf(stderr, "frame %llu is before the first keyframe\n", (unsigned long long)frame); return 1; }
+  int64_t pts0 = kf_index_get(x, 0)->pts_ns;
+  printf("frame %llu: start at keyframe frame %llu (t %.3f s, offset %llu), decode %llu frames before it\n",
+         (unsigned long long)frame, (unsigned long long)e->frame, (double)(e->pts_ns - pts0) / 1e9,
+         (unsigned long long)e->offset, (unsigned long long)(frame - e->frame));
+  // Segmented MP4: frame numbers within the file that holds them.
+  if (kf_index_get(x, kf_index_count(x) - 1)->segment) {
+    const struct kf_index_entry *s0 = kf_index_segment_start(x, e);
+    printf("  segment %05u: keyframe at frame %llu of the file, frame %llu at frame %llu\n", e->segment,
+           (unsigned long long)(e->frame - s0->frame), (unsigned long long)frame,
+           (unsigned long long)(frame - s0->frame));
+  }
+  return 0;
+}
+
+static int extract(const char *out_path, const char *tcap_path, uint64_t frame, uint64_t count) {
+  char kfi_path[1024];
+  kf_index_path(kfi_path, sizeof(kfi_path), tcap_path);
+  kf_index_t *x = kf_index_load(kfi_path);
+  if (!x) return 1;
+  tcap_reader_t *r = tcap_reader_open(tcap_path);
+  if (!r) { kf_index_free(x); return 1; }
+
+  int rc = 1;
+  FILE *out = NULL;
+  const struct kf_index_entry *e = kf_index_find(x, frame);
+  size_t n = tcap_reader_count(r);
+  if (!e || e->frame >= n) {
+    fprintf(stderr, "no keyframe at or before frame %llu\n", (unsigned long long)frame);
+    goto done;
+  }
+  out = fopen(out_path, "wb");
+  if (!out) { perror(out_path); goto done; }
+
+  uint64_t end = count && frame + count < n ? frame + count : n;
+  struct h264_au_info au;
+  h264_au_classify(tcap_reader_data(r, e->frame), tcap_reader_entry(r, e->frame)->size, &au);
+  if (!(au.has_sps && au.has_pps) && e->ps_size) fwrite(e->ps, 1, e->ps_size, out);
+  for (uint64_t i = e->frame; i < end; ++i)
+    fwrite(tcap_reader_data(r, i), 1, tcap_reader_entry(r, i)->size, out);
+  if (fclose(out) != 0) { perror(out_path); goto done; }
+  fprintf(stderr, "%s: frames %llu..%llu (keyframe %llu for frame %llu)\n", out_path,
+          (unsigned long long)e->frame, (unsigned long long)(end - 1),
+          (unsigned long long)e->frame, (unsigned long long)frame);
+  rc = 0;
+
+done:
+  tcap_reader_close(r);
+  kf_index_free(x);
+  return rc;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))) { usage(argv[0]); return 0; }
+  if (argc >= 5 && !strcmp(argv[1], "-x"))
+    return extract(argv[2], argv[3], strtoull(argv[4], NULL, 10),
+                   argc >= 6 ? strtoull(argv[5], NULL, 10) : 0);
+  if (argc != 2 && argc != 3) { usage(argv[0]); return 1; }
+
+  kf_index_t *x = kf_index_load(argv[1]);
+  if (!x) return 1;
+  int rc = argc == 3 ? seek(x, strtoull(argv[2], NULL, 10)) : list(x);
+  kf_index_free(x);
+  return rc;
+}
@@ -0,0 +1,108 @@
+// lat_hist.c
+// See lat_hist.h. Values below 2^SUB_BITS us map 1:1 to buckets; above
+// that each power of two is split into 2^SUB_BITS equal buckets.
+
+#include <string.h>
+
+#include "lat_hist.h"
+
+#define SUB_COUNT (1u << LAT_HIST_SUB_BITS)
+
+static unsigned bucket_of(uint64_t us) {
+  if (us < SUB_COUNT) return (unsigned)us;
+  unsigned msb = 63u - (unsigned)__builtin_clzll(us);
+  unsigned shift = msb - LAT_HIST_SUB_BITS;
+  uint64_t idx = (uint64_t)shift * SUB_COUNT + (us >> shift);
+  return idx < LAT_HIST_BUCKETS ? (unsigned)idx : LAT_HIST_BUCKETS - 1;
+}
+
+// Lower bound and width of a bucket, in us.
+static void bucket_range(unsigned idx, uint64_t *lo, uint64_t *width) {
+  if (idx < 2 * SUB_COUNT) { *lo = idx; *width = 1; return; }
+  unsigned shift = idx / SUB_COUNT - 1;
+  *lo = (uint64_t)(idx - shift * SUB_COUNT) << shift;
+  *width = 1ull << shift;
+}
+
+void lat_hist_reset(struct lat_hist *h) {
+  memset(h, 0, sizeof(*h));
+}
+
+void lat_hist_record_ns(struct lat_hist *h, uint64_t ns) {
+  uint64_t us = ns / 1000u;
+  __atomic_add_fetch(&h->bucket[bucket_of(us)], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&h->sum_us, us, __ATOMIC_RELAXED);
+  uint64_t cur = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+  while (us > cur &&
+         !__atomic_compare_exchange_n(&h->max_us, &cur, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+  // count last: a reader never sees more samples than bucket entries.
+  __atomic_add_fetch(&h->count, 1, __ATOMIC_RELEASE);
+}
+
+void lat_hist_drain(struct lat_hist *dst, struct lat_hist *src) {
+  uint64_t n = __atomic_exchange_n(&src->count, 0, __ATOMIC_ACQUIRE);
+  dst->count  += n;
+  dst->sum_us += __atomic_exchange_n(&src->sum_us, 0, __ATOMIC_RELAXED);
+  uint64_t mx  = __atomic_exchange_n(&src->max_us, 0, __ATOMIC_RELAXED);
+  if (mx > dst->max_us) dst->max_us = mx;
+  for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) {
+    if (__atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED))
+      dst->bucket[i] += __atomic_exchange_n(&src->bucket[i], 0, __ATOMIC_RELAXED);
+  }
+}
+
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src) {
+  dst->count  += __atomic_load_n(&src->count, __ATOMIC_ACQUIRE);
+  dst->sum_us += __atomic_load_n(&src->sum_us, __ATOMIC_RELAXED);
+  uint64_t mx  = __atomic_load_n(&src->max_us, __ATOMIC_RELAXED);
+  if (mx > dst->max_us) dst->max_us = mx;
+  for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++)
+    dst->bucket[i] += __atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED);
+}
+
+uint64_t lat_hist_count_le_us(const struct lat_hist *h, uint64_t us) {
+  uint64_t n = 0;
+  for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) {
+    uint64_t lo, width;
+    bucket_range(i, &lo, &width);
+    if (lo + width - 1 > us) break;
+    n += h->bucket[i];
+  }
+  return n;
+}
+
+uint64_t lat_hist_percentile_us(const struct lat_hist *h, double q) {
+  if (h->count == 0) return 0;
+  if (q >= 1.0) return h->max_us;
+  uint64_t total = 0;
+  for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) total += h->bucket[i];
+  uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+  if (rank == 0) rank = 1;
+
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < LAT_HIST_BUCKETS; i++) {
+    seen += h->bucket[i];
+    if (seen >= rank) {
+      uint64_t lo, width;
+      bucket_range(i, &lo, &width);
+      uint64_t mid = lo + width / 2;
+      return mid < h->max_us ? mid : h->max_us;
+    }
+  }
+  return h->max_us;
+}
+
+void lat_hist_print(const struct lat_hist *h, const char *label, FILE *fp) {
+  if (h->count == 0) {
+    fprintf(fp, "  %-18s n=0\n", label);
+    return;
+  }
+  fprintf(fp, "  %-18s n=%-7llu mean=%7.2f p50=%7.2f p99=%7.2f p99.9=%7.2f max=%7.2f ms\n",
+          label, (unsigned long long)h->count,
+          (double)h->sum_us / (double)h->count / 1e3,
+          (double)lat_hist_percentile_us(h, 0.50) / 1e3,
+          (double)lat_hist_percentile_us(h, 0.99) / 1e3,
+          (double)lat_hist_percentile_us(h, 0.999) / 1e3,
+          (double)h->max_us / 1e3);
+}
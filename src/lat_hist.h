@@ -0,0 +1,49 @@
+// lat_hist.h
+// Fixed-memory log-linear latency histogram (microsecond resolution, ~3%
+// relative precision, up to a couple of hours). Recording is a couple of
+// relaxed atomic adds, so any thread may record while another reads.
+
+#if !defined(__LAT_HIST_H__)
+#define __LAT_HIST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define LAT_HIST_SUB_BITS  5                          // 32 buckets per octave
+#define LAT_HIST_OCTAVES   28                         // top bucket ends at 2^(28+5) us (~2.4 h)
+#define LAT_HIST_BUCKETS   ((LAT_HIST_OCTAVES + 1) << LAT_HIST_SUB_BITS)
+
+struct lat_hist {
+  uint64_t bucket[LAT_HIST_BUCKETS];
+  uint64_t count;
+  uint64_t sum_us;
+  uint64_t max_us;
+};
+
+extern void     lat_hist_reset(struct lat_hist *h);
+extern void     lat_hist_record_ns(struct lat_hist *h, uint64_t ns);
+
+// Moves everything recorded in src into dst and clears src.
+extern void     lat_hist_drain(struct lat_hist *dst, struct lat_hist *src);
+
+// Adds src into dst, leaving src as it is (src may be recording).
+extern void     lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src);
+
+// Samples in buckets that lie entirely at or below us (a cumulative count
+// for a coarser histogram, e.g. Prometheus "le" buckets).
+extern uint64_t lat_hist_count_le_us(const struct lat_hist *h, uint64_t us);
+
+// q in [0,1]; returns microseconds (bucket midpoint, or the exact max for q = 1).
+extern uint64_t lat_hist_percentile_us(const struct lat_hist *h, double q);
+
+// One line: "<label> n=.. mean=.. p50=.. p99=.. p99.9=.. max=.." in ms.
+extern void     lat_hist_print(const struct lat_hist *h, const char *label, FILE *fp);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,188 @@
+// lat_stages.c
+// See lat_stages.h.
+//
+// In-flight frames live in a small direct-mapped table keyed by PTS. A slot
+// is overwritten when a newer frame hashes to it, which only loses samples
+// for frames that have been in the pipeline far longer than the table covers.
+
+#include <string.h>
+#include <time.h>
+
+#include "lat_stages.h"
+
+#define LAT_SLOTS 256
+
+struct lat_slot {
+  guint64 pts;
+  guint64 sequence;
+  gint64  capture_ns;
+  guint64 t[LAT_STAGE_NUM];    // 0 = stage not reached yet
+};
+
+struct lat_probe {
+  lat_stages_t  *ls;
+  enum lat_stage stage;
+};
+
+struct lat_stages {
+  struct lat_slot slot[LAT_SLOTS];
+  enum lat_stage  last_stage;              // deepest attached stage
+  struct lat_hist interval[LAT_STAGE_NUM]; // written by probes
+  struct lat_hist total[LAT_STAGE_NUM];    // folded in at dump time
+  GMutex          dump_lock;
+};
+
+static const char *stage_names[LAT_STAGE_NUM] = {
+  "usb->render total", "usb->push", "push->parse", "parse->decode",
+  "decode->convert", "convert->render",
+};
+
+static const char *stage_keys[LAT_STAGE_NUM] = {
+  "total", "push", "parse", "decode", "convert", "render",
+};
+
+static guint64 mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * 1000000000ull + (guint64)ts.tv_nsec;
+}
+
+static struct lat_slot *slot_for(lat_stages_t *ls, guint64 pts) {
+  // PTS values are nanoseconds a frame interval apart; mix before masking.
+  guint64 h = (pts >> 10) * 0x9E3779B97F4A7C15ull;
+  return &ls->slot[(h >> 56) % LAT_SLOTS];
+}
+
+const char *lat_stage_name(enum lat_stage stage) {
+  return stage < LAT_STAGE_NUM ? stage_names[stage] : "?";
+}
+
+const char *lat_stage_key(enum lat_stage stage) {
+  return stage < LAT_STAGE_NUM ? stage_keys[stage] : "?";
+}
+
+lat_stages_t *lat_stages_new(void) {
+  lat_stages_t *ls = g_new0(lat_stages_t, 1);
+  g_mutex_init(&ls->dump_lock);
+  return ls;
+}
+
+void lat_stages_free(lat_stages_t *ls) {
+  if (!ls) return;
+  g_mutex_clear(&ls->dump_lock);
+  g_free(ls);
+}
+
+void lat_stages_arrival(lat_stages_t *ls, GstClockTime pts, guint64 now_ns,
+                        guint64 sequence, gint64 capture_ns) {
+  if (!GST_CLOCK_TIME_IS_VALID(pts)) return;
+  struct lat_slot *s = slot_for(ls, pts);
+  __atomic_store_n(&s->pts, GST_CLOCK_TIME_NONE, __ATOMIC_RELAXED);
+  for (int i = 1; i < LAT_STAGE_NUM; i++) __atomic_store_n(&s->t[i], 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->t[LAT_STAGE_USB], now_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->sequence, sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->capture_ns, capture_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->pts, pts, __ATOMIC_RELEASE);
+}
+
+gboolean lat_stages_lookup(lat_stages_t *ls, GstClockTime pts, struct lat_frame_info *out) {
+  if (!GST_CLOCK_TIME_IS_VALID(pts)) return FALSE;
+  struct lat_slot *s = slot_for(ls, pts);
+  if (__atomic_load_n(&s->pts, __ATOMIC_ACQUIRE) != pts) return FALSE;
+  out->sequence   = __atomic_load_n(&s->sequence, __ATOMIC_RELAXED);
+  out->capture_ns = __atomic_load_n(&s->capture_ns, __ATOMIC_RELAXED);
+  for (int i = 0; i < LAT_STAGE_NUM; i++) out->t[i] = __atomic_load_n(&s->t[i], __ATOMIC_RELAXED);
+  // Slot recycled while copying: the caller gets nothing rather than a mix.
+  return __atomic_load_n(&s->pts, __ATOMIC_ACQUIRE) == pts;
+}
+
+static void record_stage(lat_stages_t *ls, guint64 pts, enum lat_stage stage, guint64 now) {
+  struct lat_slot *s = slot_for(ls, pts);
+  if (__atomic_load_n(&s->pts, __ATOMIC_ACQUIRE) != pts) return;
+  if (__atomic_load_n(&s->t[stage], __ATOMIC_RELAXED)) return;
+
+  __atomic_store_n(&s->t[stage], now, __ATOMIC_RELAXED);
+
+  // Delta from the closest earlier stage this frame was seen at.
+  for (int prev = (int)stage - 1; prev >= 0; prev--) {
+    guint64 t = __atomic_load_n(&s->t[prev], __ATOMIC_RELAXED);
+    if (t && now >= t) {
+      lat_hist_record_ns(&ls->interval[stage], now - t);
+      break;
+    }
+  }
+  if (stage == ls->last_stage) {
+    guint64 t0 = __atomic_load_n(&s->t[LAT_STAGE_USB], __ATOMIC_RELAXED);
+    if (t0 && now >= t0) lat_hist_record_ns(&ls->interval[LAT_STAGE_USB], now - t0);
+  }
+}
+
+static GstPadProbeReturn on_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  (void)pad;
+  struct lat_probe *p = data;
+  GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+  if (!buf || !GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buf))) return GST_PAD_PROBE_OK;
+
+  record_stage(p->ls, GST_BUFFER_PTS(buf), p->stage, mono_ns());
+  return GST_PAD_PROBE_OK;
+}
+
+gboolean lat_stages_attach(lat_stages_t *ls, GstElement *element,
+                           const char *pad_name, enum lat_stage stage) {
+  if (!element || stage == LAT_STAGE_USB || stage >= LAT_STAGE_NUM) return FALSE;
+  GstPad *pad = gst_element_get_static_pad(element, pad_name);
+  if (!pad) return FALSE;
+
+  struct lat_probe *p = g_new0(struct lat_probe, 1);
+  p->ls = ls;
+  p->stage = stage;
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_buffer, p, g_free);
+  gst_object_unref(pad);
+  if (stage > ls->last_stage) ls->last_stage = stage;
+  return TRUE;
+}
+
+void lat_stages_expect(lat_stages_t *ls, enum lat_stage stage) {
+  if (stage < LAT_STAGE_NUM && stage > ls->last_stage) ls->last_stage = stage;
+}
+
+void lat_stages_mark(lat_stages_t *ls, GstClockTime pts, enum lat_stage stage, guint64 now_ns) {
+  if (!GST_CLOCK_TIME_IS_VALID(pts) || stage == LAT_STAGE_USB || stage >= LAT_STAGE_NUM) return;
+  record_stage(ls, pts, stage, now_ns);
+}
+
+void lat_stages_dump(lat_stages_t *ls, gboolean interval, FILE *fp) {
+  g_mutex_lock(&ls->dump_lock);
+  struct lat_hist *h = interval ? g_new0(struct lat_hist, LAT_STAGE_NUM) : NULL;
+  for (int i = 0; i < LAT_STAGE_NUM; i++) {
+    struct lat_hist snap;
+    lat_hist_reset(&snap);
+    lat_hist_drain(&snap, &ls->interval[i]);
+    if (h) h[i] = snap;
+    // Fold into the run totals.
+    ls->total[i].count  += snap.count;
+    ls->total[i].sum_us += snap.sum_us;
+    if (snap.max_us > ls->total[i].max_us) ls->total[i].max_us = snap.max_us;
+    for (unsigned b = 0; b < LAT_HIST_BUCKETS; b++) ls->total[i].bucket[b] += snap.bucket[b];
+  }
+
+  const struct lat_hist *show = h ? h : ls->total;
+  fprintf(fp, "Latency per stage (%s):\n", interval ? "last interval" : "whole run");
+  for (int i = 1; i <= (int)ls->last_stage; i++) lat_hist_print(&show[i], stage_names[i], fp);
+  lat_hist_print(&show[LAT_STAGE_USB], stage_names[LAT_STAGE_USB], fp);
+  g_free(h);
+  g_mutex_unlock(&ls->dump_lock);
+}
+
+void lat_stages_snapshot(lat_stages_t *ls, enum lat_stage stage, struct lat_hist *out) {
+  lat_hist_reset(out);
+  if (stage >= LAT_STAGE_NUM) return;
+  g_mutex_lock(&ls->dump_lock);
+  *out = ls->total[stage];
+  lat_hist_merge(out, &ls->interval[stage]);
+  g_mutex_unlock(&ls->dump_lock);
+}
+
+const struct lat_hist *lat_stages_total(lat_stages_t *ls, enum lat_stage stage) {
+  return stage < LAT_STAGE_NUM ? &ls->total[stage] : NULL;
+}
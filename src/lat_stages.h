@@ -0,0 +1,82 @@
+// lat_stages.h
+// Per-frame latency through the decode/output pipeline. The USB callback
+// notes each frame's arrival under its PTS; buffer probes on the pads of
+// named elements look the PTS up again and record how long the frame took
+// to get from the previous stage to this one. Histograms are fixed-size,
+// so memory does not grow with run time.
+
+#if !defined(__LAT_STAGES_H__)
+#define __LAT_STAGES_H__
+
+#include <stdio.h>
+#include <gst/gst.h>
+
+#include "lat_hist.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum lat_stage {
+  LAT_STAGE_USB = 0,     // frame callback (arrival on the host)
+  LAT_STAGE_PUSH,        // appsrc src pad
+  LAT_STAGE_PARSE,       // h264parse src pad
+  LAT_STAGE_DECODE,      // decoder src pad
+  LAT_STAGE_CONVERT,     // end of the convert/scale chain
+  LAT_STAGE_RENDER,      // output sink pad
+  LAT_STAGE_NUM
+};
+
+typedef struct lat_stages lat_stages_t;
+
+// What the table knows about a frame still in flight.
+struct lat_frame_info {
+  guint64 sequence;               // UVC frame->sequence
+  gint64  capture_ns;             // UVC frame->capture_time
+  guint64 t[LAT_STAGE_NUM];       // CLOCK_MONOTONIC per stage, 0 = not reached
+};
+
+extern lat_stages_t *lat_stages_new(void);
+extern void          lat_stages_free(lat_stages_t *ls);
+
+// Called from the frame callback once the buffer's PTS is known.
+extern void          lat_stages_arrival(lat_stages_t *ls, GstClockTime pts, guint64 now_ns,
+                                        guint64 sequence, gint64 capture_ns);
+
+// Looks a frame up by PTS, e.g. to attach its metadata to a decoded output.
+extern gboolean      lat_stages_lookup(lat_stages_t *ls, GstClockTime pts,
+                                       struct lat_frame_info *out);
+
+// Installs a buffer probe on element's pad; returns FALSE if either is missing.
+extern gboolean      lat_stages_attach(lat_stages_t *ls, GstElement *element,
+                                       const char *pad_name, enum lat_stage stage);
+
+// For stages handled outside GStreamer (e.g. an appsink callback doing the
+// conversion itself): declare the stage once before streaming, then mark
+// each frame as it gets there.
+extern void          lat_stages_expect(lat_stages_t *ls, enum lat_stage stage);
+extern void          lat_stages_mark(lat_stages_t *ls, GstClockTime pts,
+                                     enum lat_stage stage, guint64 now_ns);
+
+// Prints per-stage histograms. With interval set, only what was recorded
+// since the last interval dump is shown (and folded into the run totals);
+// otherwise the run totals are shown.
+extern void          lat_stages_dump(lat_stages_t *ls, gboolean interval, FILE *fp);
+
+// Direct access for machine-readable reports; index is the stage a frame
+// reached, LAT_STAGE_USB holds the end-to-end (USB -> last stage) total.
+extern const struct lat_hist *lat_stages_total(lat_stages_t *ls, enum lat_stage stage);
+
+// Run totals plus what the current interval has recorded so far, without
+// disturbing either; any thread.
+extern void          lat_stages_snapshot(lat_stages_t *ls, enum lat_stage stage, struct lat_hist *out);
+
+extern const char   *lat_stage_name(enum lat_stage stage);
+// Short identifier of the stage a delta ends at ("decode" for
+// parse->decode, "total" for LAT_STAGE_USB), for labels and keys.
+extern const char   *lat_stage_key(enum lat_stage stage);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
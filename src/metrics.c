@@ -0,0 +1,382 @@
+// metrics.c
+// See metrics.h. The server is a single thread polling its listening
+// socket every 200 ms; each connection is read, answered with the whole
+// exposition and closed (HTTP/1.0), so a stuck client costs at most the
+// receive timeout and never touches the capture threads.
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+#define METRICS_MAX_SHARDS  64
+#define SERVER_POLL_MS      200
+#define REQUEST_MAX         4096
+
+enum series_kind {
+  SERIES_COUNTER = 0,     // sharded
+  SERIES_HISTOGRAM,       // sharded, nbounds + 3 cells
+  SERIES_COUNTER_FN,
+  SERIES_GAUGE_FN,
+  SERIES_LATENCY_FN,
+};
+
+struct series {
+  char            *name, *help, *labels;
+  enum series_kind kind;
+  int              slot;
+  double           bounds[METRICS_MAX_BOUNDS];
+  int              nbounds;
+  metrics_value_fn vfn;
+  metrics_hist_fn  hfn;
+  void            *arg;
+};
+
+struct metrics {
+  pthread_mutex_t  lock;          // registry and shard list; writers never take it
+  struct series    s[METRICS_MAX_SERIES];
+  int              nseries;
+  int              nslots;
+  metrics_shard_t *shards[METRICS_MAX_SHARDS];
+  int              nshards;
+
+  int              fd;
+  char             unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  pthread_t        thr;
+  atomic_int       run;
+  int              listening;
+};
+
+// Prometheus latency buckets, microseconds.
+static const uint64_t k_latency_le_us[] = {
+  500, 1000, 2000, 5000, 10000, 20000, 33000, 50000, 100000, 200000, 500000, 1000000,
+};
+
+metrics_t *metrics_new(void) {
+  metrics_t *m = calloc(1, sizeof(*m));
+  if (!m) return NULL;
+  pthread_mutex_init(&m->lock, NULL);
+  m->fd = -1;
+  return m;
+}
+
+metrics_shard_t *metrics_shard_new(metrics_t *m) {
+  if (!m) return NULL;
+  // Cache-line aligned, so two threads' shards never share a line.
+  metrics_shard_t *s = aligned_alloc(64, sizeof(*s));
+  if (!s) return NULL;
+  memset(s, 0, sizeof(*s));
+  pthread_mutex_lock(&m->lock);
+  if (m->nshards < METRICS_MAX_SHARDS) m->shards[m->nshards++] = s;
+  else { free(s); s = NULL; }
+  pthread_mutex_unlock(&m->lock);
+  return s;
+}
+
+static struct series *add_series(metrics_t *m, const char *name, const char *help,
+                                 const char *labels, enum series_kind kind, int cells) {
+  if (!m) return NULL;
+  struct series *s = NULL;
+  pthread_mutex_lock(&m->lock);
+  if (m->nseries < METRICS_MAX_SERIES && m->nslots + cells <= METRICS_MAX_SLOTS) {
+    s = &m->s[m->nseries++];
+    s->name   = strdup(name);
+    s->help   = strdup(help ? help : "");
+    s->labels = labels && *labels ? strdup(labels) : NULL;
+    s->kind   = kind;
+    s->slot   = cells ? m->nslots : -1;
+    m->nslots += cells;
+  } else {
+    fprintf(stderr, "metrics: no room for %s\n", name);
+  }
+  pthread_mutex_unlock(&m->lock);
+  return s;
+}
+
+int metrics_counter(metrics_t *m, const char *name, const char *help, const char *labels) {
+  struct series *s = add_series(m, name, help, labels, SERIES_COUNTER, 1);
+  return s ? s->slot : -1;
+}
+
+int metrics_histogram(metrics_t *m, const char *name, const char *help, const char *labels,
+                      const double *bounds, int nbounds) {
+  if (nbounds < 1 || nbounds > METRICS_MAX_BOUNDS) return -1;
+  struct series *s = add_series(m, name, help, labels, SERIES_HISTOGRAM, nbounds + 3);
+  if (!s) return -1;
+  memcpy(s->bounds, bounds, (size_t)nbounds * sizeof(*bounds));
+  s->nbounds = nbounds;
+  return s->slot;
+}
+
+void metrics_counter_fn(metrics_t *m, const char *name, const char *help, const char *labels,
+                        metrics_value_fn fn, void *arg) {
+  struct series *s = add_series(m, name, help, labels, SERIES_COUNTER_FN, 0);
+  if (s) { s->vfn = fn; s->arg = arg; }
+}
+
+void metrics_gauge_fn(metrics_t *m, const char *name, const char *help, const char *labels,
+                      metrics_value_fn fn, void *arg) {
+  struct series *s = add_series(m, name, help, labels, SERIES_GAUGE_FN, 0);
+  if (s) { s->vfn = fn; s->arg = arg; }
+}
+
+void metrics_latency_fn(metrics_t *m, const char *name, const char *help, const char *labels,
+                        metrics_hist_fn fn, void *arg) {
+  struct series *s = add_series(m, name, help, labels, SERIES_LATENCY_FN, 0);
+  if (s) { s->hfn = fn; s->arg = arg; }
+}
+
+/* ---------- Exposition ---------- */
+
+static uint64_t cell_sum(const metrics_t *m, int slot) {
+  uint64_t v = 0;
+  for (int i = 0; i < m->nshards; ++i) v += __atomic_load_n(&m->shards[i]->v[slot], __ATOMIC_RELAXED);
+  return v;
+}
+
+static const char *type_name(enum series_kind k) {
+  switch (k) {
+  case SERIES_COUNTER: case SERIES_COUNTER_FN:      return "counter";
+  case SERIES_GAUGE_FN:                             return "gauge";
+  case SERIES_HISTOGRAM: case SERIES_LATENCY_FN:    return "histogram";
+  }
+  return "untyped";
+}
+
+// name{labels,le="x"} — the braces only when there is something in them.
+static void series_name(FILE *fp, const struct series *s, const char *suffix, const char *le) {
+  fprintf(fp, "%s%s", s->name, suffix);
+  if (!s->labels && !le) return;
+  fprintf(fp, "{%s%s", s->labels ? s->labels : "", s->labels && le ? "," : "");
+  if (le) fprintf(fp, "le=\"%s\"", le);
+  fputc('}', fp);
+}
+
+static void render_series(FILE *fp, const metrics_t *m, const struct series *s, struct lat_hist *h) {
+  char le[32];
+  switch (s->kind) {
+  case SERIES_COUNTER:
+    series_name(fp, s, "", NULL);
+    fprintf(fp, " %llu\n", (unsigned long long)cell_sum(m, s->slot));
+    break;
+  case SERIES_COUNTER_FN:
+  case SERIES_GAUGE_FN:
+    series_name(fp, s, "", NULL);
+    fprintf(fp, " %.9g\n", s->vfn(s->arg));
+    break;
+  case SERIES_HISTOGRAM: {
+    uint64_t cum = 0;
+    for (int b = 0; b <= s->nbounds; ++b) {
+      cum += cell_sum(m, s->slot + b);
+      if (b < s->nbounds) snprintf(le, sizeof(le), "%.9g", s->bounds[b]);
+      else                snprintf(le, sizeof(le), "+Inf");
+      series_name(fp, s, "_bucket", le);
+      fprintf(fp, " %llu\n", (unsigned long long)cum);
+    }
+    series_name(fp, s, "_sum", NULL);
+    fprintf(fp, " %llu\n", (unsigned long long)cell_sum(m, s->slot + s->nbounds + 1));
+    // The +Inf bucket, so that a scrape racing a writer stays consistent.
+    series_name(fp, s, "_count", NULL);
+    fprintf(fp, " %llu\n", (unsigned long long)cum);
+    break;
+  }
+  case SERIES_LATENCY_FN: {
+    lat_hist_reset(h);
+    s->hfn(s->arg, h);
+    uint64_t total = 0;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; ++i) total += h->bucket[i];
+    for (size_t b = 0; b < sizeof(k_latency_le_us) / sizeof(k_latency_le_us[0]); ++b) {
+      snprintf(le, sizeof(le), "%g", (double)k_latency_le_us[b] / 1e6);
+      series_name(fp, s, "_bucket", le);
+      fprintf(fp, " %llu\n", (unsigned long long)lat_hist_count_le_us(h, k_latency_le_us[b]));
+    }
+    series_name(fp, s, "_bucket", "+Inf");
+    fprintf(fp, " %llu\n", (unsigned long long)total);
+    series_name(fp, s, "_sum", NULL);
+    fprintf(fp, " %.6f\n", (double)h->sum_us / 1e6);
+    series_name(fp, s, "_count", NULL);
+    fprintf(fp, " %llu\n", (unsigned long long)total);
+    break;
+  }
+  }
+}
+
+// Series of one name are grouped under a single HELP/TYPE, in the order
+// the name was first registered.
+static char *render(metrics_t *m, size_t *len) {
+  char *buf = NULL;
+  FILE *fp = open_memstream(&buf, len);
+  if (!fp) return NULL;
+  struct lat_hist *h = malloc(sizeof(*h));
+  pthread_mutex_lock(&m->lock);
+  unsigned char done[METRICS_MAX_SERIES] = {0};
+  for (int i = 0; i < m->nseries; ++i) {
+    if (done[i]) continue;
+    const struct series *s = &m->s[i];
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", s->name, s->help, s->name, type_name(s->kind));
+    for (int j = i; j < m->nseries; ++j) {
+      if (done[j] || strcmp(m->s[j].name, s->name) != 0) continue;
+      done[j] = 1;
+      if (m->s[j].kind == SERIES_LATENCY_FN && !h) continue;
+      render_series(fp, m, &m->s[j], h);
+    }
+  }
+  pthread_mutex_unlock(&m->lock);
+  free(h);
+  if (fclose(fp) != 0) { free(buf); return NULL; }
+  return buf;
+}
+
+/* ---------- Server ---------- */
+
+static void send_all(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return;
+    p += w;
+    n -= (size_t)w;
+  }
+}
+
+static void serve(metrics_t *m, int fd) {
+  struct timeval tv = { 1, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  char req[REQUEST_MAX];
+  size_t got = 0;
+  while (got < sizeof(req) - 1) {
+    ssize_t r = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+    if (r <= 0) break;
+    got += (size_t)r;
+    req[got] = '\0';
+    if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+  }
+  req[got] = '\0';
+
+  char head[256];
+  if (strncmp(req, "GET /metrics", 12) != 0 && strncmp(req, "GET / ", 6) != 0) {
+    static const char nf[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    send_all(fd, nf, sizeof(nf) - 1);
+    return;
+  }
+  size_t len = 0;
+  char *body = render(m, &len);
+  if (!body) return;
+  int n = snprintf(head, sizeof(head),
+                   "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                   "Content-Length: %zu\r\nConnection: close\r\n\r\n", len);
+  send_all(fd, head, (size_t)n);
+  send_all(fd, body, len);
+  free(body);
+}
+
+static void *server_thread(void *arg) {
+  metrics_t *m = arg;
+  while (atomic_load(&m->run)) {
+    struct pollfd pfd = { m->fd, POLLIN, 0 };
+    if (poll(&pfd, 1, SERVER_POLL_MS) <= 0) continue;
+    int c = accept(m->fd, NULL, NULL);
+    if (c < 0) continue;
+    serve(m, c);
+    close(c);
+  }
+  return NULL;
+}
+
+static int open_tcp(const char *addr) {
+  char host[64] = "127.0.0.1";
+  const char *colon = strrchr(addr, ':');
+  const char *port = addr;
+  if (colon) {
+    size_t n = (size_t)(colon - addr);
+    if (n == 0 || n >= sizeof(host)) return -1;
+    memcpy(host, addr, n);
+    host[n] = '\0';
+    port = colon + 1;
+  }
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons((uint16_t)atoi(port));
+  if (atoi(port) <= 0 || inet_pton(AF_INET, host, &sa.sin_addr) != 1) return -1;
+
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 8) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int open_unix(metrics_t *m, const char *path) {
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(sa.sun_path)) return -1;
+  strcpy(sa.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  unlink(path);   // left over from a previous run
+  if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 8) != 0) {
+    close(fd);
+    return -1;
+  }
+  strcpy(m->unix_path, path);
+  return fd;
+}
+
+int metrics_listen(metrics_t *m, const char *addr) {
+  if (!m || m->listening) return -1;
+  m->fd = !strncmp(addr, "unix:", 5) ? open_unix(m, addr + 5) : open_tcp(addr);
+  if (m->fd < 0) {
+    fprintf(stderr, "metrics: cannot listen on %s: %s\n", addr, strerror(errno));
+    return -1;
+  }
+  atomic_store(&m->run, 1);
+  if (pthread_create(&m->thr, NULL, server_thread, m) != 0) {
+    close(m->fd);
+    m->fd = -1;
+    return -1;
+  }
+  m->listening = 1;
+  return 0;
+}
+
+void metrics_shutdown(metrics_t *m) {
+  if (!m || !m->listening) return;
+  atomic_store(&m->run, 0);
+  pthread_join(m->thr, NULL);
+  close(m->fd);
+  m->fd = -1;
+  if (m->unix_path[0]) unlink(m->unix_path);
+  m->listening = 0;
+}
+
+void metrics_free(metrics_t *m) {
+  if (!m) return;
+  metrics_shutdown(m);
+  for (int i = 0; i < m->nseries; ++i) {
+    free(m->s[i].name);
+    free(m->s[i].help);
+    free(m->s[i].labels);
+  }
+  for (int i = 0; i < m->nshards; ++i) free(m->shards[i]);
+  pthread_mutex_destroy(&m->lock);
+  free(m);
+}
@@ -0,0 +1,97 @@
+// metrics.h
+// Live statistics in the Prometheus text format, served over HTTP on a
+// local TCP port or a Unix socket (curl --unix-socket PATH http://x/metrics).
+//
+// Counters and histograms updated on the hot path live in per-thread
+// shards: each writing thread owns one, and an update is a relaxed load and
+// store to its own cache lines, with no lock, no read-modify-write and no
+// sharing. A scrape sums the shards. Values that other modules already keep
+// (ring occupancy, shed counts, latency histograms, Vicon receive stats) are
+// registered as callbacks and read only when scraped, on the server thread.
+//
+// Series are registered before metrics_listen(); the same name may be
+// registered several times with different labels (one per camera, say) and
+// is rendered as one family. A NULL registry or shard turns every call into
+// a no-op, so callers need no checks of their own when metrics are off.
+
+#if !defined(__METRICS_H__)
+#define __METRICS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lat_hist.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define METRICS_MAX_SLOTS    512     // counter cells per shard
+#define METRICS_MAX_SERIES   256
+#define METRICS_MAX_BOUNDS   16      // histogram buckets, +Inf excluded
+
+typedef struct metrics metrics_t;
+
+// One writer thread's cells. Only that thread updates it.
+typedef struct metrics_shard {
+  uint64_t v[METRICS_MAX_SLOTS];
+} metrics_shard_t;
+
+// Reads a value kept elsewhere, on the server thread, at scrape time.
+typedef double (*metrics_value_fn)(void *arg);
+// Fills a latency histogram (microseconds) for a scrape.
+typedef void   (*metrics_hist_fn)(void *arg, struct lat_hist *out);
+
+extern metrics_t *metrics_new(void);
+
+// addr: "PORT" or "HOST:PORT" (TCP, HOST defaults to 127.0.0.1), or
+// "unix:PATH". Starts the server thread. Returns 0 on success.
+extern int        metrics_listen(metrics_t *m, const char *addr);
+
+// Stops the server: no callback runs after this returns. Shards stay valid
+// until metrics_free(), so writers may still be running.
+extern void       metrics_shutdown(metrics_t *m);
+extern void       metrics_free(metrics_t *m);
+
+// A shard for the calling thread (NULL when m is NULL or on failure).
+extern metrics_shard_t *metrics_shard_new(metrics_t *m);
+
+// Registration. labels are Prometheus label pairs without braces, e.g.
+// "camera=\"A123\",stage=\"decode\"", or NULL. The strings are copied.
+// Sharded counters and histograms return a slot id for metrics_add() /
+// metrics_observe(), -1 when m is NULL or full.
+extern int  metrics_counter(metrics_t *m, const char *name, const char *help, const char *labels);
+extern int  metrics_histogram(metrics_t *m, const char *name, const char *help, const char *labels,
+                              const double *bounds, int nbounds);
+extern void metrics_counter_fn(metrics_t *m, const char *name, const char *help, const char *labels,
+                               metrics_value_fn fn, void *arg);
+extern void metrics_gauge_fn(metrics_t *m, const char *name, const char *help, const char *labels,
+                             metrics_value_fn fn, void *arg);
+// Rendered in seconds on fixed bucket bounds from 0.5 ms to 1 s.
+extern void metrics_latency_fn(metrics_t *m, const char *name, const char *help, const char *labels,
+                               metrics_hist_fn fn, void *arg);
+
+// Hot path. Single writer per shard: no atomic read-modify-write needed,
+// the relaxed store only keeps a concurrent scrape from seeing a torn value.
+static inline void metrics_add(metrics_shard_t *s, int id, uint64_t n) {
+  if (!s || id < 0) return;
+  __atomic_store_n(&s->v[id], __atomic_load_n(&s->v[id], __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+// A histogram slot id is followed by one cell per bucket (+Inf last), then
+// the sum and the count. bounds must be the ones it was registered with;
+// values are summed as integers (bytes, microseconds).
+static inline void metrics_observe(metrics_shard_t *s, int id, const double *bounds, int nbounds,
+                                   double value) {
+  if (!s || id < 0) return;
+  int b = 0;
+  while (b < nbounds && value > bounds[b]) ++b;
+  metrics_add(s, id + b, 1);
+  metrics_add(s, id + nbounds + 1, (uint64_t)value);
+  metrics_add(s, id + nbounds + 2, 1);
+}
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
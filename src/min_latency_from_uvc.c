@@ -1,35 +1,229 @@
 // min_latency_from_uvc.c
 // Ultra-low-latency THETA → GStreamer via libuvc/thetauvc.
-// - Opens THETA with libuvc + thetauvc helper to negotiate H.264
-// - Pipes H.264 bytes into GStreamer appsrc (Annex-B / byte-stream)
+// - Drives each camera through libthetacap (theta_cap.h): it opens and
+//   negotiates H.264, gates on the first IDR, sheds under backlog, stamps
+//   camera-clock PTS and queues the access units; this program only watches
+//   them go by (metrics, recording, fan-out, ingest health)
+// - Pipes the queued H.264 into GStreamer appsrc (Annex-B / byte-stream)
 // - Decodes with avdec_h264 (CPU) or nvh264dec (--nvdec)
 // - Uses leaky queue + appsink drop=true to always process the latest frame
+// - Converts to BGR with videoconvert, or in-process with SIMD kernels
+//   split across cores (--convert simd)
+// - Optionally reprojects each frame into cubemap faces / pinhole views,
+//   each published to its own shared-memory ring
+// - Several cameras (--serial, repeatable) share one libuvc context; each
+//   gets its own ingest thread, pipeline and outputs, optionally pinned to
+//   its own cores (--pin)
+// - Optionally steps each camera between UHD and FHD at run time to stay
+//   within a latency budget (--adapt-budget)
+// - Reconnects a camera that stops delivering (stall, unplug) without
+//   tearing down its pipeline or outputs
+// - Starts fast: the camera is opened on its own thread while GStreamer
+//   initialises and the pipeline prerolls, the last negotiated mode is
+//   reused, and the startup timeline is printed at the first output frame
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <ctype.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
 
 #include <libuvc/libuvc.h>
 #include "thetauvc.h"   // local header in your repo (matches thetauvc.c)
+#include "h264_nal.h"
+#include "tcap.h"
+#include "lat_stages.h"
+#include "shm_ring.h"
+#include "band_pool.h"
+#include "yuv2bgr.h"
+#include "reproject.h"
+#include "mode_ctl.h"
+#include "metrics.h"
+#include "stream_watch.h"
+#include "theta_cap_dev.h"
+#include "h264_fanout.h"
+#include "ingest_mon.h"
+
+// Decoded BGR output geometry
+#define OUT_WIDTH  3840
+#define OUT_HEIGHT 1920
+
+#define MAX_CAMERAS 8
+
+enum output_mode {
+  OUTPUT_SHMSINK = 0,   // GStreamer shmsink on /tmp/theta_bgr.sock
+  OUTPUT_SHMRING,       // native seqlock ring (shm_ring.h), never blocks
+};
+
+enum convert_mode {
+  CONVERT_GST = 0,      // videoconvert, plus videoscale only if the size differs
+  CONVERT_SIMD,         // yuv2bgr.h straight into the shm ring slot
+};
+
+// Threads that carry one camera's frames, for pinning and the CPU column
+// of the stats line.
+enum cam_thread {
+  THR_USB = 0,          // libuvc callback (or replay player), in the library
+  THR_PUSH,             // the library's push thread: frame ring -> appsrc
+  THR_SRC,              // appsrc streaming task
+  THR_DEC,              // first queue's task: h264parse, decoder, convert
+  THR_OUT,              // second queue's task: sink / on_*_sample()
+  THR_N
+};
+static const char *const k_thr_names[THR_N] = { "usb", "push", "src", "dec", "out" };
+
+// CPU clock of one thread, captured from inside it on first use.
+struct thr_clock {
+  clockid_t id;
+  int       state;      // atomic: 0 not seen yet, 1 id valid, -1 unavailable
+  guint64   last_ns;    // reporter side
+};
+
+struct cam;
+struct pin_site { struct cam *cam; enum cam_thread role; };
+
+// Startup timeline. Each mark is the first time a camera got there, set
+// once by whichever thread does; the opener, main and streaming threads
+// overlap, so marks are not in order.
+enum startup_mark {
+  SM_UVC_INIT = 0,      // libuvc context up (opener thread)
+  SM_GST_INIT,          // gst_init() done (main thread)
+  SM_OPENED,            // device found and opened
+  SM_NEGOTIATED,        // stream control known (probed or from the cache)
+  SM_PIPELINE,          // pipeline built
+  SM_PLAYING,           // set to PLAYING
+  SM_STREAMING,         // uvc_start_streaming() returned
+  SM_FIRST_FRAME,       // first access unit from USB
+  SM_FIRST_IDR,         // first IDR: decoding can start
+  SM_DECODED,           // first frame out of the decoder
+  SM_OUTPUT,            // first BGR frame at the output
+  SM_NUM
+};
+static const char *const k_sm_names[SM_NUM] = {
+  "uvc_init", "gst_init", "opened", "negotiated", "pipeline", "playing", "streaming",
+  "first_frame", "first_idr", "decoded", "output",
+};
+
+// Everything that belongs to one camera, from its USB callback to its outputs.
+struct cam {
+  int          index;
+  const char  *serial;        // --serial, NULL = first THETA found
+  const char  *replay_path;   // --replay: capture file instead of a camera
+  const char  *pin_arg;       // --pin as given, for the stats line
+  cpu_set_t    cpus;
+  gboolean     pinned;
+  char         tag[32];       // names this camera's outputs and log lines
+
+  theta_cap_t *cap;             // ingest: USB (or replay) up to the queued access units
+  gboolean     cached;          // mode from the mode cache, not probed yet
+  unsigned int built_w, built_h;   // size the pipeline was built for
+  guint64      sm[SM_NUM];      // startup marks, monotonic ns
+  unsigned int mode, dec_w, dec_h, dec_fps;
+
+  GstElement  *pipeline;
+  GstElement  *appsrc;
+  gboolean     eos;           // the pipeline's EOS: a replay played to the end
+  tcap_writer_t *recorder;    // --record: raw frames as received
+  gchar       *record_path;
+  lat_stages_t *lat;          // per-stage latency histograms
+  shm_ring_writer_t *shm;     // --output shmring
+  band_pool_t *bands;         // --convert simd / reprojection workers
+  h264_fanout_t *fanout;      // --h264-out: raw AUs to local subscribers
+  ingest_mon_t *ingest;       // USB ingest health (recorded from the libuvc thread)
+  struct ingest_mon_summary ingest_sum;   // stats timer, last summary
+
+  reproject_t       *rp[REPROJECT_MAX_VIEWS];
+  shm_ring_writer_t *view_shm[REPROJECT_MAX_VIEWS];
+  gboolean           views_failed;
+  guint64            rp_frames, rp_ns, rp_max_ns;
+
+  // --adapt-budget: live mode switching. With follow_size the BGR output
+  // takes whatever size the decoder's caps carry.
+  gboolean     adaptive;
+  mode_ctl_t   adapt;
+  gboolean     follow_size;
+  guint64      win_lat_sum, win_lat_max, win_frames;   // output thread -> adapt timer
+  guint64      win_shed;                               // adapt timer only
+  gint         switch_pending;                         // first new-mode frame not out yet
+  GstClockTime switch_pts;
+  guint64      switch_start_ns;
+
+  // Written by the output thread, read by the stats timer.
+  guint64 frames_out;
+  guint64 first_out_ns, last_out_ns;   // for the --stats-json rate
+  // --metrics: one shard per thread that counts, slot ids from registration.
+  metrics_shard_t *ms[THR_N];
+  struct {
+    int received, bytes, size, gaps, pushed, push_errors, output;
+  } mid;
+  struct cam_stage_ref { struct cam *c; enum lat_stage stage; } lat_ref[LAT_STAGE_NUM];
+  struct cam_alert_ref { struct cam *c; int alert; } alert_ref[INGEST_ALERT_NUM];
+  struct thr_clock clk[THR_N];
+  struct pin_site  sites[THR_N];
+
+  // Stats timer state
+  guint64 last_report_ns, last_allocs, last_in, last_out;
+};
 
 static GMainLoop *g_loop = NULL;
-static GstElement *g_pipeline = NULL;
-static GstElement *g_appsrc  = NULL;
 
 static gboolean  g_use_nvdec = FALSE;
 static int       g_arg_fps   = 30;     // requested FPS for caps timing only
 static int       g_arg_w     = 3840;   // requested H.264 mode (fallback to 1920x960)
 static int       g_arg_h     = 1920;
+static guint     g_arg_pool  = THETA_CAP_DEFAULT_POOL;  // 0 = per-frame allocation
+static guint     g_arg_ring  = THETA_CAP_DEFAULT_RING;
+static enum theta_cap_overflow g_arg_overflow = THETA_CAP_OVERFLOW_AUTO;
+static enum theta_cap_shed g_arg_shed = THETA_CAP_SHED_GOP;
+static guint     g_arg_shed_high = 0;   // ring occupancy that counts as congestion (0 = depth/2)
+static const char *g_arg_record = NULL;
+static double    g_arg_replay_speed = 1.0; // 0 = as fast as possible
+static gboolean  g_arg_replay_loop = FALSE;
+static guint     g_arg_lat_report = 10; // seconds between latency dumps, 0 = summary only
+static const char *g_arg_stats_json = NULL;  // end-of-run summary, one JSON line per camera
+static const char *g_arg_metrics = NULL;     // Prometheus endpoint: PORT, HOST:PORT or unix:PATH
+static guint     g_arg_stall_frames = STREAM_WATCH_DEFAULT_STALL_FRAMES;  // 0 = no reconnects
+static double    g_arg_replay_stall_s = 0;    // --replay-stall: fault every N s of stream
+static double    g_arg_replay_down_s = 0;     // ... "unplugged" for this long
+static metrics_t *g_metrics = NULL;
+// theta_usb_frame_bytes buckets: 16 KiB .. 4 MiB
+#define N_SIZE_BOUNDS 9
+static const double k_size_bounds[N_SIZE_BOUNDS] = {
+  16384, 32768, 65536, 131072, 262144, 524288, 1048576, 2097152, 4194304,
+};
+static enum output_mode g_arg_output = OUTPUT_SHMSINK;
+static gboolean  g_arg_output_set = FALSE;
+static enum convert_mode g_arg_convert = CONVERT_GST;
+static int       g_arg_convert_threads = 0;  // 0 = one per CPU (per pinned CPU with --pin)
+static int       g_arg_convert_impl = SIMD_AUTO;
+static const char *g_arg_shm_name = SHM_RING_DEFAULT_NAME;
+static guint     g_arg_shm_slots = SHM_RING_DEFAULT_SLOTS;
+static guint     g_arg_adapt_budget_ms = 0;   // 0 = fixed mode
+static guint     g_arg_adapt_window_ms = 500;
+static const char *g_arg_h264_out = NULL;    // socket base name, ".sock" appended
+static guint     g_arg_h264_out_mb = H264_FANOUT_DEFAULT_MB;
+static guint     g_arg_ingest_window = INGEST_MON_DEFAULT_WINDOW;
+static double    g_arg_ingest_late_ms = 0;   // 0 = half a frame interval
+
+static gint64    g_t0_ns = 0;     // host monotonic time of PTS 0, every camera's
+static guint64   g_launch_ns = 0; // main() entry, origin of the startup timeline
+
+static struct cam g_cams[MAX_CAMERAS];
+static int        g_ncams = 0;
 
-static GTimer   *g_timer = NULL;
-static guint64   g_frames = 0;
-static guint64   g_last_report_ns = 0;
+// --view / --cubemap: reprojected outputs, one ring each per camera
+static struct reproject_view g_views[REPROJECT_MAX_VIEWS];
+static int                g_nviews = 0;
 
 static guint64 now_monotonic_ns(void) {
   struct timespec ts;
@@ -37,27 +231,162 @@ static guint64 now_monotonic_ns(void) {
   return (guint64)ts.tv_sec * 1000000000ull + (guint64)ts.tv_nsec;
 }
 
+static void sm_set(struct cam *c, enum startup_mark m, guint64 t) {
+  guint64 zero = 0;
+  if (t) __atomic_compare_exchange_n(&c->sm[m], &zero, t, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void sm_mark(struct cam *c, enum startup_mark m) {
+  sm_set(c, m, now_monotonic_ns());
+}
+
 static void on_sigint(int sig) {
   (void)sig;
   if (g_loop) g_main_loop_quit(g_loop);
 }
 
+// "2,3" or "4-7" or "0-1,6".
+static int parse_cpu_list(const char *s, cpu_set_t *set) {
+  CPU_ZERO(set);
+  while (*s) {
+    char *end;
+    long lo = strtol(s, &end, 10), hi = lo;
+    if (end == s || lo < 0) return -1;
+    if (*end == '-') {
+      s = end + 1;
+      hi = strtol(s, &end, 10);
+      if (end == s || hi < lo) return -1;
+    }
+    if (hi >= CPU_SETSIZE) return -1;
+    for (long c = lo; c <= hi; ++c) CPU_SET((int)c, set);
+    if (*end == ',') end++;
+    else if (*end) return -1;
+    s = end;
+  }
+  return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+// First call from a camera thread: move it onto the camera's cores and
+// remember its CPU clock for the stats line. Later calls are one load.
+static void note_thread(struct cam *c, enum cam_thread role) {
+  struct thr_clock *k = &c->clk[role];
+  if (__atomic_load_n(&k->state, __ATOMIC_ACQUIRE) != 0) return;
+  if (c->pinned) pthread_setaffinity_np(pthread_self(), sizeof(c->cpus), &c->cpus);
+  int ok = pthread_getcpuclockid(pthread_self(), &k->id) == 0;
+  __atomic_store_n(&k->state, ok ? 1 : -1, __ATOMIC_RELEASE);
+}
+
+// GStreamer's streaming threads may come from a shared pool, so they are
+// pinned from a probe the first time they carry this camera's data.
+static GstPadProbeReturn on_thread_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  (void)pad; (void)info;
+  struct pin_site *site = data;
+  note_thread(site->cam, site->role);
+  return GST_PAD_PROBE_OK;
+}
+
+// Startup timeline, once per camera, from the main loop.
+static gboolean startup_report(gpointer data) {
+  struct cam *c = data;
+  GString *line = g_string_new(NULL);
+  for (int m = 0; m < SM_NUM; ++m) {
+    if (!c->sm[m]) continue;
+    g_string_append_printf(line, "%s %s %.0f%s", line->len ? "," : "", k_sm_names[m],
+                           (double)(c->sm[m] - g_launch_ns) / 1e6,
+                           m == SM_NEGOTIATED && c->cached ? " (cached)" : "");
+  }
+  g_print("[%s] startup, ms from launch:%s\n", c->tag, line->str);
+  g_string_free(line, TRUE);
+  return G_SOURCE_REMOVE;
+}
+
+// A frame has been published: feed the mode controller's window and close
+// out a pending mode switch once the first frame of the new stream is out.
+static void note_output(struct cam *c, GstClockTime pts) {
+  if (!__atomic_load_n(&c->sm[SM_OUTPUT], __ATOMIC_RELAXED)) {
+    struct lat_frame_info fi;
+    if (lat_stages_lookup(c->lat, pts, &fi) && fi.t[LAT_STAGE_DECODE]) {
+      guint64 zero = 0;
+      __atomic_compare_exchange_n(&c->sm[SM_DECODED], &zero, fi.t[LAT_STAGE_DECODE], FALSE,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    sm_mark(c, SM_OUTPUT);
+    g_idle_add(startup_report, c);
+  }
+  if (!c->adaptive) return;
+  guint64 now = now_monotonic_ns();
+  struct lat_frame_info fi;
+  if (lat_stages_lookup(c->lat, pts, &fi) && fi.t[LAT_STAGE_USB] && now > fi.t[LAT_STAGE_USB]) {
+    guint64 lat = now - fi.t[LAT_STAGE_USB];
+    __atomic_add_fetch(&c->win_lat_sum, lat, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->win_frames, 1, __ATOMIC_RELAXED);
+    if (lat > __atomic_load_n(&c->win_lat_max, __ATOMIC_RELAXED))
+      __atomic_store_n(&c->win_lat_max, lat, __ATOMIC_RELAXED);
+  }
+  if (g_atomic_int_get(&c->switch_pending) && GST_CLOCK_TIME_IS_VALID(pts) && pts >= c->switch_pts &&
+      g_atomic_int_compare_and_exchange(&c->switch_pending, 1, 0)) {
+    g_print("[%s] mode switch complete: first %ux%u frame out %.0f ms after the switch began\n",
+            c->tag, c->dec_w, c->dec_h, (double)(now - c->switch_start_ns) / 1e6);
+  }
+}
+
+static GstPadProbeReturn on_out_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  (void)pad;
+  struct cam *c = data;
+  note_thread(c, THR_OUT);
+  __atomic_add_fetch(&c->frames_out, 1, __ATOMIC_RELAXED);
+  metrics_add(c->ms[THR_OUT], c->mid.output, 1);
+  if (g_arg_stats_json) {
+    guint64 now = now_monotonic_ns(), zero = 0;
+    __atomic_compare_exchange_n(&c->first_out_ns, &zero, now, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->last_out_ns, now, __ATOMIC_RELAXED);
+  }
+  // The SIMD path converts after the sink pad and reports from on_yuv_sample().
+  GstBuffer *buf = (info->type & GST_PAD_PROBE_TYPE_BUFFER) ? GST_PAD_PROBE_INFO_BUFFER(info) : NULL;
+  if (buf && g_arg_convert != CONVERT_SIMD) note_output(c, GST_BUFFER_PTS(buf));
+  return GST_PAD_PROBE_OK;
+}
+
+// Threads inherit their creator's affinity: whatever gets created while the
+// main thread wears a camera's CPU set (band pool, push thread, libuvc and
+// replay threads, decoder workers) starts out on that camera's cores.
+static void pin_scope_enter(const struct cam *c, cpu_set_t *saved) {
+  if (!c->pinned) return;
+  pthread_getaffinity_np(pthread_self(), sizeof(*saved), saved);
+  pthread_setaffinity_np(pthread_self(), sizeof(c->cpus), &c->cpus);
+}
+
+static void pin_scope_leave(const struct cam *c, const cpu_set_t *saved) {
+  if (c->pinned) pthread_setaffinity_np(pthread_self(), sizeof(*saved), saved);
+}
+
 static gboolean bus_log(GstBus *bus, GstMessage *msg, gpointer data) {
-  (void)bus; (void)data;
+  (void)bus;
+  struct cam *c = data;
   switch (GST_MESSAGE_TYPE(msg)) {
     case GST_MESSAGE_ERROR: {
       GError *err = NULL; gchar *dbg = NULL;
       gst_message_parse_error(msg, &err, &dbg);
-      g_printerr("ERROR from %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+      g_printerr("[%s] ERROR from %s: %s\n", c->tag, GST_OBJECT_NAME(msg->src), err->message);
       if (dbg) g_printerr("  Debug: %s\n", dbg);
       g_clear_error(&err); g_free(dbg);
       if (g_loop) g_main_loop_quit(g_loop);
       break;
     }
+    case GST_MESSAGE_EOS: {
+      // Only a replay without loop ends: the run does once every camera's
+      // last frame is out of its pipeline.
+      c->eos = TRUE;
+      for (int i = 0; i < g_ncams; ++i)
+        if (!g_cams[i].eos) return TRUE;
+      g_print("Replay finished.\n");
+      if (g_loop) g_main_loop_quit(g_loop);
+      break;
+    }
     case GST_MESSAGE_WARNING: {
       GError *err = NULL; gchar *dbg = NULL;
       gst_message_parse_warning(msg, &err, &dbg);
-      g_printerr("WARN  from %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
+      g_printerr("[%s] WARN  from %s: %s\n", c->tag, GST_OBJECT_NAME(msg->src), err->message);
       if (dbg) g_printerr("  Debug: %s\n", dbg);
       g_clear_error(&err); g_free(dbg);
       break;
@@ -67,98 +396,1315 @@ static gboolean bus_log(GstBus *bus, GstMessage *msg, gpointer data) {
   return TRUE;
 }
 
-static void build_pipeline(void) {
+// With one camera every output keeps its historical name; with several,
+// each name gets the camera's tag so the outputs don't collide.
+static gchar *cam_output_name(const struct cam *c, const char *base) {
+  if (g_ncams == 1) return g_strdup(base);
+  return g_strdup_printf("%s_%s", base, c->tag);
+}
+
+// --record out.tcap with several cameras: out_<tag>.tcap, ...
+static gchar *cam_record_path(const struct cam *c, const char *path) {
+  if (g_ncams == 1) return g_strdup(path);
+  const char *slash = strrchr(path, '/');
+  const char *dot = strrchr(path, '.');
+  if (!dot || (slash && dot < slash)) return g_strdup_printf("%s_%s", path, c->tag);
+  return g_strdup_printf("%.*s_%s%s", (int)(dot - path), path, c->tag, dot);
+}
+
+// Tag from the serial, or the capture file name for replays; only
+// characters that are safe in shm and file names are kept.
+static void cam_make_tag(struct cam *c) {
+  const char *src = c->serial;
+  if (!src && c->replay_path) {
+    const char *slash = strrchr(c->replay_path, '/');
+    src = slash ? slash + 1 : c->replay_path;
+  }
+  size_t n = 0;
+  for (; src && *src && *src != '.' && n + 1 < sizeof(c->tag); ++src)
+    c->tag[n++] = (isalnum((unsigned char)*src) || *src == '-') ? *src : '_';
+  c->tag[n] = '\0';
+  if (n == 0) snprintf(c->tag, sizeof(c->tag), "cam%d", c->index);
+}
+
+// Renders the configured views from one decoded BGR frame and publishes each
+// to its own ring with the source frame's metadata. Tables are built on the
+// first frame and rebuilt only if the source geometry changes.
+static void publish_views(struct cam *c, const guint8 *bgr, int w, int h, int stride,
+                          const struct shm_ring_slot *src_meta) {
+  if (g_nviews == 0 || c->views_failed) return;
+
+  if (!reproject_matches(c->rp[0], w, h, stride)) {
+    guint64 t0 = now_monotonic_ns();
+    size_t bytes = 0;
+    for (int i = 0; i < g_nviews; ++i) {
+      reproject_free(c->rp[i]);
+      c->rp[i] = reproject_new(&g_views[i], w, h, stride);
+      if (!c->rp[i]) {
+        g_printerr("[%s] Cannot build reprojection table for view %s; views disabled\n",
+                   c->tag, g_views[i].name);
+        c->views_failed = TRUE;
+        return;
+      }
+      bytes += reproject_table_bytes(c->rp[i]);
+    }
+    g_print("[%s] Reproject: %d views from %dx%d, tables built in %.0f ms (%.1f MB)\n",
+            c->tag, g_nviews, w, h,
+            (double)(now_monotonic_ns() - t0) / 1e6, (double)bytes / (1024.0 * 1024.0));
+  }
+
+  guint8 *dst[REPROJECT_MAX_VIEWS];
+  int dst_stride[REPROJECT_MAX_VIEWS];
+  for (int i = 0; i < g_nviews; ++i) {
+    dst[i] = shm_ring_begin_write(c->view_shm[i]);
+    dst_stride[i] = g_views[i].width * 3;
+  }
+  guint64 t0 = now_monotonic_ns();
+  reproject_run(c->rp, g_nviews, bgr, dst, dst_stride, c->bands);
+  guint64 dt = now_monotonic_ns() - t0;
+
+  for (int i = 0; i < g_nviews; ++i) {
+    struct shm_ring_slot meta = *src_meta;
+    meta.width  = (guint32)g_views[i].width;
+    meta.height = (guint32)g_views[i].height;
+    meta.stride = (guint32)dst_stride[i];
+    meta.bytes  = (guint64)dst_stride[i] * (guint64)g_views[i].height;
+    shm_ring_commit(c->view_shm[i], &meta);
+  }
+  __atomic_add_fetch(&c->rp_frames, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&c->rp_ns, dt, __ATOMIC_RELAXED);
+  if (dt > c->rp_max_ns) __atomic_store_n(&c->rp_max_ns, dt, __ATOMIC_RELAXED);
+}
+
+static void views_report(const struct cam *c) {
+  guint64 n = __atomic_load_n(&c->rp_frames, __ATOMIC_RELAXED);
+  if (g_nviews == 0 || n == 0) return;
+  g_print("[%s] Reproject: %llu frames, %.2f ms/frame avg, %.2f ms max\n", c->tag,
+          (unsigned long long)n,
+          (double)__atomic_load_n(&c->rp_ns, __ATOMIC_RELAXED) / 1e6 / (double)n,
+          (double)__atomic_load_n(&c->rp_max_ns, __ATOMIC_RELAXED) / 1e6);
+}
+
+// --output shmring: copy each decoded BGR frame into the next ring slot,
+// tagged with the UVC sequence/capture time and the decode-done time.
+static GstFlowReturn on_bgr_sample(GstAppSink *sink, gpointer data) {
+  struct cam *c = data;
+  GstSample *sample = gst_app_sink_pull_sample(sink);
+  if (!sample) return GST_FLOW_EOS;
+
+  GstBuffer *buf = gst_sample_get_buffer(sample);
+  GstStructure *st = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+  gint w = OUT_WIDTH, h = OUT_HEIGHT;
+  gst_structure_get_int(st, "width", &w);
+  gst_structure_get_int(st, "height", &h);
+
+  GstMapInfo map;
+  if (buf && gst_buffer_map(buf, &map, GST_MAP_READ)) {
+    struct shm_ring_slot meta;
+    struct lat_frame_info fi;
+    memset(&meta, 0, sizeof(meta));
+    if (lat_stages_lookup(c->lat, GST_BUFFER_PTS(buf), &fi)) {
+      meta.sequence   = fi.sequence;
+      meta.capture_ns = fi.capture_ns;
+      meta.decode_ns  = (gint64)fi.t[LAT_STAGE_DECODE];
+    }
+    size_t n = MIN(map.size, shm_ring_slot_capacity(c->shm));
+    memcpy(shm_ring_begin_write(c->shm), map.data, n);
+    meta.format = SHM_RING_FMT_BGR;
+    meta.width  = (guint32)w;
+    meta.height = (guint32)h;
+    meta.stride = h > 0 ? (guint32)(map.size / (gsize)h) : 0;
+    meta.bytes  = n;
+    shm_ring_commit(c->shm, &meta);
+    publish_views(c, map.data, w, h, (int)meta.stride, &meta);
+    gst_buffer_unmap(buf, &map);
+  }
+  gst_sample_unref(sample);
+  return GST_FLOW_OK;
+}
+
+// Only the appsink sees the allocation query; advertising GstVideoMeta lets
+// the decoder hand over its own padded frames instead of copying each one
+// into a tightly packed buffer first.
+static GstPadProbeReturn on_sink_query(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  (void)pad; (void)data;
+  GstQuery *q = GST_PAD_PROBE_INFO_QUERY(info);
+  if (GST_QUERY_TYPE(q) == GST_QUERY_ALLOCATION)
+    gst_query_add_allocation_meta(q, GST_VIDEO_META_API_TYPE, NULL);
+  return GST_PAD_PROBE_OK;
+}
+
+// --convert simd: the decoder's 4:2:0 frame is converted to BGR directly
+// into the next ring slot, with no intermediate BGR buffer.
+static GstFlowReturn on_yuv_sample(GstAppSink *sink, gpointer data) {
+  struct cam *c = data;
+  GstSample *sample = gst_app_sink_pull_sample(sink);
+  if (!sample) return GST_FLOW_EOS;
+
+  GstBuffer *buf = gst_sample_get_buffer(sample);
+  GstVideoInfo info;
+  GstVideoFrame vf;
+  if (buf && gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) &&
+      gst_video_frame_map(&vf, &info, buf, GST_MAP_READ)) {
+    int w = GST_VIDEO_FRAME_WIDTH(&vf), h = GST_VIDEO_FRAME_HEIGHT(&vf);
+    size_t stride = (size_t)w * 3;
+    if (stride * (size_t)h <= shm_ring_slot_capacity(c->shm)) {
+      gboolean nv12 = GST_VIDEO_FRAME_FORMAT(&vf) == GST_VIDEO_FORMAT_NV12;
+      struct yuv2bgr_src src = {
+        .layout   = nv12 ? YUV2BGR_NV12 : YUV2BGR_I420,
+        .width    = w,
+        .height   = h,
+        .y        = GST_VIDEO_FRAME_PLANE_DATA(&vf, 0),
+        .y_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&vf, 0),
+        .u        = GST_VIDEO_FRAME_PLANE_DATA(&vf, 1),
+        .u_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&vf, 1),
+        .v        = nv12 ? NULL : GST_VIDEO_FRAME_PLANE_DATA(&vf, 2),
+        .v_stride = nv12 ? 0 : GST_VIDEO_FRAME_PLANE_STRIDE(&vf, 2),
+      };
+      // Untagged streams follow GStreamer's default: BT.709 from HD up.
+      int matrix;
+      switch (info.colorimetry.matrix) {
+        case GST_VIDEO_COLOR_MATRIX_BT601: matrix = YUV2BGR_BT601; break;
+        case GST_VIDEO_COLOR_MATRIX_BT709: matrix = YUV2BGR_BT709; break;
+        default: matrix = h >= 720 ? YUV2BGR_BT709 : YUV2BGR_BT601; break;
+      }
+
+      struct shm_ring_slot meta;
+      struct lat_frame_info fi;
+      memset(&meta, 0, sizeof(meta));
+      if (lat_stages_lookup(c->lat, GST_BUFFER_PTS(buf), &fi)) {
+        meta.sequence   = fi.sequence;
+        meta.capture_ns = fi.capture_ns;
+        meta.decode_ns  = (gint64)fi.t[LAT_STAGE_DECODE];
+      }
+      guint8 *slot = shm_ring_begin_write(c->shm);
+      yuv2bgr_convert(&src, matrix, slot, (int)stride, c->bands);
+      lat_stages_mark(c->lat, GST_BUFFER_PTS(buf), LAT_STAGE_CONVERT, now_monotonic_ns());
+
+      meta.format = SHM_RING_FMT_BGR;
+      meta.width  = (guint32)w;
+      meta.height = (guint32)h;
+      meta.stride = (guint32)stride;
+      meta.bytes  = stride * (size_t)h;
+      shm_ring_commit(c->shm, &meta);
+      lat_stages_mark(c->lat, GST_BUFFER_PTS(buf), LAT_STAGE_RENDER, now_monotonic_ns());
+      note_output(c, GST_BUFFER_PTS(buf));
+      // Only this thread writes the ring, so the slot stays intact to read.
+      publish_views(c, slot, w, h, (int)stride, &meta);
+    }
+    gst_video_frame_unmap(&vf);
+  }
+  gst_sample_unref(sample);
+  return GST_FLOW_OK;
+}
+
+static void add_thread_probe(struct cam *c, const char *element, const char *pad_name,
+                             enum cam_thread role, GstPadProbeCallback cb, gpointer data) {
+  GstElement *e = gst_bin_get_by_name(GST_BIN(c->pipeline), element);
+  GstPad *pad = e ? gst_element_get_static_pad(e, pad_name) : NULL;
+  if (pad) {
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_DATA_DOWNSTREAM, cb, data, NULL);
+    gst_object_unref(pad);
+  } else {
+    g_printerr("[%s] %s thread probe on %s.%s not installed\n", c->tag, k_thr_names[role],
+               element, pad_name);
+  }
+  if (e) gst_object_unref(e);
+}
+
+// Builds the camera's pipeline for its negotiated size (0 = unknown).
+static void build_pipeline(struct cam *c) {
   const char *decoder = g_use_nvdec ? "nvh264dec" : "avdec_h264";
+  gboolean same_size = c->dec_w == OUT_WIDTH && c->dec_h == OUT_HEIGHT;
+  c->built_w = c->dec_w;
+  c->built_h = c->dec_h;
+  // A switching camera's output either follows the decoded size (shmring
+  // slots carry their geometry) or, for shmsink readers that cannot see a
+  // caps change, stays at the fixed output size through videoscale.
+  c->follow_size = c->adaptive && g_arg_output == OUTPUT_SHMRING;
+  if (c->adaptive && !c->follow_size) same_size = FALSE;
+  // Pinned cameras size their worker pools to their own cores.
+  int threads = g_arg_convert_threads;
+  if (threads == 0 && c->pinned) threads = CPU_COUNT(&c->cpus);
+
+  gchar *sink;
+  if (g_arg_output == OUTPUT_SHMRING) {
+    sink = g_strdup("appsink name=out sync=false max-buffers=1 drop=true");
+  } else {
+    gchar *sock = cam_output_name(c, "/tmp/theta_bgr");
+    sink = g_strdup_printf("shmsink name=out socket-path=%s.sock shm-size=67108864 "
+                           "wait-for-connection=true sync=false", sock);
+    g_free(sock);
+  }
+
+  // Everything after the decoder. The SIMD path stops at raw 4:2:0 and does
+  // the rest in on_yuv_sample(); videoscale is only worth its pass over the
+  // frame when the decoded size actually differs from the output.
+  gchar *convert_str;
+  if (g_arg_convert == CONVERT_SIMD) {
+    convert_str = g_strdup("video/x-raw,format=(string){I420,NV12} ! ");
+  } else if (c->follow_size) {
+    // No size in the caps: a mode switch renegotiates from the decoder's
+    // new caps, with nothing to update ahead of the frames.
+    convert_str = g_strdup_printf(
+      "videoconvert n-threads=%d name=conv ! video/x-raw,format=BGR ! ", threads);
+  } else {
+    convert_str = g_strdup_printf(
+      "videoconvert n-threads=%d%s ! %s"
+      "video/x-raw,format=BGR,width=%d,height=%d ! ",
+      threads, same_size ? " name=conv" : "",
+      same_size ? "" : "videoscale name=conv ! ", OUT_WIDTH, OUT_HEIGHT);
+  }
 
   gchar *pipeline_str = g_strdup_printf(
     "appsrc name=ap is-live=true block=true format=time "
       "caps=video/x-h264,stream-format=byte-stream,alignment=au ! "
-    "queue max-size-buffers=4 leaky=no ! "
-    "h264parse config-interval=-1 disable-passthrough=true ! "
+    "queue name=inq max-size-buffers=4 leaky=no ! "
+    "h264parse name=parse config-interval=-1 disable-passthrough=true ! "
     "video/x-h264,alignment=au,stream-format=avc ! "
-    "%s ! "
-    "videoconvert ! videoscale ! "
-    "video/x-raw,format=BGR,width=3840,height=1920 ! "
+    "%s name=dec ! "
+    "%s"
     "queue max-size-buffers=1 leaky=downstream ! "
-    "shmsink socket-path=/tmp/theta_bgr.sock shm-size=67108864 wait-for-connection=true sync=false",
-    decoder
+    "%s",
+    decoder, convert_str, sink
   );
+  g_free(convert_str);
+  g_free(sink);
 
-  g_print("Pipeline:\n  %s\n", pipeline_str);
+  g_print("[%s] Pipeline:\n  %s\n", c->tag, pipeline_str);
 
   GError *err = NULL;
-  g_pipeline = gst_parse_launch(pipeline_str, &err);
+  c->pipeline = gst_parse_launch(pipeline_str, &err);
   g_free(pipeline_str);
-  if (!g_pipeline || err) g_error("Failed to create pipeline: %s", err ? err->message : "unknown");
+  if (!c->pipeline || err) g_error("Failed to create pipeline: %s", err ? err->message : "unknown");
 
-  g_appsrc = gst_bin_get_by_name(GST_BIN(g_pipeline), "ap");
-  g_object_set(g_appsrc, "stream-type", 0, "format", GST_FORMAT_TIME, NULL);
+  c->appsrc = gst_bin_get_by_name(GST_BIN(c->pipeline), "ap");
+  g_object_set(c->appsrc, "stream-type", 0, "format", GST_FORMAT_TIME, NULL);
 
-  GstBus *bus = gst_element_get_bus(g_pipeline);
-  gst_bus_add_watch(bus, (GstBusFunc)bus_log, NULL);
+  GstBus *bus = gst_element_get_bus(c->pipeline);
+  gst_bus_add_watch(bus, (GstBusFunc)bus_log, c);
   gst_object_unref(bus);
+
+  if (g_arg_output == OUTPUT_SHMRING) {
+    // BGR rows are padded to 4 bytes by GStreamer; the SIMD path writes the
+    // decoded size unscaled and unpadded.
+    // A switching camera may later decode the largest mode.
+    size_t frame_bytes = (size_t)((OUT_WIDTH * 3 + 3) & ~3) * OUT_HEIGHT;
+    unsigned int max_w = c->dec_w, max_h = c->dec_h;
+    if (c->adaptive) thetauvc_get_mode_size(0, &max_w, &max_h, NULL);
+    frame_bytes = MAX(frame_bytes, (size_t)((max_w * 3 + 3) & ~3) * max_h);
+    gchar *name = cam_output_name(c, g_arg_shm_name);
+    c->shm = shm_ring_writer_create(name, g_arg_shm_slots, frame_bytes);
+    if (!c->shm) g_error("Cannot create shared-memory ring %s", name);
+    g_print("[%s] Output: shared-memory ring %s, %u slots x %zu bytes\n",
+            c->tag, name, g_arg_shm_slots, frame_bytes);
+
+    GstElement *out = gst_bin_get_by_name(GST_BIN(c->pipeline), "out");
+    GstAppSinkCallbacks cbs = {
+      .new_sample = g_arg_convert == CONVERT_SIMD ? on_yuv_sample : on_bgr_sample,
+    };
+    gst_app_sink_set_callbacks(GST_APP_SINK(out), &cbs, c, NULL);
+    if (g_arg_convert == CONVERT_SIMD) {
+      GstPad *pad = gst_element_get_static_pad(out, "sink");
+      gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, on_sink_query, NULL, NULL);
+      gst_object_unref(pad);
+    }
+    gst_object_unref(out);
+
+    for (int i = 0; i < g_nviews; ++i) {
+      gchar *vname = g_strdup_printf("%s_%s", name, g_views[i].name);
+      size_t bytes = (size_t)g_views[i].width * 3 * (size_t)g_views[i].height;
+      c->view_shm[i] = shm_ring_writer_create(vname, g_arg_shm_slots, bytes);
+      if (!c->view_shm[i]) g_error("Cannot create shared-memory ring %s", vname);
+      g_print("[%s] Output: view %s (yaw %.1f, pitch %.1f, fov %.1f, %dx%d) -> %s\n", c->tag,
+              g_views[i].name, g_views[i].yaw, g_views[i].pitch, g_views[i].fov,
+              g_views[i].width, g_views[i].height, vname);
+      g_free(vname);
+    }
+    g_free(name);
+  }
+
+  if (g_arg_convert == CONVERT_SIMD || g_nviews > 0)
+    c->bands = band_pool_new(threads);
+  if (g_nviews > 0)
+    g_print("[%s] Reproject: %s sampling, %d threads\n", c->tag,
+            simd_level_name(reproject_select(g_arg_convert_impl)), band_pool_threads(c->bands));
+
+  if (g_arg_convert == CONVERT_SIMD) {
+    int impl = yuv2bgr_select(g_arg_convert_impl);
+    if (g_arg_convert_impl != SIMD_AUTO && impl != g_arg_convert_impl)
+      g_printerr("warning: %s conversion not supported on this CPU\n", simd_level_name(g_arg_convert_impl));
+    g_print("[%s] Convert: %s, %d threads, %ux%u unscaled\n", c->tag,
+            simd_level_name(impl), band_pool_threads(c->bands), c->dec_w, c->dec_h);
+  } else {
+    g_print("[%s] Convert: videoconvert%s\n", c->tag,
+            c->follow_size ? " (output follows the decoded size)" :
+            same_size ? " (no scaling, sizes match)" : " + videoscale");
+  }
+
+  // Thread identity: pinning and per-thread CPU for the stats line.
+  for (int r = 0; r < THR_N; ++r) c->sites[r] = (struct pin_site){ c, (enum cam_thread)r };
+  add_thread_probe(c, "ap",  "src",  THR_SRC, on_thread_probe, &c->sites[THR_SRC]);
+  add_thread_probe(c, "inq", "src",  THR_DEC, on_thread_probe, &c->sites[THR_DEC]);
+  add_thread_probe(c, "out", "sink", THR_OUT, on_out_buffer, c);
+
+  // Stage probes, keyed by the PTS the library stamps (see on_admitted()).
+  static const struct { const char *element, *pad; enum lat_stage stage; } probes[] = {
+    { "ap",    "src",  LAT_STAGE_PUSH    },
+    { "parse", "src",  LAT_STAGE_PARSE   },
+    { "dec",   "src",  LAT_STAGE_DECODE  },
+    { "conv",  "src",  LAT_STAGE_CONVERT },
+    { "out",   "sink", LAT_STAGE_RENDER  },
+  };
+  c->lat = lat_stages_new();
+  for (size_t i = 0; i < G_N_ELEMENTS(probes); ++i) {
+    // The SIMD path marks convert/render itself from on_yuv_sample().
+    if (g_arg_convert == CONVERT_SIMD && probes[i].stage >= LAT_STAGE_CONVERT) {
+      lat_stages_expect(c->lat, probes[i].stage);
+      continue;
+    }
+    GstElement *e = gst_bin_get_by_name(GST_BIN(c->pipeline), probes[i].element);
+    if (!lat_stages_attach(c->lat, e, probes[i].pad, probes[i].stage))
+      g_printerr("[%s] latency probe on %s.%s not installed\n", c->tag, probes[i].element, probes[i].pad);
+    if (e) gst_object_unref(e);
+  }
 }
 
+static gboolean lat_report(gpointer data) {
+  (void)data;
+  for (int i = 0; i < g_ncams; ++i) {
+    if (g_ncams > 1) g_print("[%s]\n", g_cams[i].tag);
+    lat_stages_dump(g_cams[i].lat, TRUE, stdout);
+    theta_cap_dump_clock(g_cams[i].cap, TRUE, stdout);
+    if (g_cams[i].ingest) ingest_mon_print(&g_cams[i].ingest_sum, stdout);
+    views_report(&g_cams[i]);
+  }
+  return TRUE;
+}
 
+static double thread_cpu_pct(struct thr_clock *k, double dt_ns) {
+  if (__atomic_load_n(&k->state, __ATOMIC_ACQUIRE) != 1) return -1.0;
+  struct timespec ts;
+  if (clock_gettime(k->id, &ts) != 0) return -1.0;   // thread gone
+  guint64 ns = (guint64)ts.tv_sec * 1000000000ull + (guint64)ts.tv_nsec;
+  double pct = k->last_ns ? (double)(ns - k->last_ns) * 100.0 / dt_ns : 0.0;
+  k->last_ns = ns;
+  return pct;
+}
 
+// Alert changes from the last ingest summary, with what points at the cause.
+static void ingest_alerts(const struct cam *c, const struct ingest_mon_summary *s) {
+  for (int a = 0; a < INGEST_ALERT_NUM; ++a) {
+    const char *name = ingest_alert_name((enum ingest_alert)a);
+    if (s->cleared & (1u << a)) g_print("[%s] ingest ok: %s cleared\n", c->tag, name);
+    if (!(s->raised & (1u << a))) continue;
+    switch ((enum ingest_alert)a) {
+    case INGEST_ALERT_GAPS:
+      g_printerr("[%s] ingest alert: %s, %llu frames lost on USB in the last %u\n", c->tag, name,
+                 (unsigned long long)s->gaps, s->frames);
+      break;
+    case INGEST_ALERT_USB_LATE:
+      g_printerr("[%s] ingest alert: %s, %u normal-size frames late vs the camera clock "
+                 "(p99 %.1f ms, max %.1f ms): held up on the bus or host USB stack\n",
+                 c->tag, name, s->late_usb, s->late_p99_ms, s->late_max_ms);
+      break;
+    case INGEST_ALERT_ENCODER_LATE:
+      g_printerr("[%s] ingest alert: %s, %u large frames late vs the camera clock "
+                 "(p99 %.1f ms, max %.1f ms, AU max %.0f KB): encoder output bursts\n",
+                 c->tag, name, s->late_encoder, s->late_p99_ms, s->late_max_ms, s->size_max / 1024.0);
+      break;
+    case INGEST_ALERT_BURST:
+      g_printerr("[%s] ingest alert: %s, %.1f Mbit/s over the last second vs %.1f average\n",
+                 c->tag, name, s->bitrate_now_bps / 1e6, s->bitrate_avg_bps / 1e6);
+      break;
+    case INGEST_ALERT_IDR:
+      g_printerr("[%s] ingest alert: %s, IDR interval %.0f ms, last IDR %.0f ms ago\n",
+                 c->tag, name, s->idr_interval_ms, s->idr_age_ms);
+      break;
+    default:
+      break;
+    }
+  }
+}
 
+// Per-camera stats line. "in" counts frames off USB, "out" frames reaching
+// the sink; with the threads' CPU share this shows whether a camera's cores
+// keep up, and which thread is the one that doesn't.
+static void cam_report(struct cam *c, guint64 t) {
+  double dt = (double)(t - c->last_report_ns);
+  if (dt <= 0) return;
 
+  struct theta_cap_stats st;
+  theta_cap_get_stats(c->cap, &st, TRUE);
+  guint64 in  = st.frames_in;
+  guint64 out = __atomic_load_n(&c->frames_out, __ATOMIC_RELAXED);
+  double in_fps  = (double)(in - c->last_in) * 1e9 / dt;
+  double out_fps = (double)(out - c->last_out) * 1e9 / dt;
 
-static void push_h264_to_gst(const uint8_t *data, size_t len) {
-  if (!g_appsrc || !data || len == 0) return;
+  g_print("[%s] in %.1f fps, out %.1f fps%s  usb gaps %llu  pushed %llu\n", c->tag,
+          in_fps, out_fps, in_fps > 1.0 && out_fps < in_fps * 0.95 ? " (falling behind)" : "",
+          (unsigned long long)st.seq_gaps, (unsigned long long)st.pushed);
+  g_print("  allocs/s: %.1f  (pool hits %llu, total allocs %llu)\n",
+          (double)(st.allocs - c->last_allocs) * 1e9 / dt,
+          (unsigned long long)st.pool_hits, (unsigned long long)st.allocs);
+  g_print("  ring: %u/%u queued, peak %u, overwritten %llu, rejected %llu, max residency %.1f ms\n",
+          st.ring_queued, st.ring_depth, st.ring_peak,
+          (unsigned long long)st.ring_overwritten, (unsigned long long)st.ring_rejected,
+          (double)st.ring_max_residency_ns / 1e6);
+  g_print("  shed (%s): %llu frames in %llu runs, recovery last %.1f ms, max %.1f ms\n",
+          theta_cap_shed_name(g_arg_shed),
+          (unsigned long long)st.shed, (unsigned long long)st.shed_runs,
+          (double)st.shed_recovery_last_ns / 1e6, (double)st.shed_recovery_max_ns / 1e6);
 
-  GstBuffer *buf = gst_buffer_new_allocate(NULL, len, NULL);
-  GstMapInfo map;
-  gst_buffer_map(buf, &map, GST_MAP_WRITE);
-  memcpy(map.data, data, len);
-  gst_buffer_unmap(buf, &map);
+  char cpu[160];
+  int n = 0;
+  for (int r = 0; r < THR_N && n < (int)sizeof(cpu); ++r) {
+    double pct = thread_cpu_pct(&c->clk[r], dt);
+    if (pct < 0) n += snprintf(cpu + n, sizeof(cpu) - (size_t)n, " %s -", k_thr_names[r]);
+    else         n += snprintf(cpu + n, sizeof(cpu) - (size_t)n, " %s %.0f%%", k_thr_names[r], pct);
+  }
+  g_print("  cpu:%s%s%s\n", cpu, c->pinned ? "  cores " : "", c->pinned ? c->pin_arg : "");
+
+  if (c->ingest) {
+    ingest_mon_update(c->ingest, (int64_t)t, &c->ingest_sum);
+    ingest_alerts(c, &c->ingest_sum);
+  }
 
-  // Timestamp the buffer using a monotonic timer for stable cadence
-  gdouble elapsed = g_timer ? g_timer_elapsed(g_timer, NULL) : 0.0;
-  GST_BUFFER_PTS(buf) = (GstClockTime)(elapsed * GST_SECOND);
-  GST_BUFFER_DTS(buf) = GST_CLOCK_TIME_NONE;
+  c->last_allocs = st.allocs;
+  c->last_in = in;
+  c->last_out = out;
+  c->last_report_ns = t;
+}
 
+static gboolean stats_report(gpointer data) {
+  (void)data;
+  guint64 t = now_monotonic_ns();
+  for (int i = 0; i < g_ncams; ++i) cam_report(&g_cams[i], t);
+  return TRUE;
+}
+
+// Push-thread side: hand one queued access unit to appsrc. appsrc runs with
+// block=true, so a slow decoder stalls this thread, never the USB one.
+static void push_h264_to_gst(struct cam *c, GstBuffer *buf) {
   GstFlowReturn ret;
-  g_signal_emit_by_name(g_appsrc, "push-buffer", buf, &ret);
+  g_signal_emit_by_name(c->appsrc, "push-buffer", buf, &ret);
   gst_buffer_unref(buf);
 
   if (ret != GST_FLOW_OK) {
-    g_printerr("push-buffer failed: %d\n", ret);
+    g_printerr("[%s] push-buffer failed: %d\n", c->tag, ret);
+    metrics_add(c->ms[THR_PUSH], c->mid.push_errors, 1);
   }
+  metrics_add(c->ms[THR_PUSH], c->mid.pushed, 1);
+}
 
-  // Lightweight stats
-  g_frames++;
-  guint64 t = now_monotonic_ns();
-  if (t - g_last_report_ns > 2ull * 1000000000ull) {
-    g_print("Frames pushed: %llu\n", (unsigned long long)g_frames);
-    g_last_report_ns = t;
+// The library's sink: its push thread hands over each queued access unit,
+// stamped with the camera-clock PTS the latency probes key on.
+static void on_access_unit(theta_cap_t *cap, GstBuffer *buf, void *user) {
+  (void)cap;
+  struct cam *c = user;
+  note_thread(c, THR_PUSH);
+  push_h264_to_gst(c, buf);
+}
+
+// Every access unit off USB, on the libuvc thread. Recording, subscribers
+// and the ingest monitor get the stream as received: before IDR gating and
+// shedding, which are about this process's own decoder.
+static void on_received(theta_cap_t *cap, const struct theta_cap_au *au, void *user) {
+  (void)cap;
+  struct cam *c = user;
+  note_thread(c, THR_USB);
+  if (!c->sm[SM_FIRST_FRAME]) sm_mark(c, SM_FIRST_FRAME);
+  metrics_shard_t *ms = c->ms[THR_USB];
+  metrics_add(ms, c->mid.received, 1);
+  metrics_add(ms, c->mid.bytes, au->size);
+  metrics_observe(ms, c->mid.size, k_size_bounds, N_SIZE_BOUNDS, (double)au->size);
+  if (au->gap) metrics_add(ms, c->mid.gaps, au->gap);
+
+  if (c->recorder)
+    tcap_writer_write(c->recorder, au->data, au->size, (uint32_t)au->sequence, au->capture_ns,
+                      au->idr ? TCAP_FLAG_IDR : 0);
+  ingest_mon_frame(c->ingest, au->sequence, (uint32_t)au->size, au->idr,
+                   (int64_t)au->arrival_ns, au->expected_ns);
+  if (c->fanout) {
+    struct h264_au_info info = { .has_idr = au->idr, .has_sps = au->sps, .has_pps = au->pps };
+    h264_fanout_publish(c->fanout, au->data, au->size, &info, au->sequence,
+                        (int64_t)au->pts + g_t0_ns, au->capture_ns);
+  }
+}
+
+// Admitted for decoding: per-stage latency starts here, keyed by the PTS.
+static void on_admitted(theta_cap_t *cap, const struct theta_cap_au *au, void *user) {
+  (void)cap;
+  struct cam *c = user;
+  lat_stages_arrival(c->lat, (GstClockTime)au->pts, au->arrival_ns, au->sequence, au->capture_ns);
+  if (au->idr && !c->sm[SM_FIRST_IDR]) sm_mark(c, SM_FIRST_IDR);
+}
+
+// Reconnect or mode switch: the new callback thread is a new thread, to be
+// pinned and clocked again, and the ingest sequence starts over.
+static void on_restarted(theta_cap_t *cap, void *user) {
+  (void)cap;
+  struct cam *c = user;
+  c->clk[THR_USB].last_ns = 0;
+  __atomic_store_n(&c->clk[THR_USB].state, 0, __ATOMIC_RELEASE);
+  ingest_mon_restart(c->ingest);
+}
+
+// The library's view of one camera: everything up to the queued access units.
+static void cam_config(const struct cam *c, struct theta_cap_config *cfg) {
+  theta_cap_config_defaults(cfg);
+  cfg->serial          = c->serial;
+  cfg->replay_path     = c->replay_path;
+  cfg->replay_speed    = g_arg_replay_speed;
+  cfg->replay_loop     = g_arg_replay_loop;
+  cfg->width           = g_arg_w;
+  cfg->height          = g_arg_h;
+  cfg->stall_frames    = g_arg_stall_frames;
+  cfg->ring            = g_arg_ring;
+  cfg->overflow        = g_arg_overflow;
+  cfg->shed            = g_arg_shed;
+  cfg->shed_high       = g_arg_shed_high;
+  cfg->pool            = g_arg_pool;
+  cfg->t0_ns           = g_t0_ns;
+  cfg->replay_stall_ns = (uint64_t)(g_arg_replay_stall_s * 1e9);
+  cfg->replay_down_ns  = (uint64_t)(g_arg_replay_down_s * 1e9);
+  cfg->tag             = c->tag;
+}
+
+// Before the camera is open: the mode it will most likely stream, so the
+// pipeline can be built for that size meanwhile. A cache hit also means no
+// negotiation at all; otherwise the requested mode is the best guess.
+static void cam_predict(struct cam *c) {
+  struct theta_cap_config cfg;
+  cam_config(c, &cfg);
+  c->cached = theta_cap_predict_mode(&cfg, &c->mode, &c->dec_w, &c->dec_h, &c->dec_fps);
+}
+
+// Finds the camera by serial and settles its mode, from the mode cache or
+// by negotiation; a replay takes it from the file.
+static void cam_open(struct cam *c) {
+  struct theta_cap_config cfg;
+  char err[256];
+  cam_config(c, &cfg);
+  c->cap = theta_cap_open(&cfg, err, sizeof(err));
+  if (!c->cap) g_error("[%s] %s", c->tag, err);
+  int cached;
+  theta_cap_get_mode(c->cap, &c->mode, &cached);
+  theta_cap_get_size(c->cap, &c->dec_w, &c->dec_h, &c->dec_fps);
+  c->cached = cached;
+  if (c->replay_path) {
+    g_print("[%s] Replaying %s: %ux%u (mode %u), speed %s\n", c->tag, c->replay_path,
+            c->dec_w, c->dec_h, c->mode, g_arg_replay_speed > 0 ? "paced" : "unthrottled");
+    return;
+  }
+  struct theta_cap_stats st;
+  theta_cap_get_stats(c->cap, &st, FALSE);
+  sm_set(c, SM_UVC_INIT, st.usb_init_ns);
+  sm_set(c, SM_OPENED, st.opened_ns);
+  sm_set(c, SM_NEGOTIATED, st.negotiated_ns);
+  if (c->cached) g_print("[%s] thetauvc: mode index %u from the mode cache\n", c->tag, c->mode);
+  else           g_print("[%s] thetauvc: selected mode index %u\n", c->tag, c->mode);
+}
+
+// Opens the live cameras while main initialises GStreamer and prerolls
+// their pipelines. libuvc's context comes up with the first one: it starts
+// libusb and its event thread, which takes a while.
+static gpointer opener_thread_fn(gpointer data) {
+  (void)data;
+  for (int i = 0; i < g_ncams; ++i)
+    if (!g_cams[i].replay_path) cam_open(&g_cams[i]);
+  return NULL;
+}
+
+// Renegotiates a live camera to another stream mode while its pipeline
+// keeps running. The decoder picks the new size up from the next SPS and
+// the output follows its caps. Runs on the main loop; the library stops the
+// stream, renegotiates and restarts it.
+static gboolean cam_switch_mode(struct cam *c, unsigned int mode, const char *why) {
+  unsigned int w, h;
+  if (thetauvc_get_mode_size(mode, &w, &h, NULL) != UVC_SUCCESS) return FALSE;
+  unsigned int old_w = c->dec_w, old_h = c->dec_h;
+  guint64 t0 = now_monotonic_ns();
+  c->switch_pts = (GstClockTime)(t0 - (guint64)g_t0_ns);
+  c->switch_start_ns = t0;
+
+  // The new callback thread starts out on the camera's cores.
+  cpu_set_t saved;
+  pin_scope_enter(c, &saved);
+  gboolean ok = theta_cap_set_mode(c->cap, mode) == 0;
+  pin_scope_leave(c, &saved);
+  if (!ok) return FALSE;
+
+  c->mode = mode;
+  theta_cap_get_size(c->cap, &c->dec_w, &c->dec_h, &c->dec_fps);
+  g_atomic_int_set(&c->switch_pending, 1);
+  g_print("[%s] mode %ux%u -> %ux%u (%s): stream stopped, renegotiated and restarted in %.0f ms\n",
+          c->tag, old_w, old_h, w, h, why, (double)(now_monotonic_ns() - t0) / 1e6);
+  return TRUE;
+}
+
+// --adapt-budget: one controller window per tick for every live camera.
+static gboolean adapt_tick(gpointer data) {
+  (void)data;
+  guint64 now = now_monotonic_ns();
+  for (int i = 0; i < g_ncams; ++i) {
+    struct cam *c = &g_cams[i];
+    if (!c->adaptive) continue;
+    struct theta_cap_stats st;
+    theta_cap_get_stats(c->cap, &st, FALSE);
+    if (st.stalled) continue;
+    guint64 lost = st.shed + st.ring_overwritten + st.ring_rejected;
+
+    struct mode_ctl_sample smp = {
+      .frames   = (unsigned)__atomic_exchange_n(&c->win_frames, 0, __ATOMIC_RELAXED),
+      .backlog  = st.ring_queued >= st.shed_high,
+      .shed     = lost != c->win_shed,
+    };
+    guint64 sum = __atomic_exchange_n(&c->win_lat_sum, 0, __ATOMIC_RELAXED);
+    smp.lat_max_ns  = __atomic_exchange_n(&c->win_lat_max, 0, __ATOMIC_RELAXED);
+    smp.lat_mean_ns = smp.frames ? sum / smp.frames : 0;
+    c->win_shed = lost;
+
+    enum mode_ctl_action a = mode_ctl_update(&c->adapt, &smp, now);
+    if (a == MODE_CTL_HOLD) continue;
+
+    gchar *why = a == MODE_CTL_DOWN
+      ? g_strdup_printf("latency %.0f ms%s%s, budget %u ms", (double)smp.lat_mean_ns / 1e6,
+                        smp.backlog ? ", backlog" : "", smp.shed ? ", shedding" : "",
+                        g_arg_adapt_budget_ms)
+      : g_strdup_printf("headroom: max %.0f ms, budget %u ms", (double)smp.lat_max_ns / 1e6,
+                        g_arg_adapt_budget_ms);
+    int level = c->adapt.level + (a == MODE_CTL_DOWN ? 1 : -1);
+    if (cam_switch_mode(c, (unsigned int)level, why))
+      mode_ctl_applied(&c->adapt, a, now_monotonic_ns());
+    else
+      mode_ctl_init(&c->adapt, &c->adapt.cfg, THETAUVC_MODE_NUM, c->adapt.level, now_monotonic_ns());
+    g_free(why);
+  }
+  return TRUE;
+}
+
+// --metrics: the camera's series, labelled with its tag. Counters bumped
+// per frame go to the shard of the thread that bumps them; everything else
+// is read from the owning module when scraped.
+static void mx_stats(void *a, struct theta_cap_stats *st) {
+  theta_cap_get_stats(((struct cam *)a)->cap, st, FALSE);
+}
+
+static double mx_ring_occupancy(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return st.ring_queued;
+}
+
+static double mx_ring_depth(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return st.ring_depth;
+}
+
+static double mx_ring_dropped(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return (double)(st.ring_overwritten + st.ring_rejected);
+}
+
+static double mx_shed(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return (double)st.shed;
+}
+
+static double mx_no_buffer(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return (double)st.no_buffer;
+}
+
+static double mx_appsrc_bytes(void *a) {
+  return (double)gst_app_src_get_current_level_bytes(GST_APP_SRC(((struct cam *)a)->appsrc));
+}
+
+static double mx_pool_allocs(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return (double)st.allocs;
+}
+
+static double mx_fanout_subscribers(void *a) {
+  struct h264_fanout_stats fs;
+  h264_fanout_get_stats(((struct cam *)a)->fanout, &fs);
+  return (double)fs.subscribers;
+}
+
+static double mx_fanout_sent(void *a) {
+  struct h264_fanout_stats fs;
+  h264_fanout_get_stats(((struct cam *)a)->fanout, &fs);
+  return (double)fs.sent;
+}
+
+static double mx_fanout_skipped(void *a) {
+  struct h264_fanout_stats fs;
+  h264_fanout_get_stats(((struct cam *)a)->fanout, &fs);
+  return (double)fs.skipped;
+}
+
+static double mx_ingest_late(void *a) {
+  return ((struct cam *)a)->ingest_sum.late_p99_ms / 1e3;
+}
+
+static double mx_ingest_bitrate(void *a) {
+  return ((struct cam *)a)->ingest_sum.bitrate_now_bps;
+}
+
+static double mx_ingest_idr(void *a) {
+  return ((struct cam *)a)->ingest_sum.idr_interval_ms / 1e3;
+}
+
+static double mx_ingest_alert(void *a) {
+  const struct cam_alert_ref *r = a;
+  return (r->c->ingest_sum.active >> r->alert) & 1u ? 1.0 : 0.0;
+}
+
+static double mx_stalls(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return (double)st.stalls;
+}
+
+static double mx_recovery(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return (double)st.recovery_last_ns / 1e9;
+}
+
+static double mx_stalled(void *a) {
+  struct theta_cap_stats st;
+  mx_stats(a, &st);
+  return st.stalled ? 1.0 : 0.0;
+}
+
+static void mx_latency(void *a, struct lat_hist *out) {
+  const struct cam_stage_ref *r = a;
+  lat_stages_snapshot(r->c->lat, r->stage, out);
+}
+
+static void cam_metrics(struct cam *c) {
+  metrics_t *m = g_metrics;
+  char l[96], lr[160];
+  snprintf(l, sizeof(l), "camera=\"%s\"", c->tag);
+  c->ms[THR_USB]  = metrics_shard_new(m);
+  c->ms[THR_PUSH] = metrics_shard_new(m);
+  c->ms[THR_OUT]  = metrics_shard_new(m);
+
+  c->mid.received = metrics_counter(m, "theta_frames_received_total", "Access units from USB (or replay)", l);
+  c->mid.bytes    = metrics_counter(m, "theta_usb_bytes_total", "H.264 bytes from USB; rate() x 8 is the bitrate", l);
+  c->mid.size     = metrics_histogram(m, "theta_usb_frame_bytes", "Access unit size", l,
+                                      k_size_bounds, N_SIZE_BOUNDS);
+  c->mid.gaps     = metrics_counter(m, "theta_sequence_gaps_total", "Frames missing from the UVC sequence", l);
+  c->mid.pushed   = metrics_counter(m, "theta_frames_pushed_total", "Buffers handed to appsrc", l);
+  c->mid.push_errors = metrics_counter(m, "theta_push_errors_total", "push-buffer calls that failed", l);
+  c->mid.output   = metrics_counter(m, "theta_frames_output_total", "Frames reaching the output sink", l);
+
+  const char *dropped = "Frames dropped before appsrc";
+  snprintf(lr, sizeof(lr), "%s,reason=\"no_buffer\"", l);
+  metrics_counter_fn(m, "theta_frames_dropped_total", dropped, lr, mx_no_buffer, c);
+  snprintf(lr, sizeof(lr), "%s,reason=\"ring\"", l);
+  metrics_counter_fn(m, "theta_frames_dropped_total", dropped, lr, mx_ring_dropped, c);
+  snprintf(lr, sizeof(lr), "%s,reason=\"shed\"", l);
+  metrics_counter_fn(m, "theta_frames_dropped_total", dropped, lr, mx_shed, c);
+
+  metrics_gauge_fn(m, "theta_ring_occupancy", "Frames queued between USB and the push thread", l,
+                   mx_ring_occupancy, c);
+  metrics_gauge_fn(m, "theta_ring_depth", "Frame ring slots", l, mx_ring_depth, c);
+  metrics_gauge_fn(m, "theta_appsrc_queued_bytes", "Bytes queued in appsrc", l, mx_appsrc_bytes, c);
+  metrics_counter_fn(m, "theta_buffer_allocs_total", "H.264 buffer heap allocations", l,
+                     mx_pool_allocs, c);
+  metrics_counter_fn(m, "theta_stream_stalls_total", "Times the stream stopped and was reconnected", l,
+                     mx_stalls, c);
+  metrics_gauge_fn(m, "theta_stream_recovery_seconds", "Last frame before the last stall to the first after it", l,
+                   mx_recovery, c);
+  metrics_gauge_fn(m, "theta_stream_stalled", "1 while the stream is stalled and being reconnected", l,
+                   mx_stalled, c);
+  if (c->fanout) {
+    metrics_gauge_fn(m, "theta_h264_subscribers", "Connected --h264-out subscribers", l,
+                     mx_fanout_subscribers, c);
+    metrics_counter_fn(m, "theta_h264_sent_total", "Access units written to --h264-out subscribers", l,
+                       mx_fanout_sent, c);
+    metrics_counter_fn(m, "theta_h264_skipped_total", "Access units subscribers lost by falling behind", l,
+                       mx_fanout_skipped, c);
+  }
+  // Ingest values are those of the last stats summary, every 2 s.
+  if (c->ingest) {
+    metrics_gauge_fn(m, "theta_usb_late_seconds",
+                     "p99 of arrival minus the camera frame clock over the ingest window", l, mx_ingest_late, c);
+    metrics_gauge_fn(m, "theta_usb_bitrate_bps", "H.264 bitrate over the last second", l, mx_ingest_bitrate, c);
+    metrics_gauge_fn(m, "theta_idr_interval_seconds", "Last IDR to IDR interval", l, mx_ingest_idr, c);
+    for (int a = 0; a < INGEST_ALERT_NUM; ++a) {
+      c->alert_ref[a].c = c;
+      c->alert_ref[a].alert = a;
+      snprintf(lr, sizeof(lr), "%s,alert=\"%s\"", l, ingest_alert_name((enum ingest_alert)a));
+      metrics_gauge_fn(m, "theta_ingest_alert", "1 while this USB ingest alert is raised", lr,
+                       mx_ingest_alert, &c->alert_ref[a]);
+    }
+  }
+  for (int i = 0; i < LAT_STAGE_NUM; ++i) {
+    c->lat_ref[i].c = c;
+    c->lat_ref[i].stage = (enum lat_stage)i;
+    snprintf(lr, sizeof(lr), "%s,stage=\"%s\"", l, lat_stage_key((enum lat_stage)i));
+    metrics_latency_fn(m, "theta_stage_latency_seconds",
+                       "Time from the previous stage to this one; stage=\"total\" is USB to output",
+                       lr, mx_latency, &c->lat_ref[i]);
+  }
+}
+
+// Builds the pipeline for the predicted size and sets it playing, so
+// plugin loading and decoder setup happen while the camera is being opened.
+static void cam_prepare(struct cam *c) {
+  cpu_set_t saved;
+  pin_scope_enter(c, &saved);
+  build_pipeline(c);
+  sm_mark(c, SM_PIPELINE);
+  if (gst_element_set_state(c->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    g_error("[%s] Failed to set pipeline to PLAYING", c->tag);
+  }
+  sm_mark(c, SM_PLAYING);
+  pin_scope_leave(c, &saved);
+}
+
+// The camera came up in another mode than predicted: nothing has flowed
+// yet, so the pipeline is simply built again for the real size.
+static void cam_rebuild(struct cam *c) {
+  g_print("[%s] Decoded size %ux%u, not %ux%u: rebuilding the pipeline\n",
+          c->tag, c->dec_w, c->dec_h, c->built_w, c->built_h);
+  gst_element_set_state(c->pipeline, GST_STATE_NULL);
+  GstBus *bus = gst_element_get_bus(c->pipeline);
+  gst_bus_remove_watch(bus);
+  gst_object_unref(bus);
+  gst_object_unref(c->appsrc);
+  gst_object_unref(c->pipeline);
+  c->appsrc = c->pipeline = NULL;
+  lat_stages_free(c->lat);
+  c->lat = NULL;
+  shm_ring_writer_destroy(c->shm);
+  c->shm = NULL;
+  for (int i = 0; i < g_nviews; ++i) {
+    shm_ring_writer_destroy(c->view_shm[i]);
+    c->view_shm[i] = NULL;
+  }
+  band_pool_free(c->bands);
+  c->bands = NULL;
+  c->sm[SM_PIPELINE] = c->sm[SM_PLAYING] = 0;
+  cam_prepare(c);
+}
+
+// At start, the camera refused the cached control and was negotiated
+// again: nothing has flowed yet, so a different size means a rebuild.
+static void on_renegotiated(theta_cap_t *cap, void *user) {
+  struct cam *c = user;
+  c->cached = FALSE;
+  theta_cap_get_mode(cap, &c->mode, NULL);
+  theta_cap_get_size(cap, &c->dec_w, &c->dec_h, &c->dec_fps);
+  g_print("[%s] thetauvc: selected mode index %u\n", c->tag, c->mode);
+  if (c->dec_w != c->built_w || c->dec_h != c->built_h) cam_rebuild(c);
+}
+
+// The replay is over and its last access unit pushed: what is still in
+// appsrc and the decoder drains, then the pipeline posts EOS.
+static void on_replay_eos(theta_cap_t *cap, void *user) {
+  (void)cap;
+  struct cam *c = user;
+  gst_app_src_end_of_stream(GST_APP_SRC(c->appsrc));
+}
+
+// Builds and starts everything one camera needs, on its cores if pinned.
+static void cam_start(struct cam *c) {
+  cpu_set_t saved;
+  pin_scope_enter(c, &saved);
+
+  uvc_stream_ctrl_t ctrl;
+  theta_cap_get_ctrl(c->cap, &ctrl);
+  if (g_arg_record) {
+    struct tcap_mode m;
+    tcap_mode_from_ctrl(&m, c->mode, c->dec_w, c->dec_h, c->dec_fps, &ctrl);
+    c->record_path = cam_record_path(c, g_arg_record);
+    c->recorder = tcap_writer_open(c->record_path, &m);
+    if (!c->recorder) g_error("Cannot create capture file %s", c->record_path);
+    g_print("[%s] Recording raw frames to %s\n", c->tag, c->record_path);
+  }
+
+  c->last_report_ns = now_monotonic_ns();
+  if (c->adaptive) {
+    struct mode_ctl_config cfg;
+    mode_ctl_defaults(&cfg, (uint64_t)g_arg_adapt_budget_ms * 1000000ull);
+    mode_ctl_init(&c->adapt, &cfg, THETAUVC_MODE_NUM, (int)c->mode, c->last_report_ns);
+  }
+  if (g_arg_ingest_window) {
+    // Paced like the stall watch: a slowed-down replay stretches the period.
+    struct ingest_mon_config ic;
+    double interval_ns = (double)ctrl.dwFrameInterval * 100.0;
+    if (c->replay_path && g_arg_replay_speed > 0) interval_ns /= g_arg_replay_speed;
+    ingest_mon_defaults(&ic, (int64_t)interval_ns);
+    ic.window = g_arg_ingest_window;
+    if (g_arg_ingest_late_ms > 0) ic.late_ns = (int64_t)(g_arg_ingest_late_ms * 1e6);
+    c->ingest = ingest_mon_new(&ic);
+    if (!c->ingest) g_error("Invalid ingest window: %u", g_arg_ingest_window);
+  }
+  if (g_arg_h264_out) {
+    // One per camera, kept across reconnects and mode switches: the
+    // parameter sets that follow a switch reach subscribers in-band.
+    struct h264_fanout_config fc;
+    h264_fanout_defaults(&fc);
+    fc.arena_bytes = (size_t)g_arg_h264_out_mb << 20;
+    gchar *base = cam_output_name(c, g_arg_h264_out);
+    gchar *sock = g_strdup_printf("%s.sock", base);
+    c->fanout = h264_fanout_new(sock, &fc);
+    if (!c->fanout) g_error("Cannot serve H.264 on %s", sock);
+    g_print("[%s] H.264 fan-out on %s (%u MB)\n", c->tag, sock, g_arg_h264_out_mb);
+    g_free(sock);
+    g_free(base);
+  }
+  if (g_metrics) cam_metrics(c);
+
+  // Start stream: frames arrive at on_received() on the library's callback
+  // thread and leave its queue at on_access_unit() on its push thread. Both
+  // (and its stall watch) start out on this camera's cores.
+  struct theta_cap_hooks hooks = {
+    .received     = on_received,
+    .admitted     = on_admitted,
+    .restarted    = on_restarted,
+    .renegotiated = on_renegotiated,
+    .eos          = on_replay_eos,
+    .user         = c,
+  };
+  theta_cap_set_hooks(c->cap, &hooks);
+  theta_cap_set_sink(c->cap, on_access_unit, c);
+  if (theta_cap_start(c->cap) != 0) g_error("[%s] Cannot start streaming", c->tag);
+  sm_mark(c, SM_STREAMING);
+
+  struct theta_cap_stats st;
+  theta_cap_get_stats(c->cap, &st, FALSE);
+  g_print("[%s] H.264 buffer pool: %u x %zu bytes%s\n", c->tag, g_arg_pool, st.pool_buffer_bytes,
+          g_arg_pool ? "" : " (disabled, per-frame allocation)");
+  g_print("[%s] Frame ring: %u slots, %s; shedding: %s above %u queued\n", c->tag, st.ring_depth,
+          theta_cap_overflow_name(st.overflow), theta_cap_shed_name(g_arg_shed), st.shed_high);
+  pin_scope_leave(c, &saved);
+}
+
+// --stats-json: one line per camera, appended, so a bench can run several
+// configurations into the same file. Latencies are in microseconds.
+static void json_string(FILE *fp, const char *v) {
+  fputc('"', fp);
+  for (const unsigned char *p = (const unsigned char *)(v ? v : ""); *p; ++p) {
+    if (*p == '"' || *p == '\\') fprintf(fp, "\\%c", *p);
+    else if (*p < 0x20)         fprintf(fp, "\\u%04x", *p);
+    else                        fputc(*p, fp);
+  }
+  fputc('"', fp);
+}
+
+static void stats_json(struct cam *c) {
+  FILE *fp = fopen(g_arg_stats_json, "a");
+  if (!fp) { perror(g_arg_stats_json); return; }
+  struct theta_cap_stats st;
+  theta_cap_get_stats(c->cap, &st, FALSE);
+  guint64 out = __atomic_load_n(&c->frames_out, __ATOMIC_RELAXED);
+  guint64 span = c->last_out_ns - c->first_out_ns;
+  double out_fps = out > 1 && span ? (double)(out - 1) * 1e9 / (double)span : 0.0;
+
+  fputs("{\"tag\":", fp);
+  json_string(fp, c->tag);
+  fputs(",\"source\":", fp);
+  json_string(fp, c->replay_path ? c->replay_path : c->serial);
+  fprintf(fp, ",\"width\":%u,\"height\":%u,\"decoder\":\"%s\",\"convert\":\"%s\",\"output\":\"%s\","
+              "\"views\":%d,\"replay_speed\":%g,",
+          c->dec_w, c->dec_h, g_use_nvdec ? "nvh264dec" : "avdec_h264",
+          g_arg_convert == CONVERT_SIMD ? "simd" : "videoconvert",
+          g_arg_output == OUTPUT_SHMRING ? "shmring" : "shmsink",
+          g_nviews, c->replay_path ? g_arg_replay_speed : 1.0);
+  fprintf(fp, "\"stalls\":%llu,\"reconnect_attempts\":%llu,\"recoveries\":%llu,"
+              "\"recovery_max_ms\":%.1f,",
+          (unsigned long long)st.stalls, (unsigned long long)st.reconnect_attempts,
+          (unsigned long long)st.recoveries, (double)st.recovery_max_ns / 1e6);
+  fprintf(fp, "\"mode_cached\":%s,\"startup_ms\":{", c->cached ? "true" : "false");
+  for (int m = 0, n = 0; m < SM_NUM; ++m) {
+    if (!c->sm[m]) continue;
+    fprintf(fp, "%s\"%s\":%.1f", n++ ? "," : "", k_sm_names[m], (double)(c->sm[m] - g_launch_ns) / 1e6);
+  }
+  fputs("},", fp);
+  if (c->ingest) {
+    const struct ingest_mon_summary *is = &c->ingest_sum;
+    fprintf(fp, "\"ingest\":{\"late_p99_ms\":%.2f,\"late_max_ms\":%.2f,\"interval_sd_ms\":%.2f,"
+                "\"size_p99\":%u,\"bitrate_avg_bps\":%.0f,\"idr_interval_ms\":%.0f,\"alerts\":{",
+            is->late_p99_ms, is->late_max_ms, is->interval_sd_ms, is->size_p99,
+            is->bitrate_avg_bps, is->idr_interval_ms);
+    for (int a = 0; a < INGEST_ALERT_NUM; ++a)
+      fprintf(fp, "%s\"%s\":%llu", a ? "," : "", ingest_alert_name((enum ingest_alert)a),
+              (unsigned long long)is->total_raised[a]);
+    fputs("}},", fp);
+  }
+  fprintf(fp, "\"frames_in\":%llu,\"frames_pushed\":%llu,\"frames_out\":%llu,\"seq_gaps\":%llu,"
+              "\"ring_dropped\":%llu,\"shed\":%llu,\"out_fps\":%.3f,\"stages\":[",
+          (unsigned long long)st.frames_in, (unsigned long long)st.pushed, (unsigned long long)out,
+          (unsigned long long)st.seq_gaps, (unsigned long long)(st.ring_overwritten + st.ring_rejected),
+          (unsigned long long)st.shed, out_fps);
+  int first = 1;
+  for (int i = 0; i < LAT_STAGE_NUM; ++i) {
+    const struct lat_hist *h = lat_stages_total(c->lat, (enum lat_stage)i);
+    if (!h || h->count == 0) continue;
+    fprintf(fp, "%s{\"stage\":", first ? "" : ",");
+    json_string(fp, lat_stage_name((enum lat_stage)i));
+    fprintf(fp, ",\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%llu,\"p90_us\":%llu,"
+                "\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}",
+            (unsigned long long)h->count, (double)h->sum_us / (double)h->count,
+            (unsigned long long)lat_hist_percentile_us(h, 0.50),
+            (unsigned long long)lat_hist_percentile_us(h, 0.90),
+            (unsigned long long)lat_hist_percentile_us(h, 0.99),
+            (unsigned long long)lat_hist_percentile_us(h, 0.999),
+            (unsigned long long)h->max_us);
+    first = 0;
+  }
+  fputs("]}\n", fp);
+  if (fclose(fp) != 0) perror(g_arg_stats_json);
+}
+
+static void cam_stop(struct cam *c) {
+  // Streaming, its push thread and queue. The counters and the clock fit
+  // stay readable until theta_cap_close().
+  theta_cap_stop(c->cap);
+  if (c->recorder && tcap_writer_close(c->recorder) != 0)
+    g_printerr("Capture file %s is incomplete (write error)\n", c->record_path);
+  g_free(c->record_path);
+
+  if (c->fanout) {
+    struct h264_fanout_stats fs;
+    h264_fanout_get_stats(c->fanout, &fs);
+    g_print("[%s] h264 fan-out: %llu AUs published, %llu sent to %llu subscribers, %llu skipped, %llu too big\n",
+            c->tag, (unsigned long long)fs.published, (unsigned long long)fs.sent,
+            (unsigned long long)fs.joined, (unsigned long long)fs.skipped,
+            (unsigned long long)fs.too_big);
+    h264_fanout_free(c->fanout);
+  }
+
+  gst_element_set_state(c->pipeline, GST_STATE_NULL);
+  if (g_ncams > 1) g_print("[%s]\n", c->tag);
+  lat_stages_dump(c->lat, FALSE, stdout);
+  theta_cap_dump_clock(c->cap, FALSE, stdout);
+  if (c->ingest) {
+    struct ingest_mon_summary is;
+    ingest_mon_update(c->ingest, (int64_t)now_monotonic_ns(), &is);
+    ingest_mon_print(&is, stdout);
+    g_print("[%s] ingest: %llu frames, %llu lost on USB, alerts raised:", c->tag,
+            (unsigned long long)is.total_frames, (unsigned long long)is.total_gaps);
+    for (int a = 0; a < INGEST_ALERT_NUM; ++a)
+      g_print(" %s %llu", ingest_alert_name((enum ingest_alert)a), (unsigned long long)is.total_raised[a]);
+    g_print("\n");
+    c->ingest_sum = is;
   }
+  struct theta_cap_stats st;
+  theta_cap_get_stats(c->cap, &st, FALSE);
+  if (st.stalls)
+    g_print("[%s] stalls: %llu, recovered %llu (%llu attempts), recovery last %.0f ms, max %.0f ms\n",
+            c->tag, (unsigned long long)st.stalls, (unsigned long long)st.recoveries,
+            (unsigned long long)st.reconnect_attempts, (double)st.recovery_last_ns / 1e6,
+            (double)st.recovery_max_ns / 1e6);
+  if (g_arg_stats_json) stats_json(c);
+  lat_stages_free(c->lat);
+  ingest_mon_free(c->ingest);
+  views_report(c);
+  shm_ring_writer_destroy(c->shm);
+  for (int i = 0; i < g_nviews; ++i) {
+    shm_ring_writer_destroy(c->view_shm[i]);
+    reproject_free(c->rp[i]);
+  }
+  band_pool_free(c->bands);
+  theta_cap_close(c->cap);
+  if (c->appsrc)   gst_object_unref(c->appsrc);
+  if (c->pipeline) gst_object_unref(c->pipeline);
 }
 
-// libuvc callback: frame->data contains the H.264 NAL stream from THETA
-static void uvc_frame_cb(uvc_frame_t *frame, void *user_ptr) {
-  (void)user_ptr;
-  push_h264_to_gst((const uint8_t*)frame->data, frame->data_bytes);
+static struct cam *add_cam(void) {
+  if (g_ncams >= MAX_CAMERAS) return NULL;
+  struct cam *c = &g_cams[g_ncams];
+  c->index = g_ncams++;
+  return c;
 }
 
 static void usage(const char *prog) {
   fprintf(stderr,
-    "Usage: %s [--nvdec] [--fps N] [--w WIDTH] [--h HEIGHT]\n"
+    "Usage: %s [--list] [--serial S [--pin CPUS]]... [--nvdec] [--fps N] [--w WIDTH] [--h HEIGHT]\n"
+    "          [--pool N] [--ring N] [--overflow drop-oldest|drop-newest]\n"
+    "          [--shed none|nonref|gop] [--shed-high N]\n"
+    "          [--record FILE] [--replay FILE [--pin CPUS]]... [--replay-speed X] [--replay-loop]\n"
+    "          [--lat-report SEC] [--stats-json FILE] [--metrics ADDR] [--output shmsink|shmring [--shm-name NAME] [--shm-slots N]]\n"
+    "          [--convert videoconvert|simd] [--convert-threads N] [--convert-impl NAME]\n"
+    "          [--view NAME=YAW,PITCH,FOV,WxH]... [--cubemap SIZE]\n"
+    "          [--adapt-budget MS [--adapt-window MS]] [--stall-frames N] [--replay-stall SEC[,DOWN]]\n"
+    "          [--h264-out BASE [--h264-out-mb N]] [--ingest-window N] [--ingest-late-ms MS]\n"
+    "  --list       : print the connected THETAs and their serials, then exit\n"
+    "  --serial S   : capture the THETA with this serial; repeat for more cameras (up to %d)\n"
+    "  --pin CPUS   : run the preceding camera's threads on these cores, e.g. 2,3 or 4-7\n"
     "  --nvdec      : use NVIDIA NVDEC (nvh264dec) if available\n"
     "  --fps  N     : caps framerate for appsrc (default: 30)\n"
     "  --w    WIDTH : H.264 request to the camera (default: 3840)\n"
-    "  --h    HEIGHT: H.264 request to the camera (default: 1920)\n",
-    prog
+    "  --h    HEIGHT: H.264 request to the camera (default: 1920)\n"
+    "  --adapt-budget MS: switch cameras down to FHD when USB-to-output latency stays over MS,\n"
+    "                 and back to UHD when there is headroom (default: 0 = fixed mode)\n"
+    "  --adapt-window MS: controller measurement window (default: 500)\n"
+    "  --stall-frames N: reconnect a camera after N frame intervals without a frame,\n"
+    "                 0 = never (default: %d)\n"
+    "  --replay-stall SEC[,DOWN]: make replays hang every SEC seconds of stream, to exercise\n"
+    "                 reconnects; with DOWN, as if unplugged for DOWN seconds\n"
+    "  --pool N     : recycled H.264 buffers, 0 = allocate per frame (default: %d)\n"
+    "  --ring N     : frames queued between USB and GStreamer (default: %d)\n"
+    "  --overflow P : what a full ring drops (default: drop-newest when shedding, else drop-oldest)\n"
+    "  --shed P     : congestion policy: nonref frames only, or skip to next IDR (default: gop)\n"
+    "  --shed-high N: ring occupancy treated as congestion (default: half the ring)\n"
+    "  --record FILE: save received H.264 frames, sequence and capture time\n"
+    "                 (FILE_<serial>.ext per camera when there are several)\n"
+    "  --replay FILE: feed a recorded capture instead of opening a camera; repeatable\n"
+    "  --replay-speed X: 1 = recorded cadence, N = N x faster, 0 = unthrottled (default: 1)\n"
+    "  --replay-loop: restart the capture when it ends\n"
+    "  --lat-report SEC: per-stage latency dump period, 0 = end-of-run summary only (default: 10)\n"
+    "  --stats-json FILE: append an end-of-run summary per camera to FILE, one JSON object\n"
+    "                 per line (counters, output fps, latency percentiles per stage)\n"
+    "  --metrics ADDR: serve Prometheus metrics on PORT, HOST:PORT (default host 127.0.0.1)\n"
+    "                 or unix:PATH\n"
+    "  --output M   : shmsink (/tmp/theta_bgr.sock) or shmring (native multi-reader ring)\n"
+    "  --shm-name NAME, --shm-slots N: shmring segment name and slot count (default: %s, %d)\n"
+    "                 with several cameras every output name gets a _<serial> suffix\n"
+    "  --convert M  : BGR conversion: videoconvert, or simd (multithreaded, no scaling,\n"
+    "                 writes into the shmring; implies --output shmring) (default: videoconvert)\n"
+    "  --convert-threads N: conversion/reprojection threads per camera, 0 = one per CPU,\n"
+    "                 or per pinned CPU (default: 0)\n"
+    "  --convert-impl NAME: force a simd kernel: auto, avx2, sse4.1, neon, scalar (default: auto)\n"
+    "  --view NAME=YAW,PITCH,FOV,WxH: add a pinhole view (degrees), published as <shm-name>_NAME\n"
+    "  --cubemap SIZE: add six SIZExSIZE faces (front right back left up down)\n"
+    "                 views imply --output shmring; up to %d in total\n"
+    "  --h264-out BASE: also serve the camera's H.264, as received, on the Unix socket\n"
+    "                 BASE.sock (BASE_<serial>.sock per camera), e.g. %s; late subscribers\n"
+    "                 start from the SPS/PPS and last IDR (see h264_fanout_reader)\n"
+    "  --h264-out-mb N: stream kept for subscribers, in MB; must hold a GOP (default: %d)\n"
+    "  --ingest-window N: USB ingest health over the last N frames: gaps, arrival jitter,\n"
+    "                 frame sizes, bitrate, IDR interval, alerts; 0 = off (default: %d)\n"
+    "  --ingest-late-ms MS: arrival this far behind the camera clock counts as late\n"
+    "                 (default: half a frame interval)\n",
+    prog, MAX_CAMERAS, STREAM_WATCH_DEFAULT_STALL_FRAMES, THETA_CAP_DEFAULT_POOL, THETA_CAP_DEFAULT_RING,
+    SHM_RING_DEFAULT_NAME, SHM_RING_DEFAULT_SLOTS, REPROJECT_MAX_VIEWS,
+    H264_FANOUT_DEFAULT_PATH, H264_FANOUT_DEFAULT_MB, INGEST_MON_DEFAULT_WINDOW
   );
 }
 
 int main(int argc, char **argv) {
+  g_launch_ns = now_monotonic_ns();
+  gboolean list = FALSE;
+
   // Parse very simple args
   for (int i = 1; i < argc; ++i) {
     if      (!strcmp(argv[i], "--nvdec")) g_use_nvdec = TRUE;
+    else if (!strcmp(argv[i], "--list")) list = TRUE;
+    else if ((!strcmp(argv[i], "--serial") || !strcmp(argv[i], "--replay")) && i+1 < argc) {
+      struct cam *c = add_cam();
+      if (!c) { fprintf(stderr, "At most %d cameras\n", MAX_CAMERAS); return 1; }
+      if (!strcmp(argv[i], "--serial")) c->serial = argv[++i];
+      else                              c->replay_path = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--pin") && i+1 < argc) {
+      // Applies to the camera declared just before; alone, to the only one.
+      struct cam *c = g_ncams ? &g_cams[g_ncams - 1] : add_cam();
+      if (parse_cpu_list(argv[++i], &c->cpus) != 0) {
+        fprintf(stderr, "Bad CPU list: %s\n", argv[i]);
+        usage(argv[0]);
+        return 1;
+      }
+      c->pin_arg = argv[i];
+      c->pinned = TRUE;
+    }
     else if (!strcmp(argv[i], "--fps") && i+1 < argc) g_arg_fps = atoi(argv[++i]);
     else if (!strcmp(argv[i], "--w")   && i+1 < argc) g_arg_w   = atoi(argv[++i]);
     else if (!strcmp(argv[i], "--h")   && i+1 < argc) g_arg_h   = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--pool")&& i+1 < argc) g_arg_pool = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--ring")&& i+1 < argc) g_arg_ring = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--overflow") && i+1 < argc) {
+      if (theta_cap_parse_overflow(argv[++i], &g_arg_overflow) != 0) {
+        fprintf(stderr, "Unknown overflow policy: %s\n", argv[i]);
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--shed") && i+1 < argc) {
+      if (theta_cap_parse_shed(argv[++i], &g_arg_shed) != 0) {
+        fprintf(stderr, "Unknown shed policy: %s\n", argv[i]);
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--shed-high") && i+1 < argc) g_arg_shed_high = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--record") && i+1 < argc) g_arg_record = argv[++i];
+    else if (!strcmp(argv[i], "--replay-speed") && i+1 < argc) g_arg_replay_speed = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--replay-loop")) g_arg_replay_loop = TRUE;
+    else if (!strcmp(argv[i], "--lat-report") && i+1 < argc) g_arg_lat_report = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--stats-json") && i+1 < argc) g_arg_stats_json = argv[++i];
+    else if (!strcmp(argv[i], "--metrics") && i+1 < argc) g_arg_metrics = argv[++i];
+    else if (!strcmp(argv[i], "--output") && i+1 < argc) {
+      const char *m = argv[++i];
+      if      (!strcmp(m, "shmsink")) g_arg_output = OUTPUT_SHMSINK;
+      else if (!strcmp(m, "shmring")) g_arg_output = OUTPUT_SHMRING;
+      else { fprintf(stderr, "Unknown output: %s\n", m); usage(argv[0]); return 1; }
+      g_arg_output_set = TRUE;
+    }
+    else if (!strcmp(argv[i], "--convert") && i+1 < argc) {
+      const char *m = argv[++i];
+      if      (!strcmp(m, "videoconvert")) g_arg_convert = CONVERT_GST;
+      else if (!strcmp(m, "simd"))         g_arg_convert = CONVERT_SIMD;
+      else { fprintf(stderr, "Unknown convert mode: %s\n", m); usage(argv[0]); return 1; }
+    }
+    else if (!strcmp(argv[i], "--convert-threads") && i+1 < argc) g_arg_convert_threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--convert-impl") && i+1 < argc) {
+      if (simd_parse_level(argv[++i], &g_arg_convert_impl) != 0) {
+        fprintf(stderr, "Unknown conversion kernel: %s\n", argv[i]);
+        usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[i], "--view") && i+1 < argc) {
+      if (g_nviews >= REPROJECT_MAX_VIEWS || reproject_parse_view(argv[++i], &g_views[g_nviews]) != 0) {
+        fprintf(stderr, "Bad or too many views: %s\n", argv[i]);
+        usage(argv[0]);
+        return 1;
+      }
+      g_nviews++;
+    }
+    else if (!strcmp(argv[i], "--cubemap") && i+1 < argc) {
+      int size = atoi(argv[++i]);
+      if (size <= 0 || g_nviews + 6 > REPROJECT_MAX_VIEWS) {
+        fprintf(stderr, "Bad cubemap size or too many views: %s\n", argv[i]);
+        usage(argv[0]);
+        return 1;
+      }
+      reproject_cubemap(size, &g_views[g_nviews]);
+      g_nviews += 6;
+    }
+    else if (!strcmp(argv[i], "--shm-name")  && i+1 < argc) g_arg_shm_name  = argv[++i];
+    else if (!strcmp(argv[i], "--shm-slots") && i+1 < argc) g_arg_shm_slots = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--adapt-budget") && i+1 < argc) g_arg_adapt_budget_ms = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--adapt-window") && i+1 < argc) g_arg_adapt_window_ms = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--h264-out") && i+1 < argc) g_arg_h264_out = argv[++i];
+    else if (!strcmp(argv[i], "--h264-out-mb") && i+1 < argc) g_arg_h264_out_mb = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--ingest-window") && i+1 < argc) g_arg_ingest_window = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--ingest-late-ms") && i+1 < argc) g_arg_ingest_late_ms = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--stall-frames") && i+1 < argc) g_arg_stall_frames = (guint)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--replay-stall") && i+1 < argc) {
+      const char *v = argv[++i];
+      char *end;
+      g_arg_replay_stall_s = strtod(v, &end);
+      if (*end == ',') g_arg_replay_down_s = strtod(end + 1, &end);
+      if (*end || g_arg_replay_stall_s <= 0 || g_arg_replay_down_s < 0) {
+        fprintf(stderr, "Bad --replay-stall: %s\n", v);
+        usage(argv[0]);
+        return 1;
+      }
+    }
     else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
     else {
       fprintf(stderr, "Unknown arg: %s\n", argv[i]);
@@ -167,76 +1713,103 @@ int main(int argc, char **argv) {
     }
   }
 
-  signal(SIGINT, on_sigint);
-
-  // Init GStreamer
-  gst_init(&argc, &argv);
-  g_timer = g_timer_new();
-  g_last_report_ns = now_monotonic_ns();
-
-  build_pipeline();
-
-  if (gst_element_set_state(g_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
-    g_error("Failed to set pipeline to PLAYING");
+  if (g_arg_convert == CONVERT_SIMD || g_nviews > 0) {
+    if (g_arg_output_set && g_arg_output != OUTPUT_SHMRING) {
+      fprintf(stderr, "--convert simd and views write into shared-memory rings; use --output shmring\n");
+      return 1;
+    }
+    g_arg_output = OUTPUT_SHMRING;
   }
 
-  // Init libuvc + THETA
-  uvc_context_t *ctx = NULL;
-  uvc_device_t  *dev = NULL;
-  uvc_device_handle_t *devh = NULL;
+  // No --serial/--replay: the first THETA found, as before.
+  if (g_ncams == 0) add_cam();
+  int nlive = 0;
+  for (int i = 0; i < g_ncams; ++i) {
+    struct cam *c = &g_cams[i];
+    if (c->replay_path) continue;
+    nlive++;
+    for (int j = 0; j < i; ++j)
+      if (c->serial && g_cams[j].serial && !strcmp(c->serial, g_cams[j].serial)) {
+        fprintf(stderr, "Camera %s given twice\n", c->serial);
+        return 1;
+      }
+  }
+  for (int i = 0; i < g_ncams; ++i) {
+    if (nlive > 1 && !g_cams[i].replay_path && !g_cams[i].serial) {
+      fprintf(stderr, "With several cameras each one needs --serial (see --list)\n");
+      return 1;
+    }
+    cam_make_tag(&g_cams[i]);
+    for (int j = 0; j < i; ++j)
+      if (!strcmp(g_cams[i].tag, g_cams[j].tag))
+        snprintf(g_cams[i].tag, sizeof(g_cams[i].tag), "cam%d", i);
+  }
 
-  uvc_error_t res = uvc_init(&ctx, NULL);
-  if (res != UVC_SUCCESS) g_error("uvc_init failed: %d", res);
+  if (list) {
+    uvc_context_t *ctx = NULL;
+    uvc_error_t res = uvc_init(&ctx, NULL);
+    if (res != UVC_SUCCESS) g_error("uvc_init failed: %d", res);
+    thetauvc_print_devices(ctx, stdout);
+    uvc_exit(ctx);
+    return 0;
+  }
 
-  // Find/open first THETA device (filters by THETA VID/PID).
-  // Using plain uvc_find_device(0,0,NULL) is unstable when multiple UVC devices exist.
-  res = thetauvc_find_device(ctx, &dev, 0);
-  if (res != UVC_SUCCESS || !dev) g_error("THETA not found via thetauvc device filter");
-  res = uvc_open(dev, &devh);
-  if (res != UVC_SUCCESS) g_error("uvc_open failed: %d", res);
+  // The library drops at the newest end when shedding, so that everything
+  // already queued is still a decodable prefix; asking otherwise is allowed.
+  if (g_arg_shed != THETA_CAP_SHED_NONE && g_arg_overflow == THETA_CAP_OVERFLOW_DROP_OLDEST)
+    g_printerr("warning: --overflow drop-oldest can leave undecodable frames queued behind an eviction\n");
+  if (g_arg_ring == 0) { fprintf(stderr, "Invalid frame ring depth: 0\n"); return 1; }
 
-  // Negotiate an H.264 streaming profile with thetauvc helper.
-  // Many thetauvc builds use a 'formatId' 0x00 for H.264; adjust if your header defines a macro.
-	// --- replace the whole "Negotiate an H.264 streaming profile..." block with:
+  // Live cameras are opened (and negotiated, unless the mode cache knows
+  // their control) on their own thread while GStreamer starts up and the
+  // pipelines preroll for the predicted size. A missing camera still fails
+  // before any stream starts: the opener is joined first. PTS 0 is fixed
+  // before any camera is opened, so every camera shares one timeline.
+  for (int i = 0; i < g_ncams; ++i) {
+    g_cams[i].adaptive = g_arg_adapt_budget_ms > 0 && !g_cams[i].replay_path;
+    if (!g_cams[i].replay_path) cam_predict(&g_cams[i]);
+  }
+  g_t0_ns = (gint64)now_monotonic_ns();
+  GThread *opener = nlive > 0 ? g_thread_new("uvc-open", opener_thread_fn, NULL) : NULL;
 
-	uvc_stream_ctrl_t ctrl;
-	int ok = 0;
+  signal(SIGINT, on_sigint);
 
-	// Try a few mode indices exported by your thetauvc.c
-	// (commonly 0 = 3840x1920@30, 1 = 1920x960@30, but it depends on your file)
-	unsigned int modes_to_try[] = {0, 1, 2, 3};
-	for (size_t i = 0; i < sizeof(modes_to_try)/sizeof(modes_to_try[0]); ++i) {
-		if (thetauvc_get_stream_ctrl_format_size(devh, modes_to_try[i], &ctrl) == UVC_SUCCESS) {
-		  g_print("thetauvc: selected mode index %u\n", modes_to_try[i]);
-		  ok = 1;
-		  break;
-		}
-	}
+  // Init GStreamer
+  gst_init(&argc, &argv);
+  for (int i = 0; i < g_ncams; ++i) sm_mark(&g_cams[i], SM_GST_INIT);
 
-	if (!ok) {
-		g_error("Failed to negotiate H.264 stream profile via thetauvc (tried mode indices 0..3). "
-		        "Check your thetauvc.c for available modes.");
-	}
+  for (int i = 0; i < g_ncams; ++i)
+    if (g_cams[i].replay_path) cam_open(&g_cams[i]);
 
+  g_loop = g_main_loop_new(NULL, FALSE);
+  if (g_arg_metrics) g_metrics = metrics_new();
+  for (int i = 0; i < g_ncams; ++i) cam_prepare(&g_cams[i]);
+  if (opener) g_thread_join(opener);
+  for (int i = 0; i < g_ncams; ++i) {
+    struct cam *c = &g_cams[i];
+    if (c->dec_w != c->built_w || c->dec_h != c->built_h) cam_rebuild(c);
+  }
+  for (int i = 0; i < g_ncams; ++i) cam_start(&g_cams[i]);
+  if (g_metrics && metrics_listen(g_metrics, g_arg_metrics) == 0)
+    g_print("Metrics on %s\n", g_arg_metrics);
 
-  // Start stream: frames will arrive at uvc_frame_cb()
-  res = uvc_start_streaming(devh, &ctrl, uvc_frame_cb, NULL, 0);
-  if (res != UVC_SUCCESS) g_error("uvc_start_streaming failed: %d", res);
+  g_timeout_add_seconds(2, stats_report, NULL);
+  if (g_arg_lat_report) g_timeout_add_seconds(g_arg_lat_report, lat_report, NULL);
+  if (g_arg_adapt_budget_ms) {
+    if (g_arg_adapt_window_ms == 0) g_arg_adapt_window_ms = 500;
+    g_timeout_add(g_arg_adapt_window_ms, adapt_tick, NULL);
+    g_print("Mode control: %u ms budget, %u ms windows\n", g_arg_adapt_budget_ms, g_arg_adapt_window_ms);
+  }
 
-  g_print("Streaming… Ctrl+C to stop.\n");
-  g_loop = g_main_loop_new(NULL, FALSE);
+  g_print("Streaming %d camera%s… Ctrl+C to stop.\n", g_ncams, g_ncams > 1 ? "s" : "");
   g_main_loop_run(g_loop);
 
-  // Cleanup
-  uvc_stop_streaming(devh);
-  uvc_close(devh);
-  uvc_exit(ctx);
-
-  gst_element_set_state(g_pipeline, GST_STATE_NULL);
-  if (g_appsrc)   gst_object_unref(g_appsrc);
-  if (g_pipeline) gst_object_unref(g_pipeline);
+  // Cleanup. Scrapes read camera state, so the server goes first; the
+  // shards outlive the threads that write them.
+  metrics_shutdown(g_metrics);
+  for (int i = 0; i < g_ncams; ++i) cam_stop(&g_cams[i]);
+  metrics_free(g_metrics);
   if (g_loop)     g_main_loop_unref(g_loop);
-  if (g_timer)    g_timer_destroy(g_timer);
 
   return 0;
 }
@@ -0,0 +1,102 @@
+// mode_cache.c
+// See mode_cache.h. Every field of the control is kept, so a commit from the
+// cache sends exactly what the probe returned last time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mode_cache.h"
+
+#define MODE_CACHE_MAX_LINES  64
+#define MODE_CACHE_LINE       256
+
+static int cache_path(char *out, size_t size) {
+  const char *p = getenv("THETA_MODE_CACHE");
+  if (p && *p) return snprintf(out, size, "%s", p) < (int)size ? 0 : -1;
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg) return snprintf(out, size, "%s/theta_uvc_modes", xdg) < (int)size ? 0 : -1;
+  const char *home = getenv("HOME");
+  if (!home || !*home) return -1;
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%s/.cache", home);
+  mkdir(dir, 0755);   // usually there already
+  return snprintf(out, size, "%s/theta_uvc_modes", dir) < (int)size ? 0 : -1;
+}
+
+int mode_cache_load(const char *serial, unsigned int want_mode,
+                    unsigned int *mode, uvc_stream_ctrl_t *ctrl) {
+  char path[512];
+  if (!serial || !*serial || cache_path(path, sizeof(path)) != 0) return -1;
+  FILE *fp = fopen(path, "r");
+  if (!fp) return -1;
+
+  char line[MODE_CACHE_LINE], s[64];
+  int rc = -1;
+  while (rc != 0 && fgets(line, sizeof(line), fp)) {
+    unsigned int want, m, v[17];
+    if (sscanf(line, "%63s %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u",
+               s, &want, &m, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8],
+               &v[9], &v[10], &v[11], &v[12], &v[13], &v[14], &v[15], &v[16]) != 20)
+      continue;
+    if (strcmp(s, serial) || want != want_mode) continue;
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->bmHint                   = (uint16_t)v[0];
+    ctrl->bFormatIndex             = (uint8_t)v[1];
+    ctrl->bFrameIndex              = (uint8_t)v[2];
+    ctrl->dwFrameInterval          = v[3];
+    ctrl->wKeyFrameRate            = (uint16_t)v[4];
+    ctrl->wPFrameRate              = (uint16_t)v[5];
+    ctrl->wCompQuality             = (uint16_t)v[6];
+    ctrl->wCompWindowSize          = (uint16_t)v[7];
+    ctrl->wDelay                   = (uint16_t)v[8];
+    ctrl->dwMaxVideoFrameSize      = v[9];
+    ctrl->dwMaxPayloadTransferSize = v[10];
+    ctrl->dwClockFrequency         = v[11];
+    ctrl->bmFramingInfo            = (uint8_t)v[12];
+    ctrl->bPreferredVersion        = (uint8_t)v[13];
+    ctrl->bMinVersion              = (uint8_t)v[14];
+    ctrl->bMaxVersion              = (uint8_t)v[15];
+    ctrl->bInterfaceNumber         = (uint8_t)v[16];
+    *mode = m;
+    rc = 0;
+  }
+  fclose(fp);
+  return rc;
+}
+
+void mode_cache_store(const char *serial, unsigned int want_mode,
+                      unsigned int mode, const uvc_stream_ctrl_t *ctrl) {
+  char path[512], tmp[544];
+  if (!serial || !*serial || strchr(serial, ' ') || cache_path(path, sizeof(path)) != 0) return;
+
+  // Keep the other cameras' entries.
+  char keep[MODE_CACHE_MAX_LINES][MODE_CACHE_LINE];
+  int n = 0;
+  FILE *fp = fopen(path, "r");
+  if (fp) {
+    char line[MODE_CACHE_LINE], s[64];
+    unsigned int want;
+    while (n < MODE_CACHE_MAX_LINES - 1 && fgets(line, sizeof(line), fp)) {
+      if (sscanf(line, "%63s %u", s, &want) != 2) continue;
+      if (!strcmp(s, serial) && want == want_mode) continue;
+      snprintf(keep[n++], MODE_CACHE_LINE, "%s", line);
+    }
+    fclose(fp);
+  }
+
+  snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+  fp = fopen(tmp, "w");
+  if (!fp) return;
+  for (int i = 0; i < n; ++i) fputs(keep[i], fp);
+  fprintf(fp, "%s %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u %u\n",
+          serial, want_mode, mode,
+          ctrl->bmHint, ctrl->bFormatIndex, ctrl->bFrameIndex, ctrl->dwFrameInterval,
+          ctrl->wKeyFrameRate, ctrl->wPFrameRate, ctrl->wCompQuality, ctrl->wCompWindowSize,
+          ctrl->wDelay, ctrl->dwMaxVideoFrameSize, ctrl->dwMaxPayloadTransferSize,
+          ctrl->dwClockFrequency, ctrl->bmFramingInfo, ctrl->bPreferredVersion,
+          ctrl->bMinVersion, ctrl->bMaxVersion, ctrl->bInterfaceNumber);
+  if (fclose(fp) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
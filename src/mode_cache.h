@@ -0,0 +1,32 @@
+// mode_cache.h
+// The stream control each camera last streamed with, per serial and
+// requested mode, kept in a small text file. At the next start the cached
+// control is committed as is: no format lookup, no probe round trips, and
+// the pipeline can be built for the right size before the camera is even
+// open. A camera that rejects it is negotiated as usual.
+//
+// File: $THETA_MODE_CACHE, else $XDG_CACHE_HOME/theta_uvc_modes, else
+// ~/.cache/theta_uvc_modes. One line per camera and requested mode. Errors
+// are ignored: the cache is only ever an optimisation.
+
+#if !defined(__MODE_CACHE_H__)
+#define __MODE_CACHE_H__
+
+#include "libuvc/libuvc.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// 0 and *mode/*ctrl filled when an entry exists for serial and want_mode.
+extern int  mode_cache_load(const char *serial, unsigned int want_mode,
+                            unsigned int *mode, uvc_stream_ctrl_t *ctrl);
+
+// Adds or replaces the entry (rewrites the file atomically).
+extern void mode_cache_store(const char *serial, unsigned int want_mode,
+                             unsigned int mode, const uvc_stream_ctrl_t *ctrl);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
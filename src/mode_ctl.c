@@ -0,0 +1,63 @@
+// mode_ctl.c
+// See mode_ctl.h. Single-threaded; the caller's timer owns the state.
+
+#include <string.h>
+
+#include "mode_ctl.h"
+
+void mode_ctl_defaults(struct mode_ctl_config *cfg, uint64_t budget_ns) {
+  cfg->budget_ns      = budget_ns;
+  cfg->headroom       = MODE_CTL_DEFAULT_HEADROOM;
+  cfg->down_windows   = MODE_CTL_DEFAULT_DOWN_WINDOWS;
+  cfg->up_windows     = MODE_CTL_DEFAULT_UP_WINDOWS;
+  cfg->max_up_windows = MODE_CTL_DEFAULT_MAX_UP;
+  cfg->cooldown_ns    = MODE_CTL_DEFAULT_COOLDOWN_NS;
+  cfg->flap_ns        = MODE_CTL_DEFAULT_FLAP_NS;
+}
+
+void mode_ctl_init(mode_ctl_t *m, const struct mode_ctl_config *cfg,
+                   int nlevels, int level, uint64_t now_ns) {
+  memset(m, 0, sizeof(*m));
+  m->cfg = *cfg;
+  m->nlevels = nlevels;
+  m->level = level;
+  m->up_wait = cfg->up_windows;
+  m->last_switch_ns = now_ns;
+}
+
+enum mode_ctl_action mode_ctl_update(mode_ctl_t *m, const struct mode_ctl_sample *s,
+                                     uint64_t now_ns) {
+  // Right after a switch the pipeline is still draining the old stream and
+  // waiting for the new one's IDR; those windows say nothing.
+  if (now_ns - m->last_switch_ns < m->cfg.cooldown_ns) return MODE_CTL_HOLD;
+
+  int over = s->backlog || s->shed ||
+             (s->frames > 0 && s->lat_mean_ns > m->cfg.budget_ns);
+  int room = !over && s->frames > 0 &&
+             (double)s->lat_max_ns < (double)m->cfg.budget_ns * m->cfg.headroom;
+
+  m->over  = over ? m->over + 1 : 0;
+  m->under = room ? m->under + 1 : 0;
+
+  if (m->over >= m->cfg.down_windows && m->level + 1 < m->nlevels) return MODE_CTL_DOWN;
+  if (m->under >= m->up_wait && m->level > 0) return MODE_CTL_UP;
+  return MODE_CTL_HOLD;
+}
+
+void mode_ctl_applied(mode_ctl_t *m, enum mode_ctl_action a, uint64_t now_ns) {
+  if (a == MODE_CTL_HOLD) return;
+  if (a == MODE_CTL_DOWN) {
+    // Undoing a recent step up: the larger mode doesn't fit, so try it
+    // less often.
+    if (m->last_action == MODE_CTL_UP && now_ns - m->last_switch_ns < m->cfg.flap_ns) {
+      m->up_wait *= 2;
+      if (m->up_wait > m->cfg.max_up_windows) m->up_wait = m->cfg.max_up_windows;
+    }
+    m->level++;
+  } else {
+    m->level--;
+  }
+  m->over = m->under = 0;
+  m->last_action = a;
+  m->last_switch_ns = now_ns;
+}
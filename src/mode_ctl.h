@@ -0,0 +1,78 @@
+// mode_ctl.h
+// Decides when to move a camera between its stream modes (level 0 is the
+// largest, e.g. UHD; higher levels are cheaper, e.g. FHD) from windowed
+// end-to-end latency and ingest backlog:
+//   - down one level after down_windows consecutive windows over budget
+//   - up one level after up_windows consecutive windows with headroom
+// A step up that has to be undone soon after doubles the wait before the
+// next one, so a camera at the edge of its budget doesn't flap.
+// Pure bookkeeping: the caller measures, switches, and reports back.
+
+#if !defined(__MODE_CTL_H__)
+#define __MODE_CTL_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum mode_ctl_action {
+  MODE_CTL_HOLD = 0,
+  MODE_CTL_DOWN,               // to a cheaper mode (level + 1)
+  MODE_CTL_UP,                 // to a larger mode (level - 1)
+};
+
+struct mode_ctl_config {
+  uint64_t budget_ns;          // end-to-end latency budget (mean over a window)
+  double   headroom;           // step up only while the window max < budget * headroom
+  unsigned down_windows;       // consecutive over-budget windows before stepping down
+  unsigned up_windows;         // consecutive windows with headroom before stepping up
+  unsigned max_up_windows;     // cap for the doubled wait after a reverted step up
+  uint64_t cooldown_ns;        // no decision this soon after a switch
+  uint64_t flap_ns;            // stepping down this soon after a step up doubles the wait
+};
+
+#define MODE_CTL_DEFAULT_HEADROOM     0.5
+#define MODE_CTL_DEFAULT_DOWN_WINDOWS 3
+#define MODE_CTL_DEFAULT_UP_WINDOWS   20
+#define MODE_CTL_DEFAULT_MAX_UP       160
+#define MODE_CTL_DEFAULT_COOLDOWN_NS  3000000000ull
+#define MODE_CTL_DEFAULT_FLAP_NS      30000000000ull
+
+// One measurement window.
+struct mode_ctl_sample {
+  uint64_t lat_mean_ns;        // USB arrival -> output, frames output in the window
+  uint64_t lat_max_ns;
+  unsigned frames;             // frames output in the window (0 = no data)
+  int      backlog;            // ingest queue at or above its congestion mark
+  int      shed;               // frames were shed or lost in the window
+};
+
+typedef struct mode_ctl {
+  struct mode_ctl_config cfg;
+  int      level;
+  int      nlevels;
+  unsigned over;               // consecutive windows over budget
+  unsigned under;              // consecutive windows with headroom
+  unsigned up_wait;            // current up_windows, doubled on flaps
+  uint64_t last_switch_ns;
+  enum mode_ctl_action last_action;
+} mode_ctl_t;
+
+// Fills cfg with the defaults above for the given budget.
+extern void mode_ctl_defaults(struct mode_ctl_config *cfg, uint64_t budget_ns);
+
+extern void mode_ctl_init(mode_ctl_t *m, const struct mode_ctl_config *cfg,
+                          int nlevels, int level, uint64_t now_ns);
+
+// Feeds one window; returns what to do. The level only changes once the
+// caller confirms with mode_ctl_applied().
+extern enum mode_ctl_action mode_ctl_update(mode_ctl_t *m, const struct mode_ctl_sample *s,
+                                            uint64_t now_ns);
+extern void mode_ctl_applied(mode_ctl_t *m, enum mode_ctl_action a, uint64_t now_ns);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
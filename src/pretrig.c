@@ -0,0 +1,362 @@
+// pretrig.c
+// See pretrig.h.
+//
+// AU i lives in slot i & mask; head (AUs pushed) and tail (oldest kept)
+// are free-running, as are the arena byte offsets: an AU is stored whole at
+// off % cap, skipping to the start of the arena when it would wrap. The
+// indices of the IDRs in [tail, head) are kept in a second ring so that a
+// GOP can be evicted without scanning.
+//
+// Only the capture thread moves head and tail. A clip is handed to the
+// writer by setting rd (next AU to write) and raising `flushing`; from then
+// on the writer owns rd and the producer may evict only what lies before
+// it. The clip's end index is published when its post-trigger time is
+// reached, and the writer drops `flushing` once it has written that far.
+// The writer polls, so the capture thread never enters the kernel.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pretrig.h"
+
+#define WRITER_POLL_MS  20
+#define SLOT_FPS        60      // default slot count covers pre + post at this rate
+#define AU_HAS_PS       0x100u  // internal flag: SPS and PPS are in the AU
+#define CLIP_OPEN       UINT64_MAX
+
+struct pretrig_au {
+  uint64_t               off;        // free-running arena offset
+  uint32_t               size;
+  uint32_t               sequence;
+  int64_t                t_ns;
+  int64_t                capture_ns;
+  uint32_t               flags;      // TCAP_FLAG_IDR | AU_HAS_PS
+  int32_t                has_pose;
+  struct vicon_frame_rec pose;
+};
+
+struct pretrig {
+  uint8_t           *arena;
+  uint64_t           cap;
+  struct pretrig_au *au;
+  uint64_t          *gop;             // indices of the IDRs kept, same mask
+  uint64_t           mask;
+  int64_t            pre_ns, post_ns;
+  char               prefix[256];
+  struct tcap_mode   mode;
+  pthread_t          thr;
+  atomic_int         stop;
+
+  // Capture thread only.
+  uint64_t           tail, head_b;
+  uint64_t           gop_head, gop_tail;
+  int                wait_idr;
+  int                in_clip;
+  int64_t            clip_end_ns;
+  // Parameter sets for the clip being written; set before `flushing`.
+  uint8_t            clip_ps[H264_PS_MAX_BYTES];
+  size_t             clip_ps_len;
+
+  atomic_int         trig;
+  _Alignas(64) _Atomic uint64_t head;
+  _Atomic uint64_t   clip_end;
+  atomic_int         flushing;
+  _Alignas(64) _Atomic uint64_t rd;
+
+  _Alignas(64) _Atomic uint64_t triggers;
+  _Atomic uint64_t   clips;
+  _Atomic uint64_t   frames_written;
+  _Atomic uint64_t   dropped;
+  _Atomic uint64_t   skipped;
+  _Atomic uint64_t   bytes_used;
+  _Atomic uint64_t   max_bytes_used;
+  atomic_uint        frames_kept;
+  atomic_int         failed;
+};
+
+#define LOAD(p)     atomic_load_explicit(&(p), memory_order_relaxed)
+#define STORE(p, v) atomic_store_explicit(&(p), (v), memory_order_relaxed)
+#define INC(p)      atomic_fetch_add_explicit(&(p), 1, memory_order_relaxed)
+
+/* ---------- Capture side ---------- */
+
+static uint64_t used_from(pretrig_t *p, uint64_t head, uint64_t dflt) {
+  return p->tail < head ? p->au[p->tail & p->mask].off : dflt;
+}
+
+// Drops the oldest GOP unless the writer still needs part of it.
+static int evict_gop(pretrig_t *p, uint64_t head) {
+  if (p->tail == head) return 0;
+  uint64_t next = p->gop_head - p->gop_tail > 1 ? p->gop[(p->gop_tail + 1) & p->mask] : head;
+  if (atomic_load_explicit(&p->flushing, memory_order_acquire) &&
+      next > atomic_load_explicit(&p->rd, memory_order_acquire))
+    return 0;
+  p->tail = next;
+  p->gop_tail++;
+  return 1;
+}
+
+static void start_clip(pretrig_t *p, int64_t t_ns, const struct h264_ps *ps) {
+  p->in_clip = 1;
+  p->clip_end_ns = t_ns + p->post_ns;
+  p->clip_ps_len = h264_ps_annexb(ps, p->clip_ps, sizeof(p->clip_ps));
+  atomic_store_explicit(&p->rd, p->tail, memory_order_relaxed);
+  atomic_store_explicit(&p->clip_end, CLIP_OPEN, memory_order_relaxed);
+  atomic_store_explicit(&p->flushing, 1, memory_order_release);
+}
+
+void pretrig_push(pretrig_t *p, const uvc_frame_t *frame, int64_t t_ns,
+                  const struct h264_au_info *au, const struct h264_ps *ps,
+                  const struct vicon_frame_rec *pose) {
+  uint64_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+  uint32_t size = (uint32_t)frame->data_bytes;
+  int idr = au->has_idr;
+
+  if (atomic_exchange_explicit(&p->trig, 0, memory_order_acquire)) {
+    if (p->in_clip) {
+      p->clip_end_ns = t_ns + p->post_ns;
+      INC(p->triggers);
+    } else if (!atomic_load_explicit(&p->flushing, memory_order_acquire)) {
+      start_clip(p, t_ns, ps);
+      INC(p->triggers);
+    } else {
+      // The previous clip is still being written out: try again next frame.
+      atomic_store_explicit(&p->trig, 1, memory_order_relaxed);
+    }
+  }
+  if (p->in_clip && t_ns >= p->clip_end_ns) {
+    atomic_store_explicit(&p->clip_end, head, memory_order_release);
+    p->in_clip = 0;
+  }
+
+  if (!idr && p->wait_idr) { INC(p->skipped); return; }
+
+  uint64_t off;
+  for (;;) {
+    if (p->tail == head && p->head_b % p->cap)
+      p->head_b += p->cap - p->head_b % p->cap;   // empty: restart at the arena start
+    off = p->head_b;
+    if (off % p->cap + size > p->cap) off += p->cap - off % p->cap;
+    if (head - p->tail <= p->mask && off + size - used_from(p, head, off) <= p->cap) break;
+    if (size > p->cap || !evict_gop(p, head)) {
+      // Full, and what is left is pinned by the writer (or the AU is
+      // bigger than the arena): lose this GOP.
+      INC(p->dropped);
+      p->wait_idr = 1;
+      return;
+    }
+  }
+  if (p->tail == head && !idr) {
+    // The GOP this AU belongs to was just evicted.
+    INC(p->skipped);
+    p->wait_idr = 1;
+    return;
+  }
+
+  struct pretrig_au *a = &p->au[head & p->mask];
+  memcpy(p->arena + off % p->cap, frame->data, size);
+  a->off        = off;
+  a->size       = size;
+  a->sequence   = frame->sequence;
+  a->t_ns       = t_ns;
+  a->capture_ns = (int64_t)frame->capture_time.tv_sec * 1000000000LL +
+                  (int64_t)frame->capture_time.tv_usec * 1000LL;
+  a->flags      = (idr ? TCAP_FLAG_IDR : 0) | (au->has_sps && au->has_pps ? AU_HAS_PS : 0);
+  a->has_pose   = pose != NULL;
+  if (pose) a->pose = *pose;
+  if (idr) {
+    p->gop[p->gop_head++ & p->mask] = head;
+    p->wait_idr = 0;
+  }
+  p->head_b = off + size;
+  atomic_store_explicit(&p->head, head + 1, memory_order_release);
+
+  // Keep N seconds: from the last IDR at or before t - pre.
+  while (p->gop_head - p->gop_tail > 1 &&
+         p->au[p->gop[(p->gop_tail + 1) & p->mask] & p->mask].t_ns <= t_ns - p->pre_ns &&
+         evict_gop(p, head + 1))
+    ;
+
+  uint64_t used = p->head_b - used_from(p, head + 1, p->head_b);
+  STORE(p->bytes_used, used);
+  if (used > LOAD(p->max_bytes_used)) STORE(p->max_bytes_used, used);
+  STORE(p->frames_kept, (unsigned int)(head + 1 - p->tail));
+}
+
+void pretrig_trigger(pretrig_t *p) {
+  if (p) atomic_store_explicit(&p->trig, 1, memory_order_release);
+}
+
+/* ---------- Writer thread ---------- */
+
+struct clip {
+  tcap_writer_t *w;
+  FILE          *csv;
+  char           path[300];
+  uint64_t       frames;
+  int64_t        t_first, t_last;
+  int            failed;
+};
+
+static int clip_open(pretrig_t *p, struct clip *c, unsigned int n) {
+  char csv_path[320];
+  memset(c, 0, sizeof(*c));
+  snprintf(c->path, sizeof(c->path), "%s_%03u.tcap", p->prefix, n);
+  snprintf(csv_path, sizeof(csv_path), "%s_%03u_vicon.csv", p->prefix, n);
+  c->w   = tcap_writer_open(c->path, &p->mode);
+  c->csv = fopen(csv_path, "w");
+  if (!c->csv) perror(csv_path);
+  else fputs(VICON_FRAME_LOG_HEADER, c->csv);
+  c->failed = !c->w || !c->csv;
+  return !c->failed;
+}
+
+static void clip_write(pretrig_t *p, struct clip *c, const struct pretrig_au *a) {
+  uvc_frame_t f;
+  uint8_t *joined = NULL;
+  memset(&f, 0, sizeof(f));
+  f.data       = p->arena + a->off % p->cap;
+  f.data_bytes = a->size;
+  f.sequence   = a->sequence;
+  f.capture_time.tv_sec  = a->capture_ns / 1000000000LL;
+  f.capture_time.tv_usec = (a->capture_ns % 1000000000LL) / 1000;
+
+  // A clip must decode on its own: give its first IDR the parameter sets.
+  if (c->frames == 0 && !(a->flags & AU_HAS_PS) && p->clip_ps_len) {
+    joined = malloc(p->clip_ps_len + a->size);
+    if (joined) {
+      memcpy(joined, p->clip_ps, p->clip_ps_len);
+      memcpy(joined + p->clip_ps_len, f.data, a->size);
+      f.data = joined;
+      f.data_bytes = p->clip_ps_len + a->size;
+    }
+  }
+  if (c->w && tcap_writer_append(c->w, &f, a->flags & TCAP_FLAG_IDR) != 0) c->failed = 1;
+  free(joined);
+  if (c->csv && a->has_pose) vicon_frame_rec_print(c->csv, &a->pose);
+
+  if (c->frames++ == 0) c->t_first = a->t_ns;
+  c->t_last = a->t_ns;
+  INC(p->frames_written);
+}
+
+static void clip_close(pretrig_t *p, struct clip *c) {
+  if (c->w && tcap_writer_close(c->w) != 0) c->failed = 1;
+  if (c->csv && fclose(c->csv) != 0) c->failed = 1;
+  if (c->failed) STORE(p->failed, 1);
+  fprintf(stderr, "pretrig: %s: %llu frames, %.1f s%s\n", c->path,
+          (unsigned long long)c->frames,
+          c->frames ? (double)(c->t_last - c->t_first) / 1e9 : 0.0,
+          c->failed ? " (incomplete: write error)" : "");
+  INC(p->clips);
+}
+
+// Writes what is available of the clip; returns 1 once it is complete.
+static int drain(pretrig_t *p, struct clip *c) {
+  uint64_t end = atomic_load_explicit(&p->clip_end, memory_order_acquire);
+  uint64_t h   = atomic_load_explicit(&p->head, memory_order_acquire);
+  uint64_t i   = atomic_load_explicit(&p->rd, memory_order_relaxed);
+  uint64_t lim = h < end ? h : end;
+  for (; i < lim; ++i) {
+    clip_write(p, c, &p->au[i & p->mask]);
+    // Release the AU to the producer as soon as it is written.
+    atomic_store_explicit(&p->rd, i + 1, memory_order_release);
+  }
+  return end != CLIP_OPEN && i >= end;
+}
+
+static void *writer_fn(void *arg) {
+  pretrig_t *p = arg;
+  const struct timespec poll = { 0, WRITER_POLL_MS * 1000000L };
+  struct clip c;
+  unsigned int n = 0;
+  int open = 0;
+
+  for (;;) {
+    int stop = atomic_load_explicit(&p->stop, memory_order_acquire);
+    if (!open && atomic_load_explicit(&p->flushing, memory_order_acquire)) {
+      clip_open(p, &c, ++n);
+      open = 1;
+    }
+    if (open && drain(p, &c)) {
+      clip_close(p, &c);
+      open = 0;
+      atomic_store_explicit(&p->flushing, 0, memory_order_release);
+    }
+    if (stop && !open) break;
+    nanosleep(&poll, NULL);
+  }
+  return NULL;
+}
+
+/* ---------- Lifetime ---------- */
+
+pretrig_t *pretrig_new(const struct pretrig_config *c) {
+  uint64_t cap = c->bytes ? c->bytes : (uint64_t)PRETRIG_DEFAULT_MB * 1024 * 1024;
+  uint64_t want = c->slots ? c->slots
+                           : (uint64_t)((c->pre_ns + c->post_ns) / 1000000000LL + 2) * SLOT_FPS;
+  uint64_t n = 64;
+  while (n < want) n <<= 1;
+
+  pretrig_t *p = calloc(1, sizeof(*p));
+  if (!p) return NULL;
+  p->cap     = cap;
+  p->mask    = n - 1;
+  p->pre_ns  = c->pre_ns;
+  p->post_ns = c->post_ns;
+  p->mode    = c->mode;
+  p->wait_idr = 1;
+  snprintf(p->prefix, sizeof(p->prefix), "%s", c->prefix ? c->prefix : "clip");
+  p->arena = malloc(cap);
+  p->au    = calloc(n, sizeof(*p->au));
+  p->gop   = calloc(n, sizeof(*p->gop));
+  if (!p->arena || !p->au || !p->gop) goto fail;
+  // Touch the arena now rather than on the capture thread's first laps.
+  memset(p->arena, 0, cap);
+
+  int err = pthread_create(&p->thr, NULL, writer_fn, p);
+  if (err != 0) {
+    fprintf(stderr, "pretrig: pthread_create: %s\n", strerror(err));
+    goto fail;
+  }
+  return p;
+
+fail:
+  free(p->arena);
+  free(p->au);
+  free(p->gop);
+  free(p);
+  return NULL;
+}
+
+void pretrig_free(pretrig_t *p) {
+  if (!p) return;
+  // The producer has stopped: close the clip where the capture ended.
+  if (p->in_clip) {
+    atomic_store_explicit(&p->clip_end, atomic_load(&p->head), memory_order_release);
+    p->in_clip = 0;
+  }
+  atomic_store_explicit(&p->stop, 1, memory_order_release);
+  pthread_join(p->thr, NULL);
+  free(p->arena);
+  free(p->au);
+  free(p->gop);
+  free(p);
+}
+
+void pretrig_get_stats(pretrig_t *p, struct pretrig_stats *out) {
+  out->triggers       = LOAD(p->triggers);
+  out->clips          = LOAD(p->clips);
+  out->frames_written = LOAD(p->frames_written);
+  out->dropped        = LOAD(p->dropped);
+  out->skipped        = LOAD(p->skipped);
+  out->bytes_used     = LOAD(p->bytes_used);
+  out->max_bytes_used = LOAD(p->max_bytes_used);
+  out->frames_kept    = LOAD(p->frames_kept);
+  out->writing        = LOAD(p->flushing);
+  out->failed         = LOAD(p->failed);
+}
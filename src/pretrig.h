@@ -0,0 +1,86 @@
+// pretrig.h
+// Pre-trigger recording: keep the last N seconds of encoded video in
+// memory and write them out only when something happens. The capture
+// thread copies each H.264 access unit into a fixed byte arena, together
+// with the Vicon pose matched to that frame; whole GOPs are evicted from
+// the front, so what is kept always starts on an IDR. The stream's current
+// SPS/PPS are put in front of the first IDR of a clip that lacks them.
+//
+// A trigger, from any thread or a signal handler, turns the ring into a
+// clip: everything kept (the last N seconds, rounded back to an IDR) plus
+// the next M seconds is written by a background thread to
+//   <prefix>_NNN.tcap         the access units as captured (see tcap.h)
+//   <prefix>_NNN.kfi          its keyframe index (see kf_index.h)
+//   <prefix>_NNN_vicon.csv    the pose of each frame (see vicon_frame_log.h)
+// A trigger during a clip extends it by M seconds from then.
+//
+// Memory is allocated once: the arena plus a fixed number of AU slots.
+// Pushing never allocates, locks or makes a syscall. While a clip is being
+// written its frames stay pinned; if the writer falls that far behind, new
+// frames are dropped (counted) and the clip resumes at the next IDR.
+
+#if !defined(__PRETRIG_H__)
+#define __PRETRIG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libuvc/libuvc.h"
+#include "h264_nal.h"
+#include "tcap.h"
+#include "vicon_frame_log.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define PRETRIG_DEFAULT_MB  256
+
+struct pretrig_config {
+  int64_t          pre_ns;        // kept before the trigger
+  int64_t          post_ns;       // recorded after it
+  size_t           bytes;         // payload arena (0 = PRETRIG_DEFAULT_MB)
+  unsigned int     slots;         // AU slots (0 = enough for pre + post at 60 fps)
+  const char      *prefix;        // clip file names
+  struct tcap_mode mode;          // written into each clip
+};
+
+struct pretrig_stats {
+  uint64_t triggers;
+  uint64_t clips;                 // finished
+  uint64_t frames_written;
+  uint64_t dropped;               // no room while a clip was pinned
+  uint64_t skipped;               // non-IDR frames with no IDR before them
+  uint64_t bytes_used;            // arena in use now
+  uint64_t max_bytes_used;
+  uint32_t frames_kept;           // AUs in the ring now
+  int      writing;               // a clip is open
+  int      failed;                // a clip could not be written
+};
+
+typedef struct pretrig pretrig_t;
+
+// Allocates the ring and starts the writer thread.
+extern pretrig_t *pretrig_new(const struct pretrig_config *c);
+
+// Finishes the clip in progress (if any), stops the thread, frees.
+// Call once the capture thread has stopped pushing.
+extern void       pretrig_free(pretrig_t *p);
+
+// Capture thread only. t_ns is the frame's host monotonic time, ps the
+// stream's current parameter sets, pose the Vicon sample matched to the
+// frame (NULL if none).
+extern void       pretrig_push(pretrig_t *p, const uvc_frame_t *frame, int64_t t_ns,
+                               const struct h264_au_info *au, const struct h264_ps *ps,
+                               const struct vicon_frame_rec *pose);
+
+// Any thread, async-signal-safe: takes effect at the next push.
+extern void       pretrig_trigger(pretrig_t *p);
+
+// Safe from any thread.
+extern void       pretrig_get_stats(pretrig_t *p, struct pretrig_stats *out);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
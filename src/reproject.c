@@ -0,0 +1,438 @@
+// reproject.c
+// See reproject.h.
+//
+// Table layout, per view: tiles in row-major order, each tile's entries
+// row-major inside it and stored as two parallel arrays so SIMD kernels can
+// load eight of them at once:
+//   off[i]  byte offset of the top-left tap; bit 31 set when the right-hand
+//           taps wrap around to column 0 (the 180-degree seam)
+//   frac[i] fx | fy << 8, both in 1/128 (fy may be 128 at the bottom edge)
+// All kernels use the same separable integer bilinear filter,
+//   top = (p00 * (128 - fx) + p01 * fx + 64) >> 7, likewise bottom,
+//   out = (top * (128 - fy) + bottom * fy + 64) >> 7,
+// so their output is bit-identical.
+//
+// SIMD kernels load four bytes per tap. Tiles with a tap whose 4-byte read
+// would run past the end of the source frame (only possible on its last
+// row) are marked and always take the scalar path.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REPROJECT_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define REPROJECT_NEON 1
+#endif
+
+#include "reproject.h"
+
+#define WRAP_BIT   0x80000000u
+
+struct tile {
+  uint32_t first;       // index of the tile's first entry
+  uint16_t x, y, w, h;  // output rectangle
+  uint32_t scalar;      // 1 = a tap would over-read the source
+};
+
+struct reproject {
+  struct reproject_view view;
+  int       src_w, src_h, src_stride;
+  int       ntiles;
+  struct tile *tiles;
+  uint32_t *off;
+  uint16_t *frac;
+};
+
+// Samples n consecutive output pixels.
+typedef void (*span_fn)(const uint8_t *src, int stride, int wrap_dx,
+                        const uint32_t *off, const uint16_t *frac,
+                        uint8_t *dst, int n);
+
+static inline int lerp7(int a, int b, int f) {
+  return (a * (128 - f) + b * f + 64) >> 7;
+}
+
+static void span_scalar(const uint8_t *src, int stride, int wrap_dx,
+                        const uint32_t *off, const uint16_t *frac,
+                        uint8_t *dst, int n) {
+  for (int i = 0; i < n; i++) {
+    uint32_t o = off[i] & ~WRAP_BIT;
+    int dx = (off[i] & WRAP_BIT) ? wrap_dx : 3;
+    int fx = frac[i] & 0xff, fy = frac[i] >> 8;
+    const uint8_t *p00 = src + o, *p01 = p00 + dx;
+    const uint8_t *p10 = p00 + stride, *p11 = p01 + stride;
+    for (int c = 0; c < 3; c++) {
+      int t = lerp7(p00[c], p01[c], fx);
+      int b = lerp7(p10[c], p11[c], fx);
+      dst[3 * i + c] = (uint8_t)lerp7(t, b, fy);
+    }
+  }
+}
+
+#if defined(REPROJECT_X86)
+
+static inline uint32_t load32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Four BGRx pixels in, 12 BGR bytes out.
+__attribute__((target("sse4.1")))
+static inline void store_bgr4(uint8_t *dst, __m128i px) {
+  const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  px = _mm_shuffle_epi8(px, pack);
+  _mm_storel_epi64((__m128i *)dst, px);
+  uint32_t tail = (uint32_t)_mm_extract_epi32(px, 2);
+  memcpy(dst + 8, &tail, sizeof(tail));
+}
+
+// Bilinear on four BGRx pixels per 32-bit lane, channels split into
+// (B,R) and (G,x) 16-bit pairs so one mullo handles two channels.
+__attribute__((target("sse4.1")))
+static inline __m128i bilerp4(__m128i p00, __m128i p01, __m128i p10, __m128i p11,
+                              __m128i f) {
+  const __m128i m = _mm_set1_epi32(0x00ff00ff);
+  const __m128i c128 = _mm_set1_epi16(128), c64 = _mm_set1_epi16(64);
+  __m128i fx = _mm_and_si128(f, _mm_set1_epi32(0xff));
+  __m128i fy = _mm_srli_epi32(f, 8);
+  fx = _mm_or_si128(fx, _mm_slli_epi32(fx, 16));
+  fy = _mm_or_si128(fy, _mm_slli_epi32(fy, 16));
+  __m128i gx = _mm_sub_epi16(c128, fx), gy = _mm_sub_epi16(c128, fy);
+
+#define LERP(a, b, wa, wb) _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16( \
+      _mm_mullo_epi16(a, wa), _mm_mullo_epi16(b, wb)), c64), 7)
+  __m128i t_rb = LERP(_mm_and_si128(p00, m), _mm_and_si128(p01, m), gx, fx);
+  __m128i b_rb = LERP(_mm_and_si128(p10, m), _mm_and_si128(p11, m), gx, fx);
+  __m128i t_g  = LERP(_mm_and_si128(_mm_srli_epi32(p00, 8), m),
+                      _mm_and_si128(_mm_srli_epi32(p01, 8), m), gx, fx);
+  __m128i b_g  = LERP(_mm_and_si128(_mm_srli_epi32(p10, 8), m),
+                      _mm_and_si128(_mm_srli_epi32(p11, 8), m), gx, fx);
+  __m128i rb = LERP(t_rb, b_rb, gy, fy);
+  __m128i g  = LERP(t_g, b_g, gy, fy);
+#undef LERP
+  return _mm_or_si128(rb, _mm_slli_epi32(g, 8));
+}
+
+__attribute__((target("sse4.1")))
+static void span_sse41(const uint8_t *src, int stride, int wrap_dx,
+                       const uint32_t *off, const uint16_t *frac,
+                       uint8_t *dst, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    uint32_t o[4], o1[4];
+    for (int k = 0; k < 4; k++) {
+      o[k]  = off[i + k] & ~WRAP_BIT;
+      o1[k] = o[k] + (uint32_t)((off[i + k] & WRAP_BIT) ? wrap_dx : 3);
+    }
+#define GATHER(base, o) _mm_setr_epi32((int)load32(base + o[0]), (int)load32(base + o[1]), \
+                                       (int)load32(base + o[2]), (int)load32(base + o[3]))
+    __m128i p00 = GATHER(src, o), p01 = GATHER(src, o1);
+    __m128i p10 = GATHER(src + stride, o), p11 = GATHER(src + stride, o1);
+#undef GATHER
+    __m128i f = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)(frac + i)));
+    store_bgr4(dst + 3 * i, bilerp4(p00, p01, p10, p11, f));
+  }
+  span_scalar(src, stride, wrap_dx, off + i, frac + i, dst + 3 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void span_avx2(const uint8_t *src, int stride, int wrap_dx,
+                      const uint32_t *off, const uint16_t *frac,
+                      uint8_t *dst, int n) {
+  const __m256i m = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i c128 = _mm256_set1_epi16(128), c64 = _mm256_set1_epi16(64);
+  const __m256i three = _mm256_set1_epi32(3);
+  const __m256i wrap = _mm256_set1_epi32(wrap_dx - 3);
+  const __m256i low31 = _mm256_set1_epi32(0x7fffffff);
+  const int *base0 = (const int *)src, *base1 = (const int *)(src + stride);
+  int i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    __m256i ov = _mm256_loadu_si256((const __m256i *)(off + i));
+    __m256i w  = _mm256_srai_epi32(ov, 31);                  // all ones on wrap
+    __m256i o  = _mm256_and_si256(ov, low31);
+    __m256i o1 = _mm256_add_epi32(o, _mm256_add_epi32(three, _mm256_and_si256(w, wrap)));
+    __m256i p00 = _mm256_i32gather_epi32(base0, o, 1);
+    __m256i p01 = _mm256_i32gather_epi32(base0, o1, 1);
+    __m256i p10 = _mm256_i32gather_epi32(base1, o, 1);
+    __m256i p11 = _mm256_i32gather_epi32(base1, o1, 1);
+
+    __m256i f  = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(frac + i)));
+    __m256i fx = _mm256_and_si256(f, _mm256_set1_epi32(0xff));
+    __m256i fy = _mm256_srli_epi32(f, 8);
+    fx = _mm256_or_si256(fx, _mm256_slli_epi32(fx, 16));
+    fy = _mm256_or_si256(fy, _mm256_slli_epi32(fy, 16));
+    __m256i gx = _mm256_sub_epi16(c128, fx), gy = _mm256_sub_epi16(c128, fy);
+
+#define LERP(a, b, wa, wb) _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16( \
+      _mm256_mullo_epi16(a, wa), _mm256_mullo_epi16(b, wb)), c64), 7)
+#define LO(p) _mm256_and_si256(p, m)
+#define HI(p) _mm256_and_si256(_mm256_srli_epi32(p, 8), m)
+    __m256i rb = LERP(LERP(LO(p00), LO(p01), gx, fx), LERP(LO(p10), LO(p11), gx, fx), gy, fy);
+    __m256i g  = LERP(LERP(HI(p00), HI(p01), gx, fx), LERP(HI(p10), HI(p11), gx, fx), gy, fy);
+#undef HI
+#undef LO
+#undef LERP
+    __m256i px = _mm256_or_si256(rb, _mm256_slli_epi32(g, 8));
+    store_bgr4(dst + 3 * i, _mm256_castsi256_si128(px));
+    store_bgr4(dst + 3 * i + 12, _mm256_extracti128_si256(px, 1));
+  }
+  span_scalar(src, stride, wrap_dx, off + i, frac + i, dst + 3 * i, n - i);
+}
+
+#endif // REPROJECT_X86
+
+#if defined(REPROJECT_NEON)
+
+static inline uint32x4_t gather4(const uint8_t *base, const uint32_t *o) {
+  uint32_t v[4];
+  for (int k = 0; k < 4; k++) memcpy(&v[k], base + o[k], sizeof(v[k]));
+  return vld1q_u32(v);
+}
+
+static inline uint16x8_t lerp_neon(uint16x8_t a, uint16x8_t b, uint16x8_t wa, uint16x8_t wb) {
+  uint16x8_t s = vmlaq_u16(vmulq_u16(a, wa), b, wb);
+  return vshrq_n_u16(vaddq_u16(s, vdupq_n_u16(64)), 7);
+}
+
+static void span_neon(const uint8_t *src, int stride, int wrap_dx,
+                      const uint32_t *off, const uint16_t *frac,
+                      uint8_t *dst, int n) {
+  const uint32x4_t m = vdupq_n_u32(0x00ff00ff);
+  const uint16x8_t c128 = vdupq_n_u16(128);
+  int i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    uint32_t o[4], o1[4];
+    for (int k = 0; k < 4; k++) {
+      o[k]  = off[i + k] & ~WRAP_BIT;
+      o1[k] = o[k] + (uint32_t)((off[i + k] & WRAP_BIT) ? wrap_dx : 3);
+    }
+    uint32x4_t p00 = gather4(src, o), p01 = gather4(src, o1);
+    uint32x4_t p10 = gather4(src + stride, o), p11 = gather4(src + stride, o1);
+
+    uint32x4_t f  = vmovl_u16(vld1_u16(frac + i));
+    uint32x4_t fx = vandq_u32(f, vdupq_n_u32(0xff));
+    uint32x4_t fy = vshrq_n_u32(f, 8);
+    uint16x8_t wx = vreinterpretq_u16_u32(vorrq_u32(fx, vshlq_n_u32(fx, 16)));
+    uint16x8_t wy = vreinterpretq_u16_u32(vorrq_u32(fy, vshlq_n_u32(fy, 16)));
+    uint16x8_t gx = vsubq_u16(c128, wx), gy = vsubq_u16(c128, wy);
+
+#define LO(p) vreinterpretq_u16_u32(vandq_u32(p, m))
+#define HI(p) vreinterpretq_u16_u32(vandq_u32(vshrq_n_u32(p, 8), m))
+    uint16x8_t rb = lerp_neon(lerp_neon(LO(p00), LO(p01), gx, wx),
+                              lerp_neon(LO(p10), LO(p11), gx, wx), gy, wy);
+    uint16x8_t g  = lerp_neon(lerp_neon(HI(p00), HI(p01), gx, wx),
+                              lerp_neon(HI(p10), HI(p11), gx, wx), gy, wy);
+#undef HI
+#undef LO
+    uint32x4_t px = vorrq_u32(vreinterpretq_u32_u16(rb), vshlq_n_u32(vreinterpretq_u32_u16(g), 8));
+    uint8x16_t b = vreinterpretq_u8_u32(px);
+    static const uint8_t pack[16] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0 };
+    uint8x16_t packed = vqtbl1q_u8(b, vld1q_u8(pack));
+    uint8_t tmp[16];
+    vst1q_u8(tmp, packed);
+    memcpy(dst + 3 * i, tmp, 12);
+  }
+  span_scalar(src, stride, wrap_dx, off + i, frac + i, dst + 3 * i, n - i);
+}
+
+#endif // REPROJECT_NEON
+
+static span_fn g_span;
+
+int reproject_select(int level) {
+  level = simd_resolve(level);
+  switch (level) {
+#if defined(REPROJECT_X86)
+  case SIMD_SSE41: g_span = span_sse41; break;
+  case SIMD_AVX2:  g_span = span_avx2; break;
+#endif
+#if defined(REPROJECT_NEON)
+  case SIMD_NEON:  g_span = span_neon; break;
+#endif
+  default:         g_span = span_scalar; level = SIMD_SCALAR; break;
+  }
+  return level;
+}
+
+// Output pixel centre -> equirect source coordinate (pixel units).
+static void map_pixel(const struct reproject_view *v, double f,
+                      const double rot[3][3], int src_w, int src_h,
+                      int x, int y, double *u, double *w) {
+  double cx = (x + 0.5 - v->width * 0.5) / f;
+  double cy = (y + 0.5 - v->height * 0.5) / f;
+  double dx = rot[0][0] * cx + rot[0][1] * cy + rot[0][2];
+  double dy = rot[1][0] * cx + rot[1][1] * cy + rot[1][2];
+  double dz = rot[2][0] * cx + rot[2][1] * cy + rot[2][2];
+  double lon = atan2(dx, dz);                         // 0 = image centre
+  double lat = atan2(-dy, sqrt(dx * dx + dz * dz));   // +pi/2 = top row
+  *u = (lon / (2.0 * M_PI) + 0.5) * src_w - 0.5;
+  *w = (0.5 - lat / M_PI) * src_h - 0.5;
+}
+
+reproject_t *reproject_new(const struct reproject_view *v,
+                           int src_w, int src_h, int src_stride) {
+  if (!v || v->width <= 0 || v->height <= 0 || v->fov <= 0 || v->fov >= 180 ||
+      src_w < 2 || src_h < 2 || src_stride < src_w * 3) return NULL;
+
+  reproject_t *rp = calloc(1, sizeof(*rp));
+  if (!rp) return NULL;
+  rp->view = *v;
+  rp->src_w = src_w;
+  rp->src_h = src_h;
+  rp->src_stride = src_stride;
+
+  int tx = (v->width + REPROJECT_TILE_W - 1) / REPROJECT_TILE_W;
+  int ty = (v->height + REPROJECT_TILE_H - 1) / REPROJECT_TILE_H;
+  size_t n = (size_t)v->width * v->height;
+  rp->ntiles = tx * ty;
+  rp->tiles = calloc((size_t)rp->ntiles, sizeof(*rp->tiles));
+  rp->off = malloc(n * sizeof(*rp->off));
+  rp->frac = malloc(n * sizeof(*rp->frac));
+  if (!rp->tiles || !rp->off || !rp->frac) { reproject_free(rp); return NULL; }
+
+  // Camera looks down +z with x right and y down; pitch about x, then yaw
+  // about y. Columns of rot are the camera axes in world coordinates.
+  double yaw = v->yaw * M_PI / 180.0, pitch = v->pitch * M_PI / 180.0;
+  double cy = cos(yaw), sy = sin(yaw), cp = cos(pitch), sp = sin(pitch);
+  const double rot[3][3] = {
+    { cy,  sy * sp, sy * cp },
+    { 0,   cp,      -sp     },
+    { -sy, cy * sp, cy * cp },
+  };
+  double f = v->width * 0.5 / tan(v->fov * M_PI / 360.0);
+  size_t src_bytes = (size_t)src_stride * (src_h - 1) + (size_t)src_w * 3;
+
+  uint32_t idx = 0;
+  for (int t = 0; t < rp->ntiles; t++) {
+    struct tile *tl = &rp->tiles[t];
+    tl->x = (uint16_t)((t % tx) * REPROJECT_TILE_W);
+    tl->y = (uint16_t)((t / tx) * REPROJECT_TILE_H);
+    tl->w = (uint16_t)(v->width - tl->x < REPROJECT_TILE_W ? v->width - tl->x : REPROJECT_TILE_W);
+    tl->h = (uint16_t)(v->height - tl->y < REPROJECT_TILE_H ? v->height - tl->y : REPROJECT_TILE_H);
+    tl->first = idx;
+
+    for (int y = tl->y; y < tl->y + tl->h; y++) {
+      for (int x = tl->x; x < tl->x + tl->w; x++, idx++) {
+        double u, w;
+        map_pixel(v, f, rot, src_w, src_h, x, y, &u, &w);
+
+        if (u < 0) u += src_w;
+        int x0 = (int)floor(u);
+        int fx = (int)lround((u - x0) * 128.0);
+        if (fx >= 128) { x0++; fx = 0; }
+        if (x0 >= src_w) x0 -= src_w;
+        if (x0 < 0) x0 = 0;
+
+        if (w < 0) w = 0;
+        if (w > src_h - 1) w = src_h - 1;
+        int y0 = (int)floor(w);
+        int fy = (int)lround((w - y0) * 128.0);
+        if (y0 > src_h - 2) { y0 = src_h - 2; fy = 128; }
+
+        int wrap = x0 == src_w - 1;
+        uint32_t o = (uint32_t)((size_t)y0 * src_stride + (size_t)x0 * 3);
+        size_t o11 = o + (size_t)src_stride + (wrap ? 0 : 3);
+        if (o11 + 4 > src_bytes) tl->scalar = 1;
+        rp->off[idx]  = o | (wrap ? WRAP_BIT : 0);
+        rp->frac[idx] = (uint16_t)(fx | fy << 8);
+      }
+    }
+  }
+  return rp;
+}
+
+void reproject_free(reproject_t *rp) {
+  if (!rp) return;
+  free(rp->tiles);
+  free(rp->off);
+  free(rp->frac);
+  free(rp);
+}
+
+int reproject_matches(const reproject_t *rp, int src_w, int src_h, int src_stride) {
+  return rp && rp->src_w == src_w && rp->src_h == src_h && rp->src_stride == src_stride;
+}
+
+const struct reproject_view *reproject_get_view(const reproject_t *rp) {
+  return &rp->view;
+}
+
+size_t reproject_table_bytes(const reproject_t *rp) {
+  size_t n = (size_t)rp->view.width * rp->view.height;
+  return n * (sizeof(*rp->off) + sizeof(*rp->frac)) + (size_t)rp->ntiles * sizeof(*rp->tiles);
+}
+
+struct job {
+  reproject_t *const *rps;
+  int n;
+  const uint8_t *src;
+  uint8_t *const *dst;
+  const int *dst_stride;
+  span_fn span;
+};
+
+// One band = one tile of one view.
+static void run_tile(void *ctx, int band, int nbands) {
+  (void)nbands;
+  const struct job *j = ctx;
+  int v = 0;
+  while (v < j->n && band >= j->rps[v]->ntiles) band -= j->rps[v++]->ntiles;
+  if (v == j->n) return;
+
+  const reproject_t *rp = j->rps[v];
+  const struct tile *tl = &rp->tiles[band];
+  span_fn span = tl->scalar ? span_scalar : j->span;
+  int wrap_dx = 3 - 3 * rp->src_w;
+  const uint32_t *off = rp->off + tl->first;
+  const uint16_t *frac = rp->frac + tl->first;
+
+  for (int r = 0; r < tl->h; r++) {
+    uint8_t *d = j->dst[v] + (size_t)(tl->y + r) * j->dst_stride[v] + (size_t)tl->x * 3;
+    span(j->src, rp->src_stride, wrap_dx, off, frac, d, tl->w);
+    off += tl->w;
+    frac += tl->w;
+  }
+}
+
+void reproject_run(reproject_t *const *rps, int n, const uint8_t *src,
+                   uint8_t *const *dst, const int *dst_stride, band_pool_t *pool) {
+  if (!g_span) reproject_select(SIMD_AUTO);
+  struct job j = { rps, n, src, dst, dst_stride, g_span };
+  int ntiles = 0;
+  for (int i = 0; i < n; i++) ntiles += rps[i]->ntiles;
+  band_pool_run(pool, ntiles, run_tile, &j);
+}
+
+int reproject_parse_view(const char *s, struct reproject_view *v) {
+  memset(v, 0, sizeof(*v));
+  const char *eq = strchr(s, '=');
+  if (!eq || eq == s || (size_t)(eq - s) >= sizeof(v->name)) return -1;
+  memcpy(v->name, s, (size_t)(eq - s));
+  if (sscanf(eq + 1, "%lf,%lf,%lf,%dx%d", &v->yaw, &v->pitch, &v->fov,
+             &v->width, &v->height) != 5) return -1;
+  if (v->fov <= 0 || v->fov >= 180 || v->width <= 0 || v->height <= 0) return -1;
+  return 0;
+}
+
+void reproject_cubemap(int face_size, struct reproject_view out[6]) {
+  static const struct { const char *name; double yaw, pitch; } faces[6] = {
+    { "front", 0, 0 }, { "right", 90, 0 }, { "back", 180, 0 },
+    { "left", -90, 0 }, { "up", 0, 90 }, { "down", 0, -90 },
+  };
+  for (int i = 0; i < 6; i++) {
+    memset(&out[i], 0, sizeof(out[i]));
+    snprintf(out[i].name, sizeof(out[i].name), "%s", faces[i].name);
+    out[i].yaw = faces[i].yaw;
+    out[i].pitch = faces[i].pitch;
+    out[i].fov = 90.0;
+    out[i].width = out[i].height = face_size;
+  }
+}
@@ -0,0 +1,63 @@
+// reproject.h
+// Equirectangular BGR -> virtual pinhole views (a cubemap is six of them).
+// Each view gets a lookup table built once for a given source geometry:
+// output pixels are grouped into small tiles whose entries are stored
+// contiguously, and every entry holds the byte offset of the top-left
+// source tap plus 7-bit bilinear fractions. Sampling runs a SIMD kernel
+// chosen at run time, with the tiles of all views spread over a band_pool.
+
+#if !defined(__REPROJECT_H__)
+#define __REPROJECT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "band_pool.h"
+#include "simd_level.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define REPROJECT_MAX_VIEWS  8
+#define REPROJECT_TILE_W     64
+#define REPROJECT_TILE_H     16
+
+struct reproject_view {
+  char   name[16];      // shows up in the output name
+  double yaw;           // degrees, positive = right of the image centre
+  double pitch;         // degrees, positive = up
+  double fov;           // horizontal field of view, degrees
+  int    width, height;
+};
+
+typedef struct reproject reproject_t;
+
+// src_stride is in bytes; the table bakes it in, so a new source geometry
+// needs a new table (see reproject_matches()).
+extern reproject_t *reproject_new(const struct reproject_view *v,
+                                  int src_w, int src_h, int src_stride);
+extern void         reproject_free(reproject_t *rp);
+extern int          reproject_matches(const reproject_t *rp, int src_w, int src_h, int src_stride);
+extern const struct reproject_view *reproject_get_view(const reproject_t *rp);
+extern size_t       reproject_table_bytes(const reproject_t *rp);
+
+// Picks the sampling kernel (enum simd_level); returns the level selected.
+extern int          reproject_select(int level);
+
+// Renders n views of one source frame; dst[i] holds rps[i]'s output with
+// dst_stride[i] bytes per row. pool may be NULL.
+extern void         reproject_run(reproject_t *const *rps, int n, const uint8_t *src,
+                                  uint8_t *const *dst, const int *dst_stride,
+                                  band_pool_t *pool);
+
+// "NAME=YAW,PITCH,FOV,WxH", e.g. "front=0,0,90,1280x720". 0 on success.
+extern int          reproject_parse_view(const char *s, struct reproject_view *v);
+
+// Fills six 90-degree square faces: front, right, back, left, up, down.
+extern void         reproject_cubemap(int face_size, struct reproject_view out[6]);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,123 @@
+// reproject_bench.c
+// Throughput of the equirect -> view reprojection on a synthetic frame:
+// table build time, then ms/frame for every sampling kernel the CPU
+// supports, single-threaded and over the worker pool.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "reproject.h"
+
+static uint64_t now_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [--src WxH] [--cubemap SIZE] [--view NAME=YAW,PITCH,FOV,WxH]...\n"
+    "          [--frames N] [--threads N]\n"
+    "  --src WxH    : equirectangular source size (default: 3840x1920)\n"
+    "  --cubemap N  : six NxN faces (default when no view is given: 960)\n"
+    "  --view ...   : add a pinhole view, as in min_latency_from_uvc\n"
+    "  --frames N   : frames per configuration (default: 100)\n"
+    "  --threads N  : pool size for the multithreaded runs, 0 = one per CPU (default: 0)\n",
+    prog);
+}
+
+int main(int argc, char **argv) {
+  int sw = 3840, sh = 1920, frames = 100, threads = 0;
+  struct reproject_view views[REPROJECT_MAX_VIEWS];
+  int nviews = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--src") && i+1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &sw, &sh) != 2) { usage(argv[0]); return 1; }
+    }
+    else if (!strcmp(argv[i], "--cubemap") && i+1 < argc && nviews + 6 <= REPROJECT_MAX_VIEWS) {
+      reproject_cubemap(atoi(argv[++i]), &views[nviews]);
+      nviews += 6;
+    }
+    else if (!strcmp(argv[i], "--view") && i+1 < argc && nviews < REPROJECT_MAX_VIEWS) {
+      if (reproject_parse_view(argv[++i], &views[nviews]) != 0) { usage(argv[0]); return 1; }
+      nviews++;
+    }
+    else if (!strcmp(argv[i], "--frames")  && i+1 < argc) frames  = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i+1 < argc) threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else {
+      fprintf(stderr, "Unknown or excess arg: %s\n", argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (nviews == 0) {
+    reproject_cubemap(960, views);
+    nviews = 6;
+  }
+  if (sw < 2 || sh < 2 || frames < 1) { usage(argv[0]); return 1; }
+
+  int stride = sw * 3;
+  uint8_t *src = malloc((size_t)stride * sh);
+  if (!src) return 1;
+  uint32_t x = 12345u;
+  for (size_t i = 0; i < (size_t)stride * sh; i++) {
+    x = x * 1664525u + 1013904223u;
+    src[i] = (uint8_t)(x >> 24);
+  }
+
+  reproject_t *rp[REPROJECT_MAX_VIEWS];
+  uint8_t *dst[REPROJECT_MAX_VIEWS], *ref[REPROJECT_MAX_VIEWS];
+  int dst_stride[REPROJECT_MAX_VIEWS];
+  uint64_t t0 = now_monotonic_ns();
+  size_t table = 0, pixels = 0;
+  for (int i = 0; i < nviews; i++) {
+    rp[i] = reproject_new(&views[i], sw, sh, stride);
+    if (!rp[i]) { fprintf(stderr, "invalid view %s\n", views[i].name); return 1; }
+    table += reproject_table_bytes(rp[i]);
+    pixels += (size_t)views[i].width * views[i].height;
+    dst_stride[i] = views[i].width * 3;
+    dst[i] = malloc((size_t)dst_stride[i] * views[i].height);
+    ref[i] = malloc((size_t)dst_stride[i] * views[i].height);
+    if (!dst[i] || !ref[i]) return 1;
+  }
+  printf("%dx%d -> %d views, %.2f MPix/frame; tables %.1f MB built in %.0f ms\n",
+         sw, sh, nviews, (double)pixels / 1e6, (double)table / (1024.0 * 1024.0),
+         (double)(now_monotonic_ns() - t0) / 1e6);
+
+  reproject_select(SIMD_SCALAR);
+  reproject_run(rp, nviews, src, ref, dst_stride, NULL);
+
+  band_pool_t *pool = band_pool_new(threads);
+  static const int levels[] = { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON };
+  for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+    if (reproject_select(levels[l]) != levels[l]) continue;
+    for (int pass = 0; pass < 2; pass++) {
+      band_pool_t *p = pass ? pool : NULL;
+      if (pass && band_pool_threads(pool) == 1) break;
+      reproject_run(rp, nviews, src, dst, dst_stride, p);   // warm-up
+      int same = 1;
+      for (int i = 0; i < nviews; i++)
+        same &= memcmp(dst[i], ref[i], (size_t)dst_stride[i] * views[i].height) == 0;
+      t0 = now_monotonic_ns();
+      for (int f = 0; f < frames; f++) reproject_run(rp, nviews, src, dst, dst_stride, p);
+      double ms = (double)(now_monotonic_ns() - t0) / 1e6 / frames;
+      printf("  %-8s %3d thr  %8.2f ms/frame  %7.1f fps  %7.1f MPix/s%s\n",
+             simd_level_name(levels[l]), band_pool_threads(p), ms, 1000.0 / ms,
+             (double)pixels / (ms * 1000.0), same ? "" : "  OUTPUT DIFFERS FROM SCALAR");
+    }
+  }
+
+  band_pool_free(pool);
+  for (int i = 0; i < nviews; i++) {
+    reproject_free(rp[i]);
+    free(dst[i]);
+    free(ref[i]);
+  }
+  free(src);
+  return 0;
+}
@@ -0,0 +1,211 @@
+// shm_ring.c
+// See shm_ring.h. Classic seqlock per slot: the writer bumps seq to odd,
+// fills the slot, then bumps it to even; a reader's copy is valid only if
+// it saw the same even value before and after.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_ring.h"
+
+#define PAGE_ALIGN(x) (((x) + 4095u) & ~(size_t)4095u)
+
+static int64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define SEQ(p) ((_Atomic uint64_t *)&(p)->seq)
+#define WRITE_COUNT(h) ((_Atomic uint64_t *)&(h)->write_count)
+
+/* ---------- Writer ---------- */
+
+struct shm_ring_writer {
+  char                   *name;
+  struct shm_ring_header *hdr;
+  size_t                  size;
+  uint64_t                next;       // frame_index of the slot being written
+};
+
+shm_ring_writer_t *shm_ring_writer_create(const char *name, unsigned int nslots,
+                                          size_t slot_capacity) {
+  if (nslots < 2 || slot_capacity == 0) return NULL;
+
+  size_t header_bytes = PAGE_ALIGN(sizeof(struct shm_ring_header) +
+                                   nslots * sizeof(struct shm_ring_slot));
+  size_t stride = PAGE_ALIGN(slot_capacity);
+  size_t size = header_bytes + nslots * stride;
+
+  // Fresh segment every time: a reader holding the old one can never see
+  // a layout change under its feet.
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) { perror("shm_open"); return NULL; }
+  if (ftruncate(fd, (off_t)size) != 0) {
+    perror("ftruncate");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) { perror("mmap"); shm_unlink(name); return NULL; }
+
+  shm_ring_writer_t *w = calloc(1, sizeof(*w));
+  if (!w) { munmap(map, size); shm_unlink(name); return NULL; }
+  w->name = strdup(name);
+  w->hdr  = map;
+  w->size = size;
+
+  struct shm_ring_header *h = w->hdr;
+  h->version       = SHM_RING_VERSION;
+  h->nslots        = nslots;
+  h->header_bytes  = (uint32_t)header_bytes;
+  h->slot_capacity = slot_capacity;
+  h->total_bytes   = size;
+  h->writer_pid    = (int32_t)getpid();
+  for (unsigned int i = 0; i < nslots; i++)
+    h->slot[i].data_offset = header_bytes + (uint64_t)i * stride;
+  // Magic last: a reader that races the initialisation rejects the segment.
+  atomic_store_explicit((_Atomic uint32_t *)&h->magic, SHM_RING_MAGIC, memory_order_release);
+  return w;
+}
+
+void shm_ring_writer_destroy(shm_ring_writer_t *w) {
+  if (!w) return;
+  munmap(w->hdr, w->size);
+  shm_unlink(w->name);
+  free(w->name);
+  free(w);
+}
+
+size_t shm_ring_slot_capacity(const shm_ring_writer_t *w) {
+  return (size_t)w->hdr->slot_capacity;
+}
+
+uint8_t *shm_ring_begin_write(shm_ring_writer_t *w) {
+  struct shm_ring_slot *s = &w->hdr->slot[w->next % w->hdr->nslots];
+  uint64_t seq = atomic_load_explicit(SEQ(s), memory_order_relaxed);
+  if (!(seq & 1)) {
+    atomic_store_explicit(SEQ(s), seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+  }
+  return (uint8_t *)w->hdr + s->data_offset;
+}
+
+void shm_ring_commit(shm_ring_writer_t *w, const struct shm_ring_slot *meta) {
+  struct shm_ring_slot *s = &w->hdr->slot[w->next % w->hdr->nslots];
+  uint64_t seq = atomic_load_explicit(SEQ(s), memory_order_relaxed);
+
+  s->frame_index = w->next;
+  s->sequence    = meta->sequence;
+  s->capture_ns  = meta->capture_ns;
+  s->decode_ns   = meta->decode_ns;
+  s->publish_ns  = mono_ns();
+  s->format      = meta->format;
+  s->width       = meta->width;
+  s->height      = meta->height;
+  s->stride      = meta->stride;
+  s->bytes       = meta->bytes <= w->hdr->slot_capacity ? meta->bytes : w->hdr->slot_capacity;
+
+  atomic_store_explicit(SEQ(s), (seq | 1) + 1, memory_order_release);
+  w->next++;
+  atomic_store_explicit(WRITE_COUNT(w->hdr), w->next, memory_order_release);
+}
+
+/* ---------- Reader ---------- */
+
+struct shm_ring_reader {
+  const struct shm_ring_header *hdr;
+  size_t                        size;
+  uint64_t                      last_index;   // frame_index + 1 of the last copy
+  struct shm_ring_read_stats    stats;
+};
+
+shm_ring_reader_t *shm_ring_reader_open(const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct shm_ring_header)) {
+    close(fd);
+    return NULL;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  const struct shm_ring_header *h = map;
+  if (atomic_load_explicit((_Atomic uint32_t *)&h->magic, memory_order_acquire) != SHM_RING_MAGIC ||
+      h->version != SHM_RING_VERSION || h->total_bytes != (uint64_t)st.st_size) {
+    munmap(map, (size_t)st.st_size);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  shm_ring_reader_t *r = calloc(1, sizeof(*r));
+  if (!r) { munmap(map, (size_t)st.st_size); return NULL; }
+  r->hdr  = h;
+  r->size = (size_t)st.st_size;
+  // Start from whatever is newest now; older frames count as neither read nor skipped.
+  r->last_index = atomic_load_explicit(WRITE_COUNT(h), memory_order_acquire);
+  if (r->last_index) r->last_index--;
+  return r;
+}
+
+void shm_ring_reader_close(shm_ring_reader_t *r) {
+  if (!r) return;
+  munmap((void *)r->hdr, r->size);
+  free(r);
+}
+
+const struct shm_ring_header *shm_ring_reader_header(const shm_ring_reader_t *r) {
+  return r->hdr;
+}
+
+void shm_ring_reader_stats(const shm_ring_reader_t *r, struct shm_ring_read_stats *out) {
+  *out = r->stats;
+}
+
+int shm_ring_read_latest(shm_ring_reader_t *r, void *dst, size_t dst_size,
+                         struct shm_ring_slot *meta) {
+  const struct shm_ring_header *h = r->hdr;
+
+  for (;;) {
+    uint64_t count = atomic_load_explicit(WRITE_COUNT(h), memory_order_acquire);
+    if (count == 0 || count <= r->last_index) return 0;
+
+    uint64_t want = count - 1;
+    const struct shm_ring_slot *s = &h->slot[want % h->nslots];
+    uint64_t s1 = atomic_load_explicit(SEQ(s), memory_order_acquire);
+    if (s1 & 1) {
+      // The writer already lapped into this slot; the next count will differ.
+      r->stats.torn++;
+      continue;
+    }
+
+    struct shm_ring_slot m;
+    memcpy(&m, (const void *)s, sizeof(m));
+    if (m.frame_index != want) { r->stats.torn++; continue; }
+    if (m.bytes > dst_size) return -1;
+    memcpy(dst, (const uint8_t *)h + m.data_offset, (size_t)m.bytes);
+
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t s2 = atomic_load_explicit(SEQ(s), memory_order_relaxed);
+    if (s1 != s2) { r->stats.torn++; continue; }
+
+    r->stats.skipped += want - r->last_index;
+    r->stats.frames++;
+    r->last_index = want + 1;
+    if (meta) *meta = m;
+    return 1;
+  }
+}
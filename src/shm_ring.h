@@ -0,0 +1,96 @@
+// shm_ring.h
+// Fixed N-slot shared-memory frame ring with per-slot sequence counters.
+// One writer publishes frames round-robin and never waits for anyone; any
+// number of readers map the segment read-only, attach and detach at will,
+// and detect a slot being overwritten under them (torn read) by comparing
+// the slot's sequence counter before and after copying.
+
+#if !defined(__SHM_RING_H__)
+#define __SHM_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define SHM_RING_MAGIC          0x474e5254u   // "TRNG"
+#define SHM_RING_VERSION        1
+#define SHM_RING_DEFAULT_NAME   "/theta_bgr"
+#define SHM_RING_DEFAULT_SLOTS  4
+
+#define SHM_RING_FOURCC(a, b, c, d) \
+  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define SHM_RING_FMT_BGR        SHM_RING_FOURCC('B', 'G', 'R', '3')
+
+// Per-slot metadata. seq is odd while the writer is filling the slot.
+struct shm_ring_slot {
+  uint64_t seq;
+  uint64_t frame_index;      // publish counter, strictly increasing
+  uint64_t sequence;         // UVC frame->sequence
+  int64_t  capture_ns;       // UVC frame->capture_time
+  int64_t  decode_ns;        // CLOCK_MONOTONIC when the decoder emitted it
+  int64_t  publish_ns;       // CLOCK_MONOTONIC when the slot was committed
+  uint32_t format;           // SHM_RING_FMT_*
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint64_t bytes;
+  uint64_t data_offset;      // from the start of the segment
+  uint8_t  reserved[40];
+};
+
+struct shm_ring_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nslots;
+  uint32_t header_bytes;
+  uint64_t slot_capacity;    // max payload bytes per slot
+  uint64_t total_bytes;
+  uint64_t write_count;      // frames published; newest is write_count - 1
+  int32_t  writer_pid;
+  uint32_t reserved[7];
+  struct shm_ring_slot slot[];
+};
+
+/* ---------- Writer ---------- */
+typedef struct shm_ring_writer shm_ring_writer_t;
+
+// Creates (or recreates) the named segment. Readers still mapped to an
+// older segment of the same name keep their mapping and see no new frames.
+extern shm_ring_writer_t *shm_ring_writer_create(const char *name, unsigned int nslots,
+                                                 size_t slot_capacity);
+extern void               shm_ring_writer_destroy(shm_ring_writer_t *w);
+
+// Two-step publish so producers can write straight into shared memory:
+// begin returns the slot's data area (slot_capacity bytes), commit fills in
+// the metadata and makes the frame visible.
+extern uint8_t           *shm_ring_begin_write(shm_ring_writer_t *w);
+extern void               shm_ring_commit(shm_ring_writer_t *w, const struct shm_ring_slot *meta);
+extern size_t             shm_ring_slot_capacity(const shm_ring_writer_t *w);
+
+/* ---------- Reader ---------- */
+typedef struct shm_ring_reader shm_ring_reader_t;
+
+struct shm_ring_read_stats {
+  uint64_t frames;           // successful copies
+  uint64_t torn;             // copies discarded because the slot was rewritten
+  uint64_t skipped;          // frames published but never read
+};
+
+extern shm_ring_reader_t *shm_ring_reader_open(const char *name);
+extern void               shm_ring_reader_close(shm_ring_reader_t *r);
+
+// Copies the newest frame newer than the last one returned into dst.
+// Returns 1 on success, 0 if nothing new, -1 if dst is too small.
+extern int                shm_ring_read_latest(shm_ring_reader_t *r, void *dst, size_t dst_size,
+                                               struct shm_ring_slot *meta);
+extern const struct shm_ring_header *shm_ring_reader_header(const shm_ring_reader_t *r);
+extern void               shm_ring_reader_stats(const shm_ring_reader_t *r,
+                                                struct shm_ring_read_stats *out);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
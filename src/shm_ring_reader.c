@@ -0,0 +1,128 @@
+// shm_ring_reader.c
+// Minimal consumer of the shared-memory frame ring published by
+// min_latency_from_uvc --output shmring. Copies out every new frame it can
+// and reports the copy-out rate, torn reads and frames it was too slow for.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "shm_ring.h"
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_sigint(int sig) {
+  (void)sig;
+  g_stop = 1;
+}
+
+static int64_t now_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_us(long us) {
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = us * 1000L };
+  nanosleep(&ts, NULL);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [--name NAME] [--seconds N]\n"
+    "  --name NAME  : shared-memory ring name (default: %s)\n"
+    "  --seconds N  : stop after N seconds (default: run until Ctrl+C)\n",
+    prog, SHM_RING_DEFAULT_NAME);
+}
+
+int main(int argc, char **argv) {
+  const char *name = SHM_RING_DEFAULT_NAME;
+  int seconds = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if      (!strcmp(argv[i], "--name")    && i+1 < argc) name = argv[++i];
+    else if (!strcmp(argv[i], "--seconds") && i+1 < argc) seconds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else {
+      fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  signal(SIGINT, on_sigint);
+
+  shm_ring_reader_t *r = NULL;
+  uint8_t *buf = NULL;
+  size_t buf_size = 0;
+  int64_t t_start = now_monotonic_ns();
+  int64_t t_report = t_start, t_last_frame = t_start;
+  uint64_t frames = 0, bytes = 0;
+  int64_t copy_ns = 0, age_ns = 0;
+  struct shm_ring_read_stats last = {0};
+
+  while (!g_stop) {
+    int64_t now = now_monotonic_ns();
+    if (seconds > 0 && now - t_start > (int64_t)seconds * 1000000000LL) break;
+
+    if (!r) {
+      r = shm_ring_reader_open(name);
+      if (!r) { sleep_us(100000); continue; }
+      const struct shm_ring_header *h = shm_ring_reader_header(r);
+      if (h->slot_capacity > buf_size) {
+        free(buf);
+        buf_size = (size_t)h->slot_capacity;
+        buf = malloc(buf_size);
+        if (!buf) { fprintf(stderr, "out of memory\n"); return 1; }
+      }
+      memset(&last, 0, sizeof(last));
+      t_last_frame = now;
+      printf("Attached to %s: %u slots x %llu bytes (writer pid %d)\n", name, h->nslots,
+             (unsigned long long)h->slot_capacity, h->writer_pid);
+    }
+
+    struct shm_ring_slot meta;
+    int64_t t0 = now_monotonic_ns();
+    int rc = shm_ring_read_latest(r, buf, buf_size, &meta);
+    int64_t t1 = now_monotonic_ns();
+
+    if (rc == 1) {
+      frames++;
+      bytes   += meta.bytes;
+      copy_ns += t1 - t0;
+      age_ns  += t1 - meta.publish_ns;
+      t_last_frame = t1;
+    } else {
+      // Writer gone or restarted with a new segment: reattach.
+      if (t1 - t_last_frame > 2000000000LL) {
+        shm_ring_reader_close(r);
+        r = NULL;
+        continue;
+      }
+      sleep_us(500);
+    }
+
+    if (t1 - t_report >= 1000000000LL) {
+      struct shm_ring_read_stats st;
+      shm_ring_reader_stats(r, &st);
+      double dt = (double)(t1 - t_report) / 1e9;
+      printf("%.1f fps  copy-out %.1f MB/s  copy %.2f ms  publish->copied %.2f ms  torn %llu  skipped %llu\n",
+             (double)frames / dt, (double)bytes / dt / 1e6,
+             frames ? (double)copy_ns / (double)frames / 1e6 : 0.0,
+             frames ? (double)age_ns / (double)frames / 1e6 : 0.0,
+             (unsigned long long)(st.torn - last.torn),
+             (unsigned long long)(st.skipped - last.skipped));
+      last = st;
+      frames = bytes = 0;
+      copy_ns = age_ns = 0;
+      t_report = t1;
+    }
+  }
+
+  shm_ring_reader_close(r);
+  free(buf);
+  return 0;
+}
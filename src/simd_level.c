@@ -0,0 +1,48 @@
+// simd_level.c
+// See simd_level.h.
+
+#include <string.h>
+
+#include "simd_level.h"
+
+int simd_supported(int level) {
+  switch (level) {
+  case SIMD_SCALAR: return 1;
+#if defined(__x86_64__) || defined(__i386__)
+  case SIMD_SSE41:  return __builtin_cpu_supports("sse4.1");
+  case SIMD_AVX2:   return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__aarch64__)
+  case SIMD_NEON:   return 1;
+#endif
+  default:          return 0;
+  }
+}
+
+int simd_resolve(int level) {
+  static const int order[] = { SIMD_AVX2, SIMD_SSE41, SIMD_NEON, SIMD_SCALAR };
+  if (level != SIMD_AUTO && simd_supported(level)) return level;
+  for (unsigned i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+    if (simd_supported(order[i])) return order[i];
+  }
+  return SIMD_SCALAR;
+}
+
+const char *simd_level_name(int level) {
+  switch (level) {
+  case SIMD_AUTO:   return "auto";
+  case SIMD_SCALAR: return "scalar";
+  case SIMD_SSE41:  return "sse4.1";
+  case SIMD_AVX2:   return "avx2";
+  case SIMD_NEON:   return "neon";
+  default:          return "?";
+  }
+}
+
+int simd_parse_level(const char *s, int *level) {
+  for (int i = SIMD_AUTO; i <= SIMD_NEON; i++) {
+    if (strcmp(s, simd_level_name(i)) == 0) { *level = i; return 0; }
+  }
+  if (strcmp(s, "sse4") == 0) { *level = SIMD_SSE41; return 0; }
+  return -1;
+}
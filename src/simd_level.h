@@ -0,0 +1,31 @@
+// simd_level.h
+// Runtime CPU feature dispatch shared by the SIMD kernels (yuv2bgr,
+// reproject): names, parsing, and which level this CPU can run.
+
+#if !defined(__SIMD_LEVEL_H__)
+#define __SIMD_LEVEL_H__
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum simd_level {
+  SIMD_AUTO = 0,
+  SIMD_SCALAR,
+  SIMD_SSE41,
+  SIMD_AVX2,
+  SIMD_NEON,
+};
+
+extern int         simd_supported(int level);
+
+// AUTO, or a level the CPU cannot run, resolves to the best supported one.
+extern int         simd_resolve(int level);
+
+extern const char *simd_level_name(int level);
+extern int         simd_parse_level(const char *s, int *level);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,89 @@
+// stream_watch.c
+// See stream_watch.h. The owner's timer drives everything; the frame
+// callback only stores timestamps.
+
+#include <string.h>
+
+#include "stream_watch.h"
+
+void stream_watch_defaults(struct stream_watch_config *cfg, uint64_t interval_ns) {
+  cfg->interval_ns  = interval_ns;
+  cfg->stall_frames = STREAM_WATCH_DEFAULT_STALL_FRAMES;
+  cfg->grace_ns     = STREAM_WATCH_DEFAULT_GRACE_NS;
+  cfg->retry_min_ns = STREAM_WATCH_DEFAULT_RETRY_MIN_NS;
+  cfg->retry_max_ns = STREAM_WATCH_DEFAULT_RETRY_MAX_NS;
+}
+
+void stream_watch_init(stream_watch_t *w, const struct stream_watch_config *cfg, uint64_t now_ns) {
+  memset(w, 0, sizeof(*w));
+  w->cfg = *cfg;
+  w->started_ns = now_ns;
+  w->backoff_ns = cfg->retry_min_ns;
+}
+
+void stream_watch_restarted(stream_watch_t *w, uint64_t now_ns) {
+  w->started_ns = now_ns;
+}
+
+enum stream_watch_action stream_watch_tick(stream_watch_t *w, uint64_t now_ns) {
+  if (w->stalled) {
+    uint64_t first = __atomic_load_n(&w->first_frame_ns, __ATOMIC_ACQUIRE);
+    if (first) {
+      uint64_t rec = first > w->stall_since_ns ? first - w->stall_since_ns : 0;
+      w->st.recoveries++;
+      w->st.last_recovery_ns = rec;
+      if (rec > w->st.max_recovery_ns) w->st.max_recovery_ns = rec;
+      w->stalled = w->restarted = 0;
+      w->backoff_ns = w->cfg.retry_min_ns;
+      w->started_ns = now_ns;
+      return STREAM_WATCH_RECOVERED;
+    }
+    if (w->restarted) {
+      // Running again but silent: the camera took the commit and sends
+      // nothing (seen after a replug while it is still booting).
+      if (now_ns - w->started_ns < w->cfg.grace_ns) return STREAM_WATCH_OK;
+      w->restarted = 0;
+      stream_watch_attempt(w, 0, now_ns);
+      return STREAM_WATCH_OK;
+    }
+    if (now_ns < w->next_try_ns) return STREAM_WATCH_OK;
+    w->st.attempts++;
+    return STREAM_WATCH_RECONNECT;
+  }
+
+  // Until the first frame after a (re)start the grace period applies, then
+  // stall_frames intervals from the last frame.
+  uint64_t last = __atomic_load_n(&w->last_frame_ns, __ATOMIC_RELAXED);
+  uint64_t since, limit;
+  if (last < w->started_ns) { since = w->started_ns; limit = w->cfg.grace_ns; }
+  else { since = last; limit = w->cfg.interval_ns * w->cfg.stall_frames; }
+  if (now_ns - since < limit) return STREAM_WATCH_OK;
+
+  w->stalled = 1;
+  w->stall_since_ns = since;
+  w->st.stalls++;
+  w->st.last_detect_ns = now_ns - since;
+  w->st.attempts++;
+  // Armed before the restart, so a frame delivered while the caller is
+  // still returning from uvc_start_streaming() is not missed.
+  __atomic_store_n(&w->first_frame_ns, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&w->armed, 1, __ATOMIC_RELEASE);
+  return STREAM_WATCH_RECONNECT;
+}
+
+void stream_watch_attempt(stream_watch_t *w, int ok, uint64_t now_ns) {
+  if (ok) {
+    w->restarted = 1;
+    w->started_ns = now_ns;
+    return;
+  }
+  w->st.failed++;
+  w->next_try_ns = now_ns + w->backoff_ns;
+  w->backoff_ns *= 2;
+  if (w->backoff_ns > w->cfg.retry_max_ns) w->backoff_ns = w->cfg.retry_max_ns;
+}
+
+void stream_watch_get_stats(const stream_watch_t *w, struct stream_watch_stats *out) {
+  *out = w->st;
+  out->stalled = w->stalled;
+}
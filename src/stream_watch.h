@@ -0,0 +1,95 @@
+// stream_watch.h
+// Stall watchdog and reconnect pacing for one camera stream. The frame
+// callback stamps every frame; a timer on the owning thread asks what to
+// do. A stream with no frame for stall_frames frame intervals is stalled:
+// the caller then tears the stream down, finds the device again and
+// restarts it, reporting each attempt back. Failed attempts (device gone,
+// negotiation refused) are retried with a doubling delay, and a restart
+// that yields no frame within the stall timeout counts as failed too.
+//
+// Recovery time is measured from the last frame before the stall to the
+// first frame after the restart: the gap every consumer saw.
+// Pure bookkeeping apart from the frame stamp, which is one relaxed store.
+
+#if !defined(__STREAM_WATCH_H__)
+#define __STREAM_WATCH_H__
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define STREAM_WATCH_DEFAULT_STALL_FRAMES  15
+#define STREAM_WATCH_DEFAULT_GRACE_NS      5000000000ull   // first frame after a (re)start
+#define STREAM_WATCH_DEFAULT_RETRY_MIN_NS  250000000ull
+#define STREAM_WATCH_DEFAULT_RETRY_MAX_NS  4000000000ull
+
+enum stream_watch_action {
+  STREAM_WATCH_OK = 0,         // frames are flowing (or stalled, waiting to retry)
+  STREAM_WATCH_RECONNECT,      // tear down and restart now, then stream_watch_attempt()
+  STREAM_WATCH_RECOVERED,      // first frame after a restart: stats updated
+};
+
+struct stream_watch_config {
+  uint64_t interval_ns;        // frame interval
+  unsigned stall_frames;       // frame intervals without a callback = stalled
+  uint64_t grace_ns;           // allowance for the first frame after a (re)start
+  uint64_t retry_min_ns;       // delay after a failed attempt, doubled each time
+  uint64_t retry_max_ns;
+};
+
+struct stream_watch_stats {
+  uint64_t stalls;
+  uint64_t attempts;
+  uint64_t failed;             // attempts that did not bring frames back
+  uint64_t recoveries;
+  uint64_t last_detect_ns;     // last frame -> stall declared, last stall
+  uint64_t last_recovery_ns;   // last frame -> first frame after the restart
+  uint64_t max_recovery_ns;
+  int      stalled;
+};
+
+typedef struct stream_watch {
+  struct stream_watch_config cfg;
+  uint64_t last_frame_ns;      // callback thread (relaxed)
+  uint64_t first_frame_ns;     // first frame after a restart, 0 = none yet
+  int      armed;              // callback records first_frame_ns
+  // Owner only.
+  uint64_t started_ns;         // stream (re)started: grace period from here
+  uint64_t stall_since_ns;     // last frame before the stall
+  uint64_t next_try_ns;
+  uint64_t backoff_ns;
+  int      stalled;
+  int      restarted;          // an attempt succeeded, waiting for a frame
+  struct stream_watch_stats st;
+} stream_watch_t;
+
+extern void stream_watch_defaults(struct stream_watch_config *cfg, uint64_t interval_ns);
+extern void stream_watch_init(stream_watch_t *w, const struct stream_watch_config *cfg, uint64_t now_ns);
+
+// The stream was restarted for another reason (mode switch): a new grace
+// period, no stall counted.
+extern void stream_watch_restarted(stream_watch_t *w, uint64_t now_ns);
+
+// Frame callback.
+static inline void stream_watch_frame(stream_watch_t *w, uint64_t now_ns) {
+  if (__atomic_load_n(&w->armed, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&w->armed, 0, __ATOMIC_RELAXED))
+    __atomic_store_n(&w->first_frame_ns, now_ns, __ATOMIC_RELEASE);
+  __atomic_store_n(&w->last_frame_ns, now_ns, __ATOMIC_RELAXED);
+}
+
+// Owner's timer, every 100 ms or so.
+extern enum stream_watch_action stream_watch_tick(stream_watch_t *w, uint64_t now_ns);
+
+// Result of the restart asked for by STREAM_WATCH_RECONNECT: ok means the
+// stream is running again (frames are then awaited), not that any arrived.
+extern void stream_watch_attempt(stream_watch_t *w, int ok, uint64_t now_ns);
+
+extern void stream_watch_get_stats(const stream_watch_t *w, struct stream_watch_stats *out);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,413 @@
+// tcap.c
+// See tcap.h.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tcap.h"
+#include "kf_index.h"
+#include "h264_nal.h"
+
+#define TCAP_VERSION     1
+#define TCAP_WRITE_BUF   (4u * 1024u * 1024u)
+// Records are padded so headers, index and footer stay 8-byte aligned in
+// the mapping.
+#define TCAP_PAD(n)      ((8u - ((n) & 7u)) & 7u)
+
+void tcap_mode_from_ctrl(struct tcap_mode *m, unsigned int mode, unsigned int width,
+                         unsigned int height, unsigned int fps,
+                         const uvc_stream_ctrl_t *ctrl) {
+  memset(m, 0, sizeof(*m));
+  m->mode            = mode;
+  m->width           = width;
+  m->height          = height;
+  m->fps             = fps;
+  m->frame_interval  = ctrl->dwFrameInterval;
+  m->clock_frequency = ctrl->dwClockFrequency;
+  m->max_frame_size  = ctrl->dwMaxVideoFrameSize;
+}
+
+void tcap_mode_to_ctrl(const struct tcap_mode *m, uvc_stream_ctrl_t *ctrl) {
+  memset(ctrl, 0, sizeof(*ctrl));
+  ctrl->dwFrameInterval     = m->frame_interval;
+  ctrl->dwClockFrequency    = m->clock_frequency;
+  ctrl->dwMaxVideoFrameSize = m->max_frame_size;
+}
+
+/* ---------- Recording ---------- */
+
+struct tcap_writer {
+  FILE                    *fp;
+  char                    *iobuf;
+  uint64_t                 offset;
+  struct tcap_index_entry *index;
+  size_t                   count;
+  size_t                   cap;
+  int                      failed;
+  struct h264_stream       h264;      // parameter sets and GOP for the keyframe index
+  kf_index_writer_t       *kfi;       // FILE.kfi, NULL if it could not be created
+};
+
+tcap_writer_t *tcap_writer_open(const char *path, const struct tcap_mode *mode) {
+  tcap_writer_t *w = calloc(1, sizeof(*w));
+  if (!w) return NULL;
+  w->fp = fopen(path, "wb");
+  if (!w->fp) { perror(path); free(w); return NULL; }
+  // Large stdio buffer: the append runs on the libuvc thread.
+  w->iobuf = malloc(TCAP_WRITE_BUF);
+  if (w->iobuf) setvbuf(w->fp, w->iobuf, _IOFBF, TCAP_WRITE_BUF);
+
+  struct tcap_file_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, TCAP_MAGIC, sizeof(h.magic));
+  h.version     = TCAP_VERSION;
+  h.header_size = sizeof(h);
+  h.mode        = *mode;
+  if (fwrite(&h, sizeof(h), 1, w->fp) != 1) {
+    perror(path);
+    fclose(w->fp);
+    free(w->iobuf);
+    free(w);
+    return NULL;
+  }
+  w->offset = sizeof(h);
+
+  char kfi_path[1024];
+  kf_index_path(kfi_path, sizeof(kfi_path), path);
+  h264_stream_init(&w->h264);
+  w->kfi = kf_index_open(kfi_path);
+  return w;
+}
+
+int tcap_writer_append(tcap_writer_t *w, const uvc_frame_t *frame, uint32_t flags) {
+  return tcap_writer_write(w, frame->data, frame->data_bytes, frame->sequence,
+                           (int64_t)frame->capture_time.tv_sec * 1000000000LL +
+                           (int64_t)frame->capture_time.tv_usec * 1000LL, flags);
+}
+
+int tcap_writer_write(tcap_writer_t *w, const void *data, size_t size, uint32_t sequence,
+                      int64_t capture_ns, uint32_t flags) {
+  if (w->failed) return -1;
+  if (w->count == w->cap) {
+    size_t ncap = w->cap ? w->cap * 2 : 4096;
+    void *tmp = realloc(w->index, ncap * sizeof(*w->index));
+    if (!tmp) { w->failed = 1; return -1; }
+    w->index = tmp;
+    w->cap = ncap;
+  }
+
+  struct tcap_record_header rh;
+  rh.size       = (uint32_t)size;
+  rh.sequence   = sequence;
+  rh.capture_ns = capture_ns;
+
+  static const uint8_t zeros[8];
+  size_t pad = TCAP_PAD(size);
+  if (fwrite(&rh, sizeof(rh), 1, w->fp) != 1 ||
+      fwrite(data, 1, size, w->fp) != size ||
+      fwrite(zeros, 1, pad, w->fp) != pad) {
+    w->failed = 1;
+    return -1;
+  }
+
+  struct tcap_index_entry *e = &w->index[w->count++];
+  memset(e, 0, sizeof(*e));
+  e->offset     = w->offset + sizeof(rh);
+  e->size       = rh.size;
+  e->sequence   = rh.sequence;
+  e->capture_ns = rh.capture_ns;
+  e->flags      = flags;
+
+  struct h264_au_info au;
+  h264_stream_update(&w->h264, data, size, &au);
+  if (au.has_idr)
+    kf_index_add(w->kfi, &w->h264, w->count - 1, e->offset, e->capture_ns, e->sequence, e->size);
+
+  w->offset    += sizeof(rh) + size + pad;
+  return 0;
+}
+
+int tcap_writer_close(tcap_writer_t *w) {
+  if (!w) return 0;
+  int rc = w->failed ? -1 : 0;
+
+  if (!w->failed) {
+    struct tcap_footer f;
+    memset(&f, 0, sizeof(f));
+    memcpy(f.magic, TCAP_INDEX_MAGIC, sizeof(f.magic));
+    f.index_offset = w->offset;
+    f.count        = w->count;
+    if (fwrite(w->index, sizeof(*w->index), w->count, w->fp) != w->count ||
+        fwrite(&f, sizeof(f), 1, w->fp) != 1)
+      rc = -1;
+  }
+  if (fclose(w->fp) != 0) rc = -1;
+  kf_index_close(w->kfi);
+  free(w->iobuf);
+  free(w->index);
+  free(w);
+  return rc;
+}
+
+/* ---------- Reading ---------- */
+
+struct tcap_reader {
+  const uint8_t                 *map;
+  size_t                         size;
+  const struct tcap_file_header *hdr;
+  const struct tcap_index_entry *index;
+  struct tcap_index_entry       *rebuilt;   // owned when the footer was missing
+  size_t                         count;
+};
+
+// Walks the record headers of an unfinalised file. The headers carry no
+// flags, so each payload is classified again to find the IDRs.
+static int rebuild_index(tcap_reader_t *r) {
+  size_t cap = 0;
+  uint64_t off = r->hdr->header_size;
+  while (off + sizeof(struct tcap_record_header) <= r->size) {
+    struct tcap_record_header rh;
+    memcpy(&rh, r->map + off, sizeof(rh));
+    uint64_t payload = off + sizeof(rh);
+    if (rh.size == 0 || payload + rh.size > r->size) break;   // truncated tail
+    if (r->count == cap) {
+      cap = cap ? cap * 2 : 4096;
+      void *tmp = realloc(r->rebuilt, cap * sizeof(*r->rebuilt));
+      if (!tmp) return -1;
+      r->rebuilt = tmp;
+    }
+    struct tcap_index_entry *e = &r->rebuilt[r->count++];
+    memset(e, 0, sizeof(*e));
+    e->offset     = payload;
+    e->size       = rh.size;
+    e->sequence   = rh.sequence;
+    e->capture_ns = rh.capture_ns;
+    struct h264_au_info au;
+    h264_au_classify(r->map + payload, rh.size, &au);
+    if (au.has_idr) e->flags |= TCAP_FLAG_IDR;
+    off = payload + rh.size + TCAP_PAD(rh.size);
+  }
+  r->index = r->rebuilt;
+  return 0;
+}
+
+tcap_reader_t *tcap_reader_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) { perror(path); return NULL; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct tcap_file_header)) {
+    fprintf(stderr, "%s: not a capture file\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) { perror("mmap"); return NULL; }
+
+  tcap_reader_t *r = calloc(1, sizeof(*r));
+  if (!r) { munmap(map, (size_t)st.st_size); return NULL; }
+  r->map  = map;
+  r->size = (size_t)st.st_size;
+  r->hdr  = map;
+
+  if (memcmp(r->hdr->magic, TCAP_MAGIC, sizeof(r->hdr->magic)) != 0 ||
+      r->hdr->header_size < sizeof(struct tcap_file_header)) {
+    fprintf(stderr, "%s: bad capture header\n", path);
+    tcap_reader_close(r);
+    return NULL;
+  }
+
+  // A truncated file can end anywhere, so copy the candidate footer out.
+  struct tcap_footer f;
+  int have_footer = 0;
+  if (r->size >= r->hdr->header_size + sizeof(f)) {
+    memcpy(&f, r->map + r->size - sizeof(f), sizeof(f));
+    have_footer = !memcmp(f.magic, TCAP_INDEX_MAGIC, sizeof(f.magic)) &&
+      f.index_offset + f.count * sizeof(struct tcap_index_entry) + sizeof(f) == r->size;
+  }
+  if (have_footer) {
+    r->index = (const struct tcap_index_entry *)(r->map + f.index_offset);
+    r->count = (size_t)f.count;
+  } else {
+    fprintf(stderr, "%s: no index (unfinished recording), scanning records\n", path);
+    if (rebuild_index(r) != 0) { tcap_reader_close(r); return NULL; }
+  }
+
+  // Frames are replayed in place from the mapping; tell the kernel we are
+  // going to stream through it.
+  madvise((void *)r->map, r->size, MADV_SEQUENTIAL);
+  return r;
+}
+
+void tcap_reader_close(tcap_reader_t *r) {
+  if (!r) return;
+  munmap((void *)r->map, r->size);
+  free(r->rebuilt);
+  free(r);
+}
+
+const struct tcap_mode *tcap_reader_mode(const tcap_reader_t *r) {
+  return &r->hdr->mode;
+}
+
+size_t tcap_reader_count(const tcap_reader_t *r) {
+  return r->count;
+}
+
+const struct tcap_index_entry *tcap_reader_entry(const tcap_reader_t *r, size_t i) {
+  return i < r->count ? &r->index[i] : NULL;
+}
+
+const uint8_t *tcap_reader_data(const tcap_reader_t *r, size_t i) {
+  return i < r->count ? r->map + r->index[i].offset : NULL;
+}
+
+/* ---------- Replay ---------- */
+
+struct tcap_player {
+  tcap_reader_t        *reader;
+  double                speed;
+  int                   loop;
+  uvc_frame_callback_t *cb;
+  void                 *user_ptr;
+  pthread_t             thr;
+  volatile int          run;
+  volatile int          done;
+  // Fault injection, see tcap_player_set_fault().
+  uint64_t              fault_every_ns;
+  uint64_t              fault_down_ns;
+  int                   stalled;
+  int64_t               stall_ns;
+};
+
+static int64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t t_ns) {
+  struct timespec ts = { .tv_sec = t_ns / 1000000000LL, .tv_nsec = t_ns % 1000000000LL };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+static void *player_thread(void *arg) {
+  tcap_player_t *p = arg;
+  size_t n = tcap_reader_count(p->reader);
+  const struct tcap_mode *m = tcap_reader_mode(p->reader);
+  if (n == 0) { p->done = 1; return NULL; }
+
+  int64_t first_cap = tcap_reader_entry(p->reader, 0)->capture_ns;
+  int64_t last_cap  = tcap_reader_entry(p->reader, n - 1)->capture_ns;
+  // One pass lasts the recorded span plus one frame interval.
+  int64_t pass_ns   = last_cap - first_cap + (int64_t)m->frame_interval * 100;
+  uint32_t seq_span = tcap_reader_entry(p->reader, n - 1)->sequence -
+                      tcap_reader_entry(p->reader, 0)->sequence + 1;
+
+  int64_t t0 = mono_ns();
+  int64_t fault_from = first_cap;     // stream time of the last (re)start
+  // pos counts frames across passes: entry pos % n of pass pos / n.
+  for (uint64_t pos = 0; p->run && (p->loop || pos < n); pos++) {
+    size_t i = (size_t)(pos % n);
+    unsigned pass = (unsigned)(pos / n);
+    const struct tcap_index_entry *e = tcap_reader_entry(p->reader, i);
+    int64_t cap_ns = e->capture_ns + (int64_t)pass * pass_ns;
+
+    uint64_t every = __atomic_load_n(&p->fault_every_ns, __ATOMIC_RELAXED);
+    if (every && cap_ns - fault_from >= (int64_t)every) {
+      // Go quiet like a hung camera, until restarted.
+      __atomic_store_n(&p->stall_ns, mono_ns(), __ATOMIC_RELAXED);
+      __atomic_store_n(&p->stalled, 1, __ATOMIC_RELEASE);
+      while (p->run && __atomic_load_n(&p->stalled, __ATOMIC_ACQUIRE))
+        usleep(5000);
+      if (!p->run) break;
+      // A restarted camera opens with an IDR; what it would have sent
+      // meanwhile never existed. Paced, skip to the first IDR still due.
+      int64_t now = mono_ns();
+      for (uint64_t q = pos, end = pos + n; q < end && (p->loop || q < n); q++) {
+        const struct tcap_index_entry *f = tcap_reader_entry(p->reader, (size_t)(q % n));
+        int64_t f_cap = f->capture_ns + (int64_t)(q / n) * pass_ns;
+        if (!(f->flags & TCAP_FLAG_IDR)) continue;
+        if (p->speed > 0 && t0 + (int64_t)((double)(f_cap - first_cap) / p->speed) < now) continue;
+        pos = q;
+        break;
+      }
+      if (!p->loop && pos >= n) break;
+      i = (size_t)(pos % n);
+      pass = (unsigned)(pos / n);
+      e = tcap_reader_entry(p->reader, i);
+      cap_ns = e->capture_ns + (int64_t)pass * pass_ns;
+      fault_from = cap_ns;
+    }
+
+    if (p->speed > 0)
+      sleep_until(t0 + (int64_t)((double)(cap_ns - first_cap) / p->speed));
+
+    uvc_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.data                 = (void *)tcap_reader_data(p->reader, i);
+    frame.data_bytes           = e->size;
+    frame.width                = m->width;
+    frame.height               = m->height;
+    frame.frame_format         = UVC_FRAME_FORMAT_H264;
+    frame.sequence             = e->sequence + pass * seq_span;
+    frame.capture_time.tv_sec  = (time_t)(cap_ns / 1000000000LL);
+    frame.capture_time.tv_usec = (suseconds_t)((cap_ns % 1000000000LL) / 1000);
+    frame.library_owns_data    = 1;
+    p->cb(&frame, p->user_ptr);
+  }
+  p->done = 1;
+  return NULL;
+}
+
+tcap_player_t *tcap_player_start(tcap_reader_t *r, double speed, int loop,
+                                 uvc_frame_callback_t *cb, void *user_ptr) {
+  tcap_player_t *p = calloc(1, sizeof(*p));
+  if (!p) return NULL;
+  p->reader   = r;
+  p->speed    = speed;
+  p->loop     = loop;
+  p->cb       = cb;
+  p->user_ptr = user_ptr;
+  p->run      = 1;
+  if (pthread_create(&p->thr, NULL, player_thread, p) != 0) {
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+int tcap_player_done(tcap_player_t *p) {
+  return p->done;
+}
+
+void tcap_player_stop(tcap_player_t *p) {
+  if (!p) return;
+  p->run = 0;
+  pthread_join(p->thr, NULL);
+  free(p);
+}
+
+void tcap_player_set_fault(tcap_player_t *p, uint64_t every_ns, uint64_t down_ns) {
+  __atomic_store_n(&p->fault_down_ns, down_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&p->fault_every_ns, every_ns, __ATOMIC_RELAXED);
+}
+
+int tcap_player_restart(tcap_player_t *p) {
+  if (!__atomic_load_n(&p->stalled, __ATOMIC_ACQUIRE)) return 0;
+  uint64_t down = __atomic_load_n(&p->fault_down_ns, __ATOMIC_RELAXED);
+  if (down && mono_ns() - __atomic_load_n(&p->stall_ns, __ATOMIC_RELAXED) < (int64_t)down)
+    return -1;
+  __atomic_store_n(&p->stalled, 0, __ATOMIC_RELEASE);
+  return 0;
+}
@@ -0,0 +1,125 @@
+// tcap.h
+// THETA capture files: raw H.264 access units exactly as uvc_frame_cb saw
+// them, with frame->sequence, frame->capture_time and the negotiated mode,
+// so a run can be replayed through the same callback without a camera.
+//
+// Layout (little-endian, native structs):
+//   struct tcap_file_header
+//   { struct tcap_record_header; payload[size]; zero pad to 8 bytes } * N
+//   struct tcap_index_entry * N
+//   struct tcap_footer
+// The per-record headers make a file that was never closed (crash, SIGKILL)
+// recoverable: the reader rebuilds the index by walking the records.
+//
+// The writer also keeps FILE.kfi, a keyframe index with the parameter sets
+// (see kf_index.h), flushed at every IDR.
+
+#if !defined(__TCAP_H__)
+#define __TCAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libuvc/libuvc.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define TCAP_MAGIC        "TCAP0001"
+#define TCAP_INDEX_MAGIC  "TCAPIDX1"
+
+#define TCAP_FLAG_IDR     0x1u    // access unit contains an IDR slice
+
+struct tcap_mode {
+  uint32_t mode;              // thetauvc mode index
+  uint32_t width;
+  uint32_t height;
+  uint32_t fps;
+  uint32_t frame_interval;    // dwFrameInterval, 100 ns units
+  uint32_t clock_frequency;   // dwClockFrequency, Hz
+  uint32_t max_frame_size;    // dwMaxVideoFrameSize
+};
+
+struct tcap_file_header {
+  char             magic[8];
+  uint32_t         version;
+  uint32_t         header_size;
+  struct tcap_mode mode;
+  uint32_t         reserved[7];
+};
+
+struct tcap_record_header {
+  uint32_t size;
+  uint32_t sequence;
+  int64_t  capture_ns;        // frame->capture_time
+};
+
+struct tcap_index_entry {
+  uint64_t offset;            // payload offset in the file
+  uint32_t size;
+  uint32_t sequence;
+  int64_t  capture_ns;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct tcap_footer {
+  char     magic[8];
+  uint64_t index_offset;
+  uint64_t count;
+  uint64_t reserved;
+};
+
+// Mode <-> stream control helpers, so replay can stand in for negotiation.
+extern void tcap_mode_from_ctrl(struct tcap_mode *m, unsigned int mode, unsigned int width,
+                                unsigned int height, unsigned int fps,
+                                const uvc_stream_ctrl_t *ctrl);
+extern void tcap_mode_to_ctrl(const struct tcap_mode *m, uvc_stream_ctrl_t *ctrl);
+
+/* ---------- Recording ---------- */
+typedef struct tcap_writer tcap_writer_t;
+
+extern tcap_writer_t *tcap_writer_open(const char *path, const struct tcap_mode *mode);
+extern int            tcap_writer_append(tcap_writer_t *w, const uvc_frame_t *frame, uint32_t flags);
+// The same from an access unit's bytes, sequence and capture time.
+extern int            tcap_writer_write(tcap_writer_t *w, const void *data, size_t size, uint32_t sequence,
+                                        int64_t capture_ns, uint32_t flags);
+// Writes the index and footer. Returns 0 on success.
+extern int            tcap_writer_close(tcap_writer_t *w);
+
+/* ---------- Reading (memory-mapped) ---------- */
+typedef struct tcap_reader tcap_reader_t;
+
+extern tcap_reader_t *tcap_reader_open(const char *path);
+extern void           tcap_reader_close(tcap_reader_t *r);
+extern const struct tcap_mode *tcap_reader_mode(const tcap_reader_t *r);
+extern size_t         tcap_reader_count(const tcap_reader_t *r);
+extern const struct tcap_index_entry *tcap_reader_entry(const tcap_reader_t *r, size_t i);
+extern const uint8_t *tcap_reader_data(const tcap_reader_t *r, size_t i);
+
+/* ---------- Replay ---------- */
+// speed 1.0 replays at the recorded cadence, 2.0 twice as fast, 0 as fast
+// as the callback returns. With loop set, sequence numbers and capture
+// times keep increasing across passes.
+typedef struct tcap_player tcap_player_t;
+
+extern tcap_player_t *tcap_player_start(tcap_reader_t *r, double speed, int loop,
+                                        uvc_frame_callback_t *cb, void *user_ptr);
+extern int            tcap_player_done(tcap_player_t *p);
+extern void           tcap_player_stop(tcap_player_t *p);
+
+// Fault injection, for exercising reconnects without a camera. After every_ns
+// of stream time the player stops delivering, as a hung camera does, until
+// tcap_player_restart(). With down_ns set it behaves as unplugged instead:
+// restarts fail until down_ns after the stall. Delivery resumes at the next
+// IDR still due; frames the camera would have sent meanwhile are skipped.
+// every_ns 0 turns faults off.
+extern void           tcap_player_set_fault(tcap_player_t *p, uint64_t every_ns, uint64_t down_ns);
+// 0 when the player is running again (or was not stalled), -1 while "unplugged".
+extern int            tcap_player_restart(tcap_player_t *p);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
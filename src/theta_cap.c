@@ -0,0 +1,1060 @@
+// theta_cap.c
+// See theta_cap.h. Threads: libuvc's callback (or the replay player) parses
+// and queues access units, a push thread feeds appsrc (or the caller's
+// sink), the appsink's streaming thread converts and lends frames, and a
+// supervisor thread runs the stall watch. The consumer only ever touches
+// slots it has been lent.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+
+#include "theta_cap_dev.h"
+#include "thetauvc.h"
+#include "h264_pool.h"
+#include "frame_ring.h"
+#include "h264_nal.h"
+#include "gop_shed.h"
+#include "tcap.h"
+#include "dev_pts.h"
+#include "band_pool.h"
+#include "yuv2bgr.h"
+#include "stream_watch.h"
+#include "mode_cache.h"
+
+#define CAP_META_SLOTS  64     // access units between USB and the appsink, by sequence
+
+enum slot_state { SLOT_FREE = 0, SLOT_FILLING, SLOT_READY, SLOT_LENT };
+
+struct cap_slot {
+  struct theta_cap_frame f;    // first: the consumer's pointer is the slot's
+  enum slot_state state;
+  guint8       *bgr;           // THETA_CAP_BGR: owned, grown to the frame size
+  size_t        bgr_size;
+  GstSample    *sample;        // THETA_CAP_YUV: the decoder's frame, mapped
+  GstVideoFrame vf;
+};
+
+struct au_meta {
+  guint64 pts, sequence, arrival_ns;
+  gint64  capture_ns;
+  int     keyframe;
+};
+
+struct theta_cap {
+  struct theta_cap_config cfg;
+  gchar        *serial_arg, *replay_arg;
+  char          tag[64];
+  char          serial[64];    // as read from the device: reconnects look for it
+
+  // devh, ctrl and mode change under dev_lock once started: reconnects
+  // and mode switches stop the stream, so the ingest state is theirs.
+  GMutex               dev_lock;
+  uvc_context_t       *ctx;
+  uvc_device_handle_t *devh;   // NULL while a reconnect is pending
+  uvc_stream_ctrl_t    ctrl;
+  tcap_reader_t       *replay;
+  tcap_player_t       *player;
+  unsigned int  want_mode, mode, width, height, fps;
+  int           cached;        // ctrl from the mode cache, not committed yet
+  enum theta_cap_overflow overflow;   // cfg.overflow resolved
+  unsigned      shed_high;     // ditto
+  guint64       usb_init_ns, opened_ns, negotiated_ns;
+
+  // Ingest: libuvc thread only, apart from the counters.
+  struct h264_stream h264;
+  dev_pts_t     pts;
+  gint64        t0_ns;         // host time of PTS 0
+  gop_shed_t    shed;
+  h264_pool_t  *pool;
+  frame_ring_t *ring;
+  int           have_seq, have_idr;
+  guint32       last_seq;
+  guint64       frames_in, seq_gaps, ring_dropped, no_buffer, pushed;
+  struct frame_ring_stats ring_last;   // the ring's, as it was at stop
+  struct theta_cap_hooks hooks;
+  GMutex        meta_lock;
+  struct au_meta meta[CAP_META_SLOTS];
+
+  GThread      *push_thread;
+  gint          push_run;
+  int           eos_sent;
+  theta_cap_sink_fn sink;      // sink mode: no pipeline of ours
+  void         *sink_user;
+
+  GstElement   *pipeline, *appsrc;
+  band_pool_t  *bands;
+
+  // Lending, under lock.
+  GMutex        lock;
+  GCond         cond;
+  struct cap_slot *slots;
+  unsigned      nslots;
+  struct cap_slot *ready;      // pull mode: newest frame not handed out
+  theta_cap_frame_fn fn;
+  void         *user;
+  int           running, eos;
+  guint64       decoded, delivered, busy, replaced;
+
+  // Stall watch, supervisor thread.
+  stream_watch_t watch;
+  GThread      *watch_thread;
+  GCond         watch_cond;
+  unsigned      reconnect_tries;
+};
+
+// One libuvc context (and USB event thread) serves every capture.
+static GMutex         s_ctx_lock;
+static uvc_context_t *s_ctx = NULL;
+static int            s_ctx_refs = 0;
+
+static uvc_context_t *ctx_ref(void) {
+  g_mutex_lock(&s_ctx_lock);
+  if (!s_ctx && uvc_init(&s_ctx, NULL) != UVC_SUCCESS) s_ctx = NULL;
+  if (s_ctx) s_ctx_refs++;
+  uvc_context_t *ctx = s_ctx;
+  g_mutex_unlock(&s_ctx_lock);
+  return ctx;
+}
+
+static void ctx_unref(void) {
+  g_mutex_lock(&s_ctx_lock);
+  if (s_ctx && --s_ctx_refs == 0) {
+    uvc_exit(s_ctx);
+    s_ctx = NULL;
+  }
+  g_mutex_unlock(&s_ctx_lock);
+}
+
+static guint64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * 1000000000ull + (guint64)ts.tv_nsec;
+}
+
+/* ---------- Device helpers ---------- */
+
+unsigned int theta_cap_requested_mode(int width, int height) {
+  for (unsigned int m = 0; m < THETAUVC_MODE_NUM; ++m) {
+    unsigned int w, h;
+    if (thetauvc_get_mode_size(m, &w, &h, NULL) == UVC_SUCCESS && (int)w == width && (int)h == height)
+      return m;
+  }
+  return 0;
+}
+
+uvc_error_t theta_cap_open_device(uvc_context_t *ctx, const char *serial, uvc_device_handle_t **devh,
+                                  char *serial_out, size_t serial_size) {
+  uvc_device_t *dev = NULL;
+
+  // Filters by THETA VID/PID; a NULL serial takes the first one found.
+  // Plain uvc_find_device(0,0,NULL) is unstable when several UVC devices exist.
+  uvc_error_t res = thetauvc_find_device_by_serial(ctx, &dev, serial);
+  if (res != UVC_SUCCESS) return res;
+  if (!dev) return UVC_ERROR_NO_DEVICE;
+  if (serial_out && serial_size) {
+    uvc_device_descriptor_t *desc = NULL;
+    serial_out[0] = '\0';
+    if (uvc_get_device_descriptor(dev, &desc) == UVC_SUCCESS) {
+      if (desc->serialNumber) g_strlcpy(serial_out, desc->serialNumber, serial_size);
+      uvc_free_device_descriptor(desc);
+    }
+  }
+  res = uvc_open(dev, devh);
+  uvc_unref_device(dev);
+  return res;
+}
+
+uvc_error_t theta_cap_negotiate(uvc_device_handle_t *devh, unsigned int want_mode,
+                                unsigned int *mode, uvc_stream_ctrl_t *ctrl) {
+  uvc_error_t res = UVC_ERROR_INVALID_MODE;
+  for (unsigned int i = 0; i < THETAUVC_MODE_NUM; ++i) {
+    unsigned int m = i == 0 ? want_mode : i <= want_mode ? i - 1 : i;
+    res = thetauvc_get_stream_ctrl_format_size(devh, m, ctrl);
+    if (res == UVC_SUCCESS) {
+      *mode = m;
+      break;
+    }
+  }
+  return res;
+}
+
+/* ---------- Ingest ---------- */
+
+// libuvc callback. Pictures before the first IDR can't be decoded, so
+// nothing reaches the decoder before it; under backlog the shed policy
+// drops what the decoder can best do without. Nothing here waits on
+// GStreamer or on the consumer.
+static void cap_frame_cb(uvc_frame_t *frame, void *user_ptr) {
+  theta_cap_t *cap = user_ptr;
+  if (!frame->data || frame->data_bytes == 0) return;
+
+  guint64 now = now_ns();
+  if (cap->cfg.stall_frames) stream_watch_frame(&cap->watch, now);
+  __atomic_add_fetch(&cap->frames_in, 1, __ATOMIC_RELAXED);
+  guint32 gap = cap->have_seq && frame->sequence > cap->last_seq + 1 ? frame->sequence - cap->last_seq - 1 : 0;
+  if (gap) __atomic_add_fetch(&cap->seq_gaps, gap, __ATOMIC_RELAXED);
+  cap->last_seq = frame->sequence;
+  cap->have_seq = 1;
+
+  struct h264_au_info info;
+  if (h264_stream_update(&cap->h264, frame->data, frame->data_bytes, &info) && cap->h264.ps_changes)
+    g_printerr("[%s] SPS/PPS changed (generation %u, GOP was %u frames)\n", cap->tag,
+               cap->h264.ps.gen, cap->h264.gop_frames);
+
+  // Every frame feeds the clock fit, shed or not. PTS comes from the
+  // camera's frame clock anchored on host time, so USB scheduling jitter
+  // stays out of the cadence.
+  struct theta_cap_au au = {
+    .data       = frame->data,
+    .size       = frame->data_bytes,
+    .sequence   = frame->sequence,
+    .idr        = info.has_idr,
+    .sps        = info.has_sps,
+    .pps        = info.has_pps,
+    .gap        = gap,
+    .arrival_ns = now,
+    .capture_ns = (gint64)frame->capture_time.tv_sec * 1000000000LL +
+                  (gint64)frame->capture_time.tv_usec * 1000LL,
+  };
+  au.pts = dev_pts_stamp(&cap->pts, frame->sequence, (gint64)now, &au.duration);
+  au.expected_ns = dev_pts_frame_time(&cap->pts, frame->sequence);
+  if (cap->hooks.received) cap->hooks.received(cap, &au, cap->hooks.user);
+
+  // Parameter sets on their own still go through ahead of the IDR.
+  if (!cap->have_idr) {
+    if (!info.has_idr && info.has_slice) return;
+    if (info.has_idr) cap->have_idr = 1;
+  }
+  gboolean congested = frame_ring_occupancy(cap->ring) >= cap->shed_high;
+  if (!gop_shed_admit(&cap->shed, &info, congested, now)) return;
+
+  GstBuffer *buf = h264_pool_fill(cap->pool, frame->data, frame->data_bytes);
+  if (!buf) {
+    __atomic_add_fetch(&cap->no_buffer, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  GST_BUFFER_PTS(buf)      = (GstClockTime)au.pts;
+  GST_BUFFER_DURATION(buf) = (GstClockTime)au.duration;
+  GST_BUFFER_DTS(buf)      = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_OFFSET(buf)   = frame->sequence;
+  if (!info.has_idr) GST_BUFFER_FLAG_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if (!cap->sink) {
+    g_mutex_lock(&cap->meta_lock);
+    cap->meta[frame->sequence % CAP_META_SLOTS] = (struct au_meta){
+      .pts        = au.pts,
+      .sequence   = frame->sequence,
+      .arrival_ns = now,
+      .capture_ns = au.capture_ns,
+      .keyframe   = info.has_idr,
+    };
+    g_mutex_unlock(&cap->meta_lock);
+  }
+  if (cap->hooks.admitted) cap->hooks.admitted(cap, &au, cap->hooks.user);
+
+  GstBuffer *dropped = frame_ring_push(cap->ring, buf, now);
+  if (dropped) {
+    // A frame fell out of the ring: whatever references it is now garbage.
+    gst_buffer_unref(dropped);
+    gop_shed_note_loss(&cap->shed, now);
+    __atomic_add_fetch(&cap->ring_dropped, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// appsrc runs with block=true: a slow decoder stalls this thread only. At
+// the end of a replay the queue is drained, then the pipeline (or the
+// sink's eos hook) gets EOS.
+static gpointer push_thread_fn(gpointer data) {
+  theta_cap_t *cap = data;
+  while (g_atomic_int_get(&cap->push_run)) {
+    GstBuffer *buf = frame_ring_pop(cap->ring, 100);
+    if (buf) __atomic_add_fetch(&cap->pushed, 1, __ATOMIC_RELAXED);
+    if (buf && cap->sink) {
+      cap->sink(cap, buf, cap->sink_user);
+    } else if (buf) {
+      GstFlowReturn ret;
+      g_signal_emit_by_name(cap->appsrc, "push-buffer", buf, &ret);
+      gst_buffer_unref(buf);
+      if (ret != GST_FLOW_OK && ret != GST_FLOW_FLUSHING)
+        g_printerr("[%s] push-buffer failed: %d\n", cap->tag, ret);
+    } else if (cap->player && !cap->eos_sent && tcap_player_done(cap->player)) {
+      if (!cap->sink) {
+        GstFlowReturn ret;
+        g_signal_emit_by_name(cap->appsrc, "end-of-stream", &ret);
+      } else if (cap->hooks.eos) {
+        cap->hooks.eos(cap, cap->hooks.user);
+      }
+      cap->eos_sent = 1;
+    }
+  }
+  return NULL;
+}
+
+// Restarts a stopped live stream with cap->ctrl, under dev_lock. Whatever
+// is still queued is the old stream; the new one starts over at an IDR
+// with a fresh sequence count.
+static uvc_error_t cap_stream_restart(theta_cap_t *cap) {
+  gop_shed_note_loss(&cap->shed, now_ns());
+  cap->have_seq = 0;
+  dev_pts_restart(&cap->pts, cap->ctrl.dwFrameInterval);
+  if (cap->hooks.restarted) cap->hooks.restarted(cap, cap->hooks.user);
+  return uvc_start_streaming(cap->devh, &cap->ctrl, cap_frame_cb, cap, 0);
+}
+
+// Warm reconnect, under dev_lock: the device handle is dropped, the camera
+// found again by serial (after a replug it is a new USB device) and
+// restarted in the mode it was streaming; the pipeline (or the sink) and
+// lent frames are untouched. A replay with a fault set resumes its player
+// instead; its sequence and timeline carry on across the gap, as the
+// file's do.
+static int cap_reconnect(theta_cap_t *cap) {
+  if (cap->player) return tcap_player_restart(cap->player) == 0;
+
+  if (cap->devh) {
+    uvc_stop_streaming(cap->devh);
+    uvc_close(cap->devh);
+    cap->devh = NULL;
+  }
+  const char *serial = cap->serial[0] ? cap->serial : cap->cfg.serial;
+  if (theta_cap_open_device(cap->ctx, serial, &cap->devh, NULL, 0) != UVC_SUCCESS) {
+    cap->devh = NULL;
+    return 0;
+  }
+  uvc_stream_ctrl_t ctrl;
+  const char *step = "negotiation";
+  uvc_error_t res = thetauvc_get_stream_ctrl_format_size(cap->devh, cap->mode, &ctrl);
+  if (res == UVC_SUCCESS) {
+    cap->ctrl = ctrl;
+    step = "uvc_start_streaming";
+    res = cap_stream_restart(cap);
+  }
+  if (res != UVC_SUCCESS) {
+    g_printerr("[%s] reconnect: %s failed: %d\n", cap->tag, step, res);
+    uvc_close(cap->devh);
+    cap->devh = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+// Under dev_lock. Detection is the absence of frames, which covers a hung
+// stream and an unplugged camera alike: libuvc reports neither.
+static void watch_tick(theta_cap_t *cap) {
+  guint64 now = now_ns();
+  switch (stream_watch_tick(&cap->watch, now)) {
+  case STREAM_WATCH_OK:
+    break;
+  case STREAM_WATCH_RECONNECT: {
+    if (cap->reconnect_tries++ == 0)
+      g_printerr("[%s] stalled: no frame for %.0f ms, reconnecting\n", cap->tag,
+                 (double)cap->watch.st.last_detect_ns / 1e6);
+    int ok = cap_reconnect(cap);
+    guint64 t = now_ns();
+    stream_watch_attempt(&cap->watch, ok, t);
+    if (!ok)
+      g_printerr("[%s] reconnect attempt %u failed (%.0f ms), retrying in %.0f ms\n", cap->tag,
+                 cap->reconnect_tries, (double)(t - now) / 1e6,
+                 (double)(cap->watch.next_try_ns - t) / 1e6);
+    break;
+  }
+  case STREAM_WATCH_RECOVERED:
+    g_print("[%s] recovered: %.0f ms without frames, %u attempt%s\n", cap->tag,
+            (double)cap->watch.st.last_recovery_ns / 1e6, cap->reconnect_tries,
+            cap->reconnect_tries == 1 ? "" : "s");
+    cap->reconnect_tries = 0;
+    break;
+  }
+}
+
+// Stall supervisor, every 100 ms. A replay that has played out is silent
+// on purpose.
+static gpointer watch_thread_fn(gpointer data) {
+  theta_cap_t *cap = data;
+  g_mutex_lock(&cap->lock);
+  while (cap->running) {
+    g_cond_wait_until(&cap->watch_cond, &cap->lock, g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND);
+    if (!cap->running) break;
+    if (cap->eos) continue;
+    g_mutex_unlock(&cap->lock);
+    if (!cap->player || !tcap_player_done(cap->player)) {
+      g_mutex_lock(&cap->dev_lock);
+      watch_tick(cap);
+      g_mutex_unlock(&cap->dev_lock);
+    }
+    g_mutex_lock(&cap->lock);
+  }
+  g_mutex_unlock(&cap->lock);
+  return NULL;
+}
+
+/* ---------- Decode and lend ---------- */
+
+static void slot_clear(struct cap_slot *s) {
+  if (s->sample) {
+    gst_video_frame_unmap(&s->vf);
+    gst_sample_unref(s->sample);
+    s->sample = NULL;
+  }
+}
+
+// Under lock. A free slot, else in pull mode the frame still waiting to be
+// acquired: the newer one replaces it.
+static struct cap_slot *take_slot(theta_cap_t *cap) {
+  for (unsigned i = 0; i < cap->nslots; ++i)
+    if (cap->slots[i].state == SLOT_FREE) {
+      cap->slots[i].state = SLOT_FILLING;
+      return &cap->slots[i];
+    }
+  struct cap_slot *s = cap->ready;
+  if (s) {
+    cap->ready = NULL;
+    cap->replaced++;
+    s->state = SLOT_FILLING;
+  }
+  return s;
+}
+
+static void fill_meta(theta_cap_t *cap, struct theta_cap_frame *f, GstClockTime pts) {
+  f->pts_ns = (guint64)cap->t0_ns + pts;
+  g_mutex_lock(&cap->meta_lock);
+  for (int i = 0; i < CAP_META_SLOTS; ++i) {
+    const struct au_meta *m = &cap->meta[i];
+    if (m->arrival_ns && m->pts == pts) {
+      f->sequence   = m->sequence;
+      f->capture_ns = m->capture_ns;
+      f->arrival_ns = m->arrival_ns;
+      f->keyframe   = m->keyframe;
+      break;
+    }
+  }
+  g_mutex_unlock(&cap->meta_lock);
+}
+
+static GstFlowReturn on_sample(GstAppSink *sink, gpointer data) {
+  theta_cap_t *cap = data;
+  GstSample *sample = gst_app_sink_pull_sample(sink);
+  if (!sample) return GST_FLOW_EOS;
+
+  GstBuffer *buf = gst_sample_get_buffer(sample);
+  GstVideoInfo info;
+  if (!buf || !gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+  }
+
+  g_mutex_lock(&cap->lock);
+  cap->decoded++;
+  struct cap_slot *s = take_slot(cap);
+  if (!s) cap->busy++;
+  g_mutex_unlock(&cap->lock);
+  if (!s) {
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+  }
+  if (!gst_video_frame_map(&s->vf, &info, buf, GST_MAP_READ)) {
+    gst_sample_unref(sample);
+    g_mutex_lock(&cap->lock);
+    s->state = SLOT_FREE;
+    g_mutex_unlock(&cap->lock);
+    return GST_FLOW_OK;
+  }
+
+  struct theta_cap_frame *f = &s->f;
+  int w = GST_VIDEO_FRAME_WIDTH(&s->vf), h = GST_VIDEO_FRAME_HEIGHT(&s->vf);
+  gboolean nv12 = GST_VIDEO_FRAME_FORMAT(&s->vf) == GST_VIDEO_FORMAT_NV12;
+  memset(f, 0, sizeof(*f));
+  f->width  = (unsigned)w;
+  f->height = (unsigned)h;
+  fill_meta(cap, f, GST_BUFFER_PTS(buf));
+
+  if (cap->cfg.format == THETA_CAP_BGR) {
+    size_t need = (size_t)w * 3 * (size_t)h;
+    if (s->bgr_size < need) {
+      g_free(s->bgr);
+      s->bgr = g_malloc(need);
+      s->bgr_size = need;
+    }
+    struct yuv2bgr_src src = {
+      .layout   = nv12 ? YUV2BGR_NV12 : YUV2BGR_I420,
+      .width    = w,
+      .height   = h,
+      .y        = GST_VIDEO_FRAME_PLANE_DATA(&s->vf, 0),
+      .y_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&s->vf, 0),
+      .u        = GST_VIDEO_FRAME_PLANE_DATA(&s->vf, 1),
+      .u_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&s->vf, 1),
+      .v        = nv12 ? NULL : GST_VIDEO_FRAME_PLANE_DATA(&s->vf, 2),
+      .v_stride = nv12 ? 0 : GST_VIDEO_FRAME_PLANE_STRIDE(&s->vf, 2),
+    };
+    // Untagged streams follow GStreamer's default: BT.709 from HD up.
+    int matrix;
+    switch (info.colorimetry.matrix) {
+      case GST_VIDEO_COLOR_MATRIX_BT601: matrix = YUV2BGR_BT601; break;
+      case GST_VIDEO_COLOR_MATRIX_BT709: matrix = YUV2BGR_BT709; break;
+      default: matrix = h >= 720 ? YUV2BGR_BT709 : YUV2BGR_BT601; break;
+    }
+    yuv2bgr_convert(&src, matrix, s->bgr, w * 3, cap->bands);
+    gst_video_frame_unmap(&s->vf);
+    gst_sample_unref(sample);
+    f->layout    = THETA_CAP_LAYOUT_BGR;
+    f->nplanes   = 1;
+    f->plane[0]  = s->bgr;
+    f->stride[0] = w * 3;
+  } else {
+    // Lent as decoded: the sample and its mapping live until release.
+    s->sample  = sample;
+    f->layout  = nv12 ? THETA_CAP_LAYOUT_NV12 : THETA_CAP_LAYOUT_I420;
+    f->nplanes = nv12 ? 2 : 3;
+    for (unsigned p = 0; p < f->nplanes; ++p) {
+      f->plane[p]  = GST_VIDEO_FRAME_PLANE_DATA(&s->vf, p);
+      f->stride[p] = GST_VIDEO_FRAME_PLANE_STRIDE(&s->vf, p);
+    }
+  }
+  f->ready_ns = now_ns();
+
+  g_mutex_lock(&cap->lock);
+  theta_cap_frame_fn fn = cap->fn;
+  if (fn) {
+    s->state = SLOT_LENT;
+    cap->delivered++;
+  } else {
+    s->state = SLOT_READY;
+    cap->ready = s;
+    g_cond_broadcast(&cap->cond);
+  }
+  g_mutex_unlock(&cap->lock);
+  if (fn) fn(cap, f, cap->user);
+  return GST_FLOW_OK;
+}
+
+static void on_eos(GstAppSink *sink, gpointer data) {
+  (void)sink;
+  theta_cap_t *cap = data;
+  g_mutex_lock(&cap->lock);
+  cap->eos = 1;
+  g_cond_broadcast(&cap->cond);
+  g_mutex_unlock(&cap->lock);
+}
+
+// Advertising GstVideoMeta lets the decoder hand over its own padded
+// frames instead of copying each into a tightly packed buffer first.
+static GstPadProbeReturn on_sink_query(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  (void)pad; (void)data;
+  GstQuery *q = GST_PAD_PROBE_INFO_QUERY(info);
+  if (GST_QUERY_TYPE(q) == GST_QUERY_ALLOCATION)
+    gst_query_add_allocation_meta(q, GST_VIDEO_META_API_TYPE, NULL);
+  return GST_PAD_PROBE_OK;
+}
+
+// No main loop to watch the bus from: errors are logged as they are posted.
+static GstBusSyncReply on_bus(GstBus *bus, GstMessage *msg, gpointer data) {
+  (void)bus;
+  theta_cap_t *cap = data;
+  if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_WARNING) {
+    GError *err = NULL;
+    gchar *dbg = NULL;
+    if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) gst_message_parse_error(msg, &err, &dbg);
+    else                                            gst_message_parse_warning(msg, &err, &dbg);
+    g_printerr("[%s] %s from %s: %s\n", cap->tag,
+               GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR ? "error" : "warning",
+               GST_OBJECT_NAME(msg->src), err ? err->message : "?");
+    g_clear_error(&err);
+    g_free(dbg);
+  }
+  return GST_BUS_DROP;
+}
+
+static int build_pipeline(theta_cap_t *cap) {
+  gchar *desc = g_strdup_printf(
+    "appsrc name=ap is-live=true block=true format=time "
+      "caps=video/x-h264,stream-format=byte-stream,alignment=au ! "
+    "queue max-size-buffers=4 leaky=no ! "
+    "h264parse config-interval=-1 disable-passthrough=true ! "
+    "video/x-h264,alignment=au,stream-format=avc ! "
+    "%s ! video/x-raw,format=(string){I420,NV12} ! "
+    "appsink name=out sync=false max-buffers=1 drop=true",
+    cap->cfg.nvdec ? "nvh264dec" : "avdec_h264");
+  GError *err = NULL;
+  cap->pipeline = gst_parse_launch(desc, &err);
+  g_free(desc);
+  if (!cap->pipeline || err) {
+    g_printerr("[%s] cannot create pipeline: %s\n", cap->tag, err ? err->message : "unknown");
+    g_clear_error(&err);
+    if (cap->pipeline) gst_object_unref(cap->pipeline);
+    cap->pipeline = NULL;
+    return -1;
+  }
+  cap->appsrc = gst_bin_get_by_name(GST_BIN(cap->pipeline), "ap");
+  g_object_set(cap->appsrc, "stream-type", 0, "format", GST_FORMAT_TIME, NULL);
+
+  GstElement *out = gst_bin_get_by_name(GST_BIN(cap->pipeline), "out");
+  GstAppSinkCallbacks cbs = { .eos = on_eos, .new_sample = on_sample };
+  gst_app_sink_set_callbacks(GST_APP_SINK(out), &cbs, cap, NULL);
+  GstPad *pad = gst_element_get_static_pad(out, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, on_sink_query, NULL, NULL);
+  gst_object_unref(pad);
+  gst_object_unref(out);
+
+  GstBus *bus = gst_element_get_bus(cap->pipeline);
+  gst_bus_set_sync_handler(bus, on_bus, cap, NULL);
+  gst_object_unref(bus);
+  return 0;
+}
+
+/* ---------- API ---------- */
+
+void theta_cap_config_defaults(struct theta_cap_config *cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->replay_speed = 1.0;
+  cfg->width        = 3840;
+  cfg->height       = 1920;
+  cfg->format       = THETA_CAP_BGR;
+  cfg->frames       = THETA_CAP_DEFAULT_FRAMES;
+  cfg->stall_frames = STREAM_WATCH_DEFAULT_STALL_FRAMES;
+  cfg->ring         = THETA_CAP_DEFAULT_RING;
+  cfg->overflow     = THETA_CAP_OVERFLOW_AUTO;
+  cfg->shed         = THETA_CAP_SHED_GOP;
+  cfg->pool         = THETA_CAP_DEFAULT_POOL;
+}
+
+// Mode cache key: the serial asked for, or "*" for whichever THETA is first.
+static const char *cache_key(const struct theta_cap_config *cfg) {
+  return cfg->serial ? cfg->serial : "*";
+}
+
+int theta_cap_predict_mode(const struct theta_cap_config *cfg, unsigned int *mode,
+                           unsigned *width, unsigned *height, unsigned *fps) {
+  unsigned int want = theta_cap_requested_mode(cfg->width, cfg->height), m;
+  uvc_stream_ctrl_t ctrl;
+  int cached = mode_cache_load(cache_key(cfg), want, &m, &ctrl) == 0 && m < THETAUVC_MODE_NUM;
+  if (!cached) m = want;
+  if (mode) *mode = m;
+  thetauvc_get_mode_size(m, width, height, fps);
+  return cached;
+}
+
+static theta_cap_t *open_fail(theta_cap_t *cap, char *err, size_t err_size, const char *fmt, ...) {
+  if (err && err_size) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(err, err_size, fmt, ap);
+    va_end(ap);
+  }
+  theta_cap_close(cap);
+  return NULL;
+}
+
+// GStreamer is not touched before start: callers may open cameras on
+// another thread while they initialise it themselves.
+theta_cap_t *theta_cap_open(const struct theta_cap_config *cfg, char *err, size_t err_size) {
+  theta_cap_t *cap = g_new0(theta_cap_t, 1);
+  cap->cfg = *cfg;
+  cap->cfg.serial      = cap->serial_arg = g_strdup(cfg->serial);
+  cap->cfg.replay_path = cap->replay_arg = g_strdup(cfg->replay_path);
+  cap->cfg.tag = NULL;
+  g_mutex_init(&cap->lock);
+  g_mutex_init(&cap->dev_lock);
+  g_mutex_init(&cap->meta_lock);
+  g_cond_init(&cap->cond);
+  g_cond_init(&cap->watch_cond);
+  if (cfg->tag)              g_strlcpy(cap->tag, cfg->tag, sizeof(cap->tag));
+  else if (cfg->serial)      g_strlcpy(cap->tag, cfg->serial, sizeof(cap->tag));
+  else if (cfg->replay_path) {
+    gchar *base = g_path_get_basename(cfg->replay_path);
+    g_strlcpy(cap->tag, base, sizeof(cap->tag));
+    g_free(base);
+  } else {
+    g_strlcpy(cap->tag, "theta", sizeof(cap->tag));
+  }
+
+  cap->nslots = (cfg->frames ? cfg->frames : THETA_CAP_DEFAULT_FRAMES) + 1;   // + the one being filled
+  if (cfg->ring == 0) return open_fail(cap, err, err_size, "invalid ring depth 0");
+  // With shedding, ring losses must happen at the newest end so that
+  // everything already queued is still a decodable prefix.
+  cap->overflow = cfg->overflow != THETA_CAP_OVERFLOW_AUTO ? cfg->overflow :
+                  cfg->shed != THETA_CAP_SHED_NONE ? THETA_CAP_OVERFLOW_DROP_NEWEST : THETA_CAP_OVERFLOW_DROP_OLDEST;
+  cap->shed_high = cfg->shed_high ? cfg->shed_high : cfg->ring > 1 ? cfg->ring / 2 : 1;
+  cap->slots = g_new0(struct cap_slot, cap->nslots);
+
+  if (cfg->replay_path) {
+    cap->replay = tcap_reader_open(cfg->replay_path);
+    if (!cap->replay) return open_fail(cap, err, err_size, "cannot open capture file %s", cfg->replay_path);
+    const struct tcap_mode *m = tcap_reader_mode(cap->replay);
+    tcap_mode_to_ctrl(m, &cap->ctrl);
+    cap->mode   = m->mode;
+    cap->width  = m->width;
+    cap->height = m->height;
+    cap->fps    = m->fps;
+    return cap;
+  }
+
+  cap->ctx = ctx_ref();
+  if (!cap->ctx) return open_fail(cap, err, err_size, "uvc_init failed");
+  cap->usb_init_ns = now_ns();
+  cap->want_mode = theta_cap_requested_mode(cfg->width, cfg->height);
+  cap->cached = mode_cache_load(cache_key(cfg), cap->want_mode, &cap->mode, &cap->ctrl) == 0 &&
+                cap->mode < THETAUVC_MODE_NUM;
+  uvc_error_t res = theta_cap_open_device(cap->ctx, cfg->serial, &cap->devh, cap->serial, sizeof(cap->serial));
+  if (res != UVC_SUCCESS) {
+    cap->devh = NULL;
+    return open_fail(cap, err, err_size, "THETA %s not found or not usable (%d)",
+                     cfg->serial ? cfg->serial : "", res);
+  }
+  cap->opened_ns = now_ns();
+  if (!cap->cached) {
+    res = theta_cap_negotiate(cap->devh, cap->want_mode, &cap->mode, &cap->ctrl);
+    if (res != UVC_SUCCESS) return open_fail(cap, err, err_size, "cannot negotiate H.264 (%d)", res);
+  }
+  cap->negotiated_ns = now_ns();
+  thetauvc_get_mode_size(cap->mode, &cap->width, &cap->height, &cap->fps);
+  return cap;
+}
+
+void theta_cap_set_callback(theta_cap_t *cap, theta_cap_frame_fn fn, void *user) {
+  g_mutex_lock(&cap->lock);
+  cap->fn = fn;
+  cap->user = user;
+  g_mutex_unlock(&cap->lock);
+}
+
+void theta_cap_set_sink(theta_cap_t *cap, theta_cap_sink_fn fn, void *user) {
+  cap->sink = fn;
+  cap->sink_user = user;
+}
+
+void theta_cap_set_hooks(theta_cap_t *cap, const struct theta_cap_hooks *hooks) {
+  if (hooks) cap->hooks = *hooks;
+  else       memset(&cap->hooks, 0, sizeof(cap->hooks));
+}
+
+// A cached control the camera refuses (firmware update, other camera with
+// the same serial key) falls back to negotiation; a probed one that works
+// goes into the cache.
+static uvc_error_t cap_start_streaming(theta_cap_t *cap) {
+  uvc_error_t res = uvc_start_streaming(cap->devh, &cap->ctrl, cap_frame_cb, cap, 0);
+  if (res != UVC_SUCCESS && cap->cached) {
+    g_printerr("[%s] cached stream control refused (%d), negotiating\n", cap->tag, res);
+    cap->cached = 0;
+    uvc_stop_streaming(cap->devh);
+    if (theta_cap_negotiate(cap->devh, cap->want_mode, &cap->mode, &cap->ctrl) != UVC_SUCCESS) return res;
+    thetauvc_get_mode_size(cap->mode, &cap->width, &cap->height, &cap->fps);
+    dev_pts_init(&cap->pts, cap->ctrl.dwFrameInterval, cap->t0_ns);
+    if (cap->hooks.renegotiated) cap->hooks.renegotiated(cap, cap->hooks.user);
+    res = uvc_start_streaming(cap->devh, &cap->ctrl, cap_frame_cb, cap, 0);
+  }
+  if (res == UVC_SUCCESS && !cap->cached)
+    mode_cache_store(cache_key(&cap->cfg), cap->want_mode, cap->mode, &cap->ctrl);
+  return res;
+}
+
+int theta_cap_start(theta_cap_t *cap) {
+  if (cap->running) return 0;
+  if (!cap->devh && !cap->replay) return -1;
+  if (!gst_is_initialized()) gst_init(NULL, NULL);
+
+  cap->have_seq = cap->have_idr = 0;
+  cap->eos_sent = cap->eos = 0;
+  h264_stream_init(&cap->h264);
+  gop_shed_init(&cap->shed, cap->cfg.shed == THETA_CAP_SHED_GOP    ? GOP_SHED_GOP :
+                            cap->cfg.shed == THETA_CAP_SHED_NONREF ? GOP_SHED_NONREF : GOP_SHED_NONE);
+  cap->t0_ns = cap->cfg.t0_ns ? cap->cfg.t0_ns : (gint64)now_ns();
+  dev_pts_init(&cap->pts, cap->ctrl.dwFrameInterval, cap->t0_ns);
+  // Recycled buffers sized for the largest frame the camera announced.
+  if (!cap->pool) cap->pool = h264_pool_new(cap->ctrl.dwMaxVideoFrameSize, cap->cfg.pool);
+  if (!cap->sink && cap->cfg.format == THETA_CAP_BGR && !cap->bands) {
+    yuv2bgr_select(SIMD_AUTO);
+    cap->bands = band_pool_new(cap->cfg.convert_threads);
+  }
+  cap->ring = frame_ring_new(cap->cfg.ring, cap->overflow == THETA_CAP_OVERFLOW_DROP_NEWEST ?
+                                            FRAME_RING_DROP_NEWEST : FRAME_RING_DROP_OLDEST);
+  if (!cap->ring) return -1;
+  if (!cap->sink &&
+      (build_pipeline(cap) != 0 ||
+       gst_element_set_state(cap->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)) {
+    if (cap->pipeline) {
+      gst_element_set_state(cap->pipeline, GST_STATE_NULL);
+      gst_object_unref(cap->appsrc);
+      gst_object_unref(cap->pipeline);
+      cap->appsrc = cap->pipeline = NULL;
+    }
+    frame_ring_free(cap->ring);
+    cap->ring = NULL;
+    return -1;
+  }
+
+  g_mutex_lock(&cap->lock);
+  cap->running = 1;
+  g_mutex_unlock(&cap->lock);
+  g_atomic_int_set(&cap->push_run, 1);
+  cap->push_thread = g_thread_new("cap-push", push_thread_fn, cap);
+
+  int ok;
+  if (cap->replay) {
+    cap->player = tcap_player_start(cap->replay, cap->cfg.replay_speed, cap->cfg.replay_loop,
+                                    cap_frame_cb, cap);
+    ok = cap->player != NULL;
+    if (ok && cap->cfg.replay_stall_ns)
+      tcap_player_set_fault(cap->player, cap->cfg.replay_stall_ns, cap->cfg.replay_down_ns);
+  } else {
+    uvc_error_t res = cap_start_streaming(cap);
+    if (res != UVC_SUCCESS) g_printerr("[%s] uvc_start_streaming failed: %d\n", cap->tag, res);
+    ok = res == UVC_SUCCESS;
+  }
+  if (!ok) {
+    theta_cap_stop(cap);
+    return -1;
+  }
+
+  if (cap->cfg.stall_frames) {
+    // A slowed-down replay stretches the frame interval with it.
+    struct stream_watch_config wc;
+    double interval_ns = (double)cap->ctrl.dwFrameInterval * 100.0;
+    if (cap->replay && cap->cfg.replay_speed > 0) interval_ns /= cap->cfg.replay_speed;
+    stream_watch_defaults(&wc, (uint64_t)interval_ns);
+    wc.stall_frames = cap->cfg.stall_frames;
+    stream_watch_init(&cap->watch, &wc, now_ns());
+    cap->watch_thread = g_thread_new("cap-watch", watch_thread_fn, cap);
+  }
+  return 0;
+}
+
+void theta_cap_stop(theta_cap_t *cap) {
+  g_mutex_lock(&cap->lock);
+  int was_running = cap->running;
+  cap->running = 0;
+  g_cond_broadcast(&cap->cond);
+  g_cond_broadcast(&cap->watch_cond);
+  g_mutex_unlock(&cap->lock);
+  if (!was_running) return;
+
+  if (cap->watch_thread) g_thread_join(cap->watch_thread);
+  cap->watch_thread = NULL;
+  if (cap->player) {
+    tcap_player_stop(cap->player);
+    cap->player = NULL;
+  } else {
+    g_mutex_lock(&cap->dev_lock);
+    if (cap->devh) uvc_stop_streaming(cap->devh);
+    g_mutex_unlock(&cap->dev_lock);
+  }
+
+  g_atomic_int_set(&cap->push_run, 0);
+  frame_ring_close(cap->ring);
+  g_thread_join(cap->push_thread);
+  cap->push_thread = NULL;
+  for (GstBuffer *b; (b = frame_ring_try_pop(cap->ring)) != NULL; ) gst_buffer_unref(b);
+  frame_ring_get_stats(cap->ring, &cap->ring_last, FALSE);
+  frame_ring_free(cap->ring);
+  cap->ring = NULL;
+
+  if (cap->pipeline) {
+    gst_element_set_state(cap->pipeline, GST_STATE_NULL);
+    gst_object_unref(cap->appsrc);
+    gst_object_unref(cap->pipeline);
+    cap->appsrc = cap->pipeline = NULL;
+  }
+
+  // A frame nobody acquired goes back; lent ones stay with the consumer.
+  g_mutex_lock(&cap->lock);
+  struct cap_slot *s = cap->ready;
+  cap->ready = NULL;
+  g_mutex_unlock(&cap->lock);
+  if (s) theta_cap_release(cap, &s->f);
+}
+
+void theta_cap_close(theta_cap_t *cap) {
+  if (!cap) return;
+  theta_cap_stop(cap);
+  if (cap->devh) uvc_close(cap->devh);
+  if (cap->ctx)  ctx_unref();
+  tcap_reader_close(cap->replay);
+  for (unsigned i = 0; i < cap->nslots; ++i) {
+    slot_clear(&cap->slots[i]);
+    g_free(cap->slots[i].bgr);
+  }
+  g_free(cap->slots);
+  h264_pool_free(cap->pool);
+  band_pool_free(cap->bands);
+  g_mutex_clear(&cap->lock);
+  g_mutex_clear(&cap->dev_lock);
+  g_mutex_clear(&cap->meta_lock);
+  g_cond_clear(&cap->cond);
+  g_cond_clear(&cap->watch_cond);
+  g_free(cap->serial_arg);
+  g_free(cap->replay_arg);
+  g_free(cap);
+}
+
+const struct theta_cap_frame *theta_cap_acquire(theta_cap_t *cap, int timeout_ms) {
+  gint64 end = g_get_monotonic_time() + (gint64)timeout_ms * G_TIME_SPAN_MILLISECOND;
+  g_mutex_lock(&cap->lock);
+  while (!cap->ready && cap->running && !cap->eos) {
+    if (timeout_ms < 0) g_cond_wait(&cap->cond, &cap->lock);
+    else if (!g_cond_wait_until(&cap->cond, &cap->lock, end)) break;
+  }
+  struct cap_slot *s = cap->ready;
+  if (s) {
+    cap->ready = NULL;
+    s->state = SLOT_LENT;
+    cap->delivered++;
+  }
+  g_mutex_unlock(&cap->lock);
+  return s ? &s->f : NULL;
+}
+
+void theta_cap_release(theta_cap_t *cap, const struct theta_cap_frame *frame) {
+  if (!frame) return;
+  struct cap_slot *s = (struct cap_slot *)frame;
+  slot_clear(s);
+  g_mutex_lock(&cap->lock);
+  s->state = SLOT_FREE;
+  g_mutex_unlock(&cap->lock);
+}
+
+int theta_cap_set_mode(theta_cap_t *cap, unsigned int mode) {
+  unsigned int w, h, fps;
+  if (cap->replay || thetauvc_get_mode_size(mode, &w, &h, &fps) != UVC_SUCCESS) return -1;
+  g_mutex_lock(&cap->dev_lock);
+  // A pending reconnect brings the stream back in the current mode.
+  if (!cap->devh || !cap->push_thread) {
+    g_mutex_unlock(&cap->dev_lock);
+    return -1;
+  }
+  uvc_stop_streaming(cap->devh);
+
+  uvc_stream_ctrl_t ctrl;
+  int ok = thetauvc_get_stream_ctrl_format_size(cap->devh, mode, &ctrl) == UVC_SUCCESS;
+  if (ok) {
+    cap->ctrl = ctrl;
+    cap->mode = mode;
+    cap->width = w; cap->height = h; cap->fps = fps;
+    // The callback thread is joined: the pool is ours to swap.
+    if (ctrl.dwMaxVideoFrameSize > h264_pool_buffer_size(cap->pool) &&
+        h264_pool_resize(cap->pool, ctrl.dwMaxVideoFrameSize))
+      g_print("[%s] H.264 pool buffers grown to %zu bytes for %ux%u\n", cap->tag,
+              (size_t)h264_pool_buffer_size(cap->pool), w, h);
+  } else {
+    g_printerr("[%s] cannot negotiate %ux%u; staying at %ux%u\n", cap->tag, w, h, cap->width, cap->height);
+  }
+
+  // A failed restart is left to the stall watch.
+  uvc_error_t res = cap_stream_restart(cap);
+  if (res != UVC_SUCCESS) g_printerr("[%s] uvc_start_streaming failed: %d\n", cap->tag, res);
+  if (cap->cfg.stall_frames) stream_watch_restarted(&cap->watch, now_ns());
+  g_mutex_unlock(&cap->dev_lock);
+  return ok ? 0 : -1;
+}
+
+void theta_cap_get_size(const theta_cap_t *cap, unsigned *width, unsigned *height, unsigned *fps) {
+  if (width)  *width  = cap->width;
+  if (height) *height = cap->height;
+  if (fps)    *fps    = cap->fps;
+}
+
+void theta_cap_get_mode(const theta_cap_t *cap, unsigned int *mode, int *cached) {
+  if (mode)   *mode   = cap->mode;
+  if (cached) *cached = cap->cached;
+}
+
+void theta_cap_get_ctrl(theta_cap_t *cap, uvc_stream_ctrl_t *ctrl) {
+  g_mutex_lock(&cap->dev_lock);
+  *ctrl = cap->ctrl;
+  g_mutex_unlock(&cap->dev_lock);
+}
+
+int theta_cap_done(theta_cap_t *cap) {
+  if (cap->sink) return cap->player && tcap_player_done(cap->player);
+  g_mutex_lock(&cap->lock);
+  int eos = cap->eos;
+  g_mutex_unlock(&cap->lock);
+  return eos;
+}
+
+void theta_cap_get_stats(theta_cap_t *cap, struct theta_cap_stats *out, int reset_peaks) {
+  struct gop_shed_stats ss;
+  struct stream_watch_stats ws;
+  struct h264_pool_stats ps = { 0 };
+  struct frame_ring_stats rs = cap->ring_last;
+  memset(out, 0, sizeof(*out));
+  gop_shed_get_stats(&cap->shed, &ss);
+  stream_watch_get_stats(&cap->watch, &ws);
+  if (cap->ring) frame_ring_get_stats(cap->ring, &rs, reset_peaks);
+  if (cap->pool) {
+    h264_pool_get_stats(cap->pool, &ps);
+    out->pool_buffer_bytes = h264_pool_buffer_size(cap->pool);
+  }
+  out->frames_in    = __atomic_load_n(&cap->frames_in, __ATOMIC_RELAXED);
+  out->seq_gaps     = __atomic_load_n(&cap->seq_gaps, __ATOMIC_RELAXED);
+  out->ring_dropped = __atomic_load_n(&cap->ring_dropped, __ATOMIC_RELAXED);
+  out->no_buffer    = __atomic_load_n(&cap->no_buffer, __ATOMIC_RELAXED);
+  out->pushed       = __atomic_load_n(&cap->pushed, __ATOMIC_RELAXED);
+  out->shed         = ss.shed;
+  out->shed_runs    = ss.episodes;
+  out->shed_recovery_last_ns = ss.last_recovery_ns;
+  out->shed_recovery_max_ns  = ss.max_recovery_ns;
+  out->ring_overwritten = rs.overwritten;
+  out->ring_rejected    = rs.rejected;
+  out->ring_depth       = rs.depth;
+  out->ring_queued      = rs.occupancy;
+  out->ring_peak        = rs.max_occupancy;
+  out->ring_max_residency_ns = rs.max_residency_ns;
+  out->overflow     = cap->overflow;
+  out->shed_high    = cap->shed_high;
+  out->pool_hits    = ps.pool_hits;
+  out->allocs       = ps.allocs;
+  out->stalls       = ws.stalls;
+  out->reconnect_attempts = ws.attempts;
+  out->recoveries   = ws.recoveries;
+  out->recovery_last_ns = ws.last_recovery_ns;
+  out->recovery_max_ns  = ws.max_recovery_ns;
+  out->stalled      = ws.stalled;
+  out->usb_init_ns  = cap->usb_init_ns;
+  out->opened_ns    = cap->opened_ns;
+  out->negotiated_ns = cap->negotiated_ns;
+  g_mutex_lock(&cap->lock);
+  out->decoded      = cap->decoded;
+  out->delivered    = cap->delivered;
+  out->busy         = cap->busy;
+  out->replaced     = cap->replaced;
+  g_mutex_unlock(&cap->lock);
+}
+
+void theta_cap_dump_clock(theta_cap_t *cap, int interval, FILE *fp) {
+  dev_pts_dump(&cap->pts, interval, fp);
+}
+
+int theta_cap_parse_overflow(const char *s, enum theta_cap_overflow *out) {
+  if (!strcmp(s, "drop-oldest")) { *out = THETA_CAP_OVERFLOW_DROP_OLDEST; return 0; }
+  if (!strcmp(s, "drop-newest")) { *out = THETA_CAP_OVERFLOW_DROP_NEWEST; return 0; }
+  return -1;
+}
+
+const char *theta_cap_overflow_name(enum theta_cap_overflow overflow) {
+  switch (overflow) {
+    case THETA_CAP_OVERFLOW_AUTO:        return "auto";
+    case THETA_CAP_OVERFLOW_DROP_NEWEST: return "drop-newest";
+    default:                             return "drop-oldest";
+  }
+}
+
+int theta_cap_parse_shed(const char *s, enum theta_cap_shed *out) {
+  if (!strcmp(s, "none"))   { *out = THETA_CAP_SHED_NONE;   return 0; }
+  if (!strcmp(s, "nonref")) { *out = THETA_CAP_SHED_NONREF; return 0; }
+  if (!strcmp(s, "gop"))    { *out = THETA_CAP_SHED_GOP;    return 0; }
+  return -1;
+}
+
+const char *theta_cap_shed_name(enum theta_cap_shed shed) {
+  switch (shed) {
+    case THETA_CAP_SHED_NONREF: return "nonref";
+    case THETA_CAP_SHED_GOP:    return "gop";
+    default:                    return "none";
+  }
+}
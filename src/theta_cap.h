@@ -0,0 +1,249 @@
+// theta_cap.h
+// In-process capture library: a THETA (or a .tcap replay) decoded inside
+// the caller's process, with no socket and no copy between the decoder
+// and the consumer. Frames are lent from a small pool and stay valid until
+// theta_cap_release(); while the consumer holds every frame, new ones are
+// dropped rather than waited for, so capture and decode never block on it.
+//
+//   struct theta_cap_config cfg;
+//   theta_cap_config_defaults(&cfg);
+//   cfg.serial = "12345678";
+//   theta_cap_t *cap = theta_cap_open(&cfg, err, sizeof(err));
+//   theta_cap_start(cap);
+//   for (;;) {
+//     const struct theta_cap_frame *f = theta_cap_acquire(cap, 1000);
+//     if (f) { ...f->plane[0], f->stride[0]...; theta_cap_release(cap, f); }
+//   }
+//
+// or theta_cap_set_callback() before start, to be handed each frame on the
+// decoder's thread instead (release it there or later, from any thread).
+//
+// THETA_CAP_BGR frames are converted (SIMD, banded) straight into the
+// pool's buffers; THETA_CAP_YUV lends the decoder's own 4:2:0 buffer, with
+// no conversion at all.
+//
+// Ingest is the library's whichever way frames leave it: first-IDR gating,
+// GOP shedding under backlog, camera-clock PTS, pooled buffers, the queue
+// to a push thread, mode cache and warm reconnect after a stall or replug.
+// A caller with its own decode graph (min_latency_from_uvc) sets a sink
+// with theta_cap_set_sink() and is handed the queued access units instead
+// of decoded frames; theta_cap_set_hooks() lets it watch every access unit
+// as it comes off USB.
+//
+// The open/negotiate steps on their own, for callers that drive libuvc
+// themselves, are in theta_cap_dev.h.
+
+#if !defined(__THETA_CAP_H__)
+#define __THETA_CAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <gst/gst.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define THETA_CAP_DEFAULT_FRAMES  3
+#define THETA_CAP_DEFAULT_RING    8
+#define THETA_CAP_DEFAULT_POOL    8
+
+enum theta_cap_format {
+  THETA_CAP_BGR = 0,           // packed 8-bit BGR, stride = 3 * width
+  THETA_CAP_YUV,               // the decoder's frame: I420 or NV12
+};
+
+enum theta_cap_layout {
+  THETA_CAP_LAYOUT_BGR = 0,
+  THETA_CAP_LAYOUT_I420,       // planes Y, U, V
+  THETA_CAP_LAYOUT_NV12,       // planes Y, interleaved UV
+};
+
+// What a full queue to the decoder drops.
+enum theta_cap_overflow {
+  THETA_CAP_OVERFLOW_AUTO = -1,        // drop-newest when shedding, else drop-oldest
+  THETA_CAP_OVERFLOW_DROP_OLDEST = 0,  // overwrite the oldest queued access unit
+  THETA_CAP_OVERFLOW_DROP_NEWEST,      // reject the incoming one
+};
+
+// What congestion sheds before the queue, in units the decoder survives.
+enum theta_cap_shed {
+  THETA_CAP_SHED_NONE = 0,
+  THETA_CAP_SHED_NONREF,       // non-reference pictures only
+  THETA_CAP_SHED_GOP,          // everything up to the next IDR
+};
+
+struct theta_cap_config {
+  const char *serial;          // NULL = the first THETA found
+  const char *replay_path;     // .tcap capture instead of a camera
+  double      replay_speed;    // 1 = recorded cadence, 0 = as fast as possible
+  int         replay_loop;
+  int         width, height;   // requested mode: 3840x1920 or 1920x960
+  enum theta_cap_format format;
+  unsigned    frames;          // frames the consumer can hold at once
+  int         nvdec;           // nvh264dec instead of avdec_h264
+  int         convert_threads; // BGR conversion workers, 0 = one per CPU
+  unsigned    stall_frames;    // reconnect after this many silent frame intervals, 0 = never
+  unsigned    ring;            // access units queued between USB and the decoder
+  enum theta_cap_overflow overflow;
+  enum theta_cap_shed shed;
+  unsigned    shed_high;       // queued access units that count as congestion, 0 = half the ring
+                               // (theta_cap_stats has overflow and shed_high as resolved)
+  unsigned    pool;            // recycled H.264 buffers, 0 = allocate per access unit
+  int64_t     t0_ns;           // CLOCK_MONOTONIC time of PTS 0, 0 = at start
+  uint64_t    replay_stall_ns; // replays hang every replay_stall_ns of stream (reconnect tests)...
+  uint64_t    replay_down_ns;  // ... and stay silent this long, as if unplugged
+  const char *tag;             // log prefix, NULL = serial or file name
+};
+
+struct theta_cap_frame {
+  const uint8_t *plane[3];
+  int       stride[3];
+  unsigned  nplanes;
+  enum theta_cap_layout layout;
+  unsigned  width, height;
+  uint64_t  sequence;          // UVC frame sequence
+  uint64_t  pts_ns;            // camera frame clock on host time
+  int64_t   capture_ns;        // UVC capture time
+  uint64_t  arrival_ns;        // CLOCK_MONOTONIC, access unit out of USB
+  uint64_t  ready_ns;          // CLOCK_MONOTONIC, decoded (and converted)
+  int       keyframe;
+};
+
+// One access unit off USB, as the hooks see it. Valid during the call only.
+struct theta_cap_au {
+  const uint8_t *data;         // byte stream, as received
+  size_t    size;
+  uint64_t  sequence;          // UVC frame sequence
+  int       idr, sps, pps;     // NAL units it carries
+  uint32_t  gap;               // sequence numbers missed just before this one
+  uint64_t  arrival_ns;        // CLOCK_MONOTONIC
+  uint64_t  pts;               // stream PTS (camera frame clock), t0_ns + pts is host time
+  uint64_t  duration;
+  int64_t   expected_ns;       // the frame's time on the camera clock, 0 = unknown
+  int64_t   capture_ns;        // UVC capture time
+};
+
+struct theta_cap_stats {
+  uint64_t frames_in;          // access units from USB
+  uint64_t seq_gaps;           // sequence numbers never received
+  uint64_t shed;               // dropped by GOP shedding before decode
+  uint64_t shed_runs;          // shedding episodes
+  uint64_t shed_recovery_last_ns, shed_recovery_max_ns;   // first shed frame -> decodable again
+  uint64_t ring_dropped;       // lost in the queue to the decoder
+  uint64_t ring_overwritten, ring_rejected;   // ... by drop-oldest, by drop-newest
+  unsigned ring_depth, ring_queued;
+  unsigned ring_peak;          // most queued since the last reset_peaks
+  uint64_t ring_max_residency_ns;     // ditto, longest wait in the queue
+  enum theta_cap_overflow overflow;   // the config's, AUTO resolved
+  unsigned shed_high;                 // ditto, 0 resolved
+  uint64_t no_buffer;          // admitted but no buffer to copy into
+  uint64_t pushed;             // handed to the decoder (or the sink)
+  uint64_t pool_hits, allocs;  // H.264 buffers recycled, allocated
+  size_t   pool_buffer_bytes;
+  uint64_t decoded;
+  uint64_t delivered;          // lent to the consumer
+  uint64_t busy;               // decoded but dropped: every frame was held
+  uint64_t replaced;           // pull mode: ready but superseded before acquire
+  uint64_t stalls;
+  uint64_t reconnect_attempts;
+  uint64_t recoveries;
+  uint64_t recovery_last_ns, recovery_max_ns;   // last frame before a stall -> first after it
+  int      stalled;            // now
+  uint64_t usb_init_ns, opened_ns, negotiated_ns;   // CLOCK_MONOTONIC, open steps; 0 for a replay
+};
+
+typedef struct theta_cap theta_cap_t;
+
+// Called on the decoder's output thread. The frame stays valid until
+// theta_cap_release(); returning does not release it.
+typedef void (*theta_cap_frame_fn)(theta_cap_t *cap, const struct theta_cap_frame *frame, void *user);
+
+extern void         theta_cap_config_defaults(struct theta_cap_config *cfg);
+
+// Finds and opens the camera (or the replay file) and settles its mode.
+// NULL on failure, with the reason in err.
+extern theta_cap_t *theta_cap_open(const struct theta_cap_config *cfg, char *err, size_t err_size);
+extern void         theta_cap_close(theta_cap_t *cap);
+
+// Sink mode: queued access units go to fn on the push thread, not to the
+// library's decoder. fn owns buf (a byte-stream access unit with PTS,
+// duration and the UVC sequence as offset) and may block: the queue, and
+// shedding, absorb it. There is no decoding and no frame to acquire; a
+// replay without loop ends with the eos hook.
+typedef void (*theta_cap_sink_fn)(theta_cap_t *cap, GstBuffer *buf, void *user);
+
+// Ingest hooks, all optional, all called with the stream's own threads
+// blocked on them, so they must be quick.
+struct theta_cap_hooks {
+  // Every access unit off USB (or the replay), before gating and shedding.
+  void (*received)(theta_cap_t *cap, const struct theta_cap_au *au, void *user);
+  // An access unit made it into the queue; called just before it is queued.
+  void (*admitted)(theta_cap_t *cap, const struct theta_cap_au *au, void *user);
+  // The stream is about to start again after a reconnect or a mode switch,
+  // on a new callback thread. No frame is in flight.
+  void (*restarted)(theta_cap_t *cap, void *user);
+  // At start, the cached control was refused and the mode negotiated
+  // again: theta_cap_get_size() may have changed. Called before streaming.
+  void (*renegotiated)(theta_cap_t *cap, void *user);
+  // Sink mode: a replay without loop has handed its last access unit to
+  // the sink. On the push thread, once, where the decoder would get EOS.
+  void (*eos)(theta_cap_t *cap, void *user);
+  void *user;
+};
+
+// Before theta_cap_start(); NULL returns to pull mode.
+extern void         theta_cap_set_callback(theta_cap_t *cap, theta_cap_frame_fn fn, void *user);
+// Before theta_cap_start(); NULL returns to decoding.
+extern void         theta_cap_set_sink(theta_cap_t *cap, theta_cap_sink_fn fn, void *user);
+// Before theta_cap_start(); copied.
+extern void         theta_cap_set_hooks(theta_cap_t *cap, const struct theta_cap_hooks *hooks);
+
+// 0 once frames are flowing into the decoder, -1 on failure.
+extern int          theta_cap_start(theta_cap_t *cap);
+// Stops streaming and decoding. Frames still held stay valid until released.
+extern void         theta_cap_stop(theta_cap_t *cap);
+
+// Pull mode: the newest decoded frame not handed out yet, waiting up to
+// timeout_ms (-1 = forever). NULL on timeout, after stop, or at the end of
+// a replay without loop.
+extern const struct theta_cap_frame *theta_cap_acquire(theta_cap_t *cap, int timeout_ms);
+extern void         theta_cap_release(theta_cap_t *cap, const struct theta_cap_frame *frame);
+
+// Live camera, while started: stops the stream, negotiates mode and starts
+// again, with the decoder (or sink) left running; the next IDR carries the
+// new SPS. -1 if the mode could not be negotiated: the stream restarts in
+// the old one.
+extern int          theta_cap_set_mode(theta_cap_t *cap, unsigned int mode);
+
+// The size frames will have, known from open, changed by theta_cap_set_mode().
+extern void         theta_cap_get_size(const theta_cap_t *cap, unsigned *width, unsigned *height, unsigned *fps);
+// Mode index, and whether its control came from the mode cache untested.
+extern void         theta_cap_get_mode(const theta_cap_t *cap, unsigned int *mode, int *cached);
+// 1 once a replay without loop has delivered its last frame.
+extern int          theta_cap_done(theta_cap_t *cap);
+// Not while theta_cap_stop() runs. reset_peaks restarts ring_peak and
+// ring_max_residency_ns.
+extern void         theta_cap_get_stats(theta_cap_t *cap, struct theta_cap_stats *out, int reset_peaks);
+// Camera clock fit: drift and jitter (dev_pts.h).
+extern void         theta_cap_dump_clock(theta_cap_t *cap, int interval, FILE *fp);
+
+// Before open: the mode a camera with this config will most likely stream,
+// so a caller can build its decode graph meanwhile. 1 when the mode cache
+// knows it (open will not negotiate), 0 for the requested mode's guess.
+extern int          theta_cap_predict_mode(const struct theta_cap_config *cfg, unsigned int *mode,
+                                           unsigned *width, unsigned *height, unsigned *fps);
+
+// Command-line names: drop-oldest, drop-newest; none, nonref, gop.
+// 0 on success, -1 for an unknown name.
+extern int          theta_cap_parse_overflow(const char *s, enum theta_cap_overflow *out);
+extern const char  *theta_cap_overflow_name(enum theta_cap_overflow overflow);
+extern int          theta_cap_parse_shed(const char *s, enum theta_cap_shed *out);
+extern const char  *theta_cap_shed_name(enum theta_cap_shed shed);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,38 @@
+// theta_cap_dev.h
+// libthetacap's device side, for code next to the library that drives
+// libuvc itself: the open/negotiate steps on their own and the stream
+// control a capture negotiated. Not part of theta_cap.h, which keeps
+// libuvc's types out of the API.
+
+#if !defined(__THETA_CAP_DEV_H__)
+#define __THETA_CAP_DEV_H__
+
+#include <stddef.h>
+
+#include "libuvc/libuvc.h"
+#include "theta_cap.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Mode index whose size is width x height, 0 when none is.
+extern unsigned int theta_cap_requested_mode(int width, int height);
+
+// Finds the THETA with this serial (NULL = first) and opens it. The serial
+// actually read from the device goes to serial_out when given.
+extern uvc_error_t  theta_cap_open_device(uvc_context_t *ctx, const char *serial,
+                                          uvc_device_handle_t **devh,
+                                          char *serial_out, size_t serial_size);
+
+// Negotiates H.264, want_mode first, then the other modes in order.
+extern uvc_error_t  theta_cap_negotiate(uvc_device_handle_t *devh, unsigned int want_mode,
+                                        unsigned int *mode, uvc_stream_ctrl_t *ctrl);
+
+// The capture's current stream control (a replay's is the recorded one).
+extern void         theta_cap_get_ctrl(theta_cap_t *cap, uvc_stream_ctrl_t *ctrl);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
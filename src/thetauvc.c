@@ -74,57 +74,64 @@ static thetauvc_mode_t stream_mode[] = {
 };
 		
 
-uvc_error_t
-thetauvc_find_devices(uvc_context_t *ctx, uvc_device_t ***devs)
+static int
+is_theta_uvc(uint16_t vid, uint16_t pid)
+{
+	return vid == USBVID_RICOH && (pid == USBPID_THETAV_UVC
+		|| pid == USBPID_THETAZ1_UVC || pid == USBPID_THETAX_UVC);
+}
+
+/*
+ * Fetching a device descriptor opens the device and reads its strings
+ * over USB, so each UVC device is asked exactly once: product and serial
+ * are checked on the same descriptor (uvc_find_devices() would fetch it,
+ * then the caller again). The result list is allocated once, sized for
+ * the worst case; with first set the scan stops at the first match.
+ */
+static uvc_error_t
+find_theta_devices(uvc_context_t *ctx, uvc_device_t ***devs,
+	const char *serial, int first)
 {
 	uvc_device_t **devlist, **ret;
 	uvc_device_t *dev;
 	uvc_error_t res;
 
 	int idx, devcnt;
-	
-	res = uvc_find_devices(ctx, &devlist, USBVID_RICOH, 0, NULL);
+
+	res = uvc_get_device_list(ctx, &devlist);
 	if (res != UVC_SUCCESS) {
 		return res;
 	}
 
-	ret = (uvc_device_t **)malloc(sizeof(uvc_device_t *));
+	for (idx = 0; devlist[idx] != NULL; idx++)
+		;
+	ret = (uvc_device_t **)malloc((idx + 1) * sizeof(uvc_device_t *));
 	if (ret == NULL) {
 		uvc_free_device_list(devlist, 1);
 		return UVC_ERROR_NO_MEM;
 	}
-	*ret = NULL;
 
 	for (idx = 0, devcnt = 0; (dev = devlist[idx]) != NULL; idx++) {
 		uvc_device_descriptor_t *desc;
+		int match;
 
 		if (uvc_get_device_descriptor(dev, &desc) != UVC_SUCCESS)
 			continue;
 
-		if (desc->idProduct == USBPID_THETAV_UVC
-			|| desc->idProduct == USBPID_THETAZ1_UVC || desc->idProduct == USBPID_THETAX_UVC) {
-			void *tmp_ptr;
-
-			devcnt++;
-
-			tmp_ptr = realloc(ret, (devcnt+1) * sizeof(uvc_device_t *));
-			if (tmp_ptr == NULL) {
-				uvc_free_device_list(devlist, 1);
-				uvc_free_device_descriptor(desc);
-				free(ret);
-				return UVC_ERROR_NO_MEM;
-			}
+		match = is_theta_uvc(desc->idVendor, desc->idProduct)
+			&& (serial == NULL || (desc->serialNumber
+				&& !strcmp(desc->serialNumber, serial)));
+		uvc_free_device_descriptor(desc);
 
-			ret = tmp_ptr;
-			ret[devcnt-1] = dev;
-			ret[devcnt] = NULL;
+		if (match) {
+			uvc_ref_device(dev);
+			ret[devcnt++] = dev;
+			if (first)
+				break;
 		}
-		uvc_free_device_descriptor(desc);
 	}
+	ret[devcnt] = NULL;
 
-	for (idx=0; idx < devcnt; idx++)
-		uvc_ref_device(ret[idx]);
-		
 	uvc_free_device_list(devlist, 1);
 
 	if (devcnt) {
@@ -134,8 +141,13 @@ thetauvc_find_devices(uvc_context_t *ctx, uvc_device_t ***devs)
 		free(ret);
 		return UVC_ERROR_NO_DEVICE;
 	}
+}
 
-}	
+uvc_error_t
+thetauvc_find_devices(uvc_context_t *ctx, uvc_device_t ***devs)
+{
+	return find_theta_devices(ctx, devs, NULL, 0);
+}
 
 uvc_error_t
 thetauvc_print_devices(uvc_context_t *ctx, FILE *fp)
@@ -199,48 +211,18 @@ uvc_error_t
 thetauvc_find_device_by_serial(uvc_context_t *ctx, uvc_device_t **devh,
 	const char *serial)
 {
-	uvc_device_t **devlist, *dev;
+	uvc_device_t **devlist;
 	uvc_error_t res;
-	unsigned int idx;
-	int found;
 
-	res = thetauvc_find_devices(ctx, &devlist);
+	res = find_theta_devices(ctx, &devlist, serial, 1);
 	if (res != UVC_SUCCESS)
 		return res;
 
-	found = 0;
-	if (serial == NULL) {
-		dev = devlist[0];
-		found = 1;
-	} else {
-		uvc_device_descriptor_t *desc;
-
-		idx = 0;
-		do {
-			dev = devlist[idx++];
-			if (dev == NULL) {
-				res = UVC_ERROR_NO_DEVICE;
-				break;
-			}
-
-			if (uvc_get_device_descriptor(dev, &desc) != UVC_SUCCESS)
-				continue;
-
-			if (desc->serialNumber && !strcmp(desc->serialNumber, serial))
-				found=1;
-
-			uvc_free_device_descriptor(desc);
-
-		} while (found != 1);
-	}
-
-	if (dev != NULL) {
-		uvc_ref_device(dev);
-		*devh = dev;
-	}
+	uvc_ref_device(devlist[0]);
+	*devh = devlist[0];
 
 	uvc_free_device_list(devlist, 1);
-	return res;
+	return UVC_SUCCESS;
 }
 
 uvc_error_t
@@ -261,6 +243,26 @@ thetauvc_get_stream_ctrl_format_size(uvc_device_handle_t *devh,
 	return res;
 }
 
+uvc_error_t
+thetauvc_get_mode_size(unsigned int mode, unsigned int *width,
+	unsigned int *height, unsigned int *fps)
+{
+	thetauvc_mode_t *m;
+
+	if (!(mode < THETAUVC_MODE_NUM))
+		return UVC_ERROR_INVALID_MODE;
+
+	m = &stream_mode[mode];
+	if (width)
+		*width = m->width;
+	if (height)
+		*height = m->height;
+	if (fps)
+		*fps = m->fps;
+
+	return UVC_SUCCESS;
+}
+
 
 uvc_error_t
 thetauvc_run_streaming(uvc_device_t *dev, uvc_device_handle_t **devh,
@@ -0,0 +1,66 @@
+// vicon_export.c
+// Offline CSV export of a binary Vicon log written by gst_viewer_vicon.
+// Prints the same "timestamp,values..." rows the viewer used to write live,
+// optionally prefixed with the receive sequence and host/kernel receive
+// times, and a summary that shows whether any packet was lost.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vicon_log.h"
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [--rx-times] [-o OUT.csv] LOG.vlog\n"
+    "  --rx-times : prefix each row with seq, rx_mono_ns, rx_real_ns\n"
+    "  -o FILE    : write the CSV to FILE instead of stdout\n",
+    prog);
+}
+
+int main(int argc, char **argv) {
+  const char *in = NULL, *out_path = NULL;
+  int rx_times = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if      (!strcmp(argv[i], "--rx-times")) rx_times = 1;
+    else if (!strcmp(argv[i], "-o") && i+1 < argc) out_path = argv[++i];
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else if (argv[i][0] != '-' && !in) in = argv[i];
+    else {
+      fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!in) { usage(argv[0]); return 1; }
+
+  vicon_log_reader_t *r = vicon_log_reader_open(in);
+  if (!r) return 1;
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out) { perror(out_path); vicon_log_reader_close(r); return 1; }
+
+  fprintf(out, "%svicon_timestamp,values...\n", rx_times ? "seq,rx_mono_ns,rx_real_ns," : "");
+  size_t n = vicon_log_reader_count(r), skipped = 0, truncated = 0;
+  uint32_t drops = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const struct vicon_record *rec = vicon_log_reader_record(r, i);
+    if (rec->flags & VICON_REC_TRUNCATED) truncated++;
+    drops = rec->drops;
+    if (!memchr(rec->payload, ',', rec->len)) { skipped++; continue; }
+    if (rx_times)
+      fprintf(out, "%llu,%llu,%llu,", (unsigned long long)rec->seq,
+              (unsigned long long)rec->rx_mono_ns, (unsigned long long)rec->rx_real_ns);
+    vicon_packet_csv(out, rec->payload, rec->len);
+    fputc('\n', out);
+  }
+
+  // The kernel counter only ever grows, so the last record holds the total.
+  fprintf(stderr, "%s: %zu packets, kernel drops %u, truncated %zu, without timestamp %zu\n",
+          in, n, drops, truncated, skipped);
+  int rc = 0;
+  if (out != stdout && fclose(out) != 0) { perror(out_path); rc = 1; }
+  vicon_log_reader_close(r);
+  return rc;
+}
@@ -0,0 +1,171 @@
+// vicon_frame_log.c
+// See vicon_frame_log.h.
+//
+// head is advanced only by the producer, tail only by the writer; both are
+// free-running counters. The writer polls instead of being signalled, so a
+// commit is a single release store and the capture thread never enters the
+// kernel on our account.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vicon_frame_log.h"
+
+#define WRITER_POLL_MS   20
+#define WRITE_BUF_BYTES  (1024 * 1024)
+
+struct vicon_frame_log {
+  FILE                   *f;
+  char                   *buf;        // stdio buffer: one write() per MB
+  struct vicon_frame_rec *slots;
+  unsigned int            mask;
+  int                     sync_ms;
+  pthread_t               thr;
+  atomic_int              stop;
+
+  _Alignas(64) _Atomic uint64_t head;
+  _Atomic uint64_t        queued;
+  _Atomic uint64_t        dropped;
+  _Atomic unsigned int    max_backlog;
+  _Alignas(64) _Atomic uint64_t tail;
+  _Atomic uint64_t        written;
+  _Atomic uint64_t        syncs;
+  _Atomic uint64_t        max_sync_ns;
+  atomic_int              failed;
+};
+
+static uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sync_file(vicon_frame_log_t *l) {
+  uint64_t t0 = mono_ns();
+  if (fflush(l->f) != 0 || fdatasync(fileno(l->f)) != 0)
+    atomic_store_explicit(&l->failed, 1, memory_order_relaxed);
+  uint64_t dt = mono_ns() - t0;
+  atomic_fetch_add_explicit(&l->syncs, 1, memory_order_relaxed);
+  if (dt > atomic_load_explicit(&l->max_sync_ns, memory_order_relaxed))
+    atomic_store_explicit(&l->max_sync_ns, dt, memory_order_relaxed);
+}
+
+void vicon_frame_rec_print(FILE *f, const struct vicon_frame_rec *r) {
+  fprintf(f, "%llu,%lld,%s,%llu,%s", (unsigned long long)r->frame_seq,
+          (long long)r->pose.t_ns, vicon_track_result_name((enum vicon_track_result)r->match),
+          (unsigned long long)r->pose.seq, r->pose.stamp);
+  for (uint32_t k = 0; k < r->pose.nvals; ++k) fprintf(f, ",%.6f", r->pose.v[k]);
+  fputc('\n', f);
+}
+
+// Formats everything committed so far; returns the number of rows.
+static uint64_t drain(vicon_frame_log_t *l) {
+  uint64_t t = atomic_load_explicit(&l->tail, memory_order_relaxed);
+  uint64_t h = atomic_load_explicit(&l->head, memory_order_acquire);
+  for (uint64_t i = t; i < h; ++i) {
+    vicon_frame_rec_print(l->f, &l->slots[i & l->mask]);
+    // Hand the slot back as soon as it is formatted.
+    atomic_store_explicit(&l->tail, i + 1, memory_order_release);
+  }
+  if (ferror(l->f)) atomic_store_explicit(&l->failed, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&l->written, h - t, memory_order_relaxed);
+  return h - t;
+}
+
+static void *writer_fn(void *arg) {
+  vicon_frame_log_t *l = arg;
+  const struct timespec poll = { 0, WRITER_POLL_MS * 1000000L };
+  uint64_t last_sync = mono_ns(), pending = 0;
+
+  while (!atomic_load_explicit(&l->stop, memory_order_acquire)) {
+    pending += drain(l);
+    if (pending > 0 && mono_ns() - last_sync >= (uint64_t)l->sync_ms * 1000000ull) {
+      sync_file(l);
+      last_sync = mono_ns();
+      pending = 0;
+    }
+    nanosleep(&poll, NULL);
+  }
+  drain(l);
+  sync_file(l);
+  return NULL;
+}
+
+vicon_frame_log_t *vicon_frame_log_open(const char *path, unsigned int depth, int sync_ms) {
+  if (depth == 0) depth = VICON_FRAME_LOG_DEFAULT_DEPTH;
+  unsigned int n = 1;
+  while (n < depth) n <<= 1;
+
+  vicon_frame_log_t *l = calloc(1, sizeof(*l));
+  if (!l) return NULL;
+  l->mask    = n - 1;
+  l->sync_ms = sync_ms > 0 ? sync_ms : VICON_FRAME_LOG_DEFAULT_SYNC_MS;
+  l->slots   = calloc(n, sizeof(*l->slots));
+  l->buf     = malloc(WRITE_BUF_BYTES);
+  l->f       = fopen(path, "w");
+  if (!l->f) perror(path);
+  if (!l->slots || !l->buf || !l->f) goto fail;
+  setvbuf(l->f, l->buf, _IOFBF, WRITE_BUF_BYTES);
+  fputs(VICON_FRAME_LOG_HEADER, l->f);
+
+  int err = pthread_create(&l->thr, NULL, writer_fn, l);
+  if (err != 0) {
+    fprintf(stderr, "vicon_frame_log: pthread_create: %s\n", strerror(err));
+    goto fail;
+  }
+  return l;
+
+fail:
+  if (l->f) fclose(l->f);
+  free(l->buf);
+  free(l->slots);
+  free(l);
+  return NULL;
+}
+
+struct vicon_frame_rec *vicon_frame_log_reserve(vicon_frame_log_t *l) {
+  uint64_t h = atomic_load_explicit(&l->head, memory_order_relaxed);
+  uint64_t t = atomic_load_explicit(&l->tail, memory_order_acquire);
+  if (h - t > l->mask) {
+    atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+    return NULL;
+  }
+  return &l->slots[h & l->mask];
+}
+
+void vicon_frame_log_commit(vicon_frame_log_t *l) {
+  uint64_t h = atomic_load_explicit(&l->head, memory_order_relaxed) + 1;
+  atomic_store_explicit(&l->head, h, memory_order_release);
+  atomic_fetch_add_explicit(&l->queued, 1, memory_order_relaxed);
+  unsigned int backlog = (unsigned int)(h - atomic_load_explicit(&l->tail, memory_order_relaxed));
+  if (backlog > atomic_load_explicit(&l->max_backlog, memory_order_relaxed))
+    atomic_store_explicit(&l->max_backlog, backlog, memory_order_relaxed);
+}
+
+int vicon_frame_log_close(vicon_frame_log_t *l) {
+  if (!l) return 0;
+  atomic_store_explicit(&l->stop, 1, memory_order_release);
+  pthread_join(l->thr, NULL);
+  int rc = atomic_load(&l->failed) ? -1 : 0;
+  if (fclose(l->f) != 0) rc = -1;
+  free(l->buf);
+  free(l->slots);
+  free(l);
+  return rc;
+}
+
+void vicon_frame_log_get_stats(vicon_frame_log_t *l, struct vicon_frame_log_stats *out) {
+  out->queued      = atomic_load_explicit(&l->queued, memory_order_relaxed);
+  out->dropped     = atomic_load_explicit(&l->dropped, memory_order_relaxed);
+  out->written     = atomic_load_explicit(&l->written, memory_order_relaxed);
+  out->syncs       = atomic_load_explicit(&l->syncs, memory_order_relaxed);
+  out->max_sync_ns = atomic_load_explicit(&l->max_sync_ns, memory_order_relaxed);
+  out->max_backlog = atomic_load_explicit(&l->max_backlog, memory_order_relaxed);
+  out->failed      = atomic_load_explicit(&l->failed, memory_order_relaxed);
+}
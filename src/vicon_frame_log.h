@@ -0,0 +1,72 @@
+// vicon_frame_log.h
+// Per-video-frame Vicon CSV written off the capture thread. The frame
+// callback fills a preallocated slot of a single-producer/single-consumer
+// ring with the pose looked up for the frame and returns; a writer thread
+// drains the ring into a file that stays open, buffered in large blocks,
+// and fdatasync()s it periodically. The callback never makes a syscall and
+// never waits: when the writer falls behind, rows are dropped and counted.
+//
+// Rows: frame_seq,frame_mono_ns,match,vicon_seq,vicon_timestamp,values...
+// where match is a vicon_track_result_name().
+
+#if !defined(__VICON_FRAME_LOG_H__)
+#define __VICON_FRAME_LOG_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vicon_track.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VICON_FRAME_LOG_DEFAULT_DEPTH   256    // ~8 s of video at 30 fps
+#define VICON_FRAME_LOG_DEFAULT_SYNC_MS 1000
+
+struct vicon_frame_rec {
+  uint64_t            frame_seq;   // UVC frame sequence
+  int32_t             match;       // enum vicon_track_result
+  int32_t             reserved;
+  struct vicon_sample pose;        // pose.t_ns: frame time looked up
+};
+
+struct vicon_frame_log_stats {
+  uint64_t     queued;
+  uint64_t     dropped;         // ring full
+  uint64_t     written;         // rows formatted into the file
+  uint64_t     syncs;
+  uint64_t     max_sync_ns;     // longest fflush + fdatasync
+  unsigned int max_backlog;     // deepest the ring got, in records
+  int          failed;          // a write or sync failed
+};
+
+typedef struct vicon_frame_log vicon_frame_log_t;
+
+#define VICON_FRAME_LOG_HEADER \
+  "frame_seq,frame_mono_ns,match,vicon_seq,vicon_timestamp,values...\n"
+
+// One CSV row, as the writer thread formats it (also used for clips).
+extern void vicon_frame_rec_print(FILE *f, const struct vicon_frame_rec *r);
+
+// Creates (truncates) path and starts the writer thread. depth 0 and
+// sync_ms 0 take the defaults; depth is rounded up to a power of two.
+extern vicon_frame_log_t *vicon_frame_log_open(const char *path, unsigned int depth, int sync_ms);
+
+// Producer side, one thread only. reserve() returns the next free slot or
+// NULL when the ring is full (counted as a drop); the slot is published by
+// commit(). A reserved slot that is not committed is simply reused.
+extern struct vicon_frame_rec *vicon_frame_log_reserve(vicon_frame_log_t *l);
+extern void                    vicon_frame_log_commit(vicon_frame_log_t *l);
+
+// Writes what is queued, syncs, stops the thread and frees everything.
+// Returns 0 when every row reached the disk.
+extern int  vicon_frame_log_close(vicon_frame_log_t *l);
+
+// Safe from any thread.
+extern void vicon_frame_log_get_stats(vicon_frame_log_t *l, struct vicon_frame_log_stats *out);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
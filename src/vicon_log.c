@@ -0,0 +1,188 @@
+// vicon_log.c
+// See vicon_log.h.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vicon_log.h"
+
+#define VICON_LOG_VERSION  1
+// Blocks are reserved 64 MB at a time (about a minute at 1 kHz).
+#define VICON_LOG_CHUNK    (64ull * 1024 * 1024 / VICON_RECORD_BYTES)
+
+_Static_assert(sizeof(struct vicon_record) == VICON_RECORD_BYTES, "vicon_record size");
+_Static_assert(sizeof(struct vicon_log_header) == 64, "vicon_log_header size");
+
+static int64_t clock_ns(clockid_t id) {
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ---------- Writing ---------- */
+
+struct vicon_log_writer {
+  int      fd;
+  uint64_t count;
+  uint64_t reserved;          // records the file has blocks for
+  int      failed;
+};
+
+static off_t record_offset(uint64_t i) {
+  return (off_t)(sizeof(struct vicon_log_header) + i * VICON_RECORD_BYTES);
+}
+
+static int reserve(vicon_log_writer_t *w, uint64_t need) {
+  if (need <= w->reserved) return 0;
+  uint64_t upto = w->reserved + VICON_LOG_CHUNK;
+  while (upto < need) upto += VICON_LOG_CHUNK;
+  int err = posix_fallocate(w->fd, record_offset(w->reserved),
+                            record_offset(upto) - record_offset(w->reserved));
+  // Filesystems without fallocate still take the writes, just not
+  // preallocated.
+  if (err != 0 && err != EOPNOTSUPP && err != EINVAL) return -1;
+  w->reserved = upto;
+  return 0;
+}
+
+vicon_log_writer_t *vicon_log_open(const char *path) {
+  vicon_log_writer_t *w = calloc(1, sizeof(*w));
+  if (!w) return NULL;
+  w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (w->fd < 0) { perror(path); free(w); return NULL; }
+
+  struct vicon_log_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, VICON_LOG_MAGIC, sizeof(h.magic));
+  h.version       = VICON_LOG_VERSION;
+  h.header_size   = sizeof(h);
+  h.record_size   = VICON_RECORD_BYTES;
+  h.start_real_ns = clock_ns(CLOCK_REALTIME);
+  h.start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+  if (pwrite(w->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || reserve(w, 1) != 0) {
+    perror(path);
+    close(w->fd);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+int vicon_log_append(vicon_log_writer_t *w, const struct vicon_record *recs, size_t n) {
+  if (w->failed) return -1;
+  if (reserve(w, w->count + n) != 0) { w->failed = 1; return -1; }
+  size_t bytes = n * VICON_RECORD_BYTES;
+  const uint8_t *p = (const uint8_t *)recs;
+  off_t off = record_offset(w->count);
+  while (bytes > 0) {
+    ssize_t k = pwrite(w->fd, p, bytes, off);
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) { w->failed = 1; return -1; }
+    p += k; off += k; bytes -= (size_t)k;
+  }
+  w->count += n;
+  return 0;
+}
+
+uint64_t vicon_log_count(const vicon_log_writer_t *w) {
+  return w->count;
+}
+
+int vicon_log_close(vicon_log_writer_t *w) {
+  if (!w) return 0;
+  int rc = w->failed ? -1 : 0;
+  if (ftruncate(w->fd, record_offset(w->count)) != 0) rc = -1;
+  uint64_t count = w->count;
+  if (pwrite(w->fd, &count, sizeof(count), offsetof(struct vicon_log_header, count)) != sizeof(count))
+    rc = -1;
+  if (fdatasync(w->fd) != 0) rc = -1;
+  if (close(w->fd) != 0) rc = -1;
+  free(w);
+  return rc;
+}
+
+/* ---------- Reading ---------- */
+
+struct vicon_log_reader {
+  const uint8_t                 *map;
+  size_t                         size;
+  const struct vicon_log_header *hdr;
+  size_t                         count;
+};
+
+vicon_log_reader_t *vicon_log_reader_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) { perror(path); return NULL; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct vicon_log_header)) {
+    fprintf(stderr, "%s: not a Vicon log\n", path);
+    close(fd);
+    return NULL;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) { perror("mmap"); return NULL; }
+
+  vicon_log_reader_t *r = calloc(1, sizeof(*r));
+  if (!r) { munmap(map, (size_t)st.st_size); return NULL; }
+  r->map  = map;
+  r->size = (size_t)st.st_size;
+  r->hdr  = map;
+  if (memcmp(r->hdr->magic, VICON_LOG_MAGIC, sizeof(r->hdr->magic)) != 0 ||
+      r->hdr->header_size < sizeof(struct vicon_log_header) ||
+      r->hdr->record_size != VICON_RECORD_BYTES) {
+    fprintf(stderr, "%s: bad Vicon log header\n", path);
+    vicon_log_reader_close(r);
+    return NULL;
+  }
+
+  size_t room = (r->size - r->hdr->header_size) / VICON_RECORD_BYTES;
+  if (r->hdr->count > 0 && r->hdr->count <= room) {
+    r->count = (size_t)r->hdr->count;
+  } else {
+    // Unfinished log: records run up to the first unused slot.
+    fprintf(stderr, "%s: not closed cleanly, scanning records\n", path);
+    while (r->count < room && vicon_log_reader_record(r, r->count)->seq != 0) r->count++;
+  }
+  return r;
+}
+
+void vicon_log_reader_close(vicon_log_reader_t *r) {
+  if (!r) return;
+  munmap((void *)r->map, r->size);
+  free(r);
+}
+
+const struct vicon_log_header *vicon_log_reader_header(const vicon_log_reader_t *r) {
+  return r->hdr;
+}
+
+size_t vicon_log_reader_count(const vicon_log_reader_t *r) {
+  return r->count;
+}
+
+const struct vicon_record *vicon_log_reader_record(const vicon_log_reader_t *r, size_t i) {
+  return (const struct vicon_record *)(r->map + r->hdr->header_size + i * VICON_RECORD_BYTES);
+}
+
+/* ---------- Packets ---------- */
+
+int vicon_packet_csv(FILE *f, const uint8_t *data, size_t len) {
+  const uint8_t *comma = memchr(data, ',', len);
+  if (!comma) return 0;
+  size_t ts_len = (size_t)(comma - data);
+  fwrite(data, 1, ts_len, f);
+  size_t nf = (len - ts_len - 1) / sizeof(float);
+  for (size_t i = 0; i < nf; ++i) {
+    float v;
+    memcpy(&v, comma + 1 + i * sizeof(float), sizeof(v));
+    fprintf(f, ",%.6f", v);
+  }
+  return 1;
+}
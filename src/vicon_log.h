@@ -0,0 +1,83 @@
+// vicon_log.h
+// Binary log of every Vicon datagram as received: one fixed-size record per
+// packet, appended in batches to a file preallocated in large chunks, so the
+// ingest thread never formats text or waits on block allocation. CSV is an
+// offline export (vicon_export).
+//
+// Layout (little-endian, native structs):
+//   struct vicon_log_header
+//   struct vicon_record * count
+// A log that was never closed has count == 0 in its header and zeroed
+// preallocated records at the end; readers stop at the first seq == 0.
+
+#if !defined(__VICON_LOG_H__)
+#define __VICON_LOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VICON_LOG_MAGIC      "VICONLG1"
+#define VICON_RECORD_BYTES   1024
+#define VICON_PAYLOAD_MAX    (VICON_RECORD_BYTES - 40)
+
+#define VICON_REC_TRUNCATED  0x1u   // datagram longer than VICON_PAYLOAD_MAX
+
+struct vicon_record {
+  uint64_t seq;               // receive order from 1; 0 = unused slot
+  uint64_t rx_mono_ns;        // kernel receive time on CLOCK_MONOTONIC
+                              // (batch read time if the kernel gave none)
+  uint64_t rx_real_ns;        // kernel receive timestamp (CLOCK_REALTIME), 0 = none
+  uint32_t drops;             // kernel receive-queue drops so far (SO_RXQ_OVFL)
+  uint16_t len;               // payload bytes stored
+  uint16_t flags;
+  uint32_t wire_len;          // datagram size
+  uint32_t reserved;
+  uint8_t  payload[VICON_PAYLOAD_MAX];
+};
+
+struct vicon_log_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t record_size;
+  uint32_t reserved0;
+  uint64_t count;             // written on close; 0 = scan
+  int64_t  start_real_ns;     // CLOCK_REALTIME and CLOCK_MONOTONIC at open,
+  int64_t  start_mono_ns;     // to put rx_mono_ns on the wall clock
+  uint32_t reserved[4];
+};
+
+/* ---------- Writing ---------- */
+typedef struct vicon_log_writer vicon_log_writer_t;
+
+extern vicon_log_writer_t *vicon_log_open(const char *path);
+// One write per call; records are copied as they are. Returns 0 on success.
+extern int      vicon_log_append(vicon_log_writer_t *w, const struct vicon_record *recs, size_t n);
+extern uint64_t vicon_log_count(const vicon_log_writer_t *w);
+// Trims the preallocated tail and records the count. Returns 0 on success.
+extern int      vicon_log_close(vicon_log_writer_t *w);
+
+/* ---------- Reading (memory-mapped) ---------- */
+typedef struct vicon_log_reader vicon_log_reader_t;
+
+extern vicon_log_reader_t *vicon_log_reader_open(const char *path);
+extern void     vicon_log_reader_close(vicon_log_reader_t *r);
+extern const struct vicon_log_header *vicon_log_reader_header(const vicon_log_reader_t *r);
+extern size_t   vicon_log_reader_count(const vicon_log_reader_t *r);
+extern const struct vicon_record *vicon_log_reader_record(const vicon_log_reader_t *r, size_t i);
+
+/* ---------- Packets ---------- */
+// Vicon datagrams are "<timestamp text>,<float32 values>". Writes one CSV
+// row "<timestamp>,v0,v1,..." (no newline); returns 0 if the packet has no
+// timestamp separator.
+extern int      vicon_packet_csv(FILE *f, const uint8_t *data, size_t len);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
@@ -0,0 +1,161 @@
+// vicon_rx.c
+// See vicon_rx.h. One thread calls vicon_rx_batch(); counters are relaxed
+// atomics so a reporter can read them.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "vicon_rx.h"
+
+#define LOAD(p)     __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELAXED)
+
+// Room for SO_RXQ_OVFL and SCM_TIMESTAMPNS on every datagram.
+#define CMSG_BYTES  (CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct timespec)))
+
+struct vicon_rx {
+  int             fd;
+  int             stop;
+  uint64_t        next_seq;
+  uint32_t        drops;            // last SO_RXQ_OVFL value seen
+  struct vicon_rx_stats st;
+  struct mmsghdr  msgs[VICON_RX_BATCH];
+  struct iovec    iov[VICON_RX_BATCH];
+  uint8_t         cmsg[VICON_RX_BATCH][CMSG_BYTES];
+};
+
+vicon_rx_t *vicon_rx_open(uint16_t port, int rcvbuf) {
+  vicon_rx_t *rx = calloc(1, sizeof(*rx));
+  if (!rx) return NULL;
+  rx->next_seq = 1;
+  rx->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (rx->fd < 0) { perror("socket vicon"); free(rx); return NULL; }
+
+  // FORCE goes past net.core.rmem_max when we have CAP_NET_ADMIN.
+  if (rcvbuf <= 0) rcvbuf = VICON_RX_DEFAULT_RCVBUF;
+  if (setsockopt(rx->fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0)
+    setsockopt(rx->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  socklen_t sl = sizeof(rx->st.rcvbuf);
+  getsockopt(rx->fd, SOL_SOCKET, SO_RCVBUF, &rx->st.rcvbuf, &sl);
+  if (rx->st.rcvbuf / 2 < rcvbuf)
+    fprintf(stderr, "vicon: receive buffer %d bytes instead of %d (raise net.core.rmem_max)\n",
+            rx->st.rcvbuf / 2, rcvbuf);
+
+  int one = 1;
+  setsockopt(rx->fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+  setsockopt(rx->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+  // Bounded wait so the owner can notice it should stop.
+  struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+  setsockopt(rx->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = INADDR_ANY;
+  if (bind(rx->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("bind vicon");
+    close(rx->fd);
+    free(rx);
+    return NULL;
+  }
+  return rx;
+}
+
+void vicon_rx_close(vicon_rx_t *rx) {
+  if (!rx) return;
+  close(rx->fd);
+  free(rx);
+}
+
+void vicon_rx_shutdown(vicon_rx_t *rx) {
+  __atomic_store_n(&rx->stop, 1, __ATOMIC_RELEASE);
+  shutdown(rx->fd, SHUT_RD);
+}
+
+int vicon_rx_batch(vicon_rx_t *rx, struct vicon_record *recs, int max) {
+  if (__atomic_load_n(&rx->stop, __ATOMIC_ACQUIRE)) return 0;
+  if (max > VICON_RX_BATCH) max = VICON_RX_BATCH;
+
+  for (int i = 0; i < max; ++i) {
+    rx->iov[i].iov_base = recs[i].payload;
+    rx->iov[i].iov_len  = VICON_PAYLOAD_MAX;
+    struct msghdr *h = &rx->msgs[i].msg_hdr;
+    memset(h, 0, sizeof(*h));
+    h->msg_iov        = &rx->iov[i];
+    h->msg_iovlen     = 1;
+    h->msg_control    = rx->cmsg[i];
+    h->msg_controllen = CMSG_BYTES;
+  }
+
+  // MSG_TRUNC: msg_len reports the datagram size even when it didn't fit.
+  int n = recvmmsg(rx->fd, rx->msgs, (unsigned)max, MSG_WAITFORONE | MSG_TRUNC, NULL);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+    STORE(rx->st.errors, rx->st.errors + 1);
+    return -1;
+  }
+
+  // The kernel stamps packets on CLOCK_REALTIME; read both clocks once so
+  // each stamp can be moved onto CLOCK_MONOTONIC by its age.
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t real_now = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t mono = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+  int kept = 0;
+  uint64_t truncated = 0;
+  for (int i = 0; i < n; ++i) {
+    struct msghdr *h = &rx->msgs[i].msg_hdr;
+    unsigned int wire = rx->msgs[i].msg_len;
+    if (wire == 0 && __atomic_load_n(&rx->stop, __ATOMIC_ACQUIRE)) break;   // woken by shutdown
+
+    struct vicon_record *r = &recs[kept++];
+    uint64_t real = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c)) {
+      if (c->cmsg_level != SOL_SOCKET) continue;
+      if (c->cmsg_type == SO_RXQ_OVFL) {
+        memcpy(&rx->drops, CMSG_DATA(c), sizeof(rx->drops));
+      } else if (c->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec ts;
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        real = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+      }
+    }
+    r->seq        = rx->next_seq++;
+    uint64_t age  = (real > 0 && real <= real_now) ? real_now - real : 0;
+    r->rx_mono_ns = age < mono ? mono - age : mono;
+    r->rx_real_ns = real;
+    r->drops      = rx->drops;
+    r->wire_len   = wire;
+    r->len        = (uint16_t)(wire < VICON_PAYLOAD_MAX ? wire : VICON_PAYLOAD_MAX);
+    r->flags      = (h->msg_flags & MSG_TRUNC) ? VICON_REC_TRUNCATED : 0;
+    r->reserved   = 0;
+    if (r->flags) truncated++;
+  }
+
+  STORE(rx->st.packets, rx->st.packets + (uint64_t)kept);
+  STORE(rx->st.batches, rx->st.batches + 1);
+  STORE(rx->st.truncated, rx->st.truncated + truncated);
+  STORE(rx->st.kernel_drops, (uint64_t)rx->drops);
+  if ((uint32_t)kept > rx->st.max_batch) STORE(rx->st.max_batch, (uint32_t)kept);
+  return kept;
+}
+
+void vicon_rx_get_stats(vicon_rx_t *rx, struct vicon_rx_stats *out) {
+  out->packets      = LOAD(rx->st.packets);
+  out->batches      = LOAD(rx->st.batches);
+  out->truncated    = LOAD(rx->st.truncated);
+  out->kernel_drops = LOAD(rx->st.kernel_drops);
+  out->errors       = LOAD(rx->st.errors);
+  out->max_batch    = LOAD(rx->st.max_batch);
+  out->rcvbuf       = rx->st.rcvbuf;
+}
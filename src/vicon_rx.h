@@ -0,0 +1,52 @@
+// vicon_rx.h
+// Vicon UDP receiver that drains the socket in batches: one recvmmsg()
+// returns as soon as a datagram is there and takes everything else already
+// queued, each payload landing directly in a vicon_record. The socket gets
+// a large receive buffer and reports the kernel's drop counter
+// (SO_RXQ_OVFL) and receive timestamps (SO_TIMESTAMPNS) with each packet.
+
+#if !defined(__VICON_RX_H__)
+#define __VICON_RX_H__
+
+#include <stdint.h>
+
+#include "vicon_log.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VICON_RX_BATCH          64
+#define VICON_RX_DEFAULT_RCVBUF (8 * 1024 * 1024)
+
+struct vicon_rx_stats {
+  uint64_t packets;
+  uint64_t batches;
+  uint64_t truncated;         // longer than VICON_PAYLOAD_MAX
+  uint64_t kernel_drops;      // SO_RXQ_OVFL: dropped before we could read them
+  uint64_t errors;
+  uint32_t max_batch;
+  int      rcvbuf;            // effective SO_RCVBUF
+};
+
+typedef struct vicon_rx vicon_rx_t;
+
+// Binds INADDR_ANY:port. rcvbuf 0 = VICON_RX_DEFAULT_RCVBUF.
+extern vicon_rx_t *vicon_rx_open(uint16_t port, int rcvbuf);
+extern void        vicon_rx_close(vicon_rx_t *rx);
+
+// Waits up to ~200 ms for a datagram, then returns it and whatever else is
+// queued (up to max, at most VICON_RX_BATCH), numbered and stamped. Returns
+// the count, 0 on timeout or after vicon_rx_shutdown(), -1 on error.
+extern int         vicon_rx_batch(vicon_rx_t *rx, struct vicon_record *recs, int max);
+
+// Wakes a thread blocked in vicon_rx_batch(); later calls return 0.
+extern void        vicon_rx_shutdown(vicon_rx_t *rx);
+
+// Safe from any thread.
+extern void        vicon_rx_get_stats(vicon_rx_t *rx, struct vicon_rx_stats *out);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
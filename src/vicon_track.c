@@ -0,0 +1,227 @@
+// vicon_track.c
+// See vicon_track.h.
+//
+// Sample i lives in slot i & mask. head (samples pushed) is published after
+// the slot is written. A reader searches indices [head - span, head) on
+// the slots' atomic times, then copies the one or two samples it needs
+// under the slot seqlock and checks the slot still holds the index it
+// searched for; if the writer lapped it, the lookup starts over. span stays
+// a batch short of the depth so that rarely happens.
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vicon_track.h"
+
+#define LAP_MARGIN  64      // one recvmmsg batch
+#define MAX_RETRY   4
+
+struct vicon_track_slot {
+  _Atomic uint64_t    ver;    // odd while being written
+  _Atomic int64_t     t_ns;   // copy of s.t_ns for the search
+  _Atomic uint64_t    idx;    // sample index held
+  struct vicon_sample s;
+};
+
+struct vicon_track {
+  struct vicon_track_slot *slots;
+  unsigned int             mask;
+  uint64_t                 span;
+  int64_t                  max_gap_ns;
+  int64_t                  last_t;      // writer only
+  _Alignas(64) _Atomic uint64_t head;
+};
+
+/* ---------- Samples ---------- */
+
+int64_t vicon_stamp_ns(const char *stamp) {
+  int Y, M, D, h, m, sec, n = 0;
+  char sep;
+  const char *frac;
+  int64_t ns;
+  if (sscanf(stamp, "%4d-%2d-%2d%c%2d:%2d:%2d%n", &Y, &M, &D, &sep, &h, &m, &sec, &n) == 7 &&
+      n > 0 && (sep == 'T' || sep == ' ')) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = Y - 1900; tm.tm_mon = M - 1; tm.tm_mday = D;
+    tm.tm_hour = h; tm.tm_min = m; tm.tm_sec = sec;
+    ns = (int64_t)timegm(&tm) * 1000000000ll;
+    frac = stamp + n;
+  } else {
+    char *end;
+    long long whole = strtoll(stamp, &end, 10);
+    if (end == stamp || (*end != '\0' && *end != '.')) return 0;
+    ns = (int64_t)whole * 1000000000ll;
+    frac = end;
+  }
+  if (*frac == '.') {
+    int64_t unit = 100000000ll;
+    for (++frac; *frac >= '0' && *frac <= '9'; ++frac, unit /= 10) ns += (*frac - '0') * unit;
+  }
+  return ns;
+}
+
+int vicon_sample_parse(struct vicon_sample *s, const struct vicon_record *r) {
+  const uint8_t *comma = memchr(r->payload, ',', r->len);
+  if (!comma) return 0;
+  size_t ts_len = (size_t)(comma - r->payload);
+  if (ts_len >= sizeof(s->stamp)) ts_len = sizeof(s->stamp) - 1;
+  memcpy(s->stamp, r->payload, ts_len);
+  s->stamp[ts_len] = '\0';
+
+  size_t nf = (r->len - (size_t)(comma - r->payload) - 1) / sizeof(float);
+  if (nf > VICON_SAMPLE_MAX_VALUES) nf = VICON_SAMPLE_MAX_VALUES;
+  memcpy(s->v, comma + 1, nf * sizeof(float));
+  s->nvals = (uint32_t)nf;
+  s->seq      = r->seq;
+  s->t_ns     = (int64_t)r->rx_mono_ns;
+  s->vicon_ns = vicon_stamp_ns(s->stamp);
+  return 1;
+}
+
+static void slerp(float *out, const float *a, const float *b, double alpha) {
+  double qa[4] = { a[0], a[1], a[2], a[3] }, qb[4] = { b[0], b[1], b[2], b[3] };
+  double d = qa[0]*qb[0] + qa[1]*qb[1] + qa[2]*qb[2] + qa[3]*qb[3];
+  // q and -q are the same rotation; take the short way round.
+  if (d < 0) { d = -d; for (int k = 0; k < 4; ++k) qb[k] = -qb[k]; }
+  double wa, wb;
+  if (d > 0.9995) {
+    // Nearly parallel: sin() of a tiny angle loses precision, lerp instead.
+    wa = 1.0 - alpha;
+    wb = alpha;
+  } else {
+    double th = acos(d), s = sin(th);
+    wa = sin((1.0 - alpha) * th) / s;
+    wb = sin(alpha * th) / s;
+  }
+  double q[4], n = 0;
+  for (int k = 0; k < 4; ++k) { q[k] = wa * qa[k] + wb * qb[k]; n += q[k] * q[k]; }
+  n = n > 0 ? 1.0 / sqrt(n) : 0;
+  for (int k = 0; k < 4; ++k) out[k] = (float)(q[k] * n);
+}
+
+void vicon_sample_interp(struct vicon_sample *out, const struct vicon_sample *a,
+                         const struct vicon_sample *b, double alpha) {
+  uint32_t n = a->nvals < b->nvals ? a->nvals : b->nvals;
+  uint32_t i = 0;
+  for (; i + VICON_SEGMENT_VALUES <= n; i += VICON_SEGMENT_VALUES) {
+    for (int k = 0; k < 3; ++k)
+      out->v[i + k] = (float)(a->v[i + k] + alpha * (b->v[i + k] - a->v[i + k]));
+    slerp(&out->v[i + 3], &a->v[i + 3], &b->v[i + 3], alpha);
+  }
+  for (; i < n; ++i) out->v[i] = (float)(a->v[i] + alpha * (b->v[i] - a->v[i]));
+  out->nvals    = n;
+  out->seq      = a->seq;
+  out->vicon_ns = a->vicon_ns + (int64_t)llround(alpha * (double)(b->vicon_ns - a->vicon_ns));
+  if (out != a) memcpy(out->stamp, a->stamp, sizeof(out->stamp));
+}
+
+/* ---------- Ring ---------- */
+
+vicon_track_t *vicon_track_new(unsigned int depth, int64_t max_gap_ns) {
+  if (depth == 0) depth = VICON_TRACK_DEFAULT_DEPTH;
+  unsigned int n = 2 * LAP_MARGIN;
+  while (n < depth) n <<= 1;
+
+  vicon_track_t *tr = calloc(1, sizeof(*tr));
+  if (!tr) return NULL;
+  tr->slots = calloc(n, sizeof(*tr->slots));
+  if (!tr->slots) { free(tr); return NULL; }
+  tr->mask       = n - 1;
+  tr->span       = n - LAP_MARGIN;
+  tr->max_gap_ns = max_gap_ns > 0 ? max_gap_ns : VICON_TRACK_DEFAULT_GAP_NS;
+  tr->last_t     = INT64_MIN;
+  return tr;
+}
+
+void vicon_track_free(vicon_track_t *tr) {
+  if (!tr) return;
+  free(tr->slots);
+  free(tr);
+}
+
+void vicon_track_push(vicon_track_t *tr, const struct vicon_sample *s) {
+  uint64_t h = atomic_load_explicit(&tr->head, memory_order_relaxed);
+  struct vicon_track_slot *sl = &tr->slots[h & tr->mask];
+  int64_t t = s->t_ns < tr->last_t ? tr->last_t : s->t_ns;
+  tr->last_t = t;
+
+  uint64_t ver = atomic_load_explicit(&sl->ver, memory_order_relaxed);
+  atomic_store_explicit(&sl->ver, ver + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  sl->s      = *s;
+  sl->s.t_ns = t;
+  atomic_store_explicit(&sl->t_ns, t, memory_order_relaxed);
+  atomic_store_explicit(&sl->idx, h, memory_order_relaxed);
+  atomic_store_explicit(&sl->ver, ver + 2, memory_order_release);
+  atomic_store_explicit(&tr->head, h + 1, memory_order_release);
+}
+
+// Copies sample i if its slot still holds it.
+static int read_sample(vicon_track_t *tr, uint64_t i, struct vicon_sample *out) {
+  struct vicon_track_slot *sl = &tr->slots[i & tr->mask];
+  uint64_t v1 = atomic_load_explicit(&sl->ver, memory_order_acquire);
+  if (v1 & 1) return 0;
+  *out = sl->s;
+  uint64_t idx = atomic_load_explicit(&sl->idx, memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t v2 = atomic_load_explicit(&sl->ver, memory_order_relaxed);
+  return v1 == v2 && idx == i;
+}
+
+static int64_t slot_time(vicon_track_t *tr, uint64_t i) {
+  return atomic_load_explicit(&tr->slots[i & tr->mask].t_ns, memory_order_relaxed);
+}
+
+enum vicon_track_result vicon_track_lookup(vicon_track_t *tr, int64_t t_ns,
+                                           struct vicon_sample *out) {
+  struct vicon_sample a, b;
+  for (int attempt = 0; attempt < MAX_RETRY; ++attempt) {
+    uint64_t h = atomic_load_explicit(&tr->head, memory_order_acquire);
+    if (h == 0) return VICON_TRACK_EMPTY;
+    uint64_t lo = h > tr->span ? h - tr->span : 0, hi = h - 1;
+    enum vicon_track_result res;
+
+    if (t_ns >= slot_time(tr, hi)) {
+      if (!read_sample(tr, hi, out)) continue;
+      res = VICON_TRACK_HOLD;
+    } else if (t_ns < slot_time(tr, lo)) {
+      if (!read_sample(tr, lo, out)) continue;
+      res = VICON_TRACK_OLD;
+    } else {
+      // Largest i in [lo, hi) with t(i) <= t_ns; t(hi) > t_ns.
+      while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (slot_time(tr, mid) <= t_ns) lo = mid; else hi = mid;
+      }
+      if (!read_sample(tr, lo, &a) || !read_sample(tr, hi, &b)) continue;
+      if (a.t_ns > t_ns || b.t_ns <= t_ns) continue;   // lapped during the search
+      int64_t span = b.t_ns - a.t_ns;
+      if (span > tr->max_gap_ns) {
+        *out = (t_ns - a.t_ns <= b.t_ns - t_ns) ? a : b;
+        res = VICON_TRACK_GAP;
+      } else {
+        *out = a;
+        vicon_sample_interp(out, &a, &b, (double)(t_ns - a.t_ns) / (double)span);
+        res = VICON_TRACK_INTERP;
+      }
+    }
+    out->t_ns = t_ns;
+    return res;
+  }
+  return VICON_TRACK_EMPTY;
+}
+
+const char *vicon_track_result_name(enum vicon_track_result r) {
+  switch (r) {
+    case VICON_TRACK_INTERP: return "interp";
+    case VICON_TRACK_HOLD:   return "hold";
+    case VICON_TRACK_GAP:    return "gap";
+    case VICON_TRACK_OLD:    return "old";
+    default:                 return "none";
+  }
+}
@@ -0,0 +1,86 @@
+// vicon_track.h
+// Recent Vicon samples indexed by host receive time, so each video frame
+// can get the pose at its own timestamp instead of whatever packet came in
+// last. Packets are parsed once on arrival into fixed structs and pushed
+// into a ring by the ingest thread; any number of readers binary-search the
+// ring for the two samples that bracket a time and interpolate between
+// them. Slots are per-slot seqlocks: readers never block the writer and
+// never take a lock, they retry if a slot changed under them.
+//
+// Values are interpreted as consecutive 7-float segments
+//   tx ty tz qx qy qz qw
+// (translation, then rotation quaternion, as the Vicon DataStream SDK
+// gives them). Translations are interpolated linearly and quaternions with
+// slerp; values past the last whole segment are interpolated linearly.
+
+#if !defined(__VICON_TRACK_H__)
+#define __VICON_TRACK_H__
+
+#include <stdint.h>
+
+#include "vicon_log.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VICON_SAMPLE_MAX_VALUES     63      // 9 segments
+#define VICON_SAMPLE_STAMP_BYTES    32
+#define VICON_SEGMENT_VALUES        7
+#define VICON_TRACK_DEFAULT_DEPTH   4096    // 4 s at 1 kHz, 41 s at 100 Hz
+#define VICON_TRACK_DEFAULT_GAP_NS  100000000ll
+
+struct vicon_sample {
+  int64_t  t_ns;              // host CLOCK_MONOTONIC time (receive time, or
+                              // vicon_ns mapped through a clock_fit)
+  int64_t  vicon_ns;          // stamp on the Vicon clock, 0 = not parseable
+  uint64_t seq;               // vicon_record seq
+  uint32_t nvals;
+  char     stamp[VICON_SAMPLE_STAMP_BYTES];   // Vicon timestamp text, NUL-terminated
+  float    v[VICON_SAMPLE_MAX_VALUES];
+};
+
+enum vicon_track_result {
+  VICON_TRACK_EMPTY = 0,      // nothing received yet
+  VICON_TRACK_INTERP,         // between two samples
+  VICON_TRACK_HOLD,           // after the newest sample: newest returned
+  VICON_TRACK_GAP,            // bracketing samples too far apart: nearest returned
+  VICON_TRACK_OLD,            // before the oldest sample kept: oldest returned
+};
+
+// Fills s from a received record; returns 0 if the packet has no timestamp
+// separator. Extra values beyond VICON_SAMPLE_MAX_VALUES are dropped.
+extern int vicon_sample_parse(struct vicon_sample *s, const struct vicon_record *r);
+
+// Vicon timestamp text to ns: ISO 8601 "YYYY-MM-DD[T ]HH:MM:SS[.frac]"
+// (taken as UTC, whatever the zone: only differences matter) or plain
+// seconds. Returns 0 when the text is neither.
+extern int64_t vicon_stamp_ns(const char *stamp);
+
+// out = a + alpha * (b - a), segment by segment (slerp for quaternions).
+// out->seq and out->stamp are taken from a.
+extern void vicon_sample_interp(struct vicon_sample *out, const struct vicon_sample *a,
+                                const struct vicon_sample *b, double alpha);
+
+typedef struct vicon_track vicon_track_t;
+
+// depth is rounded up to a power of two (0 = default). Samples further
+// apart than max_gap_ns (0 = default) are not interpolated between.
+extern vicon_track_t *vicon_track_new(unsigned int depth, int64_t max_gap_ns);
+extern void           vicon_track_free(vicon_track_t *tr);
+
+// Single writer. Times are kept non-decreasing: a sample stamped earlier
+// than the previous one is moved up to it.
+extern void vicon_track_push(vicon_track_t *tr, const struct vicon_sample *s);
+
+// Any thread. Writes the pose at t_ns to out (out->t_ns = t_ns) and returns
+// how it was obtained.
+extern enum vicon_track_result vicon_track_lookup(vicon_track_t *tr, int64_t t_ns,
+                                                  struct vicon_sample *out);
+
+extern const char *vicon_track_result_name(enum vicon_track_result r);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
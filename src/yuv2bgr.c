@@ -0,0 +1,326 @@
+// yuv2bgr.c
+// See yuv2bgr.h.
+//
+// Fixed-point scheme (shared by every kernel so results match exactly):
+//   yterm = ((Y * 257) * 18998 >> 16) - 1192   = 64 * 1.164 * (Y - 16)
+//   cterm = 32 + 64 * coef * (C - 128)          (32 rounds the final >> 6)
+//   out   = clamp(sat16(yterm + cterm) >> 6, 0, 255)
+// which is libyuv's layout. Chroma terms are computed once per chroma
+// sample and duplicated horizontally; the vertical pair of luma rows reuses
+// the same chroma row.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YUV2BGR_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define YUV2BGR_NEON 1
+#endif
+
+#include "yuv2bgr.h"
+
+#define YG   18998
+#define YB   1192
+
+struct coef {
+  int16_t rv, gu, gv, bu;
+};
+
+// 64 * {1.596, 0.391, 0.813, 2.018} and 64 * {1.793, 0.213, 0.533, 2.112}
+static const struct coef k_coef[2] = {
+  [YUV2BGR_BT601] = { 102, 25, 52, 129 },
+  [YUV2BGR_BT709] = { 115, 14, 34, 135 },
+};
+
+typedef void (*row_fn)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                       uint8_t *dst, int width, int nv12, const struct coef *k);
+
+static inline int16_t sat16(int x) {
+  return (int16_t)(x > 32767 ? 32767 : x < -32768 ? -32768 : x);
+}
+
+static inline uint8_t clamp8(int x) {
+  return (uint8_t)(x > 255 ? 255 : x < 0 ? 0 : x);
+}
+
+// Pixels [x0, width) of one row.
+static void row_scalar_from(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                            uint8_t *dst, int x0, int width, int nv12,
+                            const struct coef *k) {
+  for (int x = x0; x < width; x++) {
+    int c = x >> 1;
+    int U = (nv12 ? u[2 * c] : u[c]) - 128;
+    int V = (nv12 ? u[2 * c + 1] : v[c]) - 128;
+    int yt = ((y[x] * 257 * YG) >> 16) - YB;
+    int r = 32 + k->rv * V;
+    int g = 32 - k->gu * U - k->gv * V;
+    int b = 32 + k->bu * U;
+    dst[3 * x + 0] = clamp8(sat16(yt + b) >> 6);
+    dst[3 * x + 1] = clamp8(sat16(yt + g) >> 6);
+    dst[3 * x + 2] = clamp8(sat16(yt + r) >> 6);
+  }
+}
+
+static void row_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                       uint8_t *dst, int width, int nv12, const struct coef *k) {
+  row_scalar_from(y, u, v, dst, 0, width, nv12, k);
+}
+
+#if defined(YUV2BGR_X86)
+
+// pshufb masks that spread 16 B, G, R bytes over 48 bytes of BGR.
+#define M_ -1
+static const int8_t k_bgr_shuf[3][3][16] __attribute__((aligned(16))) = {
+  { // B
+    {  0, M_, M_,  1, M_, M_,  2, M_, M_,  3, M_, M_,  4, M_, M_,  5 },
+    { M_, M_,  6, M_, M_,  7, M_, M_,  8, M_, M_,  9, M_, M_, 10, M_ },
+    { M_, 11, M_, M_, 12, M_, M_, 13, M_, M_, 14, M_, M_, 15, M_, M_ },
+  },
+  { // G
+    { M_,  0, M_, M_,  1, M_, M_,  2, M_, M_,  3, M_, M_,  4, M_, M_ },
+    {  5, M_, M_,  6, M_, M_,  7, M_, M_,  8, M_, M_,  9, M_, M_, 10 },
+    { M_, M_, 11, M_, M_, 12, M_, M_, 13, M_, M_, 14, M_, M_, 15, M_ },
+  },
+  { // R
+    { M_, M_,  0, M_, M_,  1, M_, M_,  2, M_, M_,  3, M_, M_,  4, M_ },
+    { M_,  5, M_, M_,  6, M_, M_,  7, M_, M_,  8, M_, M_,  9, M_, M_ },
+    { 10, M_, M_, 11, M_, M_, 12, M_, M_, 13, M_, M_, 14, M_, M_, 15 },
+  },
+};
+#undef M_
+
+// Even chroma bytes to the low half, odd to the high half (NV12 split).
+static const int8_t k_uv_split[16] __attribute__((aligned(16))) = {
+  0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+};
+
+#define LOAD_MASK(p) _mm_load_si128((const __m128i *)(p))
+
+__attribute__((target("sse4.1")))
+static inline void store_bgr16(uint8_t *dst, __m128i b, __m128i g, __m128i r) {
+  for (int o = 0; o < 3; o++) {
+    __m128i v = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(b, LOAD_MASK(k_bgr_shuf[0][o])),
+                     _mm_shuffle_epi8(g, LOAD_MASK(k_bgr_shuf[1][o]))),
+        _mm_shuffle_epi8(r, LOAD_MASK(k_bgr_shuf[2][o])));
+    _mm_storeu_si128((__m128i *)(dst + 16 * o), v);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void row_sse41(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                      uint8_t *dst, int width, int nv12, const struct coef *k) {
+  const __m128i yg  = _mm_set1_epi16((short)YG);
+  const __m128i yb  = _mm_set1_epi16(YB);
+  const __m128i c128 = _mm_set1_epi16(128);
+  const __m128i c32 = _mm_set1_epi16(32);
+  const __m128i rv = _mm_set1_epi16(k->rv), gu = _mm_set1_epi16(k->gu);
+  const __m128i gv = _mm_set1_epi16(k->gv), bu = _mm_set1_epi16(k->bu);
+  const __m128i split = LOAD_MASK(k_uv_split);
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i U, V;
+    if (nv12) {
+      __m128i uv = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(u + x)), split);
+      U = _mm_cvtepu8_epi16(uv);
+      V = _mm_cvtepu8_epi16(_mm_srli_si128(uv, 8));
+    } else {
+      U = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(u + x / 2)));
+      V = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(v + x / 2)));
+    }
+    U = _mm_sub_epi16(U, c128);
+    V = _mm_sub_epi16(V, c128);
+    __m128i cr = _mm_add_epi16(c32, _mm_mullo_epi16(V, rv));
+    __m128i cg = _mm_sub_epi16(c32, _mm_add_epi16(_mm_mullo_epi16(U, gu),
+                                                  _mm_mullo_epi16(V, gv)));
+    __m128i cb = _mm_add_epi16(c32, _mm_mullo_epi16(U, bu));
+
+    __m128i Y  = _mm_loadu_si128((const __m128i *)(y + x));
+    __m128i y0 = _mm_unpacklo_epi8(Y, Y);             // Y * 257
+    __m128i y1 = _mm_unpackhi_epi8(Y, Y);
+    y0 = _mm_sub_epi16(_mm_mulhi_epu16(y0, yg), yb);
+    y1 = _mm_sub_epi16(_mm_mulhi_epu16(y1, yg), yb);
+
+#define CH(c, y0, y1) _mm_packus_epi16( \
+      _mm_srai_epi16(_mm_adds_epi16(y0, _mm_unpacklo_epi16(c, c)), 6), \
+      _mm_srai_epi16(_mm_adds_epi16(y1, _mm_unpackhi_epi16(c, c)), 6))
+    store_bgr16(dst + 3 * x, CH(cb, y0, y1), CH(cg, y0, y1), CH(cr, y0, y1));
+#undef CH
+  }
+  row_scalar_from(y, u, v, dst, x, width, nv12, k);
+}
+
+__attribute__((target("avx2")))
+static void row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *dst, int width, int nv12, const struct coef *k) {
+  const __m256i yg  = _mm256_set1_epi16((short)YG);
+  const __m256i yb  = _mm256_set1_epi16(YB);
+  const __m256i c128 = _mm256_set1_epi16(128);
+  const __m256i c32 = _mm256_set1_epi16(32);
+  const __m256i rv = _mm256_set1_epi16(k->rv), gu = _mm256_set1_epi16(k->gu);
+  const __m256i gv = _mm256_set1_epi16(k->gv), bu = _mm256_set1_epi16(k->bu);
+  const __m256i split = _mm256_broadcastsi128_si256(LOAD_MASK(k_uv_split));
+  int x = 0;
+
+  for (; x + 32 <= width; x += 32) {
+    __m256i U, V;
+    if (nv12) {
+      // per lane [U x8 | V x8] -> [U0-7 U8-15 | V0-7 V8-15]
+      __m256i uv = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(u + x)), split);
+      uv = _mm256_permute4x64_epi64(uv, 0xD8);
+      U = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(uv));
+      V = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(uv, 1));
+    } else {
+      U = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + x / 2)));
+      V = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + x / 2)));
+    }
+    U = _mm256_sub_epi16(U, c128);
+    V = _mm256_sub_epi16(V, c128);
+    __m256i cr = _mm256_add_epi16(c32, _mm256_mullo_epi16(V, rv));
+    __m256i cg = _mm256_sub_epi16(c32, _mm256_add_epi16(_mm256_mullo_epi16(U, gu),
+                                                        _mm256_mullo_epi16(V, gv)));
+    __m256i cb = _mm256_add_epi16(c32, _mm256_mullo_epi16(U, bu));
+    // Reorder 64-bit quarters so the in-lane unpacks below duplicate chroma
+    // 0-7 into pixels 0-15 and chroma 8-15 into pixels 16-31.
+    cr = _mm256_permute4x64_epi64(cr, 0xD8);
+    cg = _mm256_permute4x64_epi64(cg, 0xD8);
+    cb = _mm256_permute4x64_epi64(cb, 0xD8);
+
+    __m256i y0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x)));
+    __m256i y1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x + 16)));
+    y0 = _mm256_or_si256(y0, _mm256_slli_epi16(y0, 8));   // Y * 257
+    y1 = _mm256_or_si256(y1, _mm256_slli_epi16(y1, 8));
+    y0 = _mm256_sub_epi16(_mm256_mulhi_epu16(y0, yg), yb);
+    y1 = _mm256_sub_epi16(_mm256_mulhi_epu16(y1, yg), yb);
+
+    // packus works per lane; the permute restores pixel order 0-31.
+#define CH(c, y0, y1) _mm256_permute4x64_epi64(_mm256_packus_epi16( \
+      _mm256_srai_epi16(_mm256_adds_epi16(y0, _mm256_unpacklo_epi16(c, c)), 6), \
+      _mm256_srai_epi16(_mm256_adds_epi16(y1, _mm256_unpackhi_epi16(c, c)), 6)), 0xD8)
+    __m256i B = CH(cb, y0, y1), G = CH(cg, y0, y1), R = CH(cr, y0, y1);
+#undef CH
+    store_bgr16(dst + 3 * x, _mm256_castsi256_si128(B), _mm256_castsi256_si128(G),
+                _mm256_castsi256_si128(R));
+    store_bgr16(dst + 3 * x + 48, _mm256_extracti128_si256(B, 1),
+                _mm256_extracti128_si256(G, 1), _mm256_extracti128_si256(R, 1));
+  }
+  row_scalar_from(y, u, v, dst, x, width, nv12, k);
+}
+
+#endif // YUV2BGR_X86
+
+#if defined(YUV2BGR_NEON)
+
+static void row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *dst, int width, int nv12, const struct coef *k) {
+  const uint16x4_t yg = vdup_n_u16(YG);
+  const int16x8_t yb = vdupq_n_s16(YB);
+  const int16x8_t c32 = vdupq_n_s16(32);
+  const uint8x8_t c128 = vdup_n_u8(128);
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    uint8x8_t u8, v8;
+    if (nv12) {
+      uint8x8x2_t uv = vld2_u8(u + x);
+      u8 = uv.val[0];
+      v8 = uv.val[1];
+    } else {
+      u8 = vld1_u8(u + x / 2);
+      v8 = vld1_u8(v + x / 2);
+    }
+    int16x8_t U = vreinterpretq_s16_u16(vsubl_u8(u8, c128));
+    int16x8_t V = vreinterpretq_s16_u16(vsubl_u8(v8, c128));
+    int16x8_t cr = vmlaq_n_s16(c32, V, k->rv);
+    int16x8_t cg = vmlsq_n_s16(vmlsq_n_s16(c32, U, k->gu), V, k->gv);
+    int16x8_t cb = vmlaq_n_s16(c32, U, k->bu);
+    int16x8x2_t r2 = vzipq_s16(cr, cr), g2 = vzipq_s16(cg, cg), b2 = vzipq_s16(cb, cb);
+
+    uint8x16_t Y = vld1q_u8(y + x);
+    int16x8_t yt[2];
+    for (int h = 0; h < 2; h++) {
+      uint8x8_t yh = h ? vget_high_u8(Y) : vget_low_u8(Y);
+      uint16x8_t y257 = vmulq_n_u16(vmovl_u8(yh), 257);
+      uint16x8_t m = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(y257), yg), 16),
+                                  vshrn_n_u32(vmull_u16(vget_high_u16(y257), yg), 16));
+      yt[h] = vsubq_s16(vreinterpretq_s16_u16(m), yb);
+    }
+
+    uint8x16x3_t bgr;
+    bgr.val[0] = vcombine_u8(vqshrun_n_s16(vqaddq_s16(yt[0], b2.val[0]), 6),
+                             vqshrun_n_s16(vqaddq_s16(yt[1], b2.val[1]), 6));
+    bgr.val[1] = vcombine_u8(vqshrun_n_s16(vqaddq_s16(yt[0], g2.val[0]), 6),
+                             vqshrun_n_s16(vqaddq_s16(yt[1], g2.val[1]), 6));
+    bgr.val[2] = vcombine_u8(vqshrun_n_s16(vqaddq_s16(yt[0], r2.val[0]), 6),
+                             vqshrun_n_s16(vqaddq_s16(yt[1], r2.val[1]), 6));
+    vst3q_u8(dst + 3 * x, bgr);
+  }
+  row_scalar_from(y, u, v, dst, x, width, nv12, k);
+}
+
+#endif // YUV2BGR_NEON
+
+static int    g_impl;           // resolved; 0 until first select
+static row_fn g_row;
+
+int yuv2bgr_select(int level) {
+  level = simd_resolve(level);
+  switch (level) {
+#if defined(YUV2BGR_X86)
+  case SIMD_SSE41: g_row = row_sse41; break;
+  case SIMD_AVX2:  g_row = row_avx2; break;
+#endif
+#if defined(YUV2BGR_NEON)
+  case SIMD_NEON:  g_row = row_neon; break;
+#endif
+  default:         g_row = row_scalar; level = SIMD_SCALAR; break;
+  }
+  g_impl = level;
+  return level;
+}
+
+struct job {
+  const struct yuv2bgr_src *src;
+  const struct coef *k;
+  uint8_t *dst;
+  int dst_stride;
+  row_fn row;
+};
+
+static void convert_band(void *ctx, int band, int nbands) {
+  const struct job *j = ctx;
+  const struct yuv2bgr_src *s = j->src;
+  int nv12 = s->layout == YUV2BGR_NV12;
+
+  // Bands start on even rows so a chroma row is never split across bands.
+  int pairs = (s->height + 1) / 2;
+  int r0 = 2 * (int)((long)pairs * band / nbands);
+  int r1 = 2 * (int)((long)pairs * (band + 1) / nbands);
+  if (r1 > s->height) r1 = s->height;
+
+  for (int r = r0; r < r1; r++) {
+    int c = r >> 1;
+    j->row(s->y + (long)r * s->y_stride,
+           s->u + (long)c * s->u_stride,
+           nv12 ? NULL : s->v + (long)c * s->v_stride,
+           j->dst + (long)r * j->dst_stride, s->width, nv12, j->k);
+  }
+}
+
+void yuv2bgr_convert(const struct yuv2bgr_src *src, int matrix,
+                     uint8_t *dst, int dst_stride, band_pool_t *pool) {
+  if (!g_impl) yuv2bgr_select(SIMD_AUTO);
+
+  struct job j = {
+    .src = src,
+    .k = &k_coef[matrix == YUV2BGR_BT601 ? YUV2BGR_BT601 : YUV2BGR_BT709],
+    .dst = dst,
+    .dst_stride = dst_stride,
+    .row = g_row,
+  };
+  // A few bands per thread so a preempted worker does not hold up the frame.
+  int nbands = 4 * band_pool_threads(pool);
+  if (nbands > (src->height + 1) / 2) nbands = (src->height + 1) / 2;
+  band_pool_run(pool, nbands, convert_band, &j);
+}
@@ -0,0 +1,50 @@
+// yuv2bgr.h
+// 8-bit 4:2:0 (I420 or NV12) to packed BGR conversion, written straight
+// into a caller-supplied buffer (e.g. a shm_ring slot). Rows are split into
+// bands across a band_pool, and each band runs the widest SIMD kernel the
+// CPU supports (AVX2, SSE4.1, NEON) with a scalar fallback. All kernels use
+// the same fixed-point math, so their output is bit-identical.
+
+#if !defined(__YUV2BGR_H__)
+#define __YUV2BGR_H__
+
+#include <stdint.h>
+
+#include "band_pool.h"
+#include "simd_level.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Limited-range ("TV") matrices; the only ones H.264 cameras emit here.
+enum yuv2bgr_matrix {
+  YUV2BGR_BT601 = 0,
+  YUV2BGR_BT709,
+};
+
+enum yuv2bgr_layout {
+  YUV2BGR_I420 = 0,     // u and v are separate planes
+  YUV2BGR_NV12,         // u points at the interleaved UV plane, v unused
+};
+
+struct yuv2bgr_src {
+  int layout;           // enum yuv2bgr_layout
+  int width, height;
+  const uint8_t *y, *u, *v;
+  int y_stride, u_stride, v_stride;
+};
+
+// Picks the kernel used by yuv2bgr_convert() (enum simd_level); returns
+// the level actually selected, see simd_resolve().
+extern int         yuv2bgr_select(int level);
+
+// Converts one frame. dst must hold height * dst_stride bytes with
+// dst_stride >= 3 * width. pool may be NULL (runs on the calling thread).
+extern void        yuv2bgr_convert(const struct yuv2bgr_src *src, int matrix,
+                                   uint8_t *dst, int dst_stride, band_pool_t *pool);
+
+#if defined(__cplusplus)
+}
+#endif
+#endif
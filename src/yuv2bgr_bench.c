@@ -0,0 +1,238 @@
+// yuv2bgr_bench.c
+// Microbenchmark for the 4:2:0 -> BGR stage: times every yuv2bgr kernel the
+// CPU supports, single-threaded and banded over a worker pool, against
+// GStreamer's videoconvert on the same synthetic frames, and reports how far
+// the two outputs differ.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+
+#include "band_pool.h"
+#include "yuv2bgr.h"
+
+#define NUM_PATTERNS 4   // distinct input frames, cycled
+
+static int g_width   = 3840;
+static int g_height  = 1920;
+static int g_frames  = 200;
+static int g_threads = 0;        // 0 = one per CPU
+static int g_matrix  = YUV2BGR_BT709;
+
+static uint64_t now_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Gradients plus a cheap LCG so neither path sees flat, cache-friendly data.
+static void fill_pattern(GstVideoInfo *info, uint8_t *data, int k) {
+  uint32_t x = 0x12345u + (uint32_t)k * 7919u;
+  for (int p = 0; p < 3; p++) {
+    uint8_t *plane = data + GST_VIDEO_INFO_PLANE_OFFSET(info, p);
+    int stride = GST_VIDEO_INFO_PLANE_STRIDE(info, p);
+    int w = p ? (g_width + 1) / 2 : g_width;
+    int h = p ? (g_height + 1) / 2 : g_height;
+    for (int r = 0; r < h; r++) {
+      for (int c = 0; c < w; c++) {
+        x = x * 1664525u + 1013904223u;
+        int base = p == 0 ? 16 + (c + r + 8 * k) % 220 : 128 + ((c * 3 - r + 16 * k) % 100) - 50;
+        plane[(size_t)r * stride + c] = (uint8_t)(base + (int)(x >> 29) - 4);
+      }
+    }
+  }
+}
+
+static void print_row(const char *name, int threads, uint64_t ns, int frames, double ref_ms) {
+  double ms = (double)ns / 1e6 / frames;
+  printf("  %-22s %3d thr  %8.2f ms/frame  %8.1f fps  %7.1f MPix/s",
+         name, threads, ms, 1000.0 / ms, (double)g_width * g_height / (ms * 1000.0));
+  if (ref_ms > 0) printf("  x%.2f", ref_ms / ms);
+  printf("\n");
+}
+
+// One frame through appsrc ! videoconvert ! appsink at a time, so the figure
+// is per-frame conversion latency rather than pipelined throughput.
+static uint64_t bench_videoconvert(GstVideoInfo *in, GstBuffer **src, int threads,
+                                   uint8_t *first_out, size_t out_stride) {
+  gchar *desc = g_strdup_printf(
+    "appsrc name=src format=time ! videoconvert n-threads=%d dither=none ! "
+    "video/x-raw,format=BGR ! appsink name=sink sync=false", threads);
+  GError *err = NULL;
+  GstElement *pipe = gst_parse_launch(desc, &err);
+  g_free(desc);
+  if (!pipe || err) {
+    fprintf(stderr, "videoconvert pipeline: %s\n", err ? err->message : "unknown");
+    g_clear_error(&err);
+    return 0;
+  }
+  GstElement *appsrc = gst_bin_get_by_name(GST_BIN(pipe), "src");
+  GstElement *appsink = gst_bin_get_by_name(GST_BIN(pipe), "sink");
+  GstCaps *caps = gst_video_info_to_caps(in);
+  gst_app_src_set_caps(GST_APP_SRC(appsrc), caps);
+  gst_caps_unref(caps);
+  gst_element_set_state(pipe, GST_STATE_PLAYING);
+
+  uint64_t total = 0;
+  for (int i = -1; i < g_frames; i++) {   // frame -1 warms up negotiation
+    GstBuffer *b = gst_buffer_ref(src[(i + NUM_PATTERNS) % NUM_PATTERNS]);
+    b = gst_buffer_make_writable(b);
+    GST_BUFFER_PTS(b) = (GstClockTime)(i + 1) * GST_SECOND / 30;
+    uint64_t t0 = now_monotonic_ns();
+    gst_app_src_push_buffer(GST_APP_SRC(appsrc), b);
+    GstSample *s = gst_app_sink_pull_sample(GST_APP_SINK(appsink));
+    uint64_t t1 = now_monotonic_ns();
+    if (!s) { fprintf(stderr, "videoconvert produced no frame\n"); break; }
+    if (i >= 0) total += t1 - t0;
+
+    if (i == 0 && first_out) {
+      GstVideoInfo oi;
+      GstVideoFrame vf;
+      if (gst_video_info_from_caps(&oi, gst_sample_get_caps(s)) &&
+          gst_video_frame_map(&vf, &oi, gst_sample_get_buffer(s), GST_MAP_READ)) {
+        for (int r = 0; r < g_height; r++)
+          memcpy(first_out + (size_t)r * out_stride,
+                 (uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(&vf, 0) + (size_t)r * GST_VIDEO_FRAME_PLANE_STRIDE(&vf, 0),
+                 (size_t)g_width * 3);
+        gst_video_frame_unmap(&vf);
+      }
+    }
+    gst_sample_unref(s);
+  }
+
+  gst_element_set_state(pipe, GST_STATE_NULL);
+  gst_object_unref(appsrc);
+  gst_object_unref(appsink);
+  gst_object_unref(pipe);
+  return total;
+}
+
+static uint64_t bench_yuv2bgr(const struct yuv2bgr_src *src, band_pool_t *pool,
+                              uint8_t *out, size_t out_stride) {
+  yuv2bgr_convert(&src[0], g_matrix, out, (int)out_stride, pool);   // warm-up
+  uint64_t t0 = now_monotonic_ns();
+  for (int i = 0; i < g_frames; i++)
+    yuv2bgr_convert(&src[i % NUM_PATTERNS], g_matrix, out, (int)out_stride, pool);
+  return now_monotonic_ns() - t0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [--width W] [--height H] [--frames N] [--threads N] [--matrix 601|709]\n"
+    "  --width, --height: frame size (default: 3840x1920)\n"
+    "  --frames N   : frames per configuration (default: 200)\n"
+    "  --threads N  : threads for the multithreaded runs, 0 = one per CPU (default: 0)\n"
+    "  --matrix M   : YUV matrix for both converters (default: 709)\n",
+    prog);
+}
+
+int main(int argc, char **argv) {
+  gst_init(&argc, &argv);
+
+  for (int i = 1; i < argc; ++i) {
+    if      (!strcmp(argv[i], "--width")   && i+1 < argc) g_width   = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--height")  && i+1 < argc) g_height  = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--frames")  && i+1 < argc) g_frames  = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i+1 < argc) g_threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--matrix")  && i+1 < argc)
+      g_matrix = atoi(argv[++i]) == 601 ? YUV2BGR_BT601 : YUV2BGR_BT709;
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) { usage(argv[0]); return 0; }
+    else {
+      fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (g_width < 2 || g_height < 2 || g_frames < 1) { usage(argv[0]); return 1; }
+
+  // Input frames in GStreamer's default I420 layout, shared by both paths.
+  GstVideoInfo in;
+  gst_video_info_set_format(&in, GST_VIDEO_FORMAT_I420, (guint)g_width, (guint)g_height);
+  in.colorimetry.range  = GST_VIDEO_COLOR_RANGE_16_235;
+  in.colorimetry.matrix = g_matrix == YUV2BGR_BT601 ? GST_VIDEO_COLOR_MATRIX_BT601
+                                                    : GST_VIDEO_COLOR_MATRIX_BT709;
+  GstBuffer *bufs[NUM_PATTERNS];
+  GstMapInfo maps[NUM_PATTERNS];
+  struct yuv2bgr_src src[NUM_PATTERNS];
+  for (int k = 0; k < NUM_PATTERNS; k++) {
+    bufs[k] = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&in), NULL);
+    gst_buffer_map(bufs[k], &maps[k], GST_MAP_WRITE);
+    fill_pattern(&in, maps[k].data, k);
+    gst_buffer_unmap(bufs[k], &maps[k]);
+    // Held read-mapped for the whole run; videoconvert's own read maps
+    // coexist with it.
+    gst_buffer_map(bufs[k], &maps[k], GST_MAP_READ);
+    src[k] = (struct yuv2bgr_src){
+      .layout   = YUV2BGR_I420,
+      .width    = g_width,
+      .height   = g_height,
+      .y        = maps[k].data + GST_VIDEO_INFO_PLANE_OFFSET(&in, 0),
+      .u        = maps[k].data + GST_VIDEO_INFO_PLANE_OFFSET(&in, 1),
+      .v        = maps[k].data + GST_VIDEO_INFO_PLANE_OFFSET(&in, 2),
+      .y_stride = GST_VIDEO_INFO_PLANE_STRIDE(&in, 0),
+      .u_stride = GST_VIDEO_INFO_PLANE_STRIDE(&in, 1),
+      .v_stride = GST_VIDEO_INFO_PLANE_STRIDE(&in, 2),
+    };
+  }
+
+  size_t out_stride = (size_t)g_width * 3;
+  uint8_t *out = malloc(out_stride * g_height);
+  uint8_t *ref = malloc(out_stride * g_height);
+  if (!out || !ref) { fprintf(stderr, "out of memory\n"); return 1; }
+
+  band_pool_t *pool = band_pool_new(g_threads);
+  int nthreads = band_pool_threads(pool);
+  printf("I420 %dx%d -> BGR, BT.%s, %d frames per run\n",
+         g_width, g_height, g_matrix == YUV2BGR_BT601 ? "601" : "709", g_frames);
+
+  uint64_t ns = bench_videoconvert(&in, bufs, 1, ref, out_stride);
+  double ref_ms = (double)ns / 1e6 / g_frames;
+  if (ns) print_row("videoconvert", 1, ns, g_frames, 0);
+  if (nthreads > 1) {
+    ns = bench_videoconvert(&in, bufs, nthreads, NULL, 0);
+    if (ns) print_row("videoconvert", nthreads, ns, g_frames, ref_ms);
+  }
+
+  static const int impls[] = {
+    SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2, SIMD_NEON,
+  };
+  for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+    if (yuv2bgr_select(impls[i]) != impls[i]) continue;   // not on this CPU
+    char name[32];
+    snprintf(name, sizeof(name), "yuv2bgr %s", simd_level_name(impls[i]));
+    print_row(name, 1, bench_yuv2bgr(src, NULL, out, out_stride), g_frames, ref_ms);
+    if (nthreads > 1)
+      print_row(name, nthreads, bench_yuv2bgr(src, pool, out, out_stride), g_frames, ref_ms);
+  }
+
+  // Agreement with videoconvert on the first frame (auto kernel).
+  yuv2bgr_select(SIMD_AUTO);
+  yuv2bgr_convert(&src[0], g_matrix, out, (int)out_stride, pool);
+  if (ref_ms > 0) {
+    int maxd = 0;
+    uint64_t sumd = 0;
+    size_t n = out_stride * g_height;
+    for (size_t i = 0; i < n; i++) {
+      int d = abs((int)out[i] - (int)ref[i]);
+      sumd += (uint64_t)d;
+      if (d > maxd) maxd = d;
+    }
+    printf("vs videoconvert: max |diff| %d, mean %.3f\n", maxd, (double)sumd / (double)n);
+  }
+
+  band_pool_free(pool);
+  for (int k = 0; k < NUM_PATTERNS; k++) {
+    gst_buffer_unmap(bufs[k], &maps[k]);
+    gst_buffer_unref(bufs[k]);
+  }
+  free(out);
+  free(ref);
+  return 0;
+}